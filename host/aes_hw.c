@@ -0,0 +1,63 @@
+/*
+ * aes_hw.c
+ *
+ * Host build: the AES engine of the 8258 for aes_regs.h. Four words written
+ * to reg_aes_data are encrypted with reg_aes_key(0..15) (aes_soft.c), then
+ * the four words of the result are read from reg_aes_data. A write through
+ * the returned pointer is taken at the next register access.
+ */
+#include "tl_common.h"
+#include "drivers.h"
+#include "hal.h"
+
+unsigned int hal_aes_regs;
+unsigned int hal_aes_keys;
+
+static struct {
+	u32 in[4];
+	u32 out[4];
+	int fed;	// words written, 4 - the result is ready
+	int rd;		// words of the result read
+	int wr;		// a write to reg_aes_data is pending
+} eng;
+
+static void hal_aes_sync(void) {
+	u8 key[16];
+	int i;
+	hal_aes_regs++;
+	if (!eng.wr)
+		return;
+	eng.wr = 0;
+	eng.in[eng.fed++] = reg_aes_data;
+	if (eng.fed == 4) {
+		for (i = 0; i < 16; i++)
+			key[i] = reg_aes_key(i);
+		aes_encrypt(key, (u8 *)eng.in, (u8 *)eng.out);
+		eng.rd = 0;
+	}
+}
+
+volatile unsigned char * hal_aes_ctrl(void) {
+	hal_aes_sync();
+	reg_aes_ctrl &= ~(FLD_AES_CTRL_DATA_FEED | FLD_AES_CTRL_CODEC_FINISHED);
+	reg_aes_ctrl |= (eng.fed < 4) ? FLD_AES_CTRL_DATA_FEED : FLD_AES_CTRL_CODEC_FINISHED;
+	return &reg_aes_ctrl;
+}
+
+volatile unsigned long * hal_aes_data(void) {
+	hal_aes_sync();
+	if (eng.fed < 4)
+		eng.wr = 1;
+	else {
+		reg_aes_data = eng.out[eng.rd++];
+		if (eng.rd == 4)
+			eng.fed = 0;
+	}
+	return &reg_aes_data;
+}
+
+volatile unsigned char * hal_aes_key(int i) {
+	hal_aes_sync();
+	hal_aes_keys++;
+	return &reg_aes_key(i);
+}
@@ -0,0 +1,24 @@
+/*
+ * aes_regs.h
+ *
+ * Host build: included before src/ccm.c with USE_AES_REGS=1 and the SDK
+ * drivers/8258/aes.c (-include). The AES registers go to the engine of aes_hw.c.
+ */
+#ifndef _HOST_AES_REGS_H_
+#define _HOST_AES_REGS_H_
+
+#include "tl_common.h"
+#include "drivers.h"
+
+volatile unsigned char * hal_aes_ctrl(void);
+volatile unsigned long * hal_aes_data(void);
+volatile unsigned char * hal_aes_key(int i);
+
+#undef reg_aes_ctrl
+#define reg_aes_ctrl	(*hal_aes_ctrl())
+#undef reg_aes_data
+#define reg_aes_data	(*hal_aes_data())
+#undef reg_aes_key
+#define reg_aes_key(i)	(*hal_aes_key(i))
+
+#endif // _HOST_AES_REGS_H_
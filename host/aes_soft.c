@@ -0,0 +1,152 @@
+/*
+ * aes_soft.c
+ *
+ * Host build: AES-128 (FIPS-197) in place of the 8258 AES engine,
+ * the interface of SDK drivers/8258/aes.c
+ */
+
+static unsigned char sbox[256], rsbox[256];
+
+unsigned int hal_aes_blocks;
+
+static unsigned char xtime(unsigned char x) {
+	return (x << 1) ^ ((x & 0x80) ? 0x1b : 0);
+}
+
+static unsigned char gmul(unsigned char a, unsigned char b) {
+	unsigned char r = 0;
+	while (b) {
+		if (b & 1)
+			r ^= a;
+		a = xtime(a);
+		b >>= 1;
+	}
+	return r;
+}
+
+/* S-box from the GF(2^8) inverse and the affine transform */
+static void aes_tables(void) {
+	unsigned int i;
+	unsigned char x, s, inv;
+	if (sbox[0])
+		return;
+	for (i = 0; i < 256; i++) {
+		inv = 0;
+		if (i) {
+			for (x = 1; gmul(i, x) != 1; x++);
+			inv = x;
+		}
+		s = inv ^ ((inv << 1) | (inv >> 7)) ^ ((inv << 2) | (inv >> 6))
+			^ ((inv << 3) | (inv >> 5)) ^ ((inv << 4) | (inv >> 4)) ^ 0x63;
+		sbox[i] = s;
+		rsbox[s] = i;
+	}
+}
+
+static void aes_key_expand(const unsigned char *key, unsigned char *rk) {
+	unsigned int i;
+	unsigned char t[4], rc = 1, b;
+	for (i = 0; i < 16; i++)
+		rk[i] = key[i];
+	for (i = 16; i < 176; i += 4) {
+		t[0] = rk[i - 4];
+		t[1] = rk[i - 3];
+		t[2] = rk[i - 2];
+		t[3] = rk[i - 1];
+		if ((i & 15) == 0) {
+			b = t[0];
+			t[0] = sbox[t[1]] ^ rc;
+			t[1] = sbox[t[2]];
+			t[2] = sbox[t[3]];
+			t[3] = sbox[b];
+			rc = xtime(rc);
+		}
+		rk[i] = rk[i - 16] ^ t[0];
+		rk[i + 1] = rk[i - 15] ^ t[1];
+		rk[i + 2] = rk[i - 14] ^ t[2];
+		rk[i + 3] = rk[i - 13] ^ t[3];
+	}
+}
+
+static void add_round_key(unsigned char *s, const unsigned char *rk) {
+	unsigned int i;
+	for (i = 0; i < 16; i++)
+		s[i] ^= rk[i];
+}
+
+static void shift_rows(unsigned char *s, int inv) {
+	unsigned char t[16];
+	unsigned int c, r;
+	for (c = 0; c < 4; c++)
+		for (r = 0; r < 4; r++) {
+			if (inv)
+				t[((c + r) & 3) * 4 + r] = s[c * 4 + r];
+			else
+				t[c * 4 + r] = s[((c + r) & 3) * 4 + r];
+		}
+	for (c = 0; c < 16; c++)
+		s[c] = t[c];
+}
+
+static void mix_columns(unsigned char *s, int inv) {
+	unsigned int c;
+	unsigned char a0, a1, a2, a3;
+	for (c = 0; c < 16; c += 4) {
+		a0 = s[c]; a1 = s[c + 1]; a2 = s[c + 2]; a3 = s[c + 3];
+		if (inv) {
+			s[c] = gmul(a0, 14) ^ gmul(a1, 11) ^ gmul(a2, 13) ^ gmul(a3, 9);
+			s[c + 1] = gmul(a0, 9) ^ gmul(a1, 14) ^ gmul(a2, 11) ^ gmul(a3, 13);
+			s[c + 2] = gmul(a0, 13) ^ gmul(a1, 9) ^ gmul(a2, 14) ^ gmul(a3, 11);
+			s[c + 3] = gmul(a0, 11) ^ gmul(a1, 13) ^ gmul(a2, 9) ^ gmul(a3, 14);
+		} else {
+			s[c] = gmul(a0, 2) ^ gmul(a1, 3) ^ a2 ^ a3;
+			s[c + 1] = a0 ^ gmul(a1, 2) ^ gmul(a2, 3) ^ a3;
+			s[c + 2] = a0 ^ a1 ^ gmul(a2, 2) ^ gmul(a3, 3);
+			s[c + 3] = gmul(a0, 3) ^ a1 ^ a2 ^ gmul(a3, 2);
+		}
+	}
+}
+
+int aes_encrypt(unsigned char *Key, unsigned char *Data, unsigned char *Result) {
+	unsigned char rk[176], s[16];
+	unsigned int i, r;
+	hal_aes_blocks++;
+	aes_tables();
+	aes_key_expand(Key, rk);
+	for (i = 0; i < 16; i++)
+		s[i] = Data[i];
+	add_round_key(s, rk);
+	for (r = 1; r <= 10; r++) {
+		for (i = 0; i < 16; i++)
+			s[i] = sbox[s[i]];
+		shift_rows(s, 0);
+		if (r != 10)
+			mix_columns(s, 0);
+		add_round_key(s, rk + r * 16);
+	}
+	for (i = 0; i < 16; i++)
+		Result[i] = s[i];
+	return 0;
+}
+
+int aes_decrypt(unsigned char *Key, unsigned char *Data, unsigned char *Result) {
+	unsigned char rk[176], s[16];
+	unsigned int i, r;
+	hal_aes_blocks++;
+	aes_tables();
+	aes_key_expand(Key, rk);
+	for (i = 0; i < 16; i++)
+		s[i] = Data[i];
+	add_round_key(s, rk + 160);
+	for (r = 9; r < 10; r--) {
+		shift_rows(s, 1);
+		for (i = 0; i < 16; i++)
+			s[i] = rsbox[s[i]];
+		add_round_key(s, rk + r * 16);
+		if (r)
+			mix_columns(s, 1);
+	}
+	for (i = 0; i < 16; i++)
+		Result[i] = s[i];
+	return 0;
+}
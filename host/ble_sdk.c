@@ -0,0 +1,210 @@
+/*
+ * ble_sdk.c
+ *
+ * Host build: the SDK BLE stack for src/ble.c and the beacons, and the globals
+ * of the modules not built for the host (app.c, app_att.c, cmd_parser.c,
+ * trigger.c, rds_count.c, scanning.c). The adv. data, the notifications and
+ * the scan enabled time go to hal_ble.
+ */
+#include "tl_common.h"
+#include "app_config.h"
+#include "drivers.h"
+#include "stack/ble/ble.h"
+#include "stack/ble/service/ble_ll_ota.h"
+#include "app.h"
+#include "ble.h"
+#include "cmd_parser.h"
+#include "trigger.h"
+#if (DEV_SERVICES & SERVICE_RDS)
+#include "rds_count.h"
+#endif
+#if USE_SYNC_SCAN
+#include "scanning.h"
+#endif
+#include "hal.h"
+
+hal_ble_t hal_ble;
+
+_attribute_aligned_(4) st_ll_adv_t blta;
+att_para_t bltAtt;
+_attribute_aligned_(4) smp_param_own_t smp_param_own;
+u32 blt_ota_start_tick;
+u32 blt_advExpectTime;
+void * ll_module_adv_cb;
+attribute_t my_Attributes[ATT_END_H];
+gap_periConnectParams_t my_periConnParameters = {DEF_CON_INERVAL, DEF_CON_INERVAL, 0, DEF_CON_INERVAL*250};
+u32 pincode;
+u8 bindkey[16];
+trigger_t trg;
+#if (DEV_SERVICES & SERVICE_RDS)
+rds_count_t rds;
+#endif
+#if USE_SYNC_SCAN
+scan_wrk_t scan;
+#endif
+
+void hal_ble_reset(void) {
+	memset(&hal_ble, 0, sizeof(hal_ble));
+	bltAtt.effective_MTU = ATT_MTU_SIZE;
+}
+
+ble_sts_t bls_ll_setAdvData(u8 *data, u8 len) {
+	if (len > sizeof(hal_ble.adv))
+		return 1;
+	memcpy(hal_ble.adv, data, len);
+	hal_ble.adv_len = len;
+	hal_ble.adv_cnt++;
+	return BLE_SUCCESS;
+}
+
+ble_sts_t bls_ll_setAdvInterval(u16 intervalMin, u16 intervalMax) {
+	hal_ble.adv_int = intervalMin;
+	(void) intervalMax;
+	hal_ble.adv_int_cnt++;
+	return BLE_SUCCESS;
+}
+
+ble_sts_t bls_att_pushNotifyData(u16 attHandle, u8 *p, int len) {
+	(void) attHandle;
+	if (len > (int)sizeof(hal_ble.ntf))
+		len = sizeof(hal_ble.ntf);
+	memcpy(hal_ble.ntf, p, len);
+	hal_ble.ntf_len = len;
+	hal_ble.ntf_cnt++;
+	return BLE_SUCCESS;
+}
+
+void bls_pm_setManualLatency(u16 latency) {
+	hal_ble.latency = latency;
+}
+
+// the scanner of scanning.c: the enabled time is the radio-on time
+ble_sts_t blc_ll_setScanEnable(scan_en_t scan_enable, dupFilter_en_t filter_duplicate) {
+	(void) filter_duplicate;
+	if (scan_enable && !hal_ble.scan_on) {
+		hal_ble.scan_tik = clock_time();
+		hal_ble.scan_cnt++;
+	} else if (!scan_enable && hal_ble.scan_on)
+		hal_ble.scan_ticks += (u32)(clock_time() - hal_ble.scan_tik);
+	hal_ble.scan_on = scan_enable != BLC_SCAN_DISABLE;
+	return BLE_SUCCESS;
+}
+void blc_ll_initScanning_module(u8 *public_adr) { (void) public_adr; }
+ble_sts_t blc_ll_setScanParameter(scan_type_t scan_type, u16 scan_interval, u16 scan_window, own_addr_type_t ownAddrType,
+		scan_fp_type_t scanFilter_policy) {
+	(void) scan_type; (void) scan_interval; (void) scan_window; (void) ownAddrType; (void) scanFilter_policy;
+	return BLE_SUCCESS;
+}
+ble_sts_t blc_ll_addScanningInAdvState(void) { return BLE_SUCCESS; }
+ble_sts_t blc_hci_le_setEventMask_cmd(u32 evtMask) { (void) evtMask; return BLE_SUCCESS; }
+void blc_hci_registerControllerEventHandler(hci_event_handler_t handler) { (void) handler; }
+ble_sts_t bls_ll_setAdvDuration(u32 duration_us, u8 duration_en) { (void) duration_us; (void) duration_en; return BLE_SUCCESS; }
+
+// the rest of the stack: no effect on the host
+ble_sts_t bls_ll_setScanRspData(u8 *data, u8 len) { (void) data; (void) len; return BLE_SUCCESS; }
+ble_sts_t bls_ll_setAdvEnable(int adv_enable) { (void) adv_enable; return BLE_SUCCESS; }
+ble_sts_t bls_ll_setAdvParam(u16 intervalMin, u16 intervalMax, adv_type_t advType, own_addr_type_t ownAddrType,
+		u8 peerAddrType, u8 *peerAddr, u8 adv_channelMap, adv_fp_type_t advFilterPolicy) {
+	(void) intervalMin; (void) intervalMax; (void) advType; (void) ownAddrType;
+	(void) peerAddrType; (void) peerAddr; (void) adv_channelMap; (void) advFilterPolicy;
+	return BLE_SUCCESS;
+}
+void bls_set_advertise_prepare(void *p) { (void) p; }
+void bls_app_registerEventCallback(u8 e, blt_event_callback_t p) { (void) e; (void) p; }
+void bls_pm_setSuspendMask(u8 mask) { (void) mask; }
+void bls_l2cap_requestConnParamUpdate(u16 min_interval, u16 max_interval, u16 latency, u16 timeout) {
+	(void) min_interval; (void) max_interval; (void) latency; (void) timeout;
+}
+void bls_l2cap_setMinimalUpdateReqSendingTime_after_connCreate(int time_ms) { (void) time_ms; }
+void blc_l2cap_registerConnUpdateRspCb(l2cap_conn_update_rsp_callback_t cb) { (void) cb; }
+void blc_l2cap_register_handler(void *p) { (void) p; }
+int blc_l2cap_packet_receive(u16 connHandle, u8 * p) { (void) connHandle; (void) p; return 0; }
+void blc_initMacAddress(int flash_addr, u8 *mac_public, u8 *mac_random_static) {
+	(void) flash_addr;
+	memset(mac_public, 0x11, 6);
+	memset(mac_random_static, 0x22, 6);
+}
+void blc_ll_initStandby_module(u8 *public_adr) { (void) public_adr; }
+void blc_ll_initAdvertising_module(u8 *public_adr) { (void) public_adr; }
+void blc_ll_initConnection_module(void) {}
+void blc_ll_initSlaveRole_module(void) {}
+void blc_ll_initPowerManagement_module(void) {}
+void blc_ll_init2MPhyCodedPhy_feature(void) {}
+void blc_ll_initChannelSelectionAlgorithm_2_feature(void) {}
+void blc_ll_initExtendedAdvertising_module(u8 *pAdvCtrl, u8 *pPriAdv, int num_sets) { (void) pAdvCtrl; (void) pPriAdv; (void) num_sets; }
+void blc_ll_initExtSecondaryAdvPacketBuffer(u8 *pSecAdv, int sec_adv_buf_len) { (void) pSecAdv; (void) sec_adv_buf_len; }
+void blc_ll_initExtAdvDataBuffer(u8 *pExtAdvData, int max_len_advData) { (void) pExtAdvData; (void) max_len_advData; }
+void blc_ll_initExtScanRspDataBuffer(u8 *pScanRspData, int max_len_scanRspData) { (void) pScanRspData; (void) max_len_scanRspData; }
+ble_sts_t blc_ll_removeAdvSet(u8 advHandle) { (void) advHandle; return BLE_SUCCESS; }
+ble_sts_t blc_ll_setExtAdvData(u8 advHandle, data_oper_t operation, data_fragm_t fragment_prefer, u8 adv_dataLen, u8 *advdata) {
+	(void) advHandle; (void) operation; (void) fragment_prefer; (void) adv_dataLen; (void) advdata;
+	return BLE_SUCCESS;
+}
+ble_sts_t blc_ll_setExtScanRspData(u8 advHandle, data_oper_t operation, data_fragm_t fragment_prefer, u8 scanRsp_dataLen, u8 *scanRspData) {
+	(void) advHandle; (void) operation; (void) fragment_prefer; (void) scanRsp_dataLen; (void) scanRspData;
+	return BLE_SUCCESS;
+}
+ble_sts_t blc_ll_setExtAdvEnable_1(u32 extAdv_en, u8 sets_num, u8 advHandle, u16 duration, u8 max_extAdvEvt) {
+	(void) extAdv_en; (void) sets_num; (void) advHandle; (void) duration; (void) max_extAdvEvt;
+	return BLE_SUCCESS;
+}
+ble_sts_t blc_ll_setExtAdvParam(u8 advHandle, adv_event_prop_t adv_evt_prop, u32 pri_advIntervalMin, u32 pri_advIntervalMax,
+		u8 pri_advChnMap, own_addr_type_t ownAddrType, u8 peerAddrType, u8 *peerAddr,
+		adv_fp_type_t advFilterPolicy, tx_power_t adv_tx_pow, le_phy_type_t pri_adv_phy, u8 sec_adv_max_skip,
+		le_phy_type_t sec_adv_phy, u8 adv_sid, u8 scan_req_noti_en) {
+	(void) advHandle; (void) adv_evt_prop; (void) pri_advIntervalMin; (void) pri_advIntervalMax;
+	(void) pri_advChnMap; (void) ownAddrType; (void) peerAddrType; (void) peerAddr;
+	(void) advFilterPolicy; (void) adv_tx_pow; (void) pri_adv_phy; (void) sec_adv_max_skip;
+	(void) sec_adv_phy; (void) adv_sid; (void) scan_req_noti_en;
+	return BLE_SUCCESS;
+}
+int blt_ext_adv_proc(void) { return 0; }
+ble_sts_t blc_ll_setDefaultPhy(le_phy_prefer_mask_t all_phys, le_phy_prefer_type_t tx_phys, le_phy_prefer_type_t rx_phys) {
+	(void) all_phys; (void) tx_phys; (void) rx_phys;
+	return BLE_SUCCESS;
+}
+ble_sts_t blc_ll_setDefaultConnCodingIndication(le_ci_prefer_t prefer_CI) { (void) prefer_CI; return BLE_SUCCESS; }
+void blc_ll_setDefaultExtAdvCodingIndication(u8 advHandle, le_ci_prefer_t prefer_CI) { (void) advHandle; (void) prefer_CI; }
+void blc_pm_setDeepsleepRetentionThreshold(u32 adv_thres_ms, u32 conn_thres_ms) { (void) adv_thres_ms; (void) conn_thres_ms; }
+void blc_pm_setDeepsleepRetentionEarlyWakeupTiming(u32 earlyWakeup_us) { (void) earlyWakeup_us; }
+void blc_pm_setDeepsleepRetentionType(SleepMode_TypeDef sleep_type) { (void) sleep_type; }
+void blc_gap_peripheral_init(void) {}
+void blc_gap_registerHostEventHandler(gap_event_handler_t handler) { (void) handler; }
+void blc_gap_setEventMask(u32 evtMask) { (void) evtMask; }
+int blc_smp_peripheral_init(void) { return 0; }
+void blc_smp_configSecurityRequestSending(secReq_cfg newConn_cfg, secReq_cfg reConn_cfg, u16 pending_ms) {
+	(void) newConn_cfg; (void) reConn_cfg; (void) pending_ms;
+}
+void blc_smp_enableAuthMITM(int MITM_en) { (void) MITM_en; }
+void blc_smp_setIoCapability(io_capability_t ioCapablility) { (void) ioCapablility; }
+void blc_smp_setParingMethods(paring_methods_t method) { (void) method; }
+void blc_smp_setSecurityLevel(le_security_mode_level_t mode_level) { (void) mode_level; }
+void bls_ota_clearNewFwDataArea(void) {}
+void bls_ota_registerStartCmdCb(ota_startCb_t cb) { (void) cb; }
+void bls_ota_setTimeout(u32 timeout_us) { (void) timeout_us; }
+int otaWrite(void * p) { (void) p; return 0; }
+void rf_set_power_level_index(RF_PowerTypeDef level) { (void) level; }
+void analog_write(unsigned char addr, unsigned char v) { (void) addr; (void) v; }
+void start_reboot(void) {}
+
+// app.c, app_att.c, cmd_parser.c, trigger.c, utils.c
+void test_config(void) {}
+void my_att_init(void) {}
+void cmd_parser(void * p) { (void) p; }
+void test_trg_on(void) {}
+void SwapMacAddress(u8 *mac_out, u8 *mac_in) {
+	int i;
+	for (i = 0; i < 6; i++)
+		mac_out[i] = mac_in[5 - i];
+}
+u8 * str_bin2hex(u8 *d, u8 *s, int len) {
+	static const char hex[] = "0123456789abcdef";
+	while (len--) {
+		*d++ = hex[*s >> 4];
+		*d++ = hex[*s++ & 0x0f];
+	}
+	return d;
+}
+u8 get_battery_level(u16 battery_mv) {
+	return battery_mv >= 3000 ? 100 : (battery_mv > 2200 ? (battery_mv - 2200) / 8 : 0);
+}
@@ -0,0 +1,30 @@
+/*
+ * gpio_regs.h
+ *
+ * Host build: included before src/epd_spi.c (-include). The GPIO output and
+ * function registers, reg_spi_data, reg_spi_ctrl and clock_time() go to
+ * the pin trace of gpio_trace.c.
+ */
+#ifndef _HOST_GPIO_REGS_H_
+#define _HOST_GPIO_REGS_H_
+
+#include "tl_common.h"
+#include "drivers.h"
+
+volatile unsigned char * hal_gpio_out(unsigned int pin);
+volatile unsigned char * hal_gpio_func(unsigned int pin);
+volatile unsigned char * hal_spi_data(void);
+volatile unsigned char * hal_spi_ctrl(void);
+unsigned long hal_gpio_clock(void);
+
+#undef reg_gpio_out
+#define reg_gpio_out(i)		(*hal_gpio_out(i))
+#undef reg_gpio_func
+#define reg_gpio_func(i)	(*hal_gpio_func(i))
+#undef reg_spi_data
+#define reg_spi_data		(*hal_spi_data())
+#undef reg_spi_ctrl
+#define reg_spi_ctrl		(*hal_spi_ctrl())
+#define clock_time()		hal_gpio_clock()
+
+#endif // _HOST_GPIO_REGS_H_
@@ -0,0 +1,163 @@
+/*
+ * gpio_trace.c
+ *
+ * Host build: the pin trace of src/epd_spi.c (gpio_regs.h). An access to a GPIO
+ * register costs HAL_GPIO_WR_TICKS, a clock_time() read HAL_GPIO_POLL_TICKS,
+ * a change of the traced pins is logged with the tick of the register access
+ * that made it. A byte written to reg_spi_data shifts out on SPI DO/CK
+ * (PB7/PD7, mode 0, MSB first) at the clock of reg_spi_sp.
+ */
+#include "tl_common.h"
+#include "app_config.h"
+#include "drivers.h"
+#include "hal.h"
+
+#define HAL_GPIO_WR_TICKS	4 // a register read-modify-write, 6 cycles at 24 MHz
+#define HAL_GPIO_POLL_TICKS	4 // a clock_time() read and compare of a wait loop
+
+#define HAL_SPI_DO		GPIO_PB7
+#define HAL_SPI_CK		GPIO_PD7
+
+hal_gpio_ev_t hal_gpio_ev[HAL_GPIO_TRACE_SIZE];
+int hal_gpio_ev_cnt;
+int hal_gpio_err;
+
+static struct {
+	unsigned int pins[HAL_GPIO_TRACE_PINS];
+	int n;
+	u32 wr_tik;		// tick of the last register access
+	u32 spi_tik;	// tick of the write to reg_spi_data
+	u32 spi_end;	// tick, the SPI block busy up to
+	int spi_pend;	// a byte in reg_spi_data to shift out
+	u8 spi_do, spi_ck;
+	u8 lv;
+} gt;
+
+static int hal_pin_level(unsigned int pin) {
+	if (reg_gpio_func(pin) & (pin & 0xff))
+		return (reg_gpio_out(pin) & (pin & 0xff)) != 0;
+	if (pin == HAL_SPI_DO)
+		return gt.spi_do;
+	if (pin == HAL_SPI_CK)
+		return gt.spi_ck;
+	return 0;
+}
+
+static u8 hal_gpio_level(void) {
+	u8 lv = 0;
+	int i;
+	for (i = 0; i < gt.n; i++)
+		if (hal_pin_level(gt.pins[i]))
+			lv |= 1 << i;
+	return lv;
+}
+
+static void hal_gpio_ev_add(u32 tik) {
+	u8 lv = hal_gpio_level();
+	if (lv == gt.lv)
+		return;
+	gt.lv = lv;
+	if (hal_gpio_ev_cnt < HAL_GPIO_TRACE_SIZE) {
+		hal_gpio_ev[hal_gpio_ev_cnt].tick = tik;
+		hal_gpio_ev[hal_gpio_ev_cnt].lv = lv;
+	}
+	hal_gpio_ev_cnt++;
+}
+
+/* The byte of reg_spi_data on DO/CK, if the block and the pins are set up
+ * as the SDK spi_master_init(), spi_write() */
+static void hal_spi_byte(void) {
+	u32 half = ((reg_spi_sp & 0x7f) + 1) * CLOCK_16M_SYS_TIMER_CLK_1US / CLOCK_SYS_CLOCK_1US;
+	u8 data = reg_spi_data;
+	int i;
+	if (!(reg_clk_en0 & FLD_CLK0_SPI_EN) || !(reg_spi_sp & FLD_SPI_ENABLE)
+		|| (reg_spi_ctrl & (FLD_SPI_MASTER_MODE_EN | FLD_SPI_DATA_OUT_DIS | FLD_SPI_RD)) != FLD_SPI_MASTER_MODE_EN
+		|| (reg_spi_inv_clk & FLD_SPI_MODE_WORK_MODE)
+		|| (reg_pin_i2c_spi_out_en & (FLD_PIN_PBGROUP_SPI_EN | FLD_PIN_PDGROUP_SPI_EN))
+			!= (FLD_PIN_PBGROUP_SPI_EN | FLD_PIN_PDGROUP_SPI_EN)
+		|| !(reg_pin_i2c_spi_en & FLD_PIN_PD7_SPI_EN)
+		|| (reg_gpio_func(HAL_SPI_DO) & (HAL_SPI_DO & 0xff))
+		|| (reg_gpio_func(HAL_SPI_CK) & (HAL_SPI_CK & 0xff))) {
+		hal_gpio_err++;
+		return;
+	}
+	for (i = 0; i < 8; i++) {
+		gt.spi_do = (data >> (7 - i)) & 1;
+		gt.spi_ck = 0;
+		hal_gpio_ev_add(gt.spi_tik + 2 * i * half);
+		gt.spi_ck = 1;
+		hal_gpio_ev_add(gt.spi_tik + (2 * i + 1) * half);
+	}
+	gt.spi_ck = 0;
+	gt.spi_end = gt.spi_tik + 16 * half;
+	hal_gpio_ev_add(gt.spi_end);
+}
+
+/* The writes since the last register access */
+void hal_gpio_sync(void) {
+	if (gt.spi_pend) {
+		gt.spi_pend = 0;
+		hal_spi_byte();
+	}
+	hal_gpio_ev_add(gt.wr_tik);
+}
+
+static void hal_gpio_access(void) {
+	hal_gpio_sync();
+	gt.wr_tik = reg_system_tick;
+	reg_system_tick += HAL_GPIO_WR_TICKS;
+}
+
+void hal_gpio_trace(const unsigned int *pins, int n) {
+	memset(&gt, 0, sizeof(gt));
+	memcpy(gt.pins, pins, n * sizeof(pins[0]));
+	gt.n = n;
+	gt.lv = hal_gpio_level();
+	gt.wr_tik = reg_system_tick;
+	hal_gpio_ev[0].tick = reg_system_tick;
+	hal_gpio_ev[0].lv = gt.lv;
+	hal_gpio_ev_cnt = 1;
+	hal_gpio_err = 0;
+}
+
+volatile unsigned char * hal_gpio_out(unsigned int pin) {
+	hal_gpio_access();
+	return &reg_gpio_out(pin);
+}
+
+volatile unsigned char * hal_gpio_func(unsigned int pin) {
+	hal_gpio_access();
+	return &reg_gpio_func(pin);
+}
+
+volatile unsigned char * hal_spi_data(void) {
+	hal_gpio_access();
+	gt.spi_pend = 1;
+	gt.spi_tik = reg_system_tick;
+	return &reg_spi_data;
+}
+
+volatile unsigned char * hal_spi_ctrl(void) {
+	hal_gpio_sync();
+	gt.wr_tik = reg_system_tick;
+	if ((int)(reg_system_tick - gt.spi_end) < 0) {
+		reg_spi_ctrl |= FLD_SPI_BUSY;
+		reg_system_tick += HAL_GPIO_POLL_TICKS;
+	} else
+		reg_spi_ctrl &= ~FLD_SPI_BUSY;
+	return &reg_spi_ctrl;
+}
+
+unsigned long hal_gpio_clock(void) {
+	hal_gpio_sync();
+	reg_system_tick += HAL_GPIO_POLL_TICKS;
+	return reg_system_tick;
+}
+
+// SDK: the function of a pin, AS_GPIO - the GPIO output
+void gpio_set_func(GPIO_PinTypeDef pin, GPIO_FuncTypeDef func) {
+	if (func == AS_GPIO)
+		BM_SET(reg_gpio_func(pin), pin & 0xff);
+	else
+		BM_CLR(reg_gpio_func(pin), pin & 0xff);
+}
@@ -0,0 +1,161 @@
+/*
+ * hal.c
+ *
+ * Host build: SDK flash and power management calls on a RAM flash.
+ * NOR semantics: erase sets 0xff, program only clears bits.
+ * The flash time advances the fake clock (reg_system_tick in the register file).
+ */
+#include "tl_common.h"
+#include "drivers.h"
+#include "hal.h"
+
+unsigned char hal_flash[HAL_FLASH_SIZE];
+hal_stat_t hal_stat;
+hal_i2c_stat_t hal_i2c_stat;
+unsigned char hal_flash_id2 = 0x13;
+unsigned int hal_wakeup_us = 1000000;
+unsigned int hal_stall_us;
+int hal_errors;
+
+static unsigned int hal_cut_cnt; // = 0 - no power loss
+
+void hal_stat_clear(void) {
+	memset(&hal_stat, 0, sizeof(hal_stat));
+}
+
+void hal_reset(void) {
+	memset(hal_flash, 0xff, sizeof(hal_flash));
+	hal_stat_clear();
+	memset(&hal_i2c_stat, 0, sizeof(hal_i2c_stat));
+	hal_flash_id2 = 0x13;
+	hal_wakeup_us = 1000000;
+	hal_cut_cnt = 0;
+	hal_stall_us = 0;
+	reg_system_tick = 0;
+}
+
+void hal_clock_us(unsigned int us) {
+	reg_system_tick += us * CLOCK_16M_SYS_TIMER_CLK_1US;
+}
+
+unsigned int hal_clock_get_us(void) {
+	return reg_system_tick / CLOCK_16M_SYS_TIMER_CLK_1US;
+}
+
+static void hal_busy(unsigned int us) {
+	hal_stat.busy_us += us;
+	hal_clock_us(us);
+}
+
+void hal_cut_after(unsigned int n) {
+	hal_cut_cnt = n;
+}
+
+/* Returns 1 if this write/erase is cut by the power loss */
+static int hal_cut(void) {
+	if (hal_cut_cnt && --hal_cut_cnt == 0)
+		return 1;
+	return 0;
+}
+
+static unsigned int hal_addr(unsigned long addr, unsigned long len) {
+	if (addr >= HAL_FLASH_SIZE || len > HAL_FLASH_SIZE - addr) {
+		printf("flash: bad address %08lx [%lu]\n", addr, len);
+		hal_exit(2);
+	}
+	return addr;
+}
+
+void flash_read_page(unsigned long addr, unsigned long len, unsigned char *buf) {
+	memcpy(buf, &hal_flash[hal_addr(addr, len)], len);
+	hal_stat.rd++;
+	hal_stat.rd_bytes += len;
+	hal_busy(HAL_READ_US + len / 4);
+}
+
+void flash_write_page(unsigned long addr, unsigned long len, unsigned char *buf) {
+	unsigned int i, a = hal_addr(addr, len);
+	if ((a & 0xff) + len > 256) {
+		printf("flash: page overflow %08x [%lu]\n", a, len);
+		hal_exit(2);
+	}
+	if (hal_cut()) {
+		for (i = 0; i < len / 2; i++)
+			hal_flash[a + i] &= buf[i];
+		hal_cut_point();
+	}
+	for (i = 0; i < len; i++)
+		hal_flash[a + i] &= buf[i];
+	hal_stat.wr++;
+	hal_stat.wr_bytes += len;
+	hal_busy(HAL_PAGE_US * (len + 255) / 256);
+}
+
+void flash_write(unsigned int addr, unsigned int len, unsigned char *buf) {
+	unsigned int n;
+	while (len) {
+		n = 256 - (addr & 0xff);
+		if (n > len)
+			n = len;
+		flash_write_page(addr, n, buf);
+		addr += n;
+		buf += n;
+		len -= n;
+	}
+}
+
+void flash_erase_sector(unsigned long addr) {
+	unsigned int a = hal_addr(addr & ~(HAL_SECTOR_SIZE - 1), HAL_SECTOR_SIZE);
+	if (hal_cut()) {
+		memset(&hal_flash[a], 0xff, HAL_SECTOR_SIZE / 2);
+		hal_cut_point();
+	}
+	memset(&hal_flash[a], 0xff, HAL_SECTOR_SIZE);
+	hal_stat.er++;
+	hal_busy(HAL_ERASE_US);
+}
+
+void flash_read_id(unsigned char *buf) {
+	buf[0] = 0x51;
+	buf[1] = 0x60;
+	buf[2] = hal_flash_id2;
+}
+
+/* The next BLE event: the idle tasks (flash_eep_task, memo_erase_task) run
+ * only if it is far enough */
+u32 bls_pm_getSystemWakeupTick(void) {
+	return clock_time() + hal_wakeup_us * CLOCK_16M_SYS_TIMER_CLK_1US;
+}
+
+void sleep_us(unsigned long us) {
+	hal_clock_us(us);
+}
+
+// pm_wait_us(), pm_wait_ms(): 'tick' of the system clock (timer0)
+void cpu_stall_wakeup_by_timer0(unsigned int tick) {
+	unsigned int us = tick / CLOCK_SYS_CLOCK_1US;
+	hal_stall_us += us;
+	hal_clock_us(us);
+}
+
+// the screen drivers: the pins and the wakeup sources have no effect on the host
+void gpio_setup_up_down_resistor(GPIO_PinTypeDef gpio, GPIO_PullTypeDef up_down) {
+}
+
+void bls_pm_setWakeupSource(u8 source) {
+}
+
+int hal_run_tests(const hal_test_t *t) {
+	int fails = 0, e;
+	hal_regs_init();
+	while (t->name) {
+		hal_reset();
+		e = hal_errors;
+		t->fn();
+		printf("%-32s %s\n", t->name, (hal_errors == e) ? "ok" : "FAIL");
+		if (hal_errors != e)
+			fails++;
+		t++;
+	}
+	return fails != 0;
+}
@@ -0,0 +1,131 @@
+/*
+ * hal.h
+ *
+ * Host build: HAL shim for the firmware modules (RAM flash, fake clock, soft AES).
+ * The tests include the firmware headers (SDK types.h redefines size_t),
+ * so this header does not include the system headers.
+ */
+#ifndef _HOST_HAL_H_
+#define _HOST_HAL_H_
+
+#define HAL_FLASH_SIZE	(1024*1024)
+#define HAL_SECTOR_SIZE	4096
+
+// flash latency (typical values of the 8258 flash, datasheet)
+#define HAL_ERASE_US	45000 // sector erase
+#define HAL_PAGE_US		2000 // page program, up to 256 bytes
+#define HAL_READ_US		1 // + 1 us per 4 bytes
+
+typedef struct _hal_stat_t {
+	unsigned int rd;		// flash_read_page() calls
+	unsigned int wr;		// flash_write() calls
+	unsigned int er;		// flash_erase_sector() calls
+	unsigned int rd_bytes;
+	unsigned int wr_bytes;
+	unsigned int busy_us;	// flash time
+} hal_stat_t;
+
+// i2c_bus.c, i2c_hw.c
+typedef struct _hal_i2c_stat_t {
+	unsigned int trs;		// transactions (i2c_hw.c: address phases)
+	unsigned int bytes;		// with the address bytes
+	unsigned int spin_us;	// i2c_hw.c: reg_i2c_status polled while busy
+} hal_i2c_stat_t;
+
+/* i2c_hw.c: the I2C master of the 8258 (reg_i2c_*, src/i2c.c) and the slaves of a test.
+ * The log of the address phases: "70w:3517." - write to 0x70 (<< 1) and STOP,
+ * "40w:fe 40r:2." - write, repeated START, read of 2 bytes, "44r!." - NAK */
+typedef struct _hal_i2c_dev_t {
+	unsigned char addr;	// I2C address << 1, 0 - end of the list
+	int (*ack)(int rd);	// address phase: 0 - NAK (asleep, busy), NULL - always ACK
+	void (*wr)(const unsigned char *buf, int len); // the bytes of a write phase, at its end
+	unsigned char (*rd)(int idx);	// byte 'idx' of a read phase
+} hal_i2c_dev_t;
+
+#define HAL_I2C_LOG_SIZE	512
+extern const hal_i2c_dev_t *hal_i2c_devs;
+extern char hal_i2c_log[HAL_I2C_LOG_SIZE];
+void hal_i2c_reset(void); // the bus idle, the log cleared
+
+// gpio_trace.c: the pins of src/epd_spi.c (gpio_regs.h), a level change with the tick of the write
+#define HAL_GPIO_TRACE_PINS	3
+#define HAL_GPIO_TRACE_SIZE	65536
+typedef struct _hal_gpio_ev_t {
+	unsigned int tick;
+	unsigned char lv;	// bit n - pins[n] of hal_gpio_trace()
+} hal_gpio_ev_t;
+
+extern hal_gpio_ev_t hal_gpio_ev[HAL_GPIO_TRACE_SIZE];
+extern int hal_gpio_ev_cnt;	// may be above HAL_GPIO_TRACE_SIZE, the rest is not stored
+extern int hal_gpio_err;	// a byte to reg_spi_data with the SPI block or its pins not set up
+void hal_gpio_trace(const unsigned int *pins, int n); // the trace cleared, event 0 - the current levels
+void hal_gpio_sync(void); // the writes after the last register access, at the end of a trace
+
+// ble_sdk.c: the SDK BLE stack of src/ble.c
+typedef struct _hal_ble_t {
+	unsigned char adv[31];	// bls_ll_setAdvData()
+	unsigned char adv_len;
+	unsigned int adv_cnt;
+	unsigned short adv_int;	// bls_ll_setAdvInterval(), x0.625 ms
+	unsigned int adv_int_cnt;
+	unsigned char ntf[256];	// bls_att_pushNotifyData(), the last one
+	int ntf_len;
+	unsigned int ntf_cnt;
+	unsigned short latency;	// bls_pm_setManualLatency()
+	unsigned char scan_on;	// blc_ll_setScanEnable()
+	unsigned int scan_cnt;	// scan enables
+	unsigned int scan_tik;	// tick of the scan enable
+	unsigned long long scan_ticks; // scan enabled (radio on) time, system ticks
+} hal_ble_t;
+
+extern hal_ble_t hal_ble;
+void hal_ble_reset(void); // the log cleared, MTU = ATT_MTU_SIZE
+
+extern unsigned char hal_flash[HAL_FLASH_SIZE];
+extern hal_stat_t hal_stat;
+extern unsigned char hal_flash_id2;	// flash_read_id() buf[2]: 0x13 - 512K, 0x14 - 1M
+extern unsigned int hal_wakeup_us;	// bls_pm_getSystemWakeupTick() - clock_time(), us
+extern unsigned int hal_stall_us;	// pm_wait_us() time (cpu stall, wakeup by timer0)
+extern hal_i2c_stat_t hal_i2c_stat;
+extern unsigned int hal_aes_blocks;	// aes_soft.c: aes_encrypt()/aes_decrypt() calls
+extern unsigned int hal_aes_keys;	// aes_hw.c: writes to reg_aes_key()
+extern unsigned int hal_aes_regs;	// aes_hw.c: accesses to the AES registers
+
+void hal_reset(void);				// flash erased, stats, clock = 0
+void hal_stat_clear(void);
+void hal_clock_us(unsigned int us);	// advance the fake clock
+unsigned int hal_clock_get_us(void);
+
+/* Power loss: the 'n'-th flash write/erase from now is cut
+ * (an erase leaves the sector half erased, a write - half written),
+ * hal_cut_run() returns 1 after the cut */
+void hal_cut_after(unsigned int n);
+int hal_cut_run(void (*fn)(void));
+void hal_cut_point(void); // from hal.c
+
+// hal_sys.c: system side
+void hal_regs_init(void);
+void hal_exit(int code);
+unsigned long long hal_ns(void);	// host time, for the render time
+unsigned long long hal_cycles(void);	// host time stamp counter (x86), else ns
+int hal_file_read(const char *name, char *buf, int size); // returns the length, -1 - no file
+int hal_file_write(const char *name, const char *buf, int len); // returns 0 - ok
+int hal_getenv_int(const char *name); // 0 - not set
+int hal_snprintf(char *buf, int size, const char *fmt, ...);
+
+int printf(const char *fmt, ...);
+
+extern int hal_errors;
+#define CHECK(c) do { if (!(c)) { printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #c); hal_errors++; } } while (0)
+#define CHECK_EQ(a, b) do { long long _a = (long long)(a), _b = (long long)(b); if (_a != _b) { \
+		printf("%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n", __FILE__, __LINE__, #a, #b, _a, _b); hal_errors++; } } while (0)
+
+// test list, each test_*.c defines its 'tests[]'
+typedef struct _hal_test_t {
+	const char *name;
+	void (*fn)(void);
+} hal_test_t;
+
+int hal_run_tests(const hal_test_t *t);
+
+#endif // _HOST_HAL_H_
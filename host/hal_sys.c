@@ -0,0 +1,114 @@
+/*
+ * hal_sys.c
+ *
+ * Host build: the system side of the shim (register file, power loss jump, output,
+ * host time, golden files).
+ * Does not include the firmware headers.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <setjmp.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#define HAL_REG_BASE	0x800000 // REG_BASE_ADDR of the 8258
+#define HAL_REG_SIZE	0x10000
+
+static jmp_buf hal_cut_jmp;
+static int hal_cut_armed;
+
+/* The SDK inline register accesses (clock_time, irq_disable, ...)
+ * go to a RAM page at the register address */
+void hal_regs_init(void) {
+	static int done;
+	void *p;
+	if (done)
+		return;
+	setvbuf(stdout, NULL, _IOLBF, 0); // the output up to a crash
+	p = mmap((void *)HAL_REG_BASE, HAL_REG_SIZE, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+	if (p != (void *)HAL_REG_BASE) {
+		fprintf(stderr, "register file: mmap at %#x failed\n", HAL_REG_BASE);
+		exit(2);
+	}
+	done = 1;
+}
+
+// printf() of the firmware headers (SDK u_printf.h)
+int u_printf(const char *fmt, ...) {
+	va_list ap;
+	int n;
+	va_start(ap, fmt);
+	n = vprintf(fmt, ap);
+	va_end(ap);
+	return n;
+}
+
+int hal_snprintf(char *buf, int size, const char *fmt, ...) {
+	va_list ap;
+	int n;
+	va_start(ap, fmt);
+	n = vsnprintf(buf, size, fmt, ap);
+	va_end(ap);
+	return n;
+}
+
+int hal_cut_run(void (*fn)(void)) {
+	if (setjmp(hal_cut_jmp)) {
+		hal_cut_armed = 0;
+		return 1;
+	}
+	hal_cut_armed = 1;
+	fn();
+	hal_cut_armed = 0;
+	return 0;
+}
+
+void hal_cut_point(void) {
+	if (hal_cut_armed)
+		longjmp(hal_cut_jmp, 1);
+}
+
+void hal_exit(int code) {
+	exit(code);
+}
+
+unsigned long long hal_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+unsigned long long hal_cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+	return __builtin_ia32_rdtsc();
+#else
+	return hal_ns();
+#endif
+}
+
+int hal_file_read(const char *name, char *buf, int size) {
+	FILE *f = fopen(name, "rb");
+	int n;
+	if (!f)
+		return -1;
+	n = fread(buf, 1, size, f);
+	fclose(f);
+	return n;
+}
+
+int hal_file_write(const char *name, const char *buf, int len) {
+	FILE *f = fopen(name, "wb");
+	int n;
+	if (!f)
+		return -1;
+	n = fwrite(buf, 1, len, f);
+	fclose(f);
+	return n != len;
+}
+
+int hal_getenv_int(const char *name) {
+	const char *s = getenv(name);
+	return s ? atoi(s) : 0;
+}
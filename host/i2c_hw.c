@@ -0,0 +1,156 @@
+/*
+ * i2c_hw.c
+ *
+ * Host build: the I2C master of the 8258 for src/i2c.c (I2C_GROUP).
+ * A command written to reg_i2c_ctrl runs from the time of the write (i2c_regs.h),
+ * the bus is busy for 9 clocks per byte at reg_i2c_speed, START/STOP - 1 clock.
+ * A read of reg_i2c_status while busy is a poll: 1/4 us, counted in spin_us.
+ */
+#include "tl_common.h"
+#include "app_config.h"
+#include "drivers.h"
+#include "hal.h"
+
+#define HAL_I2C_POLL_TICKS	4 // a status read while busy, 1/4 us
+#define HAL_I2C_WR_MAX		64
+
+const hal_i2c_dev_t *hal_i2c_devs;
+char hal_i2c_log[HAL_I2C_LOG_SIZE];
+
+static struct {
+	const hal_i2c_dev_t *dev;	// NULL - no slave at the address
+	u32 busy_end;	// tick
+	u32 ctrl_tik;	// tick of the write to reg_i2c_ctrl
+	int polls;		// status reads while busy, of the current us
+	int log_len;
+	int phase;		// address phase: 0 - none, 1 - write, 2 - read
+	int nak;
+	int cnt;		// bytes written or read
+	u8 addr;
+	u8 status;
+	u8 wr[HAL_I2C_WR_MAX];
+} bus;
+
+void hal_i2c_reset(void) {
+	memset(&bus, 0, sizeof(bus));
+	hal_i2c_log[0] = 0;
+}
+
+static void hal_i2c_logf(const char *fmt, int v) {
+	if (bus.log_len < HAL_I2C_LOG_SIZE - 16)
+		bus.log_len += hal_snprintf(&hal_i2c_log[bus.log_len], HAL_I2C_LOG_SIZE - bus.log_len, fmt, v);
+}
+
+// SDK: the pins of the I2C group
+void i2c_gpio_set(I2C_GPIO_GroupTypeDef i2c_pin_group) {
+	(void) i2c_pin_group;
+}
+
+/* End of the address phase: the write goes to the slave, the log */
+static void hal_i2c_phase_end(void) {
+	int i;
+	if (!bus.phase)
+		return;
+	hal_i2c_logf(bus.log_len ? " %02x" : "%02x", bus.addr & 0xfe);
+	hal_i2c_logf("%c", bus.phase == 2 ? 'r' : 'w');
+	if (bus.nak)
+		hal_i2c_logf("%c", '!');
+	else if (bus.phase == 2)
+		hal_i2c_logf(":%d", bus.cnt);
+	else if (bus.cnt) {
+		hal_i2c_logf("%c", ':');
+		for (i = 0; i < bus.cnt && i < HAL_I2C_WR_MAX; i++)
+			hal_i2c_logf("%02x", bus.wr[i]);
+		if (bus.dev && bus.dev->wr)
+			bus.dev->wr(bus.wr, bus.cnt < HAL_I2C_WR_MAX ? bus.cnt : HAL_I2C_WR_MAX);
+	}
+	bus.phase = 0;
+}
+
+static void hal_i2c_wr(u8 b) {
+	if (bus.phase != 1 || bus.nak)
+		return;
+	if (bus.cnt < HAL_I2C_WR_MAX)
+		bus.wr[bus.cnt] = b;
+	bus.cnt++;
+}
+
+/* The command of reg_i2c_ctrl, in the order of the 8258 master:
+ * START, ID, ADDR, DO, DI, STOP. Returns the bus time in ticks */
+static u32 hal_i2c_cmd(u8 ctrl) {
+	const hal_i2c_dev_t *d;
+	u32 bytes = 0, speed = reg_i2c_speed ? reg_i2c_speed : 1;
+	if (ctrl & FLD_I2C_CMD_START)
+		hal_i2c_phase_end(); // repeated START
+	if (ctrl & FLD_I2C_CMD_ID) {
+		hal_i2c_phase_end();
+		bus.addr = reg_i2c_id;
+		bus.phase = (bus.addr & FLD_I2C_WRITE_READ_BIT) ? 2 : 1;
+		bus.cnt = 0;
+		bus.dev = NULL;
+		for (d = hal_i2c_devs; d && d->addr; d++)
+			if (d->addr == (bus.addr & 0xfe)) {
+				bus.dev = d;
+				break;
+			}
+		bus.nak = !bus.dev || (bus.dev->ack && !bus.dev->ack(bus.phase == 2));
+		hal_i2c_stat.trs++;
+		bytes++;
+	}
+	if (ctrl & FLD_I2C_CMD_ADDR) {
+		hal_i2c_wr(reg_i2c_adr);
+		bytes++;
+	}
+	if (ctrl & FLD_I2C_CMD_DO) {
+		hal_i2c_wr(reg_i2c_do);
+		bytes++;
+	}
+	if (ctrl & FLD_I2C_CMD_DI) {
+		if (bus.phase == 2) {
+			reg_i2c_di = (!bus.nak && bus.dev->rd) ? bus.dev->rd(bus.cnt) : 0xff;
+			bus.cnt++;
+		} else
+			hal_i2c_wr(reg_i2c_di);
+		bytes++;
+	}
+	if (ctrl & FLD_I2C_CMD_STOP) {
+		hal_i2c_phase_end();
+		hal_i2c_logf("%c", '.');
+	}
+	hal_i2c_stat.bytes += bytes;
+	bus.status = bus.nak ? FLD_I2C_NAK : 0;
+	// 9 clocks per byte at CLOCK_SYS_CLOCK_HZ/(4*speed), START/STOP - 1 clock
+	return ((bytes * 9 + ((ctrl & (FLD_I2C_CMD_START | FLD_I2C_CMD_STOP)) ? 1 : 0))
+		* 4 * speed * CLOCK_16M_SYS_TIMER_CLK_1US) / CLOCK_SYS_CLOCK_1US;
+}
+
+/* The pending command of reg_i2c_ctrl */
+static void hal_i2c_sync(void) {
+	u8 ctrl = reg_i2c_ctrl;
+	if (ctrl) {
+		reg_i2c_ctrl = 0;
+		bus.busy_end = bus.ctrl_tik + hal_i2c_cmd(ctrl);
+	}
+}
+
+volatile unsigned char * hal_i2c_ctrl(void) {
+	hal_i2c_sync();
+	bus.ctrl_tik = reg_system_tick;
+	return &reg_i2c_ctrl;
+}
+
+volatile unsigned char * hal_i2c_status(void) {
+	static volatile unsigned char status;
+	hal_i2c_sync();
+	if ((int)(reg_system_tick - bus.busy_end) < 0) {
+		reg_system_tick += HAL_I2C_POLL_TICKS;
+		if (++bus.polls >= CLOCK_16M_SYS_TIMER_CLK_1US / HAL_I2C_POLL_TICKS) {
+			bus.polls = 0;
+			hal_i2c_stat.spin_us++;
+		}
+	}
+	status = bus.status;
+	if ((int)(reg_system_tick - bus.busy_end) < 0)
+		status |= FLD_I2C_CMD_BUSY;
+	return &status;
+}
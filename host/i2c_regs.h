@@ -0,0 +1,21 @@
+/*
+ * i2c_regs.h
+ *
+ * Host build: included before src/i2c.c (-include). A write to reg_i2c_ctrl
+ * and a read of reg_i2c_status go to the bus of i2c_hw.c.
+ */
+#ifndef _HOST_I2C_REGS_H_
+#define _HOST_I2C_REGS_H_
+
+#include "tl_common.h"
+#include "drivers.h"
+
+volatile unsigned char * hal_i2c_ctrl(void);
+volatile unsigned char * hal_i2c_status(void);
+
+#undef reg_i2c_ctrl
+#define reg_i2c_ctrl	(*hal_i2c_ctrl())
+#undef reg_i2c_status
+#define reg_i2c_status	(*hal_i2c_status())
+
+#endif // _HOST_I2C_REGS_H_
@@ -0,0 +1,35 @@
+/*
+ * stubs.c
+ *
+ * Host build: globals of the application, BLE and sensor modules
+ * (app.c, ble.c, sensors.c, rtc_pcf85163.c) that are not built for the host
+ */
+#include "tl_common.h"
+#include "app_config.h"
+#include "drivers.h"
+#include "app.h"
+#if (DEV_SERVICES & SERVICE_SCREEN)
+#include "lcd.h"
+#endif
+#if (DEV_SERVICES & SERVICE_HARD_CLOCK)
+#include "rtc.h"
+#endif
+#include "hal.h"
+
+measured_data_t measured_data;
+work_flg_t wrk;
+cfg_t cfg;
+
+#if (DEV_SERVICES & SERVICE_KEY) || (DEV_SERVICES & SERVICE_RDS)
+ext_key_t ext_key;
+#endif
+
+#if (DEV_SERVICES & SERVICE_SCREEN)
+scomfort_t cmf;
+external_data_t ext;
+sensor_cfg_t sensor_cfg;
+#endif
+
+#if (DEV_SERVICES & SERVICE_HARD_CLOCK)
+rtc_time_t rtc;
+#endif
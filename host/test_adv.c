@@ -0,0 +1,750 @@
+/*
+ * test_adv.c
+ *
+ * Host tests: the advertising packets of ble.c and the beacons. The packet
+ * is built into the shadow buffer right after a measurement and in main_loop,
+ * the adv. prepare callback only loads it; cycles and AES blocks in the callback
+ * against the baseline callback, which built and encrypted the packet itself.
+ * The encrypted beacons against the bytes of the baseline sources, ccm.c on the
+ * AES registers (aes_hw.c) against the baseline ccm_auth_crypt().
+ * The history notifications of CMD_ID_LOGBLK (send_memo_blk(), rd_memo.bulk).
+ */
+#include "tl_common.h"
+#include "app_config.h"
+#include "drivers.h"
+#include "app.h"
+#include "ble.h"
+#include "custom_beacon.h"
+#if USE_MIHOME_BEACON
+#include "mi_beacon.h"
+#endif
+#if USE_BTHOME_BEACON
+#include "bthome_beacon.h"
+#endif
+#if (DEV_SERVICES & SERVICE_BINDKEY)
+#include "ccm.h"
+#endif
+#if (DEV_SERVICES & SERVICE_HISTORY)
+#include "cmd_parser.h"
+#include "logger.h"
+#endif
+#include "hal.h"
+
+#define ADV_EVENTS		1000
+
+int app_advertise_prepare_handler(rf_packet_adv_t * p);
+
+static rf_packet_adv_t pkt;
+
+static const char * const adv_names[] = { "atc", "pvvx", "mi", "bthome" };
+
+// the beacons of the build
+static const u8 adv_types[] = {
+#if USE_ATC_BEACON
+	ADV_TYPE_ATC,
+#endif
+#if USE_CUSTOM_BEACON
+	ADV_TYPE_PVVX,
+#endif
+#if USE_MIHOME_BEACON
+	ADV_TYPE_MI,
+#endif
+#if USE_BTHOME_BEACON
+	ADV_TYPE_BTHOME,
+#endif
+};
+
+#if (DEV_SERVICES & SERVICE_BINDKEY)
+#define ADV_CRYPTO		1
+#else
+#define ADV_CRYPTO		0
+#endif
+
+static void adv_setup(u8 type, u8 crypto) {
+	int i;
+	hal_reset();
+	hal_ble_reset();
+	memset(&adv_buf, 0, sizeof(adv_buf));
+	memset(&wrk, 0, sizeof(wrk));
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.flg.advertising_type = type;
+	cfg.flg2.adv_crypto = crypto;
+	cfg.flg2.adv_flags = 1;
+	cfg.advertising_interval = 40; // 2.5 sec
+	cfg.measure_interval = 4;
+	cfg.rf_tx_power = RF_POWER_P3p01dBm;
+	for (i = 0; i < 16; i++)
+		bindkey[i] = 0xa0 + i;
+	measured_data.temp = 2345;
+	measured_data.humi = 5678;
+	measured_data.battery_mv = 2950;
+	measured_data.battery_level = 93;
+	init_ble();
+#if USE_ADV_ADAPTIVE
+	adv_buf.scale = 1;
+#endif
+	hal_ble_reset();
+}
+
+/* A new measurement as read_sensors(): the packet into the shadow buffer */
+static void adv_measure(int n) {
+	measured_data.temp = 2345 + n;
+	measured_data.count++;
+	wrk.msc.all_flgs = 0xff;
+	set_next_adv_data();
+}
+
+/* The measurement builds and encrypts the shadow packet, the callback loads it
+ * without AES, the stack packet is not touched before the adv. event */
+static void test_adv_shadow(void) {
+	u8 img[ADV_IMG_SIZE];
+	u8 size, crypto;
+	u32 blocks;
+	int t, i, err;
+	for (t = 0; t < (int)sizeof(adv_types); t++)
+		for (crypto = 0; crypto <= ADV_CRYPTO; crypto++) {
+			adv_setup(adv_types[t], crypto);
+			blocks = hal_aes_blocks;
+			adv_measure(0);
+			CHECK_EQ(hal_ble.adv_cnt, 0);
+			CHECK(adv_buf.img_next != NULL);
+			if (!adv_buf.img_next)
+				continue;
+			if (crypto)
+				CHECK(hal_aes_blocks > blocks);
+			size = adv_buf.img_next->size;
+			memcpy(img, adv_buf.img_next->data, size);
+			CHECK(size > 3 && size <= ADV_IMG_SIZE);
+			CHECK_EQ(img[1], GAP_ADTYPE_FLAGS);
+			blocks = hal_aes_blocks;
+			app_advertise_prepare_handler(&pkt);
+			CHECK_EQ(hal_aes_blocks, blocks);
+			CHECK_EQ(hal_ble.adv_cnt, 1);
+			CHECK_EQ(hal_ble.adv_len, size);
+			CHECK(memcmp(hal_ble.adv, img, size) == 0);
+			CHECK(adv_buf.img_next == NULL);
+			// the ext. adv. path (p = NULL) does not take it
+			adv_measure(1);
+			app_advertise_prepare_handler(NULL);
+			CHECK_EQ(hal_ble.adv_cnt, 1);
+			CHECK(adv_buf.img_next != NULL);
+			// the adv. events: no AES in the callback, the packet of the last build
+			err = 0;
+			for (i = 0; i < 4 * cfg.measure_interval; i++) {
+				if (i % cfg.measure_interval == 0)
+					adv_measure(i);
+				if (adv_buf.img_next) {
+					size = adv_buf.img_next->size;
+					memcpy(img, adv_buf.img_next->data, size);
+				}
+				blocks = hal_aes_blocks;
+				app_advertise_prepare_handler(&pkt);
+				err += hal_aes_blocks != blocks;
+				err += hal_ble.adv_len != size || memcmp(hal_ble.adv, img, size);
+				if (adv_buf.next_adv)
+					set_next_adv_data();
+			}
+			CHECK_EQ(err, 0);
+		}
+}
+
+/* Two builds before an adv. event: the later one is loaded, the other image
+ * is the next build target */
+static void test_adv_double(void) {
+	adv_setup(adv_types[0], ADV_CRYPTO);
+	adv_measure(0);
+	CHECK(adv_buf.img_next == &adv_buf.img[0]);
+	adv_measure(1);
+	CHECK(adv_buf.img_next == &adv_buf.img[1]);
+	CHECK_EQ(adv_buf.img_back, 0);
+	app_advertise_prepare_handler(&pkt);
+	CHECK_EQ(hal_ble.adv_cnt, 1);
+	CHECK(memcmp(hal_ble.adv, adv_buf.img[1].data, adv_buf.img[1].size) == 0);
+	// a sensor error: the packet with the name only
+	wrk.msc.b.th_sensor_read = 0;
+	adv_buf.next_adv = 1;
+	set_next_adv_data();
+	CHECK(adv_buf.img_next == &adv_buf.img[0]);
+	app_advertise_prepare_handler(&pkt);
+	CHECK_EQ(hal_ble.adv[4], GAP_ADTYPE_LOCAL_NAME_COMPLETE);
+}
+
+/* Cycles and AES blocks in the adv. prepare callback per adv. event,
+ * a measurement each cfg.measure_interval events. Baseline: the callback
+ * also ran set_next_adv_data() (assembly and AES-CCM) */
+static void test_adv_hook_time(void) {
+	unsigned long long cyc[2];
+	u32 blocks[2];
+	u8 m;
+	int t, i;
+	for (t = 0; t < (int)sizeof(adv_types); t++) {
+		for (m = 0; m < 2; m++) {
+			adv_setup(adv_types[t], ADV_CRYPTO);
+			cyc[m] = 0;
+			blocks[m] = 0;
+			for (i = 0; i < ADV_EVENTS; i++) {
+				unsigned long long tc;
+				u32 b;
+				if (i % cfg.measure_interval == 0) {
+					measured_data.temp = 2345 + i;
+					wrk.msc.all_flgs = 0xff;
+					if (m)
+						set_next_adv_data(); // read_sensors()
+				}
+				b = hal_aes_blocks;
+				tc = hal_cycles();
+				app_advertise_prepare_handler(&pkt);
+				if (!m) // baseline: the build in the callback
+					set_next_adv_data();
+				cyc[m] += hal_cycles() - tc;
+				blocks[m] += hal_aes_blocks - b;
+				if (m && adv_buf.next_adv)
+					set_next_adv_data(); // main_loop
+			}
+		}
+		CHECK_EQ(blocks[1], 0);
+		CHECK(blocks[0] > 0 || !ADV_CRYPTO);
+		CHECK(cyc[1] < cyc[0]);
+		printf("adv hook %-6s %s: baseline %5llu cycles %.2f AES blocks, shadow %4llu cycles %.2f AES blocks per event (host)\n",
+			adv_names[adv_types[t]], ADV_CRYPTO ? "crypt" : "plain", cyc[0] / ADV_EVENTS, (double)blocks[0] / ADV_EVENTS,
+			cyc[1] / ADV_EVENTS, (double)blocks[1] / ADV_EVENTS);
+	}
+}
+
+#if USE_ADV_ADAPTIVE
+#define ADV_FLAT_MEAS	40	// measurements in the deadband of a replay
+
+/* cfg.advertising_interval, cfg.measure_interval, cfg.flg3.adv_adaptive -> the max. scale:
+ * 1 << adv_adaptive, no more than measure_interval and 16000 (10 sec) */
+static const struct {
+	u8 adv_int;
+	u8 meas_int;
+	u8 adaptive;
+	u8 scale_max;
+} adv_adapt_cases[] = {
+	{ 20, 8, 0, 1 },
+	{ 20, 8, 1, 2 },
+	{ 20, 8, 2, 4 },
+	{ 20, 8, 3, 8 },
+	{ 20, 2, 3, 2 },	// measure_interval
+	{ 40, 4, 3, 4 },	// measure_interval, 16000
+	{ 80, 8, 3, 2 },	// 16000
+	{ 160, 8, 3, 1 },	// 16000
+};
+
+static void adv_adapt_setup(u8 adv_int, u8 meas_int, u8 adaptive) {
+	adv_setup(adv_types[0], 0);
+	cfg.advertising_interval = adv_int;
+	cfg.measure_interval = meas_int;
+	cfg.flg3.adv_adaptive = adaptive;
+	wrk.adv_interval = adv_int * 100; // test_config()
+	wrk.meas_scale = 1;
+	adv_buf.scale = 1;
+	adv_buf.flat_count = 0;
+	measured_data.battery_level = 93;
+}
+
+/* A measurement of the replay as read_sensors(), returns adv_buf.scale */
+static u8 adv_adapt_meas(s16 temp, s16 humi) {
+	measured_data.temp = temp;
+	measured_data.humi = humi;
+	measured_data.count++;
+	wrk.msc.all_flgs = 0xff;
+	set_next_adv_data();
+	return adv_buf.scale;
+}
+
+/* Measured values in the deadband: the adv. interval x2 each ADV_ADAPT_STEPS
+ * measurements up to the caps, a change out of the deadband restores it at once */
+static void test_adv_adaptive(void) {
+	u32 adv_int, steps;
+	u8 scale, max;
+	int c, i, expect, err;
+	for (c = 0; c < (int)ARRAY_SIZE(adv_adapt_cases); c++) {
+		adv_adapt_setup(adv_adapt_cases[c].adv_int, adv_adapt_cases[c].meas_int, adv_adapt_cases[c].adaptive);
+		adv_int = cfg.advertising_interval * 100;
+		max = adv_adapt_cases[c].scale_max;
+		CHECK_EQ(adv_adapt_meas(2500, 5000), 1); // the reference values
+		err = 0;
+		for (i = 1; i <= ADV_FLAT_MEAS; i++) {
+			// +-ADV_ADAPT_TEMP, +-ADV_ADAPT_HUMI around the reference are in the deadband
+			scale = adv_adapt_meas(2500 + ((i & 1) ? ADV_ADAPT_TEMP : -ADV_ADAPT_TEMP),
+				5000 + ((i & 2) ? ADV_ADAPT_HUMI : -ADV_ADAPT_HUMI));
+			expect = 1 << (i / ADV_ADAPT_STEPS);
+			if (expect > max)
+				expect = max;
+			err += scale != expect;
+			err += wrk.adv_interval != adv_int * scale;
+			if (scale > 1)
+				err += hal_ble.adv_int != adv_int * scale;
+		}
+		CHECK_EQ(err, 0);
+		for (steps = 0; (1u << steps) < max; steps++);
+		CHECK_EQ(hal_ble.adv_int_cnt, steps); // only the changes of the interval
+		// temperature out of the deadband: the interval at once
+		CHECK_EQ(adv_adapt_meas(2500 + ADV_ADAPT_TEMP + 1, 5000), 1);
+		CHECK_EQ(wrk.adv_interval, adv_int);
+		if (max > 1)
+			CHECK_EQ(hal_ble.adv_int, adv_int);
+		CHECK_EQ(hal_ble.adv_int_cnt, steps + (max > 1));
+		// the change is the new reference, the stretch starts again
+		for (i = 1; i <= ADV_ADAPT_STEPS; i++)
+			scale = adv_adapt_meas(2500 + ADV_ADAPT_TEMP + 1, 5000);
+		CHECK_EQ(scale, max > 1 ? 2 : 1);
+		// humidity, battery level
+		CHECK_EQ(adv_adapt_meas(2500 + ADV_ADAPT_TEMP + 1, 5000 - ADV_ADAPT_HUMI - 1), 1);
+		for (i = 1; i <= ADV_ADAPT_STEPS; i++)
+			adv_adapt_meas(2500 + ADV_ADAPT_TEMP + 1, 5000 - ADV_ADAPT_HUMI - 1);
+		measured_data.battery_level -= ADV_ADAPT_BAT + 1;
+		CHECK_EQ(adv_adapt_meas(2500 + ADV_ADAPT_TEMP + 1, 5000 - ADV_ADAPT_HUMI - 1), 1);
+		CHECK_EQ(wrk.adv_interval, adv_int);
+	}
+	// connected or the connectable interval (key, rds): no stretch
+	adv_adapt_setup(20, 8, 3);
+	adv_int = cfg.advertising_interval * 100;
+	wrk.ble_connected = 1;
+	for (i = 0; i < ADV_FLAT_MEAS; i++)
+		adv_adapt_meas(2500, 5000);
+	CHECK_EQ(adv_buf.scale, 1);
+	CHECK_EQ(hal_ble.adv_int_cnt, 0);
+	wrk.ble_connected = 0;
+	wrk.adv_interval = CONNECTABLE_ADV_INERVAL;
+	for (i = 0; i < ADV_FLAT_MEAS; i++)
+		adv_adapt_meas(2500, 5000);
+	CHECK_EQ(adv_buf.scale, 1);
+	CHECK_EQ(wrk.adv_interval, CONNECTABLE_ADV_INERVAL);
+	CHECK_EQ(hal_ble.adv_int_cnt, 0);
+}
+
+/* The adv. events of a flat replay: the measurement period does not depend
+ * on the stretched interval, the events per measurement drop by the scale */
+static void test_adv_adaptive_period(void) {
+	u32 t, t_meas, adv_int, events, meas, err;
+	int c;
+	for (c = 0; c < (int)ARRAY_SIZE(adv_adapt_cases); c++) {
+		adv_adapt_setup(adv_adapt_cases[c].adv_int, adv_adapt_cases[c].meas_int, adv_adapt_cases[c].adaptive);
+		adv_int = cfg.advertising_interval * 100;
+		adv_adapt_meas(2500, 5000);
+		t = t_meas = 0;
+		events = meas = err = 0;
+		while (meas < ADV_FLAT_MEAS) {
+			t += wrk.adv_interval; // x0.625 ms
+			events++;
+			wrk.start_measure = 0;
+			app_advertise_prepare_handler(&pkt);
+			if (wrk.start_measure) {
+				// the period in the adv. intervals of the config
+				err += t - t_meas != cfg.measure_interval * adv_int;
+				t_meas = t;
+				adv_adapt_meas(2500, 5000);
+				meas++;
+			}
+			if (adv_buf.next_adv)
+				set_next_adv_data();
+		}
+		CHECK_EQ(err, 0);
+		CHECK_EQ(adv_buf.scale, adv_adapt_cases[c].scale_max);
+		printf("adv adaptive %3u x %u, max x%u: %u measurements, %u adv. events (%u at x1)\n",
+			cfg.advertising_interval, cfg.measure_interval, adv_adapt_cases[c].scale_max, meas, events,
+			meas * cfg.measure_interval);
+	}
+}
+#endif // USE_ADV_ADAPTIVE
+
+#if (DEV_SERVICES & SERVICE_BINDKEY)
+#define ADV_VEC_MAX		27
+
+/* The encrypted beacons of the baseline sources (c5e9bf2: bthome_beacon.c,
+ * mi_beacon.c, custom_beacon.c, ccm.c): bindkey a0..af, MAC 11:11:11:11:11:11,
+ * 23.45 C, 56.78 %, 2950 mV, 93 %. BTHome: call_count 1 - data1, 2 - data2;
+ * Mi: stages 0..2 after two mi_beacon_summ() of 23.45 and 23.65 C */
+typedef struct _adv_vec_t {
+	u8 type;
+	u8 call_count;
+	u32 send_count;
+	u8 len;
+	u8 data[ADV_VEC_MAX];
+} adv_vec_t;
+
+static const adv_vec_t adv_vecs[] = {
+// BTHome (the objects) and Mi (the device id) of LYWSD03MMC
+#if USE_BTHOME_BEACON && (DEVICE_TYPE == DEVICE_LYWSD03MMC)
+	{ ADV_TYPE_BTHOME, 1, 0x12345678, 21, { 0x14, 0x16, 0xd2, 0xfc, 0x41, 0x93, 0x93, 0xad, 0xb0, 0xa6, 0xcc, 0x6a,
+		0x20, 0x78, 0x56, 0x34, 0x12, 0x6d, 0xb4, 0x62, 0x24 } },
+	{ ADV_TYPE_BTHOME, 2, 0x12345679, 20, { 0x13, 0x16, 0xd2, 0xfc, 0x41, 0x91, 0xe5, 0x21, 0x67, 0x2c, 0x10, 0x91,
+		0x79, 0x56, 0x34, 0x12, 0x66, 0x30, 0x0a, 0x90 } },
+#endif
+#if USE_MIHOME_BEACON && (DEVICE_TYPE == DEVICE_LYWSD03MMC)
+	{ ADV_TYPE_MI, 0, 0x12345678, 27, { 0x1a, 0x16, 0x95, 0xfe, 0x58, 0x58, 0x5b, 0x05, 0x78, 0x11, 0x11, 0x11,
+		0x11, 0x11, 0x11, 0xe5, 0x54, 0xf2, 0x2e, 0xc9, 0x56, 0x34, 0x12, 0x0c, 0x82, 0xf1, 0x5f } },
+	{ ADV_TYPE_MI, 0, 0x12345679, 27, { 0x1a, 0x16, 0x95, 0xfe, 0x58, 0x58, 0x5b, 0x05, 0x79, 0x11, 0x11, 0x11,
+		0x11, 0x11, 0x11, 0xd6, 0x2b, 0x57, 0xba, 0x1c, 0x56, 0x34, 0x12, 0xa1, 0x20, 0x6c, 0x52 } },
+	{ ADV_TYPE_MI, 0, 0x1234567a, 26, { 0x19, 0x16, 0x95, 0xfe, 0x58, 0x58, 0x5b, 0x05, 0x7a, 0x11, 0x11, 0x11,
+		0x11, 0x11, 0x11, 0x32, 0xbf, 0x72, 0x07, 0x56, 0x34, 0x12, 0x28, 0x32, 0xe2, 0x0a } },
+#endif
+#if USE_ATC_BEACON
+	{ ADV_TYPE_ATC, 0, 0x12345678, 12, { 0x0b, 0x16, 0x1a, 0x18, 0x78, 0xcf, 0x2c, 0x70, 0x53, 0x7b, 0x4f, 0xa6 } },
+	{ ADV_TYPE_ATC, 0, 0x123456f9, 12, { 0x0b, 0x16, 0x1a, 0x18, 0xf9, 0xa0, 0x83, 0xb6, 0x0a, 0x9d, 0xaa, 0xd6 } },
+#endif
+#if USE_CUSTOM_BEACON
+	{ ADV_TYPE_PVVX, 0, 0x12345678, 15, { 0x0e, 0x16, 0x1a, 0x18, 0x78, 0xf8, 0x22, 0xf2, 0x2a, 0x44, 0xee, 0x3c,
+		0xea, 0x64, 0x83 } },
+	{ ADV_TYPE_PVVX, 0, 0x123456f9, 15, { 0x0e, 0x16, 0x1a, 0x18, 0xf9, 0x59, 0xe2, 0x73, 0xa3, 0x8a, 0xc8, 0x81,
+		0x72, 0x97, 0x8e } },
+#endif
+};
+
+int sdk_aes_encrypt(unsigned char *Key, unsigned char *Data, unsigned char *Result); // SDK aes.c on aes_hw.c
+int __real_ccm_auth_crypt(int mode, const unsigned char *key, const unsigned char *iv, size_t iv_len,
+		const unsigned char *add, size_t add_len, const unsigned char *input, size_t length,
+		unsigned char *output, unsigned char *tag, size_t tag_len);
+
+enum { CCM_BASE, CCM_REGS, CCM_PRE, CCM_MODES };
+static const char * const ccm_names[] = { "baseline", "regs", "precomputed" };
+
+static struct {
+	u8 mode;
+	u32 calls;
+	u32 blocks, keys, regs;
+	unsigned long long cyc;
+} ccm_run;
+
+/* Baseline ccm_auth_crypt(), the encryption: sdk_aes_encrypt() per block,
+ * the key written to the engine and the data packed byte by byte each time */
+#define BASE_CBC_MAC	\
+	for (i = 0; i < 16; i++) \
+		y[i] ^= b[i]; \
+	sdk_aes_encrypt((u8 *)key, y, y);
+
+#define BASE_CTR_CRYPT(dst, src, len) \
+	sdk_aes_encrypt((u8 *)key, ctr, b); \
+	for (i = 0; i < len; i++) \
+		dst[i] = src[i] ^ b[i];
+
+static int base_ccm_encrypt(const unsigned char *key, const unsigned char *iv, size_t iv_len,
+		const unsigned char *add, size_t add_len, const unsigned char *input, size_t length,
+		unsigned char *output, unsigned char *tag, size_t tag_len) {
+	unsigned char i, q, b[16], y[16], ctr[16];
+	size_t len_left, use_len;
+	const unsigned char *src;
+	unsigned char *dst;
+	q = 16 - 1 - (unsigned char) iv_len;
+	b[0] = ((add_len > 0) << 6) | (((tag_len - 2) / 2) << 3) | (q - 1);
+	memcpy(b + 1, iv, iv_len);
+	for (i = 0, len_left = length; i < q; i++, len_left >>= 8)
+		b[15 - i] = (unsigned char) (len_left & 0xFF);
+	memset(y, 0, 16);
+	BASE_CBC_MAC;
+	if (add_len > 0) {
+		len_left = add_len;
+		src = add;
+		memset(b, 0, 16);
+		b[0] = (unsigned char) ((add_len >> 8) & 0xFF);
+		b[1] = (unsigned char) ((add_len) & 0xFF);
+		use_len = len_left < 16 - 2 ? len_left : 16 - 2;
+		memcpy(b + 2, src, use_len);
+		len_left -= use_len;
+		src += use_len;
+		BASE_CBC_MAC;
+		while (len_left > 0) {
+			use_len = len_left > 16 ? 16 : len_left;
+			memset(b, 0, 16);
+			memcpy(b, src, use_len);
+			BASE_CBC_MAC;
+			len_left -= use_len;
+			src += use_len;
+		}
+	}
+	ctr[0] = q - 1;
+	memcpy(ctr + 1, iv, iv_len);
+	memset(ctr + 1 + iv_len, 0, q);
+	ctr[15] = 1;
+	len_left = length;
+	src = input;
+	dst = output;
+	while (len_left > 0) {
+		use_len = len_left > 16 ? 16 : len_left;
+		memset(b, 0, 16);
+		memcpy(b, src, use_len);
+		BASE_CBC_MAC;
+		BASE_CTR_CRYPT(dst, src, use_len);
+		dst += use_len;
+		src += use_len;
+		len_left -= use_len;
+		for (i = 0; i < q; i++)
+			if (++ctr[15 - i] != 0)
+				break;
+	}
+	for (i = 0; i < q; i++)
+		ctr[15 - i] = 0;
+	BASE_CTR_CRYPT(y, y, 16);
+	memcpy(tag, y, tag_len);
+	return 0;
+}
+
+/* ccm_auth_crypt() of the beacons (-Wl,--wrap): the baseline or ccm.c,
+ * the AES blocks, key register writes, AES register accesses and cycles */
+int __wrap_ccm_auth_crypt(int mode, const unsigned char *key, const unsigned char *iv, size_t iv_len,
+		const unsigned char *add, size_t add_len, const unsigned char *input, size_t length,
+		unsigned char *output, unsigned char *tag, size_t tag_len) {
+	u32 blocks = hal_aes_blocks, keys = hal_aes_keys, regs = hal_aes_regs;
+	unsigned long long tc = hal_cycles();
+	int ret;
+	if (ccm_run.mode == CCM_BASE && mode == CCM_ENCRYPT)
+		ret = base_ccm_encrypt(key, iv, iv_len, add, add_len, input, length, output, tag, tag_len);
+	else
+		ret = __real_ccm_auth_crypt(mode, key, iv, iv_len, add, add_len, input, length, output, tag, tag_len);
+	ccm_run.cyc += hal_cycles() - tc;
+	ccm_run.blocks += hal_aes_blocks - blocks;
+	ccm_run.keys += hal_aes_keys - keys;
+	ccm_run.regs += hal_aes_regs - regs;
+	ccm_run.calls++;
+	return ret;
+}
+
+/* The inputs of the vectors */
+static void adv_vec_setup(u8 type, u32 send_count) {
+	int i;
+	adv_setup(type, 1);
+	memset(&measured_data, 0, sizeof(measured_data));
+	memset(mac_public, 0x11, 6);
+	for (i = 0; i < 16; i++)
+		bindkey[i] = 0xa0 + i;
+	measured_data.temp = 2345;
+	measured_data.humi = 5678;
+	measured_data.temp_x01 = 235;
+	measured_data.humi_x01 = 568;
+	measured_data.battery_mv = 2950;
+	measured_data.battery_level = 93;
+	adv_buf.send_count = send_count;
+}
+
+#if USE_MIHOME_BEACON
+/* Mi: to the last stage (battery, the shortest packet), two measurements for
+ * the averaging, the next packet is stage 0 */
+static void adv_vec_mi_start(void) {
+	u8 m = 0xff;
+	int i;
+	mi_beacon_init();
+	for (i = 0; i < 3; i++) {
+		mi_encrypt_data_beacon();
+		if (m > adv_buf.data[0])
+			m = adv_buf.data[0];
+	}
+	for (i = 0; i < 3 && adv_buf.data[0] != m; i++)
+		mi_encrypt_data_beacon();
+	mi_beacon_summ();
+	measured_data.temp = 2365;
+	mi_beacon_summ();
+}
+#endif
+
+/* The packet of vector 'v': CCM_PRE - the key stream of the nonce
+ * calculated before, as main_loop after the previous packet */
+static void adv_vec_build(const adv_vec_t *v, u8 mode) {
+	ccm_run.mode = mode;
+#if USE_CCM_PRECOMPUTE
+	if (mode == CCM_PRE) {
+		adv_buf.send_count = v->send_count - 1;
+		ccm_run.mode = CCM_REGS;
+		prepare_adv_crypt();
+		ccm_run.mode = mode;
+	}
+#endif
+	adv_buf.send_count = v->send_count;
+	adv_buf.call_count = v->call_count;
+	memset(adv_buf.data, 0, sizeof(adv_buf.data));
+	switch (v->type) {
+#if USE_BTHOME_BEACON
+	case ADV_TYPE_BTHOME:
+		bthome_beacon_init();
+		bthome_encrypt_data_beacon();
+		break;
+#endif
+#if USE_MIHOME_BEACON
+	case ADV_TYPE_MI:
+		mi_encrypt_data_beacon();
+		break;
+#endif
+#if USE_ATC_BEACON
+	case ADV_TYPE_ATC:
+		atc_encrypt_data_beacon();
+		break;
+#endif
+#if USE_CUSTOM_BEACON
+	case ADV_TYPE_PVVX:
+		pvvx_encrypt_data_beacon();
+		break;
+#endif
+	}
+}
+
+/* The encrypted beacons of bthome_beacon.c, mi_beacon.c and custom_beacon.c
+ * with the baseline CCM, ccm.c on the AES registers and with the precomputed
+ * key stream are the bytes of the baseline sources. Per packet: the AES blocks
+ * do not change, the key is written to the engine once instead of per block */
+static void test_adv_crypt_vectors(void) {
+	u32 blocks[CCM_MODES], keys[CCM_MODES], regs[CCM_MODES], pkts;
+	unsigned long long cyc[CCM_MODES];
+	u8 mode, type;
+	int i, j, k, err;
+	for (i = 0; i < (int)ARRAY_SIZE(adv_vecs); i = j) {
+		type = adv_vecs[i].type;
+		for (j = i; j < (int)ARRAY_SIZE(adv_vecs) && adv_vecs[j].type == type; j++);
+		pkts = j - i;
+		for (mode = 0; mode < CCM_MODES; mode++) {
+			if (mode == CCM_PRE && !USE_CCM_PRECOMPUTE)
+				continue;
+			memset(&ccm_run, 0, sizeof(ccm_run));
+			adv_vec_setup(type, 0);
+#if USE_MIHOME_BEACON
+			if (type == ADV_TYPE_MI)
+				adv_vec_mi_start();
+#endif
+			memset(&ccm_run, 0, sizeof(ccm_run));
+			err = 0;
+			for (k = i; k < j; k++) {
+				adv_vec_build(&adv_vecs[k], mode);
+				if (adv_buf.data[0] + 1 != adv_vecs[k].len || memcmp(adv_buf.data, adv_vecs[k].data, adv_vecs[k].len)) {
+					printf("adv %s %s: vector %d differs\n", adv_names[type], ccm_names[mode], k - i);
+					err++;
+				}
+			}
+			CHECK_EQ(err, 0);
+			CHECK_EQ(ccm_run.calls, pkts);
+			blocks[mode] = ccm_run.blocks;
+			keys[mode] = ccm_run.keys;
+			regs[mode] = ccm_run.regs;
+			cyc[mode] = ccm_run.cyc;
+		}
+		CHECK_EQ(blocks[CCM_REGS], blocks[CCM_BASE]);
+		CHECK_EQ(keys[CCM_BASE], 16 * blocks[CCM_BASE]);
+		CHECK_EQ(keys[CCM_REGS], 16 * pkts);
+		CHECK(regs[CCM_REGS] < regs[CCM_BASE]);
+		printf("ccm %-6s per packet: baseline %.1f AES blocks %.1f key writes %.1f AES reg. accesses %llu cycles,"
+			" regs %.1f / %.1f / %.1f / %llu\n", adv_names[type],
+			(double)blocks[CCM_BASE] / pkts, (double)keys[CCM_BASE] / pkts, (double)regs[CCM_BASE] / pkts,
+			cyc[CCM_BASE] / pkts, (double)blocks[CCM_REGS] / pkts, (double)keys[CCM_REGS] / pkts,
+			(double)regs[CCM_REGS] / pkts, cyc[CCM_REGS] / pkts);
+#if USE_CCM_PRECOMPUTE
+		// a CBC-MAC block per packet, BTHome data2 is not the prepared length (B_0 again)
+		CHECK_EQ(blocks[CCM_PRE], pkts + (type == ADV_TYPE_BTHOME));
+		printf("ccm %-6s per packet: precomputed %.1f AES blocks %.1f AES reg. accesses %llu cycles\n",
+			adv_names[type], (double)blocks[CCM_PRE] / pkts, (double)regs[CCM_PRE] / pkts, cyc[CCM_PRE] / pkts);
+#endif
+	}
+}
+#endif // (DEV_SERVICES & SERVICE_BINDKEY)
+
+#if (DEV_SERVICES & SERVICE_HISTORY)
+#define MEMO_BULK_RECS	100 // records in the history
+
+/* The history of MEMO_BULK_RECS records, a CMD_ID_LOGBLK request as cmd_parser.c */
+static void memo_bulk_setup(u16 mtu, u32 cnt, u32 cur) {
+	u32 i;
+	adv_setup(ADV_TYPE_BTHOME, 0);
+	cfg.averaging_measurements = 1;
+	cfg.connect_latency = 49;
+	memset(&memo, 0, sizeof(memo));
+	memset(&rd_memo, 0, sizeof(rd_memo));
+	memo_init();
+	for (i = 0; i < MEMO_BULK_RECS; i++) {
+		wrk.utc_time_sec = 1700000000 + i * 10;
+		measured_data.temp = i;
+		measured_data.humi = i * 3;
+		write_memo();
+	}
+	memo_rd_init();
+	bltAtt.effective_MTU = mtu;
+	hal_ble.latency = 0;
+	rd_memo.bulk = 1;
+	rd_memo.cnt = cnt;
+	rd_memo.cur = cur;
+}
+
+/* The notifications up to the end [cmd][0][0]: records of get_memo() from cur + 1,
+ * (MTU - 3 - 3) / sizeof(memo_blk_t) up to MEMO_BULK_RECS_MAX in each, returns the records */
+static u32 memo_bulk_read(u32 cur, u32 per_pkt, u32 *pkts) {
+	memo_blk_t blk;
+	u32 recs = 0, n, i, first, err = 0;
+	*pkts = 0;
+	while (rd_memo.cnt && *pkts < MEMO_BULK_RECS + 2) {
+		hal_ble.ntf_cnt = 0;
+		send_memo_blk();
+		CHECK_EQ(hal_ble.ntf_cnt, 1);
+		CHECK_EQ(hal_ble.ntf[0], CMD_ID_LOGBLK);
+		first = hal_ble.ntf[1] | (hal_ble.ntf[2] << 8);
+		n = (hal_ble.ntf_len - 3) / sizeof(memo_blk_t);
+		CHECK_EQ((hal_ble.ntf_len - 3) % sizeof(memo_blk_t), 0);
+		if (!first) // the end
+			break;
+		(*pkts)++;
+		CHECK_EQ(first, cur + recs + 1);
+		CHECK(n != 0 && n <= per_pkt);
+		for (i = 0; i < n; i++) {
+			get_memo(first + i, &blk);
+			err += memcmp(&hal_ble.ntf[3 + i * sizeof(memo_blk_t)], &blk, sizeof(memo_blk_t)) != 0;
+		}
+		// not the last packet: full
+		if (rd_memo.cnt && rd_memo.cur < rd_memo.cnt)
+			err += n != per_pkt;
+		recs += n;
+	}
+	CHECK_EQ(err, 0);
+	CHECK_EQ(hal_ble.ntf_len, 3);
+	CHECK_EQ(rd_memo.cnt, 0);
+	CHECK_EQ(hal_ble.latency, cfg.connect_latency);
+	return recs;
+}
+
+/* CMD_ID_LOGBLK: the records per notification by the MTU, the MEMO_BULK_RECS_MAX cap,
+ * a start record, a request over the history, the end marker */
+static void test_memo_bulk(void) {
+	static const u16 mtus[] = { 23, 50, 65, 100, 166, 247 };
+	u32 i, per_pkt, pkts, recs;
+	for (i = 0; i < ARRAY_SIZE(mtus); i++) {
+		per_pkt = (mtus[i] - 3 - 3) / sizeof(memo_blk_t);
+		if (per_pkt > MEMO_BULK_RECS_MAX)
+			per_pkt = MEMO_BULK_RECS_MAX;
+		// all records
+		memo_bulk_setup(mtus[i], MEMO_BULK_RECS, 0);
+		recs = memo_bulk_read(0, per_pkt, &pkts);
+		CHECK_EQ(recs, MEMO_BULK_RECS);
+		CHECK_EQ(pkts, (MEMO_BULK_RECS + per_pkt - 1) / per_pkt);
+		printf("memo bulk MTU %3u: %2u records per notify, %3u notifies of %u records (CMD_ID_LOGGER: %u)\n",
+			mtus[i], per_pkt, pkts + 1, recs, recs + 1);
+		// from the record 21, a whole number of packets
+		memo_bulk_setup(mtus[i], 20 + 4 * per_pkt, 20);
+		CHECK_EQ(memo_bulk_read(20, per_pkt, &pkts), 4 * per_pkt);
+		CHECK_EQ(pkts, 4);
+		// over the history: up to the last record
+		memo_bulk_setup(mtus[i], MEMO_BULK_RECS + 30, MEMO_BULK_RECS - 5);
+		CHECK_EQ(memo_bulk_read(MEMO_BULK_RECS - 5, per_pkt, &pkts), 5);
+	}
+	// nothing to send: the end only
+	memo_bulk_setup(247, MEMO_BULK_RECS, MEMO_BULK_RECS);
+	CHECK_EQ(memo_bulk_read(MEMO_BULK_RECS, MEMO_BULK_RECS_MAX, &pkts), 0);
+	CHECK_EQ(pkts, 0);
+}
+#endif // (DEV_SERVICES & SERVICE_HISTORY)
+
+static const hal_test_t tests[] = {
+	{ "adv: shadow packet", test_adv_shadow },
+	{ "adv: double buffer", test_adv_double },
+	{ "adv: hook time", test_adv_hook_time },
+#if USE_ADV_ADAPTIVE
+	{ "adv: adaptive interval", test_adv_adaptive },
+	{ "adv: adaptive meas. period", test_adv_adaptive_period },
+#endif
+#if (DEV_SERVICES & SERVICE_BINDKEY)
+	{ "adv: encrypted beacon vectors", test_adv_crypt_vectors },
+#endif
+#if (DEV_SERVICES & SERVICE_HISTORY)
+	{ "ble: history bulk", test_memo_bulk },
+#endif
+	{ NULL, NULL }
+};
+
+int main(void) {
+	return hal_run_tests(tests);
+}
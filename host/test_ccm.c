@@ -0,0 +1,95 @@
+/*
+ * test_ccm.c
+ *
+ * Host tests: software AES (FIPS-197) and AES-CCM (ccm.c, RFC 3610 vectors)
+ */
+#include "tl_common.h"
+#include "drivers/8258/aes.h"
+#include "ccm.h"
+#include "hal.h"
+
+// FIPS-197 C.1
+static const u8 aes_key[16] = {
+	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f };
+static const u8 aes_pt[16] = {
+	0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff };
+static const u8 aes_ct[16] = {
+	0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30, 0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a };
+
+// RFC 3610 Packet Vector #1 and #2
+static const u8 ccm_key[16] = {
+	0xc0, 0xc1, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xcb, 0xcc, 0xcd, 0xce, 0xcf };
+static const u8 ccm_nonce1[13] = {
+	0x00, 0x00, 0x00, 0x03, 0x02, 0x01, 0x00, 0xa0, 0xa1, 0xa2, 0xa3, 0xa4, 0xa5 };
+static const u8 ccm_ct1[23 + 8] = {
+	0x58, 0x8c, 0x97, 0x9a, 0x61, 0xc6, 0x63, 0xd2, 0xf0, 0x66, 0xd0, 0xc2, 0xc0, 0xf9, 0x89, 0x80,
+	0x6d, 0x5f, 0x6b, 0x61, 0xda, 0xc3, 0x84, 0x17, 0xe8, 0xd1, 0x2c, 0xfd, 0xf9, 0x26, 0xe0 };
+static const u8 ccm_nonce2[13] = {
+	0x00, 0x00, 0x00, 0x04, 0x03, 0x02, 0x01, 0xa0, 0xa1, 0xa2, 0xa3, 0xa4, 0xa5 };
+static const u8 ccm_ct2[24 + 8] = {
+	0x72, 0xc9, 0x1a, 0x36, 0xe1, 0x35, 0xf8, 0xcf, 0x29, 0x1c, 0xa8, 0x94, 0x08, 0x5c, 0x87, 0xe3,
+	0xcc, 0x15, 0xc4, 0x39, 0xc9, 0xe4, 0x3a, 0x3b, 0xa0, 0x91, 0xd5, 0x6e, 0x10, 0x40, 0x09, 0x16 };
+
+static u8 msg[32];
+
+static void msg_fill(void) {
+	unsigned i;
+	for (i = 0; i < sizeof(msg); i++)
+		msg[i] = i;
+}
+
+static void test_aes(void) {
+	u8 out[16], dec[16];
+	aes_encrypt((u8 *)aes_key, (u8 *)aes_pt, out);
+	CHECK(memcmp(out, aes_ct, 16) == 0);
+	aes_decrypt((u8 *)aes_key, out, dec);
+	CHECK(memcmp(dec, aes_pt, 16) == 0);
+}
+
+static void ccm_vector(const u8 *nonce, unsigned len, const u8 *ct) {
+	u8 out[32], tag[8], dec[32];
+	msg_fill();
+	// add = msg[0..7], input = msg[8..]
+	CHECK_EQ(aes_ccm_encrypt_and_tag(ccm_key, nonce, 13, msg, 8, msg + 8, len, out, tag, 8), 0);
+	CHECK(memcmp(out, ct, len) == 0);
+	CHECK(memcmp(tag, ct + len, 8) == 0);
+	CHECK_EQ(aes_ccm_auth_decrypt(ccm_key, nonce, 13, msg, 8, out, len, dec, tag, 8), 0);
+	CHECK(memcmp(dec, msg + 8, len) == 0);
+	tag[0] ^= 1;
+	CHECK(aes_ccm_auth_decrypt(ccm_key, nonce, 13, msg, 8, out, len, dec, tag, 8) != 0);
+}
+
+static void test_ccm_rfc3610(void) {
+	ccm_vector(ccm_nonce1, 23, ccm_ct1);
+	ccm_vector(ccm_nonce2, 24, ccm_ct2);
+}
+
+#if USE_CCM_PRECOMPUTE
+/* The precomputed key stream gives the same packet, also for another length */
+static void test_ccm_precompute(void) {
+	u8 out[32], tag[8], ref[32], rtag[8];
+	unsigned len;
+	msg_fill();
+	for (len = 23; len >= 20; len--) {
+		aes_ccm_encrypt_and_tag(ccm_key, ccm_nonce1, 13, msg, 8, msg + 8, len, ref, rtag, 8);
+		ccm_precompute(ccm_key, ccm_nonce1, 13, msg, 8, 23, 8);
+		aes_ccm_encrypt_and_tag(ccm_key, ccm_nonce1, 13, msg, 8, msg + 8, len, out, tag, 8);
+		CHECK(memcmp(out, ref, len) == 0);
+		CHECK(memcmp(tag, rtag, 8) == 0);
+	}
+	CHECK(memcmp(ref, ccm_ct1, 20) == 0);
+}
+#endif
+
+static const hal_test_t tests[] = {
+	{ "aes: FIPS-197", test_aes },
+	{ "ccm: RFC 3610", test_ccm_rfc3610 },
+#if USE_CCM_PRECOMPUTE
+	{ "ccm: precomputed key stream", test_ccm_precompute },
+#endif
+	{ NULL, NULL }
+};
+
+int main(void) {
+	return hal_run_tests(tests);
+}
@@ -0,0 +1,148 @@
+/*
+ * test_eep.c
+ *
+ * Host tests: flash EEP store (flash_eep.c), RAM directory, incremental pack, power loss
+ */
+#include "tl_common.h"
+#include "flash_eep.h"
+#include "hal.h"
+
+#define OBJ_SIZE	32
+#define OBJ_CNT		20 // > FEEP_DIR_SIZE
+
+// cold boot: the RAM directory and the pack state are not retained (first words: base, seg)
+extern unsigned int feep_dir[], feep_pack[];
+
+static void eep_boot(void) {
+	feep_dir[0] = 0;
+	feep_pack[0] = 0;
+	flash_read_cfg(NULL, EEP_ID_CFG, 0); // user_init(): the config is read
+}
+
+static void obj_fill(u8 *buf, unsigned id, unsigned ver) {
+	unsigned i;
+	for (i = 0; i < OBJ_SIZE; i++)
+		buf[i] = id * 16 + ver + i;
+}
+
+static int obj_check(unsigned id, unsigned ver) {
+	u8 buf[OBJ_SIZE], rd[OBJ_SIZE];
+	obj_fill(buf, id, ver);
+	if (flash_read_cfg(rd, id, sizeof(rd)) != OBJ_SIZE)
+		return 0;
+	return memcmp(buf, rd, OBJ_SIZE) == 0;
+}
+
+static void obj_write(unsigned id, unsigned ver) {
+	u8 buf[OBJ_SIZE];
+	obj_fill(buf, id, ver);
+	CHECK(flash_write_cfg(buf, id, sizeof(buf)));
+}
+
+static void test_rw(void) {
+	unsigned i, wr;
+	eep_boot();
+	for (i = 1; i <= OBJ_CNT; i++)
+		obj_write(i, 0);
+	for (i = 1; i <= OBJ_CNT; i++)
+		CHECK(obj_check(i, 0));
+	CHECK_EQ(flash_read_cfg(NULL, OBJ_CNT + 1, 0), FMEM_NOT_FOUND);
+	// the same data is not written again
+	wr = hal_stat.wr;
+	obj_write(3, 0);
+	CHECK_EQ(hal_stat.wr, wr);
+	obj_write(3, 1);
+	CHECK(hal_stat.wr > wr);
+	eep_boot();
+	CHECK(obj_check(3, 1));
+	CHECK(obj_check(OBJ_CNT, 0));
+}
+
+/* Objects 1..10, then id 1 rewritten until the free space is < FEEP_PACK_FREE */
+static unsigned eep_fill(void) {
+	unsigned i, ver = 0;
+	eep_boot();
+	hal_wakeup_us = 0; // no idle time: flash_eep_task() does nothing
+	for (i = 1; i <= 10; i++)
+		obj_write(i, 0);
+	while (feep_dir[1] + FEEP_PACK_FREE < feep_dir[0] + FMEMORY_SCFG_BANK_SIZE) // fend, base
+		obj_write(1, ++ver);
+	return ver;
+}
+
+static void test_idle_pack(void) {
+	unsigned i, ver = eep_fill(), er;
+	unsigned base = feep_dir[0];
+	// the next BLE event is near: no step
+	hal_wakeup_us = FEEP_STEP_TIME_MS * 1000 - 1000;
+	hal_stat_clear();
+	flash_eep_task();
+	CHECK_EQ(hal_stat.er + hal_stat.wr, 0);
+	// idle time: one erase or one object per step
+	hal_wakeup_us = 1000000;
+	for (i = 0; i < 200 && feep_dir[0] == base; i++) {
+		er = hal_stat.er;
+		flash_eep_task();
+		CHECK(hal_stat.er - er <= 1);
+		if (i == 5)
+			obj_write(2, 1); // a write during the pack goes to the old segment and is moved
+	}
+	CHECK(feep_dir[0] != base);
+	CHECK(obj_check(1, ver));
+	CHECK(obj_check(2, 1));
+	for (i = 3; i <= 10; i++)
+		CHECK(obj_check(i, 0));
+	eep_boot();
+	CHECK(obj_check(1, ver));
+	CHECK(obj_check(2, 1));
+}
+
+static unsigned cut_ver;
+
+static void cut_run(void) {
+	unsigned i;
+	hal_wakeup_us = 1000000;
+	for (i = 0; i < 200; i++)
+		flash_eep_task();
+}
+
+/* Power loss at each flash write/erase of the pack:
+ * after the boot the objects have the last values, the pack restarts */
+static void test_power_loss(void) {
+	static u8 snap[FMEMORY_SCFG_BANKS * FMEMORY_SCFG_BANK_SIZE];
+	unsigned i, n, cuts = 0;
+	cut_ver = eep_fill();
+	memcpy(snap, &hal_flash[FMEMORY_SCFG_BASE_ADDR], sizeof(snap));
+	for (n = 1; n < 400; n++) {
+		memcpy(&hal_flash[FMEMORY_SCFG_BASE_ADDR], snap, sizeof(snap));
+		eep_boot();
+		hal_cut_after(n);
+		if (!hal_cut_run(cut_run))
+			break;
+		cuts++;
+		hal_cut_after(0);
+		eep_boot();
+		CHECK(obj_check(1, cut_ver));
+		for (i = 2; i <= 10; i++)
+			CHECK(obj_check(i, 0));
+		// and the pack completes after the boot
+		cut_run();
+		CHECK(feep_dir[0] != FMEMORY_SCFG_BASE_ADDR);
+		obj_write(1, cut_ver + 1);
+		CHECK(obj_check(1, cut_ver + 1));
+		for (i = 2; i <= 10; i++)
+			CHECK(obj_check(i, 0));
+	}
+	CHECK(cuts > 10);
+}
+
+static const hal_test_t tests[] = {
+	{ "eep: read/write", test_rw },
+	{ "eep: idle time pack", test_idle_pack },
+	{ "eep: power loss in pack", test_power_loss },
+	{ NULL, NULL }
+};
+
+int main(void) {
+	return hal_run_tests(tests);
+}
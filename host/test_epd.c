@@ -0,0 +1,221 @@
+/*
+ * test_epd.c
+ *
+ * Host tests: the e-paper 3-wire SPI of epd_spi.c on the pin trace of gpio_trace.c.
+ * The frames are decoded from EPD_SCL, EPD_SDA and EPD_CSB (9 bits, D/C first,
+ * read at the rising clock), the clock and setup times are checked; the transfer
+ * time per byte against the baseline transmit() of the epd_*.c drivers.
+ * Built twice: the bit-bang path and USE_EPD_HW_SPI=1 (test_epd_spi).
+ */
+#include "tl_common.h"
+#include "app_config.h"
+#include "drivers.h"
+#include "drivers/8258/gpio_8258.h"
+#include "gpio_regs.h"
+#include "hal.h"
+
+#if (DEV_SERVICES & SERVICE_SCREEN) && (USE_EPD)
+#include "epd_spi.h"
+
+#define EPD_BLK_SIZE	1000 // bytes of the transfer time
+#define EPD_FRAMES_MAX	(EPD_BLK_SIZE + 16)
+
+// the clock of the path: bit-bang EPD_SCL half period 1.5 us, SPI 1 MHz
+#if USE_EPD_HW_SPI
+#define EPD_HALF_TICKS	(CLOCK_16M_SYS_TIMER_CLK_1US / 2)
+#else
+#define EPD_HALF_TICKS	(CLOCK_16M_SYS_TIMER_CLK_1US * 3 / 2)
+#endif
+
+#define EPD_WR_TICKS	(CLOCK_16M_SYS_TIMER_CLK_1US / 4) // a GPIO write after the edge (gpio_trace.c)
+
+enum { PIN_SCL = 1, PIN_SDA = 2, PIN_CSB = 4 };
+
+static const unsigned int epd_pins[] = { EPD_SCL, EPD_SDA, EPD_CSB };
+
+static struct {
+	int frames;
+	u16 frame[EPD_FRAMES_MAX];	// D/C bit 8
+	u32 min_high, min_low;	// EPD_SCL in a frame, ticks
+	u32 min_setup;	// EPD_SDA change to the rising EPD_SCL
+	u32 min_csb_high;	// between the frames
+	int err;		// clock outside of a frame, EPD_SDA change at high clock, not 9 bits
+} wave;
+
+/* The pins as after the boot (PXn_FUNC AS_GPIO): EPD_CSB high, EPD_SCL low */
+static void epd_trace_start(void) {
+	int i;
+	for (i = 0; i < (int)ARRAY_SIZE(epd_pins); i++)
+		BM_SET(reg_gpio_func(epd_pins[i]), epd_pins[i] & 0xff);
+	BM_SET(reg_gpio_out(EPD_CSB), EPD_CSB & 0xff);
+	BM_CLR(reg_gpio_out(EPD_SCL), EPD_SCL & 0xff);
+	BM_CLR(reg_gpio_out(EPD_SDA), EPD_SDA & 0xff);
+	hal_gpio_trace(epd_pins, ARRAY_SIZE(epd_pins));
+}
+
+/* The frames of the trace. In one event: EPD_SCL falls, EPD_SDA changes, EPD_SCL rises */
+static void epd_decode(void) {
+	u32 scl_tik = 0, sda_tik = 0, csb_tik = 0, dt;
+	u16 v = 0;
+	int i, bits = 0, in_frame = 0;
+	u8 lv, prev;
+	memset(&wave, 0, sizeof(wave));
+	wave.min_high = wave.min_low = wave.min_setup = wave.min_csb_high = 0xffffffff;
+	hal_gpio_sync();
+	CHECK(hal_gpio_ev_cnt <= HAL_GPIO_TRACE_SIZE);
+	prev = hal_gpio_ev[0].lv;
+	for (i = 1; i < hal_gpio_ev_cnt && i < HAL_GPIO_TRACE_SIZE; i++) {
+		u32 tik = hal_gpio_ev[i].tick;
+		lv = hal_gpio_ev[i].lv;
+		if ((prev & PIN_CSB) && !(lv & PIN_CSB)) { // frame start
+			if (csb_tik && wave.min_csb_high > tik - csb_tik)
+				wave.min_csb_high = tik - csb_tik;
+			in_frame = 1;
+			bits = 0;
+			v = 0;
+			if (prev & PIN_SCL)
+				wave.err++;
+		}
+		if ((prev & PIN_SCL) && !(lv & PIN_SCL)) {
+			dt = tik - scl_tik;
+			if (in_frame && wave.min_high > dt)
+				wave.min_high = dt;
+			scl_tik = tik;
+		}
+		if ((prev ^ lv) & PIN_SDA) {
+			if ((prev & lv & PIN_SCL) && in_frame)
+				wave.err++;
+			sda_tik = tik;
+		}
+		if (!(prev & PIN_SCL) && (lv & PIN_SCL)) {
+			if (!in_frame)
+				wave.err++;
+			else {
+				dt = tik - scl_tik;
+				if (bits && wave.min_low > dt)
+					wave.min_low = dt;
+				dt = tik - sda_tik;
+				if (wave.min_setup > dt)
+					wave.min_setup = dt;
+				v = (v << 1) | ((lv & PIN_SDA) ? 1 : 0);
+				bits++;
+			}
+			scl_tik = tik;
+		}
+		if (!(prev & PIN_CSB) && (lv & PIN_CSB)) { // frame end
+			if (bits != 9 || (lv & PIN_SCL))
+				wave.err++;
+			else if (wave.frames < EPD_FRAMES_MAX)
+				wave.frame[wave.frames++] = v;
+			in_frame = 0;
+			csb_tik = tik;
+		}
+		prev = lv;
+	}
+}
+
+/* The frames from 'first', returns the number of wrong ones */
+static int epd_frames_check(int first, u8 cd, const u8 *data, int len) {
+	int i, err = 0;
+	if (wave.frames < first + len)
+		return len;
+	for (i = 0; i < len; i++)
+		err += wave.frame[first + i] != (((cd & 1) << 8) | data[i]);
+	return err;
+}
+
+/* Baseline: transmit() of the epd_*.c drivers, gpio_write() and sleep_us(2) per half period
+ * (gpio_write() of the SDK is inline, before gpio_regs.h) */
+#define base_write(pin, v) { if (v) BM_SET(reg_gpio_out(pin), (pin) & 0xff); else BM_CLR(reg_gpio_out(pin), (pin) & 0xff); }
+
+static void base_transmit(u8 cd, u8 data_to_send) {
+	int i;
+	base_write(EPD_SCL, 0);
+	base_write(EPD_CSB, 0);
+	sleep_us(2);
+	base_write(EPD_SDA, cd);
+	sleep_us(2);
+	base_write(EPD_SCL, 1);
+	sleep_us(2);
+	for (i = 0; i < 8; i++) {
+		base_write(EPD_SCL, 0);
+		base_write(EPD_SDA, data_to_send & 0x80);
+		data_to_send <<= 1;
+		sleep_us(2);
+		base_write(EPD_SCL, 1);
+		sleep_us(2);
+	}
+	base_write(EPD_SCL, 0);
+	sleep_us(2);
+	base_write(EPD_CSB, 1);
+	sleep_us(2);
+}
+
+/* A command and data bytes: the frames, the clock of the path, EPD_SDA set up
+ * a half period before the rising clock, EPD_CSB high 1.5 us (- a GPIO write) */
+static void test_epd_waveform(void) {
+	static const u8 data[] = { 0x00, 0xff, 0xa5, 0x5a, 0x81, 0x7e, 0x01, 0x80 };
+	u8 cmd = 0x12;
+	epd_trace_start();
+	epd_transmit(0, cmd);
+	epd_transmit_blk(1, data, sizeof(data));
+	epd_transmit(1, 0x3c);
+	epd_decode();
+	CHECK_EQ(hal_gpio_err, 0);
+	CHECK_EQ(wave.err, 0);
+	CHECK_EQ(wave.frames, 2 + sizeof(data));
+	CHECK_EQ(wave.frame[0], cmd);
+	CHECK_EQ(epd_frames_check(1, 1, data, sizeof(data)), 0);
+	CHECK_EQ(wave.frame[1 + sizeof(data)], 0x100 | 0x3c);
+	CHECK(wave.min_high >= EPD_HALF_TICKS);
+	CHECK(wave.min_low >= EPD_HALF_TICKS);
+	CHECK(wave.min_setup >= EPD_HALF_TICKS - EPD_WR_TICKS);
+	CHECK(wave.min_csb_high >= CLOCK_16M_SYS_TIMER_CLK_1US * 3 / 2 - EPD_WR_TICKS);
+	printf("epd %s: SCL high %.2f us, low %.2f us, SDA setup %.2f us, CSB high %.2f us (min)\n",
+		USE_EPD_HW_SPI ? "spi" : "gpio", wave.min_high / 16.0, wave.min_low / 16.0,
+		wave.min_setup / 16.0, wave.min_csb_high / 16.0);
+}
+
+/* The time of EPD_BLK_SIZE data bytes (a LUT or a frame buffer) */
+static void test_epd_time(void) {
+	static u8 data[EPD_BLK_SIZE];
+	u32 t, tb;
+	int i;
+	for (i = 0; i < EPD_BLK_SIZE; i++)
+		data[i] = i * 37;
+	epd_trace_start();
+	t = reg_system_tick;
+	epd_transmit_blk(1, data, EPD_BLK_SIZE);
+	epd_decode();
+	t = reg_system_tick - t;
+	CHECK_EQ(hal_gpio_err, 0);
+	CHECK_EQ(wave.err, 0);
+	CHECK_EQ(wave.frames, EPD_BLK_SIZE);
+	CHECK_EQ(epd_frames_check(0, 1, data, EPD_BLK_SIZE), 0);
+	epd_trace_start();
+	tb = reg_system_tick;
+	for (i = 0; i < EPD_BLK_SIZE; i++)
+		base_transmit(1, data[i]);
+	epd_decode();
+	tb = reg_system_tick - tb;
+	CHECK_EQ(wave.err, 0);
+	CHECK_EQ(wave.frames, EPD_BLK_SIZE);
+	CHECK_EQ(epd_frames_check(0, 1, data, EPD_BLK_SIZE), 0);
+	CHECK(t < tb);
+	printf("epd %s: %d bytes, %.2f us per byte, baseline transmit() %.2f us per byte (%u%%)\n",
+		USE_EPD_HW_SPI ? "spi" : "gpio", EPD_BLK_SIZE, t / 16.0 / EPD_BLK_SIZE, tb / 16.0 / EPD_BLK_SIZE,
+		t * 100 / tb);
+}
+#endif // (DEV_SERVICES & SERVICE_SCREEN) && (USE_EPD)
+
+static const hal_test_t tests[] = {
+#if (DEV_SERVICES & SERVICE_SCREEN) && (USE_EPD)
+	{ "epd: waveform", test_epd_waveform },
+	{ "epd: transfer time", test_epd_time },
+#endif
+	{ NULL, NULL }
+};
+
+int main(void) {
+	return hal_run_tests(tests);
+}
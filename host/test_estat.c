@@ -0,0 +1,124 @@
+/*
+ * test_estat.c
+ *
+ * Host tests: the active and sleep time counters of estat.c on the fake clock.
+ * The sections nest and follow each other in one scope, the sleep time goes
+ * to the wakeup counter, the ticks fold into ms. The overhead of a section
+ * (estat_enter() .. estat_leave()) against an AES-CCM packet of ccm.c.
+ */
+#include "tl_common.h"
+#include "app_config.h"
+#include "drivers.h"
+#include "estat.h"
+#include "ccm.h"
+#include "hal.h"
+
+#if USE_ENERGY_STAT
+
+#define ESTAT_SECTIONS	1000000	// sections of the overhead
+#define ESTAT_PKTS		10000	// AES-CCM packets
+
+#define US(x)	((x) * CLOCK_16M_SYS_TIMER_CLK_1US)
+
+static void estat_start(void) {
+	estat.cur = ESTAT_OTHER;
+	estat_clear();
+}
+
+/* Two sections in one scope, a nested one: the time goes to the innermost
+ * subsystem, each leave restores the interrupted one */
+static void test_estat_sections(void) {
+	u8 prev, prev_flash, prev_aes;
+	estat_start();
+	hal_clock_us(10);
+	prev = estat_enter(ESTAT_SENSOR);
+	hal_clock_us(100);
+	prev_flash = estat_enter(ESTAT_FLASH);
+	hal_clock_us(40);
+	prev_aes = estat_enter(ESTAT_AES);
+	hal_clock_us(7);
+	estat_leave(prev_aes);
+	hal_clock_us(3);
+	CHECK_EQ(estat.cur, ESTAT_FLASH);
+	estat_leave(prev_flash);
+	hal_clock_us(20);
+	estat_leave(prev);
+	CHECK_EQ(estat.cur, ESTAT_OTHER);
+	hal_clock_us(5);
+	// the next section in the same scope
+	prev = estat_enter(ESTAT_LCD);
+	hal_clock_us(200);
+	estat_leave(prev);
+	estat_switch(ESTAT_OTHER);
+	CHECK_EQ(estat.acc[ESTAT_OTHER], US(15));
+	CHECK_EQ(estat.acc[ESTAT_SENSOR], US(120));
+	CHECK_EQ(estat.acc[ESTAT_FLASH], US(43));
+	CHECK_EQ(estat.acc[ESTAT_AES], US(7));
+	CHECK_EQ(estat.acc[ESTAT_LCD], US(200));
+	// a scan window: only from the active time of main_loop
+	estat_set(ESTAT_OTHER, ESTAT_SCAN);
+	hal_clock_us(9000);
+	estat_set(ESTAT_SENSOR, ESTAT_OTHER); // not the current one
+	estat_set(ESTAT_SCAN, ESTAT_OTHER);
+	CHECK_EQ(estat.acc[ESTAT_SCAN], US(9000));
+	// sleep: up to the wakeup, then the active time of the stack
+	estat_switch(ESTAT_SUSPEND);
+	hal_clock_us(2500000);
+	estat_wake(ESTAT_DEEP);
+	CHECK_EQ(estat.acc[ESTAT_DEEP], US(2500000));
+	CHECK_EQ(estat.cur, ESTAT_OTHER);
+	// ms totals, the rest in ticks
+	estat_fold();
+	CHECK_EQ(estat.ms[ESTAT_DEEP], 2500);
+	CHECK_EQ(estat.acc[ESTAT_DEEP], 0);
+	CHECK_EQ(estat.ms[ESTAT_SCAN], 9);
+	CHECK_EQ(estat.ms[ESTAT_SENSOR], 0);
+	CHECK_EQ(estat.acc[ESTAT_SENSOR], US(120));
+	CHECK_EQ(estat_active_ms(), 9);
+	estat_clear();
+	CHECK_EQ(estat.ms[ESTAT_DEEP] + estat.acc[ESTAT_LCD], 0);
+}
+
+/* Cycles of a section against a BTHome AES-CCM packet (11 bytes, 4 bytes MIC),
+ * which has one section itself */
+static void test_estat_overhead(void) {
+	static const u8 key[16] = { 0x23, 0x1d, 0x39, 0xc1, 0xd7, 0xcc, 0x1a, 0xb1,
+		0xae, 0xe2, 0x24, 0xcd, 0x09, 0x6d, 0xb9, 0x32 };
+	u8 nonce[13], msg[11], out[11], mic[4], aad = 0x11;
+	unsigned long long tc, cyc_sec, cyc_pkt;
+	u8 prev;
+	int i;
+	memset(nonce, 0x5a, sizeof(nonce));
+	memset(msg, 0xa5, sizeof(msg));
+	estat_start();
+	tc = hal_cycles();
+	for (i = 0; i < ESTAT_SECTIONS; i++) {
+		prev = estat_enter(ESTAT_AES);
+		estat_leave(prev);
+	}
+	cyc_sec = hal_cycles() - tc;
+	CHECK_EQ(estat.cur, ESTAT_OTHER);
+	tc = hal_cycles();
+	for (i = 0; i < ESTAT_PKTS; i++) {
+		nonce[12] = i;
+		aes_ccm_encrypt_and_tag(key, nonce, sizeof(nonce), &aad, 1, msg, sizeof(msg), out, mic, sizeof(mic));
+	}
+	cyc_pkt = hal_cycles() - tc;
+	CHECK(cyc_sec * 100 / ESTAT_SECTIONS < cyc_pkt / ESTAT_PKTS); // < 1%
+	printf("estat: section %.1f cycles, AES-CCM packet %llu cycles (%.2f%%), 2 clock_time() reads per section\n",
+		(double)cyc_sec / ESTAT_SECTIONS, cyc_pkt / ESTAT_PKTS,
+		(double)cyc_sec * ESTAT_PKTS * 100 / ESTAT_SECTIONS / cyc_pkt);
+}
+#endif // USE_ENERGY_STAT
+
+static const hal_test_t tests[] = {
+#if USE_ENERGY_STAT
+	{ "estat: sections", test_estat_sections },
+	{ "estat: overhead", test_estat_overhead },
+#endif
+	{ NULL, NULL }
+};
+
+int main(void) {
+	return hal_run_tests(tests);
+}
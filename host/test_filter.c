@@ -0,0 +1,213 @@
+/*
+ * test_filter.c
+ *
+ * Host tests: the filters of the measured values (filter.c), step and impulse
+ * responses against the float models, the Kalman variance clamp, time per call.
+ */
+#include "tl_common.h"
+#include "app_config.h"
+#include "app.h"
+#include "filter.h"
+#include "hal.h"
+
+#if USE_SENSOR_FILTER
+
+#define STEPS		64
+#define STEP_AT		8	// the step or the impulse
+#define LEVEL		1000
+
+static s16 out[STEPS];
+
+static void set_filter(u8 type, u8 par1, u8 par2) {
+	memset(&flt.cfg, 0, sizeof(flt.cfg));
+	flt.cfg[0].type = type;
+	flt.cfg[0].par1 = par1;
+	flt.cfg[0].par2 = par2;
+	reset_filter();
+}
+
+/* width = 0 - step from 0 to LEVEL at STEP_AT, else an impulse of 'width' samples */
+static s16 input(int i, int width) {
+	if (i < STEP_AT)
+		return 0;
+	if (width && i >= STEP_AT + width)
+		return 0;
+	return LEVEL;
+}
+
+static void run(int width) {
+	int i;
+	for (i = 0; i < STEPS; i++) {
+		measured_data.temp = input(i, width);
+		filter_measures();
+		out[i] = measured_data.temp;
+	}
+}
+
+static int iabs(int x) {
+	return x < 0 ? -x : x;
+}
+
+static void test_filter_none(void) {
+	int i;
+	set_filter(FILTER_NONE, 0, 0);
+	run(1);
+	for (i = 0; i < STEPS; i++)
+		CHECK_EQ(out[i], input(i, 1));
+}
+
+/* median of n (the upper one for an even n): impulses up to (n - 1)/2 samples
+ * are removed, a step is delayed by (n - 1)/2 */
+static void test_filter_median(void) {
+	static const u8 par[] = { 0, 3, 4, 5, 9 }; // 0 -> 3, 9 -> 5
+	int j, i, n, w, err;
+	for (j = 0; j < (int)ARRAY_SIZE(par); j++) {
+		n = par[j] < 3 ? 3 : (par[j] > FILTER_MEDIAN_MAX ? FILTER_MEDIAN_MAX : par[j]);
+		for (w = 1; w <= (n - 1) / 2; w++) {
+			set_filter(FILTER_MEDIAN, par[j], 0);
+			run(w);
+			err = 0;
+			for (i = 0; i < STEPS; i++)
+				err += out[i] != 0;
+			CHECK_EQ(err, 0);
+		}
+		set_filter(FILTER_MEDIAN, par[j], 0);
+		run(0);
+		err = 0;
+		for (i = 0; i < STEPS; i++)
+			err += out[i] != ((i >= STEP_AT + (n - 1) / 2) ? LEVEL : 0);
+		CHECK_EQ(err, 0);
+	}
+}
+
+/* EMA: within 1 unit of x += (z - x) / 2^par1, ends exactly on the level */
+static void test_filter_ema(void) {
+	int shf, i, err;
+	double x;
+	for (shf = 1; shf <= 7; shf++) {
+		set_filter(FILTER_EMA, shf, 0);
+		run(0);
+		err = 0;
+		x = 0;
+		for (i = 0; i < STEPS; i++) {
+			x += (input(i, 0) - x) / (1 << shf);
+			err += iabs(out[i] - (int)(x + 0.5)) > 1;
+			if (i && out[i] < out[i - 1])
+				err++;
+		}
+		CHECK_EQ(err, 0);
+		for (i = 0; i < 2000; i++) {
+			measured_data.temp = LEVEL;
+			filter_measures();
+		}
+		CHECK_EQ(measured_data.temp, LEVEL);
+		// and back down
+		for (i = 0; i < 2000; i++) {
+			measured_data.temp = 0;
+			filter_measures();
+		}
+		CHECK_EQ(measured_data.temp, 0);
+	}
+}
+
+/* Kalman: within 3 units of the float filter, for a step and an impulse */
+static void kalman_check(u8 par1, u8 par2, int width) {
+	double q = par1 * par1, r = par2 * par2, p, x, k;
+	int i, err = 0;
+	if (r == 0)
+		r = 1;
+	set_filter(FILTER_KALMAN, par1, par2);
+	run(width);
+	p = r;
+	x = input(0, width);
+	for (i = 1; i < STEPS; i++) {
+		p += q;
+		if (p > 0xffff)
+			p = 0xffff;
+		k = p / (p + r);
+		x += (input(i, width) - x) * k;
+		p = p * (1 - k);
+		err += iabs(out[i] - (int)(x + 0.5)) > 3;
+	}
+	CHECK_EQ(err, 0);
+}
+
+static void test_filter_kalman(void) {
+	int i;
+	kalman_check(1, 10, 0);
+	kalman_check(1, 10, 1);
+	kalman_check(5, 10, 0);
+	kalman_check(20, 5, 1);
+	// a small process noise: the impulse is attenuated to the steady gain
+	set_filter(FILTER_KALMAN, 1, 10);
+	run(1);
+	CHECK(out[STEP_AT] > 0 && out[STEP_AT] < LEVEL / 5);
+	CHECK(out[STEPS - 1] < 5);
+	// no process noise: the gain stays >= 1/256, a late step is still followed
+	set_filter(FILTER_KALMAN, 0, 1);
+	run(0);
+	for (i = 0; i < 2000; i++) {
+		measured_data.temp = -LEVEL;
+		filter_measures();
+	}
+	CHECK(measured_data.temp < -LEVEL + 10);
+}
+
+/* par1 = par2 = 255: p + q > 0xffff at each step, the clamp keeps p and the
+ * gain in range (p << 8 in u32), full-scale steps do not overflow */
+static void test_filter_kalman_clamp(void) {
+	int i, err = 0;
+	s16 prev;
+	kalman_check(255, 255, 0);
+	set_filter(FILTER_KALMAN, 255, 255);
+	measured_data.temp = -32768;
+	filter_measures();
+	prev = measured_data.temp;
+	CHECK_EQ(prev, -32768);
+	for (i = 0; i < 32; i++) {
+		measured_data.temp = 32767;
+		filter_measures();
+		err += flt.ch[0].p > (0xffff << FILTER_KALMAN_PSHL);
+		err += measured_data.temp < prev; // rises to the level without a wrap
+		prev = measured_data.temp;
+	}
+	CHECK_EQ(err, 0);
+	CHECK(iabs(prev - 32767) <= 1);
+}
+
+/* host time per filter_measures() (two channels), for the comparison of the types */
+static void test_filter_time(void) {
+	static const char * const names[] = { "none", "median5", "ema4", "kalman" };
+	static const u8 par1[] = { 0, 5, 4, 2 };
+	unsigned long long ns;
+	int t, i;
+	for (t = FILTER_NONE; t <= FILTER_KALMAN; t++) {
+		set_filter(t, par1[t], 10);
+		flt.cfg[1] = flt.cfg[0];
+		ns = hal_ns();
+		for (i = 0; i < 100000; i++) {
+			measured_data.temp = 2000 + (i & 31);
+			measured_data.humi = 5000 - (i & 15);
+			filter_measures();
+		}
+		ns = hal_ns() - ns;
+		printf("filter %-8s %3llu ns per call (host)\n", names[t], ns / 100000);
+	}
+}
+#endif // USE_SENSOR_FILTER
+
+static const hal_test_t tests[] = {
+#if USE_SENSOR_FILTER
+	{ "filter: none", test_filter_none },
+	{ "filter: median", test_filter_median },
+	{ "filter: ema", test_filter_ema },
+	{ "filter: kalman", test_filter_kalman },
+	{ "filter: kalman clamp", test_filter_kalman_clamp },
+	{ "filter: time", test_filter_time },
+#endif
+	{ NULL, NULL }
+};
+
+int main(void) {
+	return hal_run_tests(tests);
+}
@@ -0,0 +1,443 @@
+/*
+ * test_lcd.c
+ *
+ * Host tests: the screen drivers (lcd.c, lcd_*.c, epd_*.c) render a matrix of
+ * temperature, humidity, battery and clock states into display_buff,
+ * the frames are compared with golden/lcd_<DEVICE_TYPE>.txt.
+ * HAL_GOLDEN_UPDATE=1 writes the golden file (make golden).
+ * USE_LCD_DIRTY: the I2C writes of send_to_lcd() on the bus of i2c_hw.c
+ * to a model of the LCD controller RAM.
+ * USE_EPD: the full refresh cadence (epd_cfg) on the pin trace of gpio_trace.c.
+ */
+#include "tl_common.h"
+#include "app_config.h"
+#include "app.h"
+#if (DEV_SERVICES & SERVICE_SCREEN)
+#include "lcd.h"
+#if (DEV_SERVICES & SERVICE_HARD_CLOCK)
+#include "rtc.h"
+#endif
+#endif
+#include "hal.h"
+
+#if (DEV_SERVICES & SERVICE_SCREEN)
+
+#define T0		1700000000 // 22:13:20 UTC
+#define MODES	4
+
+static const s16 temps[] = { -2000, -345, 0, 2345, 9999, 12000 }; // x0.01 C
+static const s16 humis[] = { 0, 4560, 9990, 10000 }; // x0.01 %
+static const struct { u16 mv; u8 level; } batts[] = { { 2100, 3 }, { 2700, 57 }, { 3100, 100 } };
+
+static char out[64 * 1024], golden[64 * 1024];
+static int out_len;
+
+#if (DEVICE_TYPE == DEVICE_MJWSD05MMC) || (DEVICE_TYPE == DEVICE_MJWSD05MMC_EN)
+/* 0 - time (am/pm), 1 - temperature in F, 2 - humidity x0.01 and comfort, 3 - battery % */
+static void set_mode(int mode) {
+	cfg.flg.time_am_pm = mode == 0;
+	cfg.flg.temp_F_or_C = mode == 1;
+	cfg.flg.x100 = mode == 2;
+	cfg.flg.comfort_smiley = mode == 2;
+	cfg.flg2.screen_type = (mode == 3) ? SCR_TYPE_BAT_P : mode;
+}
+#else
+/* 0 - C and smiley, 1 - F and comfort, 2 - battery stage, 3 - clock stage */
+static void set_mode(int mode) {
+	cfg.flg.temp_F_or_C = mode == 1;
+	cfg.flg.comfort_smiley = mode == 1;
+	cfg.flg2.smiley = 7;
+	cfg.flg.show_batt_enabled = mode == 2;
+	cfg.flg.show_time_smile = mode == 3;
+	lcd_flg.show_stage = (mode == 3) ? 3 : (mode == 2);
+}
+#endif
+
+static void set_values(s16 t, s16 h, int b) {
+	measured_data.temp = t;
+	measured_data.humi = h;
+	measured_data.temp_x01 = (t + 5) / 10;
+	measured_data.humi_x01 = (h + 5) / 10;
+	measured_data.humi_x1 = (h + 50) / 100;
+	measured_data.battery_mv = batts[b].mv;
+#if USE_AVERAGE_BATTERY
+	measured_data.average_battery_mv = batts[b].mv;
+#endif
+	measured_data.battery_level = batts[b].level;
+}
+
+static void frame_dump(int t, int h, int b, int m) {
+	int i;
+	out_len += hal_snprintf(&out[out_len], sizeof(out) - out_len, "%6d %5d %3d %d %d |",
+		temps[t], humis[h], batts[b].level, m, wrk.ble_connected);
+	for (i = 0; i < LCD_BUF_SIZE; i++)
+		out_len += hal_snprintf(&out[out_len], sizeof(out) - out_len, " %02x", display_buff[i]);
+	out_len += hal_snprintf(&out[out_len], sizeof(out) - out_len, "\n");
+}
+
+/* Prints the first differing lines, returns their number */
+static int golden_diff(int len) {
+	int i = 0, j = 0, n = 0, line = 1, si, sj;
+	while (i < out_len || j < len) {
+		si = i;
+		sj = j;
+		while (i < out_len && out[i] != '\n')
+			i++;
+		while (j < len && golden[j] != '\n')
+			j++;
+		if (i - si != j - sj || memcmp(&out[si], &golden[sj], i - si)) {
+			if (n++ < 5)
+				printf("frame %d:\n  golden: %.*s\n  output: %.*s\n", line, j - sj, &golden[sj], i - si, &out[si]);
+		}
+		i++;
+		j++;
+		line++;
+	}
+	return n;
+}
+
+static void test_lcd_golden(void) {
+	unsigned long long ns, dt, sum = 0, max = 0;
+	int t, h, b, m, frames = 0, len;
+	memset(&cfg, 0, sizeof(cfg));
+	memset(&lcd_flg, 0, sizeof(lcd_flg));
+	cmf.t[0] = 2000;
+	cmf.t[1] = 2500;
+	cmf.h[0] = 3000;
+	cmf.h[1] = 6000;
+	wrk.utc_time_sec = T0;
+	init_lcd();
+	out_len = 0;
+	for (m = 0; m < MODES; m++)
+		for (b = 0; b < (int)ARRAY_SIZE(batts); b++)
+			for (h = 0; h < (int)ARRAY_SIZE(humis); h++)
+				for (t = 0; t < (int)ARRAY_SIZE(temps); t++) {
+					set_mode(m);
+					set_values(temps[t], humis[h], b);
+					wrk.ble_connected = frames & 1;
+					wrk.utc_time_sec = T0 + frames * 61;
+#if (DEV_SERVICES & SERVICE_HARD_CLOCK)
+					rtc.hours = wrk.utc_time_sec / 3600 % 24;
+					rtc.minutes = wrk.utc_time_sec / 60 % 60;
+#endif
+					ns = hal_ns();
+					lcd();
+					update_lcd();
+					dt = hal_ns() - ns;
+					sum += dt;
+					if (max < dt)
+						max = dt;
+					frame_dump(t, h, b, m);
+					frames++;
+				}
+	printf("lcd: %d frames, render avg %llu ns, max %llu ns (host)\n", frames, sum / frames, max);
+	if (hal_getenv_int("HAL_GOLDEN_UPDATE")) {
+		CHECK_EQ(hal_file_write(HAL_GOLDEN, out, out_len), 0);
+		return;
+	}
+	len = hal_file_read(HAL_GOLDEN, golden, sizeof(golden));
+	if (len < 0) {
+		printf("%s: no golden file (make golden)\n", HAL_GOLDEN);
+		hal_errors++;
+		return;
+	}
+	CHECK_EQ(golden_diff(len), 0);
+}
+#if USE_LCD_DIRTY
+#define LCDC_RAM_SIZE	10
+#define LCDC_STEPS		2000
+
+/* The I2C LCD controllers of send_to_lcd() */
+enum { LCDC_B14, LCDC_B19, LCDC_BL55028 };
+
+static const struct { const char *name; u8 addr; u8 type; } lcdc[] = {
+#if DEVICE_TYPE == DEVICE_LYWSD03MMC
+	{ "B1.4", B14_I2C_ADDR << 1, LCDC_B14 },
+	{ "B1.9", B19_I2C_ADDR << 1, LCDC_B19 },
+#elif DEVICE_TYPE == DEVICE_MHO_C122
+	{ "B1.4", B14_I2C_ADDR << 1, LCDC_B14 },
+#elif DEVICE_TYPE == DEVICE_ZTH05Z
+	{ "BL55028", BL55028_I2C_ADDR << 1, LCDC_BL55028 },
+#endif
+};
+
+static u8 lcdc_type, lcdc_ram[LCDC_RAM_SIZE];
+static int lcdc_err;
+
+static u8 rev8(u8 b) {
+	b = (b & 0xf0) >> 4 | (b & 0x0f) << 4;
+	b = (b & 0xcc) >> 2 | (b & 0x33) << 2;
+	return (b & 0xaa) >> 1 | (b & 0x55) << 1;
+}
+
+/* A write to the controller: B1.4 - 0x80 0x40 (address 0), then 0xC0 and a data byte,
+ * B1.9, BL55028 - ADSET (the address in nibbles, display data from 4 or 8) and the data,
+ * a command with bit 7 (0xC8 mode set) */
+static void lcdc_wr(const u8 *buf, int len) {
+	int i, a;
+	if (lcdc_type == LCDC_B14) {
+		if (len < 2 || buf[0] != 0x80 || buf[1] != 0x40 || (len & 1)) {
+			lcdc_err++;
+			return;
+		}
+		for (i = 2, a = 0; i < len; i += 2, a++) {
+			if (buf[i] != 0xc0 || a >= LCDC_RAM_SIZE)
+				lcdc_err++;
+			else
+				lcdc_ram[a] = buf[i + 1];
+		}
+		return;
+	}
+	if (buf[0] & 0x80)
+		return;
+	a = buf[0] - ((lcdc_type == LCDC_B19) ? 4 : 8);
+	if (a < 0 || (a & 1)) {
+		lcdc_err++;
+		return;
+	}
+	for (a >>= 1, i = 1; i < len; i++) {
+		if (a >= LCDC_RAM_SIZE)
+			lcdc_err++;
+		else
+			lcdc_ram[a++] = buf[i];
+	}
+}
+
+static hal_i2c_dev_t lcdc_dev[] = { { 0, NULL, lcdc_wr, NULL }, { 0, NULL, NULL, NULL } };
+
+/* The controller RAM of display_buff, returns its size */
+static int lcdc_image(u8 *img) {
+	int i;
+	if (lcdc_type == LCDC_B19) {
+		// d0,d1,0,0,d2,d3,0,0,d4,d5, bit-reversed
+		memset(img, 0, LCDC_RAM_SIZE);
+		for (i = 0; i < LCD_BUF_SIZE; i++)
+			img[i + (i & ~1)] = rev8(display_buff[i]);
+		return LCDC_RAM_SIZE;
+	}
+	memcpy(img, display_buff, LCD_BUF_SIZE);
+	return LCD_BUF_SIZE;
+}
+
+static int lcdc_check(void) {
+	u8 img[LCDC_RAM_SIZE];
+	int n = lcdc_image(img);
+	return memcmp(img, lcdc_ram, n) != 0;
+}
+
+/* init_lcd(): the controller RAM cleared, all bytes to send */
+static void lcdc_start(int v) {
+	lcdc_type = lcdc[v].type;
+	lcdc_dev[0].addr = lcdc[v].addr;
+	hal_i2c_devs = lcdc_dev;
+	hal_i2c_reset();
+	memset(lcdc_ram, 0, sizeof(lcdc_ram));
+	lcdc_err = 0;
+	lcd_i2c_addr = lcdc[v].addr;
+	lcd_dirty = LCD_DIRTY_ALL;
+}
+
+/* The bus log of the runs {pos, len} in the controller RAM */
+static int lcdc_expect(char *s, int size, u8 addr, const u8 *runs) {
+	u8 img[LCDC_RAM_SIZE];
+	int r, i, len = 0;
+	s[0] = 0;
+	lcdc_image(img);
+	for (r = 0; r < 4 && runs[r + 1]; r += 2) {
+		len += hal_snprintf(&s[len], size - len, r ? " %02xw:" : "%02xw:", addr);
+		if (lcdc_type == LCDC_B14)
+			len += hal_snprintf(&s[len], size - len, "8040");
+		else
+			len += hal_snprintf(&s[len], size - len, "%02x", ((lcdc_type == LCDC_B19) ? 4 : 8) + (runs[r] << 1));
+		for (i = runs[r]; i < runs[r] + runs[r + 1]; i++)
+			len += hal_snprintf(&s[len], size - len, (lcdc_type == LCDC_B14) ? "c0%02x" : "%02x", img[i]);
+		len += hal_snprintf(&s[len], size - len, ".");
+	}
+	if (len && lcdc_type == LCDC_B19)
+		len += hal_snprintf(&s[len], size - len, " %02xw:c8.", addr);
+	return len;
+}
+
+/* The changed bytes of display_buff and the runs per controller: pos, len */
+static const struct { u8 mask; u8 runs[3][4]; } lcdc_cases[] = {
+	{ 0x08, { { 0, 4 }, { 5, 1 }, { 3, 1 } } },
+	{ 0x21, { { 0, 6 }, { 0, 1, 9, 1 }, { 0, 1, 5, 1 } } },
+	{ 0x06, { { 0, 3 }, { 1, 4 }, { 1, 2 } } }, // B1.9: a gap of 2 inside the run
+	{ 0x05, { { 0, 3 }, { 0, 1, 4, 1 }, { 0, 3 } } }, // B1.9: a gap of 3, two runs
+	{ 0x00, { { 0 }, { 0 }, { 0 } } }, // no change, no write
+};
+
+/* lcd_next_run(): the ADSET and the bytes of each run, B1.4 - up to the last changed byte */
+static void test_lcd_i2c_runs(void) {
+	static const u8 frame[LCD_BUF_SIZE] = { 0x11, 0x22, 0x33, 0x44, 0x55, 0x66 };
+	char s[HAL_I2C_LOG_SIZE];
+	int v, c, i;
+	memset(&cfg, 0, sizeof(cfg));
+	for (v = 0; v < (int)ARRAY_SIZE(lcdc); v++) {
+		lcdc_start(v);
+		memcpy(display_buff, frame, sizeof(display_buff));
+		update_lcd();
+		CHECK_EQ(lcdc_check(), 0);
+		for (c = 0; c < (int)ARRAY_SIZE(lcdc_cases); c++) {
+			hal_i2c_reset();
+			for (i = 0; i < LCD_BUF_SIZE; i++)
+				if (lcdc_cases[c].mask & (1 << i))
+					display_buff[i] ^= 0x5a;
+			update_lcd();
+			lcdc_expect(s, sizeof(s), lcdc[v].addr, lcdc_cases[c].runs[lcdc[v].type]);
+			if (strcmp(hal_i2c_log, s)) {
+				printf("%s, changed %02x:\n  expected: %s\n  bus:      %s\n", lcdc[v].name, lcdc_cases[c].mask, s, hal_i2c_log);
+				hal_errors++;
+			}
+			CHECK_EQ(lcdc_check(), 0);
+		}
+		CHECK_EQ(lcdc_err, 0);
+	}
+}
+
+/* The I2C bytes of the changed bytes against all bytes of a changed frame
+ * (the baseline send_to_lcd()), a random walk of temperature and humidity */
+static void test_lcd_i2c_bytes(void) {
+	u32 bytes[2], rnd;
+	s16 t, h;
+	int v, m, i, frames, err;
+	memset(&cfg, 0, sizeof(cfg));
+	memset(&lcd_flg, 0, sizeof(lcd_flg));
+	cmf.t[0] = 2000;
+	cmf.t[1] = 2500;
+	cmf.h[0] = 3000;
+	cmf.h[1] = 6000;
+	wrk.utc_time_sec = T0;
+	for (v = 0; v < (int)ARRAY_SIZE(lcdc); v++) {
+		for (m = 0; m < 2; m++) {
+			lcdc_start(v);
+			set_mode(0);
+			rnd = 12345;
+			t = 2345;
+			h = 4560;
+			frames = 0;
+			err = 0;
+			for (i = 0; i < LCDC_STEPS; i++) {
+				rnd = rnd * 1103515245 + 12345;
+				t += (int)((rnd >> 16) % 21) - 10;
+				h += (int)((rnd >> 8) % 41) - 20;
+				if (h < 0 || h > 9999)
+					h = 4560;
+				set_values(t, h, 1);
+				lcd();
+				if (memcmp(display_buff, display_cmp_buff, sizeof(display_buff))) {
+					frames++;
+					if (m)
+						lcd_dirty = LCD_DIRTY_ALL;
+				}
+				if (i == 0)
+					hal_i2c_stat.bytes = 0;
+				update_lcd();
+				err += lcdc_check();
+			}
+			bytes[m] = hal_i2c_stat.bytes;
+			CHECK_EQ(err, 0);
+			CHECK_EQ(lcdc_err, 0);
+		}
+		CHECK(bytes[0] < bytes[1]);
+		printf("lcd i2c %-7s: %d steps, %d frames, I2C bytes: changed %u, all %u (%u%%)\n",
+			lcdc[v].name, LCDC_STEPS, frames, bytes[0], bytes[1], bytes[0] * 100 / bytes[1]);
+	}
+}
+#endif // USE_LCD_DIRTY
+#if USE_EPD
+#define EPD_UPDATES		70
+
+static const unsigned int epd_pins[] = { EPD_SCL, EPD_SDA, EPD_CSB };
+
+/* One update as main_loop(): update_lcd(), task_lcd() up to stage 0 with EPD_BUSY
+ * ready. Returns the bytes (9-bit frames, EPD_CSB low) sent to the panel */
+static int epd_update(void) {
+	int i, n = 0;
+	hal_gpio_trace(epd_pins, ARRAY_SIZE(epd_pins));
+	update_lcd();
+	for (i = 0; i < 16 && stage_lcd; i++)
+		task_lcd();
+	CHECK_EQ(stage_lcd, 0);
+	hal_gpio_sync();
+	for (i = 1; i < hal_gpio_ev_cnt && i < HAL_GPIO_TRACE_SIZE; i++)
+		if ((hal_gpio_ev[i - 1].lv & 4) && !(hal_gpio_ev[i].lv & 4))
+			n++;
+	return n;
+}
+
+/* The update 'k' after a full refresh is the next full one, 0 - never:
+ * refresh_cnt partial updates, refresh_min minutes (an update per minute) */
+static const struct { u8 cnt, min, period; } epd_cadence[] = {
+	{ 0, 0, 0 },
+	{ 3, 0, 4 },
+	{ 0, 5, 5 },
+	{ 4, 3, 3 }, // the time first
+	{ 2, 10, 3 }, // the count first
+	{ DEF_EPD_REFRESH_CNT, 0, DEF_EPD_REFRESH_CNT ? DEF_EPD_REFRESH_CNT + 1 : 0 },
+};
+
+/* init_lcd() (a full refresh) and the updates of a new temperature each minute:
+ * the full refreshes by epd_refresh_full() and the bytes sent */
+static void test_epd_refresh(void) {
+	int c, k, i, n, full, part, fulls, err;
+	u32 bytes;
+	for (c = 0; c < (int)ARRAY_SIZE(epd_cadence); c++) {
+		memset(&cfg, 0, sizeof(cfg));
+		memset(&lcd_flg, 0, sizeof(lcd_flg));
+		for (i = 0; i < (int)ARRAY_SIZE(epd_pins); i++)
+			BM_SET(reg_gpio_func(epd_pins[i]), epd_pins[i] & 0xff);
+		BM_SET(reg_gpio_out(EPD_CSB), EPD_CSB & 0xff);
+		BM_SET(reg_gpio_in(EPD_BUSY), EPD_BUSY & 0xff);
+		epd_cfg.refresh_cnt = epd_cadence[c].cnt;
+		epd_cfg.refresh_min = epd_cadence[c].min;
+		wrk.utc_time_sec = T0;
+		set_values(2000, 4560, 1);
+		lcd();
+		init_lcd();
+		full = epd_update();
+		part = 0;
+		fulls = 0;
+		err = 0;
+		bytes = 0;
+		for (k = 1; k <= EPD_UPDATES; k++) {
+			wrk.utc_time_sec += 60;
+			set_values(2000 + k * 10, 4560, 1);
+			lcd();
+			n = epd_update();
+			bytes += n;
+			if (epd_cadence[c].period && (k % epd_cadence[c].period) == 0) {
+				err += n != full;
+				fulls++;
+			} else {
+				if (!part)
+					part = n;
+				err += n != part;
+			}
+		}
+		CHECK(full != part);
+		CHECK_EQ(err, 0);
+		printf("epd refresh cnt %2d min %2d: full %d bytes, partial %d bytes, %d updates - %d full, %u bytes\n",
+			epd_cadence[c].cnt, epd_cadence[c].min, full, part, EPD_UPDATES, fulls, bytes);
+	}
+}
+#endif // USE_EPD
+#endif // (DEV_SERVICES & SERVICE_SCREEN)
+
+static const hal_test_t tests[] = {
+#if (DEV_SERVICES & SERVICE_SCREEN)
+	{ "lcd: golden frames", test_lcd_golden },
+#if USE_LCD_DIRTY
+	{ "lcd: i2c runs", test_lcd_i2c_runs },
+	{ "lcd: i2c bytes", test_lcd_i2c_bytes },
+#endif
+#if USE_EPD
+	{ "lcd: epd refresh cadence", test_epd_refresh },
+#endif
+#endif
+	{ NULL, NULL }
+};
+
+int main(void) {
+	return hal_run_tests(tests);
+}
@@ -0,0 +1,544 @@
+/*
+ * test_logger.c
+ *
+ * Host tests: history ring (logger.c) - write/read, head search at boot,
+ * time query, ring wrap, clear, power loss at the sector change and in the clear,
+ * erase-ahead, flash reads of the head search against the linear scan,
+ * replay of the history through the adaptive measurement step (filter.c, USE_MEAS_ADAPTIVE)
+ */
+#include "tl_common.h"
+#include "app_config.h"
+#include "app.h"
+#include "drivers.h"
+#include "flash_eep.h"
+#include "logger.h"
+#include "filter.h"
+#include "hal.h"
+
+#define MEMO_SEC_RECS_HOST	((FLASH_SECTOR_SIZE - sizeof(memo_head_t)) / sizeof(memo_blk_t)) // 409
+#define MEMO_SECS_HOST		((FLASH_ADDR_END_MEMO - FLASH_ADDR_START_MEMO) / FLASH_SECTOR_SIZE)
+// get_memo_count_from_time(): the sector and the record binary search
+// (up to 3 reads per record of the delta format), no walk over the sectors
+#define MEMO_QUERY_RD_MAX	56
+// memo_init(): the sector and the record binary search
+#define MEMO_INIT_RD_MAX	40
+#define T0		1700000000
+#define STEP	10 // sec
+
+static u32 recs; // written records
+
+// flash_eep.c: the RAM directory and the pack state (first words: base, seg)
+extern unsigned int feep_dir[], feep_pack[];
+
+// cold boot: the RAM state of the logger and EEP is not retained
+static void memo_boot(void) {
+	feep_dir[0] = 0;
+	feep_pack[0] = 0;
+	memset(&memo, 0, sizeof(memo));
+	memset(&rd_memo, 0, sizeof(rd_memo));
+	wrk.utc_time_sec = 0;
+	memo_init();
+}
+
+static void memo_start(void) {
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.averaging_measurements = 1;
+	recs = 0;
+	memo_boot();
+}
+
+static void memo_add(u32 n) {
+	while (n--) {
+		wrk.utc_time_sec = T0 + recs * STEP;
+		measured_data.temp = recs;
+		measured_data.humi = recs >> 1;
+		measured_data.battery_mv = 3000;
+		write_memo();
+		recs++;
+	}
+}
+
+/* Record 'bnum' (1 - the newest) is the record number recs - bnum */
+static int memo_check(u32 bnum) {
+	memo_blk_t blk;
+	u32 i = recs - bnum;
+	if (!get_memo(bnum, &blk))
+		return 0;
+	return blk.time == T0 + i * STEP && blk.val1 == (s16)i && blk.val2 == (u16)(i >> 1);
+}
+
+/* Records in the ring */
+static u32 memo_avail(void) {
+	return get_memo_count_from_time(0);
+}
+
+static u32 memo_sec(void) {
+	return memo.faddr & (~(FLASH_SECTOR_SIZE-1));
+}
+
+/* Records up to the sector change (either format): written from the start */
+static u32 memo_recs_to_sec_change(void) {
+	u32 sec;
+	memo_start();
+	sec = memo_sec();
+	while (memo_sec() == sec)
+		memo_add(1);
+	return recs;
+}
+
+static void test_write_read(void) {
+	u32 i;
+	memo_start();
+	memo_add(1000); // 3 sectors
+	memo_rd_init();
+	CHECK_EQ(memo_avail(), 1000);
+	for (i = 1; i <= 1000; i++)
+		CHECK(memo_check(i));
+}
+
+static void test_boot(void) {
+	memo_inf_t saved;
+	memo_start();
+	memo_add(900);
+	saved = memo;
+	memo_boot();
+	CHECK_EQ(memo.faddr, saved.faddr);
+	CHECK_EQ(memo.cnt_cur_sec, saved.cnt_cur_sec);
+	CHECK(wrk.utc_time_sec > T0 + (recs - 1) * STEP);
+	memo_add(1);
+	memo_rd_init();
+	CHECK(memo_check(1));
+	CHECK(memo_check(2));
+	CHECK(memo_check(901));
+}
+
+static void test_time_query(void) {
+	u32 j;
+	memo_start();
+	memo_add(3000);
+	memo_rd_init();
+	for (j = 0; j < 3000; j += 97) {
+		CHECK_EQ(get_memo_count_from_time(T0 + j * STEP), 3000 - j);
+		CHECK_EQ(get_memo_count_from_time(T0 + j * STEP - 1), 3000 - j);
+	}
+	CHECK_EQ(get_memo_count_from_time(T0 + 3000 * STEP), 0);
+}
+
+/* Wrap of the ring: the oldest sectors are overwritten, the head is found at boot.
+ * The time query reads O(log sectors) heads */
+static void test_wrap(void) {
+	u32 cnt, j, secs = 0, sec;
+	memo_start();
+	sec = memo_sec();
+	while (secs < MEMO_SECS_HOST + 8) {
+		memo_add(1);
+		if (memo_sec() != sec) {
+			sec = memo_sec();
+			secs++;
+		}
+	}
+	memo_rd_init();
+	cnt = memo_avail();
+	CHECK(cnt > recs / secs * (MEMO_SECS_HOST - 3) && cnt < recs);
+	CHECK(memo_check(1));
+	CHECK(memo_check(cnt));
+	for (j = recs - cnt; j < recs; j += cnt / 7) {
+		hal_stat_clear();
+		CHECK_EQ(get_memo_count_from_time(T0 + j * STEP), recs - j);
+		CHECK(hal_stat.rd <= MEMO_QUERY_RD_MAX);
+	}
+	hal_stat_clear();
+	CHECK_EQ(memo_avail(), cnt);
+	printf("wrap: %u records in %u sectors, time query %u flash reads\n", cnt, MEMO_SECS_HOST, hal_stat.rd);
+	CHECK(hal_stat.rd <= MEMO_QUERY_RD_MAX);
+	memo_boot();
+	memo_rd_init();
+	CHECK_EQ(memo_avail(), cnt);
+}
+
+static void test_clear(void) {
+	memo_start();
+	memo_add(2000);
+	hal_stat_clear();
+	clear_memo();
+	CHECK(hal_stat.er <= 1); // logical clear
+	memo_rd_init();
+	CHECK_EQ(memo_avail(), 0);
+	memo_boot();
+	memo_rd_init();
+	CHECK_EQ(memo_avail(), 0);
+	recs = 0;
+	memo_add(10);
+	memo_rd_init();
+	CHECK_EQ(memo_avail(), 10);
+	CHECK(memo_check(10));
+}
+
+/* Power loss in clear_memo(): the history is cleared or not, never in part */
+static void test_clear_power_loss(void) {
+	static u8 snap[HAL_FLASH_SIZE];
+	u32 n, cnt, cleared = 0;
+	memo_start();
+	memo_add(MEMO_SEC_RECS_HOST * 3);
+	memcpy(snap, hal_flash, sizeof(snap));
+	for (n = 1; n <= 8; n++) {
+		memcpy(hal_flash, snap, sizeof(snap));
+		memo_boot();
+		hal_cut_after(n);
+		hal_cut_run(clear_memo);
+		hal_cut_after(0);
+		memo_boot();
+		memo_rd_init();
+		cnt = memo_avail();
+		CHECK(cnt == 0 || cnt == MEMO_SEC_RECS_HOST * 3);
+		if (!cnt) {
+			cleared++;
+			// the older generation stays in the flash, the readers skip it
+			CHECK(memo.gen == 1);
+			recs = 0;
+			memo_add(3);
+			memo_rd_init();
+			CHECK_EQ(memo_avail(), 3);
+			CHECK(memo_check(3));
+		}
+	}
+	CHECK(cleared > 0 && cleared < 8);
+}
+
+/* Erase-ahead: the sector change does not erase, the erased sector survives clear_memo() */
+static void test_erase_ahead(void) {
+	u32 erased, sec;
+	memo_start();
+	memo_add(10);
+	memo_erase_task();
+	erased = memo.erased;
+	CHECK(erased != 0);
+	hal_stat_clear();
+	sec = memo.faddr & (~(FLASH_SECTOR_SIZE-1));
+	while ((memo.faddr & (~(FLASH_SECTOR_SIZE-1))) == sec)
+		memo_add(1); // sector change
+	CHECK_EQ(hal_stat.er, 0);
+	CHECK_EQ(memo.faddr & (~(FLASH_SECTOR_SIZE-1)), erased);
+	CHECK_EQ(memo.erased, 0);
+	memo_erase_task();
+	erased = memo.erased;
+	CHECK(erased != 0 && erased != FLASH_ADDR_START_MEMO);
+	clear_memo();
+	CHECK_EQ(memo.erased, erased);
+}
+
+/* Flash reads of the linear scan (memo_init() before the binary search):
+ * the heads up to the open sector, then its records one by one up to the free one
+ * (delta format: the block offsets one by one). The flash is only read */
+static u32 memo_scan_reads(void) {
+	memo_head_t mhs;
+	u32 faddr = memo.start_addr, end, tmp;
+	hal_stat_clear();
+	while (faddr < memo.end_addr) {
+		flash_read_page(faddr, sizeof(mhs), (u8 *)&mhs);
+		if (mhs.id != MEMO_GEN_ID(MEMO_SEC_ID, memo.gen)
+#if USE_MEMO_DELTA
+			&& mhs.id != MEMO_GEN_ID(MEMO_SEC_ID_DLT, memo.gen)
+#endif
+			)
+			break;
+		if (mhs.flg == 0xffff) {
+			end = faddr + FLASH_SECTOR_SIZE;
+#if USE_MEMO_DELTA
+			if (mhs.id != MEMO_GEN_ID(MEMO_SEC_ID, memo.gen)) {
+				tmp = 0;
+				do {
+					end -= sizeof(u16);
+					flash_read_page(end, sizeof(u16), (u8 *)&tmp);
+				} while ((tmp & 0xffff) != 0xffff);
+				break;
+			}
+#endif
+			for (faddr += sizeof(memo_head_t); faddr < end; faddr += sizeof(memo_blk_t)) {
+				flash_read_page(faddr, sizeof(tmp), (u8 *)&tmp);
+				if (tmp == 0xffffffff)
+					break;
+			}
+			break;
+		}
+		faddr += FLASH_SECTOR_SIZE;
+	}
+	return hal_stat.rd;
+}
+
+/* Writes up to 'secs' sector changes, then 'part' records */
+static void memo_fill(u32 secs, u32 part) {
+	u32 sec = memo_sec();
+	while (secs) {
+		memo_add(1);
+		if (memo_sec() != sec) {
+			sec = memo_sec();
+			secs--;
+		}
+	}
+	memo_add(part);
+}
+
+/* Flash reads of memo_init() at boot (the EEP directory is in RAM) against the
+ * linear scan, empty, full and wrapped rings of the 512K and 1M flash.
+ * An empty ring costs the bounded search instead of one head read */
+static void test_init_reads(void) {
+	static const char * const names[] = { "empty", "full", "wrapped" };
+	memo_inf_t saved;
+	u32 m, t, secs, rd, rd_lin;
+	for (m = 0; m < 2; m++) {
+		for (t = 0; t < 3; t++) {
+			hal_reset();
+			hal_flash_id2 = m ? 0x14 : 0x13; // 1M: memo_init() takes the larger ring
+			memo_start();
+			secs = (memo.end_addr - memo.start_addr) / FLASH_SECTOR_SIZE;
+			if (t)
+				memo_fill((t == 1) ? secs - 1 : secs + secs / 2, 150);
+			saved = memo;
+			rd_lin = memo_scan_reads();
+			memset(&memo, 0, sizeof(memo));
+			hal_stat_clear();
+			memo_init();
+			rd = hal_stat.rd;
+			CHECK_EQ(memo.faddr, saved.faddr);
+			CHECK_EQ(memo.cnt_cur_sec, saved.cnt_cur_sec);
+			printf("init %s %-7s: %3u flash reads, linear scan %3u\n", m ? "1M  " : "512K", names[t], rd, rd_lin);
+			if (t) {
+				CHECK(rd <= MEMO_INIT_RD_MAX);
+				CHECK(rd * 3 < rd_lin);
+			} else
+				CHECK(rd <= MEMO_INIT_RD_MAX / 2);
+		}
+	}
+}
+
+static u32 cut_n;
+
+static void cut_write(void) {
+	memo_add(cut_n);
+}
+
+/* Power loss in write_memo() at the sector change: the boot continues the ring */
+static void test_power_loss(void) {
+	static u8 snap[FLASH_ADDR_END_MEMO - FLASH_ADDR_START_MEMO];
+	u32 n, r;
+	r = memo_recs_to_sec_change() - 2;
+	memo_start();
+	memo_add(r);
+	memcpy(snap, &hal_flash[FLASH_ADDR_START_MEMO], sizeof(snap));
+	for (n = 1; n <= 6; n++) {
+		memcpy(&hal_flash[FLASH_ADDR_START_MEMO], snap, sizeof(snap));
+		recs = r;
+		memo_boot();
+		cut_n = 8;
+		hal_cut_after(n);
+		CHECK(hal_cut_run(cut_write));
+		hal_cut_after(0);
+		memo_boot();
+		memo_add(5);
+		memo_rd_init();
+		CHECK(memo_check(1));
+		CHECK(memo_check(5));
+		CHECK(memo_avail() >= r);
+	}
+}
+
+#if USE_MEAS_ADAPTIVE
+#define RP_STEPS	6000 // measurement steps
+#define RP_AVG		18 // averaging_measurements
+#define RP_JUMP		4000 // step of the trace
+
+/* x0.01 C: slow ramp, fast ramp, jump of 3 C */
+static s16 rp_trace(u32 i) {
+	if (i < 2000)
+		return 2000 + i / 4;
+	if (i < RP_JUMP)
+		return 2500 + (i - 2000) * 3;
+	return 8800;
+}
+
+static u16 rp_humi_flat(u32 i) {
+	(void) i;
+	return 5000;
+}
+
+/* sensor noise, -2..2 */
+static int rp_noise(u32 i) {
+	return (int)(((i * 1103515245u + 12345u) >> 16) % 5) - 2;
+}
+
+/* x0.01 C: a room, 22..24.5 C over the day, airing at step 2500 (-3 C in 5 min,
+ * back in 1 hour), sensor noise */
+static s16 rp_room_temp(u32 i) {
+	int t = (i < 3000) ? 2200 + i / 12 : 2450 - (i - 3000) / 12;
+	if (i >= 2500 && i < 2530)
+		t -= (i - 2500) * 10;
+	else if (i >= 2530 && i < 2530 + 360)
+		t -= 300 - (i - 2530) * 300 / 360;
+	return t + rp_noise(i);
+}
+
+/* x0.01 %: 45 %, a shower at step 4000 (+25 % in 3 min, 2 hours down), noise */
+static u16 rp_room_humi(u32 i) {
+	int h = 4500;
+	if (i >= 4000 && i < 4018)
+		h += (i - 4000) * 2500 / 18;
+	else if (i >= 4018 && i < 4018 + 720)
+		h += 2500 - (i - 4018) * 2500 / 720;
+	return h + 2 * rp_noise(i + 7);
+}
+
+typedef struct {
+	const char *name;
+	s16 (*temp)(u32 i);
+	u16 (*humi)(u32 i);
+	u32 events; // fast changes: up to MEAS_ADAPT_MAX - 1 late steps each
+} rp_log_t;
+
+static const rp_log_t rp_logs[] = {
+	{ "ramps", rp_trace, rp_humi_flat, 1 },
+	{ "room", rp_room_temp, rp_room_humi, 2 },
+};
+
+/* The measurement skip of the adv. callback (ble.c): 1 - measure now */
+static int rp_measure_step(void) {
+	if (++wrk.meas_skip < wrk.meas_scale)
+		return 0;
+	wrk.meas_skip = 0;
+	return 1;
+}
+
+static void rp_adaptive_start(void) {
+	wrk.ble_connected = 0;
+	wrk.meas_scale = 1;
+	wrk.meas_scale_max = MEAS_ADAPT_MAX;
+	wrk.meas_skip = 0;
+}
+
+/* The full rate history of the logs (a record per measurement step) through
+ * meas_adaptive_step(): conversions against the error of the held value */
+static void test_adaptive_log_replay(void) {
+	const rp_log_t *l;
+	memo_blk_t blk;
+	u32 i, n, conv, late;
+	s32 ht = 0, hh = 0, et, eh, max_t, max_h, sum_t, sum_h;
+	for (l = rp_logs; l < &rp_logs[ARRAY_SIZE(rp_logs)]; l++) {
+		hal_reset();
+		memo_start();
+		for (i = 0; i < RP_STEPS; i++) {
+			wrk.utc_time_sec = T0 + i * STEP;
+			measured_data.temp = l->temp(i);
+			measured_data.humi = l->humi(i);
+			measured_data.battery_mv = 3000;
+			write_memo();
+		}
+		memo_rd_init();
+		n = memo_avail();
+		CHECK_EQ(n, RP_STEPS);
+		rp_adaptive_start();
+		conv = late = 0;
+		max_t = max_h = sum_t = sum_h = 0;
+		for (i = 0; i < n; i++) {
+			CHECK(get_memo(n - i, &blk));
+			if (rp_measure_step()) {
+				measured_data.temp = blk.val1;
+				measured_data.humi = blk.val2;
+				meas_adaptive_step();
+				ht = blk.val1;
+				hh = blk.val2;
+				conv++;
+			}
+			et = blk.val1 - ht;
+			eh = blk.val2 - hh;
+			if (et < 0)
+				et = -et;
+			if (eh < 0)
+				eh = -eh;
+			late += et > MEAS_ADAPT_TEMP || eh > MEAS_ADAPT_HUMI;
+			sum_t += et;
+			sum_h += eh;
+			if (max_t < et)
+				max_t = et;
+			if (max_h < eh)
+				max_h = eh;
+		}
+		printf("adaptive %-5s: %u steps, %u conversions (%u%% saved), held error: temp max %d avg %d.%02d, humi max %d avg %d.%02d x0.01, %u late steps\n",
+			l->name, n, conv, 100 - conv * 100 / n, max_t, sum_t / n, sum_t * 100 / n % 100,
+			max_h, sum_h / n, sum_h * 100 / n % 100, late);
+		CHECK(conv < n / 2);
+		CHECK(late <= l->events * (MEAS_ADAPT_MAX - 1));
+		CHECK(sum_t <= (s32)n * MEAS_ADAPT_TEMP / 4);
+		CHECK(sum_h <= (s32)n * MEAS_ADAPT_HUMI / 4);
+	}
+}
+
+/* The readings at the step of meas_adaptive_step(), the records are
+ * compared with the averages of RP_AVG full rate measurements */
+static void test_adaptive_replay(void) {
+	memo_blk_t blk;
+	u32 i, k, n, conv = 0;
+	s32 ref, err, max_err = 0, max_err_jump = 0;
+	int d;
+	memo_start(); // summ_data is empty: the tests above do not average
+	cfg.averaging_measurements = RP_AVG;
+	rp_adaptive_start();
+	for (i = 0; i < RP_STEPS; i++) {
+		if (!rp_measure_step())
+			continue;
+		conv++;
+		wrk.utc_time_sec = T0 + i * STEP;
+		measured_data.temp = rp_trace(i);
+		measured_data.humi = 5000;
+		measured_data.battery_mv = 3000;
+		write_memo();
+		meas_adaptive_step();
+	}
+	memo_rd_init();
+	n = memo_avail();
+	// the carry of the steps over a record keeps the record interval
+	CHECK(n + 1 >= RP_STEPS / RP_AVG && n <= RP_STEPS / RP_AVG);
+	for (i = 1; i <= n; i++) {
+		CHECK(get_memo(i, &blk));
+		k = (blk.time - T0) / STEP;
+		if (k + 1 < RP_AVG)
+			continue;
+		ref = 0;
+		for (d = 0; d < RP_AVG; d++)
+			ref += rp_trace(k - d);
+		err = blk.val1 - ref / RP_AVG;
+		if (err < 0)
+			err = -err;
+		if (k >= RP_JUMP && k < RP_JUMP + RP_AVG + MEAS_ADAPT_MAX) {
+			if (max_err_jump < err)
+				max_err_jump = err;
+		} else if (max_err < err)
+			max_err = err;
+	}
+	printf("adaptive: %u steps, %u conversions, %u records, max error %d (jump %d) x0.01 C\n",
+		RP_STEPS, conv, n, max_err, max_err_jump);
+	CHECK(max_err <= MEAS_ADAPT_TEMP);
+	CHECK(max_err_jump <= rp_trace(RP_JUMP) - rp_trace(RP_JUMP - 1)); // the jump
+	CHECK(conv < RP_STEPS / 2);
+}
+#endif
+
+static const hal_test_t tests[] = {
+	{ "logger: write/read", test_write_read },
+	{ "logger: boot", test_boot },
+	{ "logger: time query", test_time_query },
+	{ "logger: ring wrap", test_wrap },
+	{ "logger: clear", test_clear },
+	{ "logger: power loss", test_power_loss },
+	{ "logger: power loss in clear", test_clear_power_loss },
+	{ "logger: erase-ahead", test_erase_ahead },
+	{ "logger: head search reads", test_init_reads },
+#if USE_MEAS_ADAPTIVE
+	{ "logger: adaptive step, log replay", test_adaptive_log_replay },
+	{ "logger: adaptive step, records", test_adaptive_replay },
+#endif
+	{ NULL, NULL }
+};
+
+int main(void) {
+	return hal_run_tests(tests);
+}
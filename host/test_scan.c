@@ -0,0 +1,440 @@
+/*
+ * test_scan.c
+ *
+ * Host tests: the BTHome peer scanner of scanning.c (USE_SYNC_SCAN) on the fake
+ * clock. The adv. reports go to scanning_event_callback() as the HCI LE adv.
+ * reports of the SDK, the scan enabled time of ble_sdk.c is the radio-on time.
+ * The peer table and the parser (throughput), the learning of the adv. period,
+ * the scan windows and a simulation of jittered peer advertisers: the hit rate
+ * against the radio-on time.
+ */
+#include "tl_common.h"
+#include "app_config.h"
+#include "drivers.h"
+#include "stack/ble/ble.h"
+#include "app.h"
+#include "ble.h"
+#include "bthome_beacon.h"
+#include "hal.h"
+
+#if USE_SYNC_SCAN
+#include "scanning.h"
+
+#define SCAN_MS			CLOCK_16M_SYS_TIMER_CLK_1MS
+#define SCAN_REPORTS	200000	// reports of the throughput
+#define SCAN_SIM_SEC	3600	// simulated time
+#define SCAN_SIM_LEARN	300		// sec, the hit rate after the acquisition
+#define SCAN_SIM_LOSS	5		// %, lost peer adv. events
+#define SCAN_SIM_DELAY	10000	// us, advDelay of the peers
+#define SCAN_OWN_ADV	2500	// ms, own adv. interval: main_loop runs
+#define SCAN_SIM_HITS	85		// %, min. hit rate of the peer windows
+#define SCAN_SIM_DUTY	3		// %, max. radio-on time
+
+int scanning_event_callback(u32 h, u8 *p, int n);
+
+// ble.c, app.c for scanning.c
+adv_buf_t adv_buf;
+u8 mac_public[6];
+void load_adv_data(void) {}
+void app_wakeup_set(void) {} // the simulation takes scan.wake_tik
+// scanning.h: the external definition of the inline scan_stop() (gnu99)
+extern void scan_stop(void);
+
+/* Peer MACs: 0..3 and 4..7 on the same hash, the probe wraps around the table */
+static const u8 scan_macs[SCAN_PEERS][6] = {
+	{ 0x00, 0x5a, 0xa5, 0x01, 0x38, 0xc1 },
+	{ 0x10, 0x5a, 0xa5, 0x02, 0x38, 0xc1 },
+	{ 0x20, 0x5a, 0xa5, 0x03, 0x38, 0xc1 },
+	{ 0x30, 0x5a, 0xa5, 0x04, 0x38, 0xc1 },
+	{ 0x07, 0x11, 0x22, 0x05, 0x38, 0xc1 },
+	{ 0x17, 0x11, 0x22, 0x06, 0x38, 0xc1 },
+	{ 0x27, 0x11, 0x22, 0x07, 0x38, 0xc1 },
+	{ 0x37, 0x11, 0x22, 0x08, 0x38, 0xc1 },
+};
+
+static u32 scan_rnd_seed = 1;
+
+static u32 scan_rnd(u32 n) {
+	scan_rnd_seed = scan_rnd_seed * 1103515245 + 12345;
+	return (scan_rnd_seed >> 8) % n;
+}
+
+/* HCI LE adv. report of a BTHome v2 packet (no security): flags and
+ * service data of pid, battery, temperature, humidity, then the rssi */
+static u8 scan_ev[64];
+
+static void scan_report(const u8 *mac, u8 pid, s16 temp, u16 humi, u8 bat, s8 rssi) {
+	event_adv_report_t *pa = (event_adv_report_t *)scan_ev;
+	u8 *p = pa->data;
+	pa->subcode = HCI_SUB_EVT_LE_ADVERTISING_REPORT;
+	pa->nreport = 1;
+	pa->event_type = 0;
+	pa->adr_type = 0;
+	memcpy(pa->mac, mac, 6);
+	*p++ = 2; *p++ = GAP_ADTYPE_FLAGS; *p++ = 0x06;
+	*p++ = 14; *p++ = GAP_ADTYPE_SERVICE_DATA_UUID_16BIT;
+	*p++ = ADV_BTHOME_UUID16 & 0xff; *p++ = ADV_BTHOME_UUID16 >> 8;
+	*p++ = BtHomeID_Info;
+	*p++ = BtHomeID_PacketId; *p++ = pid;
+	*p++ = BtHomeID_battery; *p++ = bat;
+	*p++ = BtHomeID_temperature; *p++ = temp & 0xff; *p++ = (u16)temp >> 8;
+	*p++ = BtHomeID_humidity; *p++ = humi & 0xff; *p++ = humi >> 8;
+	pa->len = p - pa->data;
+	*p = (u8)rssi;
+	scanning_event_callback(HCI_FLAG_EVENT_BT_STD | HCI_EVT_LE_META, scan_ev, p + 1 - scan_ev);
+}
+
+static void scan_setup(u8 peers) {
+	int i;
+	hal_ble_reset();
+	memset(&scan, 0, sizeof(scan));
+	memset(&wrk, 0, sizeof(wrk));
+	wrk.utc_time_sec = 1000;
+	for (i = 0; i < SCAN_PEERS; i++)
+		if (peers & BIT(i))
+			memcpy(scan.peers.MAC[i], scan_macs[i], 6);
+	scan_peers_init();
+}
+
+/* The table: all peers on the colliding hashes are found, foreign MACs
+ * on the same hashes, empty and duplicate entries are not */
+static void test_scan_table(void) {
+	u8 mac[6];
+	int i, err = 0;
+	scan_setup(0xff);
+	CHECK_EQ(scan.peer_mask, 0xff);
+	for (i = 0; i < SCAN_PEERS; i++)
+		scan_report(scan_macs[i], i, 2000 + i, 5000 + i, 90 + i, -60 - i);
+	for (i = 0; i < SCAN_PEERS; i++) {
+		err += scan.peer[i].pid != i || scan.peer[i].temp != 2000 + i || scan.peer[i].humi != 5000 + i;
+		err += scan.peer[i].battery != 90 + i || scan.peer[i].rssi != -60 - i || scan.peer[i].time != 1000;
+	}
+	CHECK_EQ(err, 0);
+	// a foreign MAC on the hash of 0..3
+	memcpy(mac, scan_macs[0], 6);
+	mac[0] = 0x40;
+	scan_report(mac, 99, -1000, 100, 1, -90);
+	err = 0;
+	for (i = 0; i < SCAN_PEERS; i++)
+		err += scan.peer[i].pid != i;
+	CHECK_EQ(err, 0);
+	// duplicate and empty entries
+	memcpy(scan.peers.MAC[5], scan_macs[2], 6);
+	memset(scan.peers.MAC[6], 0, 6);
+	scan_peers_init();
+	CHECK_EQ(scan.peer_mask, 0xff & ~(BIT(5) | BIT(6)));
+	scan_report(scan_macs[2], 7, 2100, 5100, 80, -50);
+	CHECK_EQ(scan.peer[2].pid, 7);
+	CHECK_EQ(scan.peer[5].time, 0);
+}
+
+/* Cycles per report of scanning_event_callback(): foreign devices (the lookup
+ * only) and the peers (the lookup and the BTHome parser), 1 and 8 peers */
+static void test_scan_throughput(void) {
+	static const u8 peers[] = { 0x01, 0xff };
+	unsigned long long tc, cyc_peer, cyc_other;
+	u8 mac[6];
+	int p, i;
+	for (p = 0; p < (int)sizeof(peers); p++) {
+		scan_setup(peers[p]);
+		memcpy(mac, scan_macs[0], 6);
+		tc = hal_cycles();
+		for (i = 0; i < SCAN_REPORTS; i++) {
+			mac[0] = 0x40 + (i & 0x3f); // all hashes
+			scan_report(mac, i, 2000, 5000, 90, -70);
+		}
+		cyc_other = hal_cycles() - tc;
+		tc = hal_cycles();
+		for (i = 0; i < SCAN_REPORTS; i++)
+			scan_report(scan_macs[i & 7 & (peers[p] == 0xff ? 7 : 0)], i, 2000 + (i & 0xff), 5000, 90, -70);
+		cyc_peer = hal_cycles() - tc;
+		CHECK_EQ(scan.peer[0].temp, 2000 + ((SCAN_REPORTS - (peers[p] == 0xff ? 8 : 1)) & 0xff));
+		printf("scan %d peer(s): foreign report %llu cycles, peer report %llu cycles (host, with the report build)\n",
+			__builtin_popcount(peers[p]), cyc_other / SCAN_REPORTS, cyc_peer / SCAN_REPORTS);
+	}
+}
+
+/* The period from the reports: the first interval, the report of the next channel
+ * is skipped, k periods rounded, the period corrected by 1/4 of the error */
+static void test_scan_learn(void) {
+	scan_sched_t *ps = &scan_sched[0];
+	u32 p = 2003 * SCAN_MS, period, d;
+	int i;
+	scan_setup(0x01);
+	hal_clock_us(1000000);
+	scan_report(scan_macs[0], 0, 2000, 5000, 90, -70);
+	CHECK_EQ(ps->period, 0);
+	CHECK(ps->last_tik != 0);
+	d = ps->last_tik;
+	hal_clock_us(1000); // next channel
+	scan_report(scan_macs[0], 0, 2000, 5000, 90, -70);
+	CHECK_EQ(ps->last_tik, d);
+	reg_system_tick = d + p;
+	scan_report(scan_macs[0], 1, 2000, 5000, 90, -70);
+	CHECK_EQ(ps->period, p);
+	// 2 events missed: d = 3 periods
+	d = 3 * 2011 * SCAN_MS;
+	reg_system_tick = ps->last_tik + d;
+	scan_report(scan_macs[0], 4, 2000, 5000, 90, -70);
+	period = p + ((s32)(d / 3) - (s32)p) / 4;
+	CHECK_EQ(ps->period, period);
+	// a report at 1/3 of the period: k = 0, no correction
+	reg_system_tick = ps->last_tik + period / 3;
+	scan_report(scan_macs[0], 5, 2000, 5000, 90, -70);
+	CHECK_EQ(ps->period, period);
+	// the first interval over a missed event: 2 periods, the reports of each event bring it down
+	scan_setup(0x01);
+	p = 2500 * SCAN_MS;
+	scan_report(scan_macs[0], 0, 2000, 5000, 90, -70);
+	reg_system_tick = ps->last_tik + 2 * p;
+	scan_report(scan_macs[0], 2, 2000, 5000, 90, -70);
+	CHECK_EQ(ps->period, 2 * p);
+	for (i = 0; i < 20; i++) {
+		reg_system_tick = ps->last_tik + p;
+		scan_report(scan_macs[0], 3 + i, 2000, 5000, 90, -70);
+	}
+	CHECK(ps->period > p && ps->period - p < p / 100);
+	printf("scan learn: 2 x 2500 ms -> %.2f ms after 20 reports\n", ps->period / (double)SCAN_MS);
+}
+
+/* The window margin of the peer: the misses and the advDelay/2 */
+#define SCAN_W(miss)	(((3 * SCAN_MS) << (miss)) + 5 * SCAN_MS)
+
+/* A peer with the learned period, the next report in 'next' ms */
+static void scan_peer_set(int n, u32 period_ms, u32 next_ms, u8 miss) {
+	scan_sched_t *ps = &scan_sched[n];
+	ps->period = period_ms * SCAN_MS;
+	ps->last_tik = reg_system_tick + next_ms * SCAN_MS - ps->period;
+	ps->miss = miss;
+	ps->acq_time = wrk.utc_time_sec + 1000;
+}
+
+/* The window around the next reports: the advDelay and the margin of the misses,
+ * the overlapping windows are joined, a close window is opened at once */
+static void test_scan_windows(void) {
+	u32 now, w0 = SCAN_W(0);
+	scan_setup(0x07);
+	hal_clock_us(1000000);
+	now = reg_system_tick;
+	scan_peer_set(0, 2000, 100, 0);
+	scan_peer_set(1, 5000, 103, 0);
+	scan_peer_set(2, 3000, 150, 0);
+	scan_schedule();
+	CHECK_EQ(scan.win_mask, 0x03);
+	CHECK_EQ(scan.wake_tik, (now + 100 * SCAN_MS - w0) | 1);
+	CHECK_EQ(scan.win_tik, 3 * SCAN_MS + 2 * w0);
+	CHECK_EQ(scan.start_tik, 0);
+	// the window of the wakeup: both reports, the window ends early
+	reg_system_tick = scan.wake_tik;
+	scan.wake_tik = 0;
+	scan_window_open();
+	CHECK(scan.start_tik != 0 && hal_ble.scan_on);
+	reg_system_tick += w0;
+	scan_report(scan_macs[0], 1, 2000, 5000, 90, -70);
+	scan_task();
+	CHECK(scan.start_tik != 0);
+	reg_system_tick += 3 * SCAN_MS;
+	scan_report(scan_macs[1], 1, 2000, 5000, 90, -70);
+	scan_task();
+	CHECK_EQ(scan.start_tik, 0);
+	CHECK(!hal_ble.scan_on);
+	CHECK_EQ(hal_ble.scan_ticks, w0 + 3 * SCAN_MS);
+	// next: peer 2 alone, x2 margin after each miss
+	CHECK_EQ(scan.win_mask, 0x04);
+	scan_sched[2].miss = 2;
+	scan_schedule();
+	CHECK_EQ(scan.win_tik, 2 * SCAN_W(2));
+	// a window closer than SCAN_WAKE_MIN: at once
+	scan_peer_set(2, 3000, 2, 0);
+	scan_schedule();
+	CHECK(scan.start_tik != 0);
+	CHECK_EQ(scan.wake_tik, 0);
+	CHECK_EQ(scan.win_mask, 0x04);
+	CHECK_EQ(scan.win_tik, 2 * SCAN_MS + w0);
+	// missed: counted at the window end
+	reg_system_tick += scan.win_tik + 1;
+	scan_task();
+	CHECK_EQ(scan_sched[2].miss, 1);
+}
+
+#define SCAN_ACQ_TIK	(12000 * SCAN_MS + 2) // the acquisition window is over
+
+/* Acquisition windows of a silent peer: SCAN_ACQ_TIME each, the interval x2 after
+ * each empty one, none after 6 of them until the peer is heard. A lost peer
+ * (misses in succession) is learned again after the backoff */
+static void test_scan_acq(void) {
+	static const u32 acq_dt[] = { 0, 120, 240, 480, 960, 1920 }; // sec, after the window
+	u32 t = 1000;
+	int i, err = 0;
+	scan_setup(0x01);
+	for (i = 0; i < (int)ARRAY_SIZE(acq_dt); i++) {
+		t += acq_dt[i];
+		wrk.utc_time_sec = t - 1;
+		scan_schedule();
+		err += scan.start_tik != 0; // not yet
+		wrk.utc_time_sec = t;
+		scan_schedule();
+		err += scan.start_tik == 0 || scan.win_type != SCAN_WIN_ACQ;
+		reg_system_tick += SCAN_ACQ_TIK; // start_tik | 1
+		wrk.utc_time_sec = t += 12;
+		scan_task();
+		err += scan.start_tik != 0 || hal_ble.scan_ticks != (i + 1) * SCAN_ACQ_TIK;
+	}
+	CHECK_EQ(err, 0);
+	CHECK_EQ(scan_sched[0].acq_miss, 6);
+	wrk.utc_time_sec += 100000;
+	scan_schedule();
+	CHECK_EQ(scan.start_tik, 0);
+	CHECK_EQ(scan.wake_tik, 0);
+	// heard in a server window: learned, the peer windows
+	scan_report(scan_macs[0], 0, 2000, 5000, 90, -70);
+	CHECK_EQ(scan_sched[0].acq_miss, 0);
+	reg_system_tick = scan_sched[0].last_tik + 2000 * SCAN_MS;
+	scan_report(scan_macs[0], 1, 2000, 5000, 90, -70);
+	CHECK_EQ(scan_sched[0].period, 2000 * SCAN_MS);
+	reg_system_tick += 10 * SCAN_MS;
+	scan_schedule();
+	CHECK_EQ(scan.win_mask, 0x01);
+	CHECK(scan.wake_tik != 0);
+	// lost: SCAN_MISS_MAX + 1 empty windows
+	for (i = 0; i < 6; i++) {
+		reg_system_tick = scan.wake_tik;
+		scan.wake_tik = 0;
+		scan_window_open();
+		reg_system_tick += scan.win_tik + 1;
+		scan_task();
+	}
+	CHECK_EQ(scan_sched[0].period, 0);
+	CHECK_EQ(scan_sched[0].acq_time, wrk.utc_time_sec + 60);
+	CHECK_EQ(scan.start_tik, 0);
+}
+
+/* A peer advertiser: the period with the drift, the advDelay of each event */
+typedef struct {
+	u32 period_ms;
+	s32 ppm;
+	unsigned long long next_us;	// the next adv. event, without advDelay
+	unsigned long long ev_us;	// the next report, with advDelay
+	u32 events, heard;
+	u8 pid;
+} scan_sim_peer_t;
+
+static void scan_sim_next(scan_sim_peer_t *sp) {
+	sp->next_us += (unsigned long long)sp->period_ms * (1000000 + sp->ppm) / 1000;
+	sp->ev_us = sp->next_us + scan_rnd(SCAN_SIM_DELAY);
+}
+
+/* The scan enabled time, us */
+static unsigned long long scan_sim_on_us(void) {
+	unsigned long long tik = hal_ble.scan_ticks;
+	if (hal_ble.scan_on)
+		tik += (u32)reg_system_tick - hal_ble.scan_tik;
+	return tik / CLOCK_16M_SYS_TIMER_CLK_1US;
+}
+
+/* Jittered peers (advDelay 0..10 ms, +-50 ppm, SCAN_SIM_LOSS of the reports lost)
+ * and main_loop: scan_schedule() after the own adv. events, scan_window_open()
+ * at scan.wake_tik, scan_task() each ms while scanning. The hit rate after
+ * the acquisition against the radio-on time */
+static void test_scan_sim(void) {
+	static const u32 periods[] = { 2500, 5000, 10000, 3100 };
+	scan_sim_peer_t sim[ARRAY_SIZE(periods)];
+	unsigned long long t = 0, t_own = 0, next, on_us = 0xffffffffffffffffULL;
+	unsigned long long t_end = (unsigned long long)SCAN_SIM_SEC * 1000000;
+	unsigned long long t_learn = (unsigned long long)SCAN_SIM_LEARN * 1000000;
+	u32 ev = 0, hit = 0;
+	int i, n = ARRAY_SIZE(periods), wake;
+	double on, tt = SCAN_SIM_SEC - SCAN_SIM_LEARN;
+	scan_setup((1 << n) - 1);
+	scan_rnd_seed = 1;
+	for (i = 0; i < n; i++) {
+		memset(&sim[i], 0, sizeof(sim[i]));
+		sim[i].period_ms = periods[i];
+		sim[i].ppm = (i & 1) ? 50 : -50;
+		sim[i].next_us = scan_rnd(periods[i] * 1000);
+		sim[i].ev_us = sim[i].next_us + scan_rnd(SCAN_SIM_DELAY);
+	}
+	while (t < t_end) {
+		// the next step: a peer report, the own adv. event, the wakeup, a poll of the scan
+		next = t_own;
+		for (i = 0; i < n; i++)
+			if (next > sim[i].ev_us)
+				next = sim[i].ev_us;
+		if (scan.start_tik) {
+			if (next > t + 1000)
+				next = t + 1000;
+		} else if (scan.wake_tik) {
+			s32 dt = scan.wake_tik - (u32)reg_system_tick;
+			if (dt < 0)
+				dt = 0;
+			dt = (dt + CLOCK_16M_SYS_TIMER_CLK_1US - 1) / CLOCK_16M_SYS_TIMER_CLK_1US;
+			if (next > t + dt)
+				next = t + dt;
+		}
+		t = next;
+		reg_system_tick = t * CLOCK_16M_SYS_TIMER_CLK_1US;
+		wrk.utc_time_sec = 1000 + (u32)(t / 1000000);
+		if (t >= t_learn && on_us == 0xffffffffffffffffULL) {
+			on_us = scan_sim_on_us();
+			for (i = 0; i < n; i++)
+				sim[i].events = sim[i].heard = 0;
+		}
+		for (i = 0; i < n; i++) {
+			if (sim[i].ev_us > t)
+				continue;
+			sim[i].events++;
+			if (hal_ble.scan_on && scan_rnd(100) >= SCAN_SIM_LOSS) {
+				scan_report(scan_macs[i], sim[i].pid, 2000, 5000, 90, -70);
+				sim[i].heard++;
+			}
+			sim[i].pid++;
+			scan_sim_next(&sim[i]);
+		}
+		wake = scan.start_tik != 0;
+		if (scan.wake_tik && (s32)(scan.wake_tik - (u32)reg_system_tick) <= 0) {
+			scan.wake_tik = 0;
+			scan_window_open();
+			wake = 1;
+		}
+		if (t >= t_own) {
+			t_own += SCAN_OWN_ADV * 1000;
+			wake = 1;
+		}
+		if (wake) {
+			if (!scan.start_tik)
+				scan_schedule();
+			reg_system_tick += CLOCK_16M_SYS_TIMER_CLK_1US; // main_loop, start_tik | 1
+			if (scan.start_tik)
+				scan_task();
+		}
+	}
+	for (i = 0; i < n; i++) {
+		ev += sim[i].events;
+		hit += sim[i].heard;
+		printf("scan sim peer %d: %5u ms, %4u events, %5.1f%% heard\n", i, sim[i].period_ms, sim[i].events,
+			sim[i].heard * 100.0 / sim[i].events);
+	}
+	on = (scan_sim_on_us() - on_us) / 1e6;
+	printf("scan sim: %.1f%% of %u events heard, radio on %.1f s of %.0f s (%.2f%%), %u windows;"
+		" continuous scan: %d%% heard, radio on 100%%\n", hit * 100.0 / ev, ev, on, tt, on * 100 / tt,
+		hal_ble.scan_cnt, 100 - SCAN_SIM_LOSS);
+	CHECK(hit * 100 >= ev * SCAN_SIM_HITS);
+	CHECK(on * 100 < tt * SCAN_SIM_DUTY);
+}
+#endif // USE_SYNC_SCAN
+
+static const hal_test_t tests[] = {
+#if USE_SYNC_SCAN
+	{ "scan: peer table", test_scan_table },
+	{ "scan: parser throughput", test_scan_throughput },
+	{ "scan: period learning", test_scan_learn },
+	{ "scan: windows", test_scan_windows },
+	{ "scan: acquisition backoff", test_scan_acq },
+	{ "scan: hit rate", test_scan_sim },
+#endif
+	{ NULL, NULL }
+};
+
+int main(void) {
+	return hal_run_tests(tests);
+}
@@ -0,0 +1,697 @@
+/*
+ * test_sensor.c
+ *
+ * Host tests: the I2C queue of i2c.c on the 8258 master of i2c_hw.c - chains,
+ * rejected transactions, NAK, the background run of main_loop; the command
+ * chains of sensors.c (probe, start, read) on models of SHTC3, SHT4x, SHT30,
+ * AHT2x, CHT8305 and CHT8215: the bus log, the delays, the busy-wait time;
+ * the sensor saved in EEP_ID_SID, its confirmation at boot and the fallback probe.
+ */
+#include "tl_common.h"
+#include "app_config.h"
+#include "app.h"
+#include "drivers.h"
+#include "i2c.h"
+#include "sensor.h"
+#include "flash_eep.h"
+#include "hal.h"
+
+#if defined(I2C_GROUP) && (DEV_SERVICES & SERVICE_THS) && !USE_SENSOR_SCD41 && !USE_SENSOR_BME280
+
+#define LOOP_US		100 // main_loop() time between i2c_queue_poll()
+
+extern unsigned int feep_dir[];
+
+static u32 us_now(void) {
+	return clock_time() / CLOCK_16M_SYS_TIMER_CLK_1US;
+}
+
+//---- a slave that ACKs everything, reads 0x00, 0x01, ...
+
+static u8 echo_rd(int idx) {
+	return idx;
+}
+
+static const hal_i2c_dev_t echo_dev[] = {
+	{ 0xa0, NULL, NULL, echo_rd },
+	{ 0 }
+};
+
+static u32 cb_cnt;
+static int cb_err;
+
+static void queue_cb(int err) {
+	cb_cnt++;
+	cb_err = err;
+}
+
+static void bus_start(const hal_i2c_dev_t * devs) {
+	hal_i2c_devs = devs;
+	hal_i2c_reset();
+	memset(&hal_i2c_stat, 0, sizeof(hal_i2c_stat));
+	hal_stall_us = 0;
+	cb_cnt = 0;
+	cb_err = -1;
+}
+
+static void test_queue_chain(void) {
+	u8 buf[4];
+	u32 t;
+	bus_start(echo_dev);
+	CHECK(i2c_queue_cmd(0xa0, 0x0201, 2, NULL, 0, 300));
+	CHECK(i2c_queue_cmd(0xa0, 0x05, 1, buf, 2, 0));
+	CHECK(i2c_queue_cmd(0xa0, 0, 0, &buf[2], 2, 0));
+	t = us_now();
+	CHECK_EQ(i2c_queue_run(), 0);
+	CHECK(!strcmp(hal_i2c_log, "a0w:0102. a0w:05 a0r:2. a0r:2."));
+	CHECK_EQ(buf[1], 1);
+	CHECK_EQ(buf[3], 1);
+	CHECK(us_now() - t >= 300); // the delay after the first one
+	CHECK_EQ(hal_i2c_stat.spin_us, 0); // stall, no busy-wait
+	// send_i2c_buf() of 12 bytes through the queue
+	bus_start(echo_dev);
+	memcpy(buf, "\x10\x20\x30\x40", 4);
+	CHECK_EQ(send_i2c_buf(0xa0, buf, 4), 0);
+	CHECK(!strcmp(hal_i2c_log, "a0w:10203040."));
+	CHECK_EQ(hal_i2c_stat.spin_us, 0);
+}
+
+/* a rejected transaction fails the chain at its number, no false ACK */
+static void test_queue_reject(void) {
+	static u8 big[300];
+	int i;
+	bus_start(echo_dev);
+	for (i = 0; i < I2C_QUEUE_SIZE; i++)
+		CHECK(i2c_queue_cmd(0xa0, i, 1, NULL, 0, 0));
+	CHECK(!i2c_queue_cmd(0xa0, 0x55, 1, NULL, 0, 0)); // queue full
+	CHECK_EQ(i2c_queue_run(), I2C_QUEUE_SIZE + 1);
+	CHECK(!strcmp(hal_i2c_log, "a0w:00. a0w:01. a0w:02. a0w:03."));
+	// wrlen > I2C_QTR_WRMAX, rdlen > 255: nothing on the bus
+	bus_start(echo_dev);
+	CHECK(!i2c_queue_cmd(0xa0, 0x04030201, 4, NULL, 0, 0));
+	CHECK_EQ(i2c_queue_run(), 1);
+	CHECK(read_i2c_buf(0xa0, big, 256) != 0);
+	CHECK(read_i2c_byte_addr(0xa0, 0, big, 300) != 0);
+	CHECK(send_i2c_buf(0xa0, big, 256) != 0);
+	CHECK_EQ(hal_i2c_stat.trs, 0);
+	CHECK_EQ(read_i2c_buf(0xa0, big, 255), 0);
+	CHECK_EQ(big[254], 254);
+	// after a rejected one, the next ones are rejected too
+	bus_start(echo_dev);
+	CHECK(i2c_queue_cmd(0xa0, 1, 1, NULL, 0, 0));
+	CHECK(!i2c_queue_cmd(0xa0, 2, 1, NULL, 300, 0));
+	CHECK(!i2c_queue_cmd(0xa0, 3, 1, NULL, 0, 0));
+	CHECK_EQ(i2c_queue_run(), 2);
+	CHECK(!strcmp(hal_i2c_log, "a0w:01."));
+	// NAK of the second one: the rest is dropped
+	bus_start(echo_dev);
+	CHECK(i2c_queue_cmd(0xa0, 1, 1, NULL, 0, 0));
+	CHECK(i2c_queue_cmd(0xb0, 2, 1, NULL, 0, 0));
+	CHECK(i2c_queue_cmd(0xa0, 3, 1, NULL, 0, 0));
+	CHECK_EQ(i2c_queue_run(), 2);
+	CHECK(!strcmp(hal_i2c_log, "a0w:01. b0w!."));
+	CHECK_EQ(send_i2c_byte(0xb0, 1), 1);
+	CHECK_EQ(i2c_queue_run(), 0); // the queue is empty and clean
+}
+
+/* i2c_queue_start(): the delays return to main_loop, the callback at the end */
+static void test_queue_background(void) {
+	u32 t, loops = 0;
+	bus_start(echo_dev);
+	i2c_queue_cmd(0xa0, 1, 1, NULL, 0, 1000);
+	i2c_queue_cmd(0xa0, 2, 1, NULL, 0, 0);
+	t = us_now();
+	i2c_queue_start(queue_cb);
+	CHECK(i2c_queue_busy());
+	CHECK(!strcmp(hal_i2c_log, "a0w:01."));
+	while (i2c_queue_busy() && loops < 100) {
+		hal_clock_us(LOOP_US); // main_loop
+		if (!i2c_queue_poll())
+			break;
+		loops++;
+	}
+	CHECK(!strcmp(hal_i2c_log, "a0w:01. a0w:02."));
+	CHECK_EQ(cb_cnt, 1);
+	CHECK_EQ(cb_err, 0);
+	CHECK(loops >= 1000 / LOOP_US - 2);
+	CHECK(hal_stall_us < 1000); // the delay returns to main_loop, the bytes stall
+	CHECK(us_now() - t >= 1000);
+	CHECK_EQ(hal_i2c_stat.spin_us, 0);
+	// a transaction in the delay (the screen): the chain ends first, its callback
+	bus_start(echo_dev);
+	i2c_queue_cmd(0xa0, 1, 1, NULL, 0, 1000);
+	i2c_queue_cmd(0xa0, 2, 1, NULL, 0, 0);
+	i2c_queue_start(queue_cb);
+	CHECK_EQ(send_i2c_byte(0xa0, 3), 0);
+	CHECK(!strcmp(hal_i2c_log, "a0w:01. a0w:02. a0w:03."));
+	CHECK_EQ(cb_cnt, 1);
+	CHECK_EQ(cb_err, 0);
+	CHECK(!i2c_queue_busy());
+	// an empty chain ends at once
+	bus_start(echo_dev);
+	i2c_queue_start(queue_cb);
+	CHECK(!i2c_queue_busy());
+	CHECK_EQ(cb_cnt, 1);
+	CHECK_EQ(cb_err, 0);
+}
+
+//---- sensor models: one sensor on the bus
+
+static u8 sens_crc(const u8 *p, int len) {
+	u8 crc = 0xff;
+	int i, b;
+	for (i = 0; i < len; i++) {
+		crc ^= p[i];
+		for (b = 0; b < 8; b++)
+			crc = (crc & 0x80) ? (crc << 1) ^ 0x31 : crc << 1;
+	}
+	return crc;
+}
+
+static struct {
+	u32 ready_tik;	// end of the reset, wakeup, conversion
+	u32 early;		// commands and reads before ready_tik (NAK)
+	u8 awake;
+	u8 measuring;
+	u8 reg;			// register pointer (CHT83xx)
+	u8 rd[8];
+	u8 rd_len;
+} sm;
+
+#define SM_T	0x6666 // 24.99 C (SHT: 17500 * T / 65536 - 4500)
+#define SM_H	0x8000 // 50.00 % (SHT: 10000 * H / 65536)
+#define SHT_TEMP	((17500 * SM_T >> 16) - 4500)
+
+static int sm_busy(void) {
+	return (int)(clock_time() - sm.ready_tik) < 0;
+}
+
+static void sm_word(int i, u16 w) {
+	sm.rd[i * 3] = w >> 8;
+	sm.rd[i * 3 + 1] = w;
+	sm.rd[i * 3 + 2] = sens_crc(&sm.rd[i * 3], 2);
+	sm.rd_len = i * 3 + 3;
+}
+
+static void sm_wait(u32 us) {
+	sm.ready_tik = clock_time() + us * CLOCK_16M_SYS_TIMER_CLK_1US;
+}
+
+static void sm_reset(void) {
+	memset(&sm, 0, sizeof(sm));
+}
+
+/* SHTC3, SHT4x, SHT30: the address is NAKed while busy (wakeup, reset, conversion) */
+static int sht_ack(int rd) {
+	if (sm_busy()) {
+		sm.early++;
+		return 0;
+	}
+	if (rd && sm.measuring) {
+		sm.measuring = 0;
+		sm_word(0, SM_T);
+		sm_word(1, SM_H);
+	}
+	return !rd || sm.rd_len;
+}
+
+static u8 sht_rd(int idx) {
+	return idx < sm.rd_len ? sm.rd[idx] : 0xff;
+}
+
+#define CMD2(b0, b1)	((len == 2) && buf[0] == (b0) && buf[1] == (b1))
+
+#if USE_SENSOR_SHTC3
+static int shtc3_ack(int rd) {
+	if (!sm.awake && rd)
+		return 0;
+	return sht_ack(rd);
+}
+
+static void shtc3_wr(const u8 *buf, int len) {
+	sm.rd_len = 0;
+	if (CMD2(0x35, 0x17)) { // wakeup
+		sm.awake = 1;
+		sm_wait(200);
+	} else if (!sm.awake) {
+		return;
+	} else if (CMD2(0xb0, 0x98)) { // sleep
+		sm.awake = 0;
+	} else if (CMD2(0xef, 0xc8)) { // ID
+		sm_word(0, 0x0887);
+	} else if (CMD2(0x78, 0x66)) { // measure
+		sm.measuring = 1;
+		sm_wait(10800);
+	}
+}
+
+static const hal_i2c_dev_t shtc3_dev[] = {
+	{ SHTC3_I2C_ADDR << 1, shtc3_ack, shtc3_wr, sht_rd },
+	{ 0 }
+};
+#endif
+
+#if USE_SENSOR_SHT4X
+static void sht4x_wr(const u8 *buf, int len) {
+	sm.rd_len = 0;
+	if (len != 1)
+		return;
+	if (buf[0] == 0x94) // soft reset
+		sm_wait(900);
+	else if (buf[0] == 0x89) { // serial number
+		sm_word(0, 0x1234);
+		sm_word(1, 0x5678);
+		sm_wait(900);
+	} else if (buf[0] == 0xfd) { // measure, high precision
+		sm.measuring = 1;
+		sm_wait(6900);
+	}
+}
+
+static const hal_i2c_dev_t sht4x_dev[] = {
+	{ SHT4x_I2C_ADDR << 1, sht_ack, sht4x_wr, sht_rd },
+	{ 0 }
+};
+#endif
+
+#if USE_SENSOR_SHT30
+static u32 sht30_sn;		// 0 - none (GXHT3x, CHT832x)
+static u16 sht30_status;
+
+static void sht30_wr(const u8 *buf, int len) {
+	sm.rd_len = 0;
+	if (CMD2(0x30, 0xa2)) // soft reset
+		sm_wait(1000);
+	else if (CMD2(0xf3, 0x2d)) // status
+		sm_word(0, sht30_status);
+	else if (CMD2(0x37, 0x80)) { // serial number
+		if (sht30_sn) {
+			sm_word(0, sht30_sn >> 16);
+			sm_word(1, sht30_sn);
+		}
+	} else if (CMD2(0x24, 0x00)) { // measure
+		sm.measuring = 1;
+		sm_wait(12500);
+	}
+}
+
+static const hal_i2c_dev_t sht30_dev[] = {
+	{ SHT30_I2C_ADDR_MAX << 1, sht_ack, sht30_wr, sht_rd },
+	{ 0 }
+};
+#endif
+
+#if USE_SENSOR_AHT20_30
+static u8 aht2x_status = 0x18; // calibrated, initialized
+
+/* AHT2x: the address is NAKed in the reset, busy (status bit 7) in the conversion */
+static int aht2x_ack(int rd) {
+	if (sm.measuring == 0 && sm_busy()) {
+		sm.early++;
+		return 0;
+	}
+	return 1;
+}
+
+static void aht2x_wr(const u8 *buf, int len) {
+	if (len == 1 && buf[0] == 0xba) { // soft reset
+		sm.measuring = 0;
+		sm_wait(9000);
+	} else if (len == 3 && buf[0] == 0xac && buf[1] == 0x33 && buf[2] == 0x00) { // measure
+		sm.measuring = 1;
+		sm_wait(75000);
+	}
+}
+
+static u8 aht2x_rd(int idx) {
+	// H = 0x80000 (50.00 %), T = 0x60000 (25.00 C: 1250 * T / 65536 / 16 - 5000)
+	static const u8 data[6] = { 0x18, 0x80, 0x00, 0x06, 0x00, 0x00 };
+	if (idx == 0)
+		return (sm.measuring && sm_busy()) ? (aht2x_status | 0x80) : aht2x_status;
+	if (idx < 6)
+		return data[idx];
+	return sens_crc(data, 6);
+}
+
+static const hal_i2c_dev_t aht2x_dev[] = {
+	{ AHT2x_I2C_ADDR << 1, aht2x_ack, aht2x_wr, aht2x_rd },
+	{ 0 }
+};
+#endif
+
+#if USE_SENSOR_CHT8305 || USE_SENSOR_CHT8215
+static u16 cht_vid;
+
+/* CHT83xx: the register pointer, the address is NAKed in the reset and the conversion */
+static int cht_ack(int rd) {
+	if (sm_busy()) {
+		sm.early++;
+		return 0;
+	}
+	return 1;
+}
+
+static void cht_wr(const u8 *buf, int len) {
+	sm.reg = buf[0];
+	if (cht_vid == 0x8305) {
+		if (len == 3 && buf[0] == 0x02 && (buf[1] & 0x80)) // config: soft reset
+			sm_wait(4000);
+		else if (len == 1 && buf[0] == 0x00) // start of the conversion
+			sm_wait(12000);
+	}
+}
+
+static u8 cht_rd(int idx) {
+	u16 w;
+	switch (sm.reg) {
+	case 0xfe:
+		w = 0x5959;
+		break;
+	case 0xff:
+		w = cht_vid;
+		break;
+	case 0x00:
+		if (cht_vid == 0x8305) { // T, H in one read
+			w = (idx < 2) ? SM_T : SM_H;
+			break;
+		}
+		w = 0x1900; // 25.00 C (25606 * 0x1900 >> 16)
+		break;
+	case 0x01:
+		w = 0x6666; // 79.99 % (20000 * 0x6666 >> 16)
+		break;
+	default:
+		w = 0;
+	}
+	return (idx & 1) ? w : w >> 8;
+}
+
+static const hal_i2c_dev_t cht_dev[] = {
+	{ CHT8305_I2C_ADDR << 1, cht_ack, cht_wr, cht_rd },
+	{ 0 }
+};
+#endif
+
+//---- sensors.c chains
+
+/* Power on, 'erase' - a new device (no EEP_ID_SID) */
+static void sensor_boot(const hal_i2c_dev_t * devs, int erase) {
+	if (erase)
+		hal_reset();
+	feep_dir[0] = 0;
+	flash_read_cfg(NULL, EEP_ID_CFG, 0); // user_init(): the config is read
+	memset(&sensor_cfg, 0, sizeof(sensor_cfg));
+	memset(&measured_data, 0, sizeof(measured_data));
+	sm_reset();
+	bus_start(devs);
+}
+
+/* init_sensor() at boot: the chain, its log (NULL - not checked), the busy-wait
+ * (scan_i2c_addr() only), the sensor in EEP_ID_SID */
+static u32 sid_id; // EEP_ID_SID after boot_check()
+
+static void boot_check(const char * name, const hal_i2c_dev_t * devs, int erase, u8 type, const char * log) {
+	sensor_sid_t sid;
+	u32 t;
+	sensor_boot(devs, erase);
+	t = us_now();
+	init_sensor();
+	t = us_now() - t;
+	CHECK_EQ(sensor_cfg.sensor_type, type);
+	CHECK_EQ(sm.early, 0);
+	if (log && strcmp(hal_i2c_log, log)) {
+		printf("%s log: %s\n", name, hal_i2c_log);
+		CHECK(0);
+	}
+	CHECK_EQ(flash_read_cfg(&sid, EEP_ID_SID, sizeof(sid)), sizeof(sid));
+	CHECK_EQ(sid.i2c_addr, sensor_cfg.i2c_addr);
+	CHECK_EQ(sid.sensor_type, type);
+	sid_id = sid.id;
+	printf("%-16s %5u us, stall %5u us, busy-wait %u us (scan_i2c_addr)\n",
+		name, t, hal_stall_us, hal_i2c_stat.spin_us);
+}
+
+/* New device: the address scan and the probe, the sensor is saved */
+static void probe_check(const char * name, const hal_i2c_dev_t * devs, u8 type, const char * log) {
+	char s[32];
+	hal_snprintf(s, sizeof(s), "probe   %s", name);
+	boot_check(s, devs, 1, type, log);
+	CHECK(hal_stat.wr != 0);
+	CHECK_EQ(sid_id, sensor_cfg.id);
+}
+
+/* Next boot: the saved sensor is confirmed, no address scan, no EEP write */
+static void confirm_check(const char * name, const hal_i2c_dev_t * devs, u8 type, const char * log) {
+	char s[32];
+	u32 wr = hal_stat.wr;
+	hal_snprintf(s, sizeof(s), "confirm %s", name);
+	boot_check(s, devs, 0, type, log);
+	CHECK_EQ(hal_i2c_stat.spin_us, 0);
+	CHECK_EQ(hal_stat.wr, wr);
+}
+
+/* Next boot, the saved sensor is not confirmed: the log starts with the
+ * confirmation ('log'), the address scan and the probe, the new one is saved */
+static void fallback_check(const char * name, const hal_i2c_dev_t * devs, u8 type, const char * log) {
+	char s[32];
+	hal_snprintf(s, sizeof(s), "rescan  %s", name);
+	boot_check(s, devs, 0, type, NULL);
+	if (strncmp(hal_i2c_log, log, strlen(log))) {
+		printf("%s log: %s\n", s, hal_i2c_log);
+		CHECK(0);
+	}
+	CHECK(hal_i2c_stat.spin_us != 0);
+	CHECK_EQ(sid_id, sensor_cfg.id);
+}
+
+static void measure_cb(int err) {
+	cb_cnt++;
+	cb_err = err;
+	sensor_cfg.time_measure = clock_time() | 1;
+}
+
+/* One measurement of app.c at the next measurement step: the start chain in the
+ * background (i2c_queue_start(), i2c_queue_poll() in main_loop), the wakeup at
+ * measure_timeout, read_sensor_cb(); 'spin' - the busy-wait of scan_i2c_addr() */
+static void measure_check(const char * name, const char * log, s16 temp, u16 humi, u32 spin) {
+	u32 t, loops = 0, stall;
+	hal_clock_us(1000000);
+	hal_i2c_reset();
+	memset(&hal_i2c_stat, 0, sizeof(hal_i2c_stat));
+	hal_stall_us = 0;
+	cb_cnt = 0;
+	sensor_cfg.time_measure = 0;
+	t = us_now();
+	start_measure_sensor_deep_sleep();
+	i2c_queue_start(measure_cb);
+	while (i2c_queue_busy() && loops < 1000) {
+		hal_clock_us(LOOP_US); // main_loop
+		i2c_queue_poll();
+		loops++;
+	}
+	stall = hal_stall_us;
+	CHECK_EQ(cb_cnt, 1);
+	CHECK_EQ(cb_err, 0);
+	CHECK(sensor_cfg.time_measure != 0);
+	// sleep up to the end of the conversion
+	do
+		hal_clock_us(LOOP_US);
+	while (clock_time() - sensor_cfg.time_measure <= sensor_cfg.measure_timeout);
+	CHECK_EQ(read_sensor_cb(), 1);
+	CHECK_EQ(measured_data.temp, temp);
+	CHECK_EQ(measured_data.humi, humi);
+	CHECK_EQ(sm.early, 0);
+	CHECK_EQ(hal_i2c_stat.spin_us, spin);
+	if (strcmp(hal_i2c_log, log)) {
+		printf("measure log: %s\n", hal_i2c_log);
+		CHECK(0);
+	}
+	printf("measure %-8s %5u us, start: stall %3u us, main_loop %4u us, busy-wait %u us, bus %u bytes\n",
+		name, us_now() - t, stall, loops * LOOP_US, hal_i2c_stat.spin_us, hal_i2c_stat.bytes);
+}
+
+#if USE_SENSOR_SHTC3
+static void test_chain_shtc3(void) {
+	probe_check("SHTC3", shtc3_dev, TH_SENSOR_SHTC3,
+		"00w!. e0w. e0w:3517. e0w:efc8. e0r:3. e0w:b098.");
+	confirm_check("SHTC3", shtc3_dev, TH_SENSOR_SHTC3, "00w!. e0w:3517. e0w:efc8. e0r:3. e0w:b098.");
+	measure_check("SHTC3", "e0w:3517. e0w:7866. e0r:6. e0w:b098.", SHT_TEMP, 5000, 0);
+}
+#endif
+
+#if USE_SENSOR_SHT4X
+static void test_chain_sht4x(void) {
+	probe_check("SHT4x", sht4x_dev, TH_SENSOR_SHT4x,
+#if USE_SENSOR_SHTC3
+		"00w!. e0w!."
+#else
+		"00w!."
+#endif
+#if USE_SENSOR_AHT20_30
+		" 70w!."
+#endif
+#if USE_SENSOR_CHT8305 || USE_SENSOR_CHT8215
+		" 80w!. 82w!. 84w!. 86w!."
+#endif
+		" 88w. 88w:94. 88w:89. 88r:6.");
+	confirm_check("SHT4x", sht4x_dev, TH_SENSOR_SHT4x, "00w!. 88w:89. 88r:6.");
+	measure_check("SHT4x", "88w:fd. 88r:6.", SHT_TEMP, 5000 * 12500 / 10000 - 600, 0);
+}
+#endif
+
+#if USE_SENSOR_SHT30
+static void test_chain_sht30(void) {
+	sht30_sn = 0x12345678;
+	sht30_status = 0x8010;
+	probe_check("SHT30", sht30_dev, TH_SENSOR_SHT30,
+#if USE_SENSOR_SHTC3
+		"00w!. e0w!."
+#else
+		"00w!."
+#endif
+#if USE_SENSOR_AHT20_30
+		" 70w!."
+#endif
+#if USE_SENSOR_CHT8305 || USE_SENSOR_CHT8215
+		" 80w!. 82w!. 84w!. 86w!."
+#endif
+		" 88w!. 8aw."
+#if USE_SENSOR_SHT4X
+		" 8aw:94. 8aw:89. 8ar!."
+#endif
+		" 8aw:30a2. 8aw:f32d. 8ar:3. 8aw:3780. 8ar:6.");
+	confirm_check("SHT30", sht30_dev, TH_SENSOR_SHT30, "00w!. 8aw:f32d. 8ar:3. 8aw:3780. 8ar:6.");
+	measure_check("SHT30", "8aw:2400. 8ar:6.", SHT_TEMP, 5000, 0);
+}
+#endif
+
+#if USE_SENSOR_AHT20_30
+static void test_chain_aht2x(void) {
+	probe_check("AHT2x", aht2x_dev, TH_SENSOR_AHT2x,
+#if USE_SENSOR_SHTC3
+		"00w!. e0w!. 70w. 70w:ba. 70r:1.");
+#else
+		"00w!. 70w. 70w:ba. 70r:1.");
+#endif
+	confirm_check("AHT2x", aht2x_dev, TH_SENSOR_AHT2x, "00w!. 70r:1.");
+	measure_check("AHT2x", "70w:ac3300. 70r:7.", 2500, 5000, 0);
+}
+#endif
+
+#if USE_SENSOR_CHT8305
+static void test_chain_cht8305(void) {
+	cht_vid = 0x8305;
+	probe_check("CHT8305", cht_dev, TH_SENSOR_CHT8305,
+#if USE_SENSOR_SHTC3
+		"00w!. e0w!."
+#else
+		"00w!."
+#endif
+#if USE_SENSOR_AHT20_30
+		" 70w!."
+#endif
+		" 80w. 80w:fe 80r:2. 80w:ff 80r:2. 80w:029000. 80w:021000. 80w:00.");
+	confirm_check("CHT8305", cht_dev, TH_SENSOR_CHT8305, "00w!. 80w:ff 80r:2. 80w:029000. 80w:021000. 80w:00.");
+	// scan_i2c_addr() before the start (wakeup), 100 kHz
+	measure_check("CHT8305", "80w. 80w:00. 80r:4.", (16500 * SM_T >> 16) - 4000, 5000, 100);
+}
+#endif
+
+#if USE_SENSOR_CHT8215
+static void test_chain_cht8215(void) {
+	cht_vid = 0x1582;
+	probe_check("CHT8215", cht_dev, TH_SENSOR_CHT8215,
+#if USE_SENSOR_SHTC3
+		"00w!. e0w!."
+#else
+		"00w!."
+#endif
+#if USE_SENSOR_AHT20_30
+		" 70w!."
+#endif
+		" 80w. 80w:fe 80r:2. 80w:ff 80r:2.");
+	confirm_check("CHT8215", cht_dev, TH_SENSOR_CHT8215, "00w!. 80w:ff 80r:2.");
+	measure_check("CHT8215", "80w:00 80r:2. 80w:01 80r:2.", 2500, 20000 * 0x6666 >> 16, 0);
+}
+#endif
+
+/* The saved sensor is changed or gone: the confirmation fails, the probe saves the new one */
+static void test_sid_fallback(void) {
+	u32 wr;
+#if USE_SENSOR_SHT30
+	// SHT3x: other serial number at the address
+	sht30_sn = 0x12345678;
+	sht30_status = 0x8010;
+	probe_check("SHT30", sht30_dev, TH_SENSOR_SHT30, NULL);
+	sht30_sn = 0x9abcdef0;
+	fallback_check("SHT30", sht30_dev, TH_SENSOR_SHT30, "00w!. 8aw:f32d. 8ar:3. 8aw:3780. 8ar:6. e0w!.");
+	CHECK_EQ(sensor_cfg.id, 0x9abcdef0);
+	// GXHT3x, CHT832x: no serial number, the status id is not compared
+	sht30_sn = 0;
+	probe_check("GXHT3x", sht30_dev, TH_SENSOR_SHT30, NULL);
+	CHECK_EQ(sensor_cfg.id, 0x00308010);
+	sht30_status = 0x0000;
+	confirm_check("GXHT3x", sht30_dev, TH_SENSOR_SHT30, NULL);
+	// and a SHT3x in its place
+	sht30_sn = 0x12345678;
+	fallback_check("SHT30", sht30_dev, TH_SENSOR_SHT30, "00w!. 8aw:f32d. 8ar:3. 8aw:3780. 8ar:6. e0w!.");
+	CHECK_EQ(sensor_cfg.id, 0x12345678);
+#endif
+#if USE_SENSOR_AHT20_30
+	// AHT2x: not calibrated (or other part at 0x38) - the probe with the reset
+	aht2x_status = 0x18;
+	probe_check("AHT2x", aht2x_dev, TH_SENSOR_AHT2x, NULL);
+	aht2x_status = 0x00;
+	wr = hal_stat.wr;
+	fallback_check("AHT2x", aht2x_dev, TH_SENSOR_AHT2x, "00w!. 70r:1.");
+	CHECK(hal_stat.wr != wr); // the status id changed
+	aht2x_status = 0x18;
+#endif
+#if USE_SENSOR_SHTC3 && USE_SENSOR_SHT4X
+	// other sensor type
+	probe_check("SHTC3", shtc3_dev, TH_SENSOR_SHTC3, NULL);
+	// the wakeup and the sleep of the confirmation, the scan
+	fallback_check("SHT4x", sht4x_dev, TH_SENSOR_SHT4x, "00w!. e0w!. e0w!. e0w!.");
+#endif
+#if USE_SENSOR_CHT8305 && USE_SENSOR_CHT8215
+	cht_vid = 0x8305;
+	probe_check("CHT8305", cht_dev, TH_SENSOR_CHT8305, NULL);
+	cht_vid = 0x1582;
+	fallback_check("CHT8215", cht_dev, TH_SENSOR_CHT8215, "00w!. 80w:ff 80r:2.");
+#endif
+	(void) wr;
+}
+
+#endif // I2C_GROUP && SERVICE_THS
+
+static const hal_test_t tests[] = {
+#if defined(I2C_GROUP) && (DEV_SERVICES & SERVICE_THS) && !USE_SENSOR_SCD41 && !USE_SENSOR_BME280
+	{ "i2c: queue chain", test_queue_chain },
+	{ "i2c: queue reject", test_queue_reject },
+	{ "i2c: queue background", test_queue_background },
+#if USE_SENSOR_SHTC3
+	{ "sensor: SHTC3 chains", test_chain_shtc3 },
+#endif
+#if USE_SENSOR_SHT4X
+	{ "sensor: SHT4x chains", test_chain_sht4x },
+#endif
+#if USE_SENSOR_SHT30
+	{ "sensor: SHT30 chains", test_chain_sht30 },
+#endif
+#if USE_SENSOR_AHT20_30
+	{ "sensor: AHT2x chains", test_chain_aht2x },
+#endif
+#if USE_SENSOR_CHT8305
+	{ "sensor: CHT8305 chains", test_chain_cht8305 },
+#endif
+#if USE_SENSOR_CHT8215
+	{ "sensor: CHT8215 chains", test_chain_cht8215 },
+#endif
+	{ "sensor: saved sensor fallback", test_sid_fallback },
+#endif
+	{ NULL, NULL }
+};
+
+int main(void) {
+	return hal_run_tests(tests);
+}
@@ -0,0 +1,118 @@
+/*
+ * test_utils.c
+ *
+ * Host tests: memset/memcpy/memcmp of utils.c (built as fw_mem*) against libc,
+ * every dst/src offset 0..3, every length 0..64, overlapping copies.
+ */
+#include "tl_common.h"
+#include "hal.h"
+
+#define OFS_MAX		4
+#define LEN_MAX		64
+#define BUF_SIZE	(LEN_MAX + 2 * 16)
+
+void * fw_memset(void * dest, int val, unsigned int len);
+void * fw_memcpy(void * out, const void * in, unsigned int length);
+int fw_memcmp(const void * m1, const void *m2, unsigned int len);
+
+// word aligned, the offsets are added
+static u32 buf_w[BUF_SIZE / 4], ref_w[BUF_SIZE / 4], src_w[BUF_SIZE / 4];
+#define buf	((u8 *)buf_w)
+#define ref	((u8 *)ref_w)
+#define src	((u8 *)src_w)
+
+static void fill(u8 *p, u8 seed) {
+	int i;
+	for (i = 0; i < BUF_SIZE; i++)
+		p[i] = seed + i * 7;
+}
+
+static int sign(int x) {
+	return (x > 0) - (x < 0);
+}
+
+static void test_memset(void) {
+	int o, len, err = 0;
+	void *r;
+	for (o = 0; o < OFS_MAX; o++)
+		for (len = 0; len <= LEN_MAX; len++) {
+			fill(buf, 0x11);
+			fill(ref, 0x11);
+			r = fw_memset(buf + 16 + o, 0xa5, len);
+			memset(ref + 16 + o, 0xa5, len);
+			if (r != buf + 16 + o || memcmp(buf, ref, BUF_SIZE))
+				err++;
+		}
+	CHECK_EQ(err, 0);
+}
+
+static void test_memcpy(void) {
+	int so, d, len, err = 0;
+	void *r;
+	for (so = 0; so < OFS_MAX; so++)
+		for (d = 0; d < OFS_MAX; d++)
+			for (len = 0; len <= LEN_MAX; len++) {
+				fill(src, 0x40);
+				fill(buf, 0x11);
+				fill(ref, 0x11);
+				r = fw_memcpy(buf + 16 + d, src + 16 + so, len);
+				memcpy(ref + 16 + d, src + 16 + so, len);
+				if (r != buf + 16 + d || memcmp(buf, ref, BUF_SIZE))
+					err++;
+			}
+	CHECK_EQ(err, 0);
+}
+
+/* dst - src = -8..8 in one buffer: a copy as memmove() */
+static void test_memcpy_overlap(void) {
+	int so, sh, len, err = 0;
+	for (so = 0; so < OFS_MAX; so++)
+		for (sh = -8; sh <= 8; sh++)
+			for (len = 0; len <= LEN_MAX; len++) {
+				fill(buf, 0x11);
+				fill(ref, 0x11);
+				fw_memcpy(buf + 12 + so + sh, buf + 12 + so, len);
+				memmove(ref + 12 + so + sh, ref + 12 + so, len);
+				if (memcmp(buf, ref, BUF_SIZE))
+					err++;
+			}
+	CHECK_EQ(err, 0);
+}
+
+/* equal blocks and one differing byte at each position, above and below */
+static void test_memcmp(void) {
+	static const u8 dv[2] = { 0x01, 0xfe };
+	int o1, o2, len, pos, v, err = 0;
+	u8 *p1, *p2;
+	for (o1 = 0; o1 < OFS_MAX; o1++)
+		for (o2 = 0; o2 < OFS_MAX; o2++)
+			for (len = 0; len <= LEN_MAX; len++) {
+				p1 = buf + 16 + o1;
+				p2 = ref + 16 + o2;
+				fill(buf, 0);
+				fill(ref, 0);
+				memcpy(p2, p1, len);
+				if (fw_memcmp(p1, p2, len) != 0)
+					err++;
+				for (pos = 0; pos < len; pos++)
+					for (v = 0; v < 2; v++) {
+						memcpy(p2, p1, len);
+						p2[pos] = p1[pos] ^ dv[v];
+						if (sign(fw_memcmp(p1, p2, len)) != sign(memcmp(p1, p2, len)))
+							err++;
+					}
+			}
+	CHECK_EQ(err, 0);
+}
+
+static const hal_test_t tests[] = {
+	{ "utils: memset", test_memset },
+	{ "utils: memcpy", test_memcpy },
+	{ "utils: memcpy overlap", test_memcpy_overlap },
+	{ "utils: memcmp", test_memcmp },
+	{ NULL, NULL }
+};
+
+int main(void) {
+	return hal_run_tests(tests);
+}
@@ -45,6 +45,10 @@
 #if USE_SDM_OUT
 #include "sdm_out.h"
 #endif
+#if USE_SENSOR_FILTER || USE_MEAS_ADAPTIVE
+#include "filter.h"
+#endif
+#include "estat.h"
 
 
 void app_enter_ota_mode(void);
@@ -433,6 +437,10 @@ void test_config(void) {
 		cfg.advertising_interval = 160; // 160*62.5 = 10000 ms
 	wrk.adv_interval_delay = cfg.flg3.adv_interval_delay;
 	wrk.adv_interval = cfg.advertising_interval * 100; // Tadv_interval = adv_interval * 62.5 ms , adv_interval in 0.625 ms
+#if USE_ADV_ADAPTIVE
+	adv_buf.scale = 1;
+	adv_buf.flat_count = 0;
+#endif
 
 	// measurement_step_time = adv_interval * 62.5 * measure_interval, max 250 sec
 	if (cfg.measure_interval < 2)
@@ -447,6 +455,16 @@ void test_config(void) {
 		cfg.measure_interval = tmp / wrk.adv_interval;
 		wrk.measurement_step_time = wrk.adv_interval * (u32)cfg.measure_interval;
 	}
+#if USE_MEAS_ADAPTIVE
+	tmp = 400000 / wrk.measurement_step_time;
+	if (tmp > MEAS_ADAPT_MAX)
+		tmp = MEAS_ADAPT_MAX;
+	else if (tmp == 0)
+		tmp = 1;
+	wrk.meas_scale_max = tmp;
+	wrk.meas_scale = 1;
+	wrk.meas_skip = 0;
+#endif
 	wrk.measurement_step_time *= (625 * sys_tick_per_us);
 	wrk.measurement_step_time -= 256; // us
 #endif
@@ -529,6 +547,10 @@ void low_vbat(void) {
 	go_sleep(180u * CLOCK_16M_SYS_TIMER_CLK_1S); // go deep-sleep 3 minutes
 }
 
+#if USE_SYNC_SCAN && SENSOR_SLEEP_MEASURE
+RAM u32 meas_wakeup_tik; // app wakeup of the measurement end, = 0 - none
+#endif
+
 #if (DEV_SERVICES & (SERVICE_THS | SERVICE_IUS | SERVICE_18B20 | SERVICE_PLM))
 #if SENSOR_SLEEP_MEASURE
 _attribute_ram_code_
@@ -539,6 +561,7 @@ void WakeupLowPowerCb(int par) {
 _attribute_ram_code_
 void read_sensors(void) {
 #endif
+		u8 estat_prev = estat_enter(ESTAT_SENSOR);
 #if (DEV_SERVICES & SERVICE_RDS)
 		rds_input_on();
 #endif
@@ -562,6 +585,9 @@ void read_sensors(void) {
 #ifdef CHL_ADC2 // DIY version only!
 			measured_data.humi = get_adc_mv(CHL_ADC2);
 #endif
+#if USE_SENSOR_FILTER
+			filter_measures();
+#endif
 #if (DEV_SERVICES & (SERVICE_THS | SERVICE_PLM))
 			measured_data.temp_x01 = (measured_data.temp + 5)/ 10;
 			measured_data.humi_x01 = (measured_data.humi + 5)/ 10;
@@ -592,8 +618,12 @@ void read_sensors(void) {
 #if (DEV_SERVICES & SERVICE_BINDKEY) && USE_MIHOME_BEACON
 			if ((cfg.flg.advertising_type == ADV_TYPE_MI) && cfg.flg2.adv_crypto)
 				mi_beacon_summ();
+#endif
+#if USE_MEAS_ADAPTIVE
+			meas_adaptive_step();
 #endif
 			wrk.msc.all_flgs = 0xff;
+			set_next_adv_data(); // the next adv. packet, encrypted, into the shadow buffer
 		}
 #if (DEV_SERVICES & SERVICE_RDS)
 		if (trg.rds.type1 == RDS_NONE) {
@@ -610,24 +640,77 @@ void read_sensors(void) {
 #if (DEVICE_TYPE == DEVICE_MJWSD05MMC) || (DEVICE_TYPE == DEVICE_MJWSD05MMC_EN)
 		SET_LCD_UPDATE();
 #endif
+		estat_leave(estat_prev);
 #if SENSOR_SLEEP_MEASURE
 		sensor_cfg.time_measure = 0;
 	}
+#if USE_SYNC_SCAN
+	meas_wakeup_tik = 0;
+	app_wakeup_set(); // the peer scan window stays
+#else
 	bls_pm_setAppWakeupLowPower(0, 0); // clear callback
 #endif
+#endif
 }
 #endif // (DEV_SERVICES & (SERVICE_THS | SERVICE_IUS | SERVICE_18B20 | SERVICE_PLM))
 
+#if USE_SYNC_SCAN
+RAM u32 app_wakeup_tik; // the set app wakeup, = 0 - none
+
+/* The single app wakeup callback of the SDK is shared by the measurement end
+ * and the peer scan window (scan.wake_tik): the earliest one is set,
+ * the callback runs all due ones and sets the next one */
+_attribute_ram_code_
+static void app_wakeup_cb(int par) {
+	u32 tik = app_wakeup_tik;
+	(void) par;
+	app_wakeup_tik = 0;
+	bls_pm_setAppWakeupLowPower(0, 0); // clear callback
+#if SENSOR_SLEEP_MEASURE
+	if (meas_wakeup_tik && (int)(meas_wakeup_tik - tik) <= 0)
+		WakeupLowPowerCb(0);
+#endif
+	if (scan.wake_tik && (int)(scan.wake_tik - tik) <= 0) {
+		scan.wake_tik = 0;
+		scan_window_open();
+	}
+	app_wakeup_set();
+}
+
+_attribute_ram_code_
+void app_wakeup_set(void) {
+	u32 tik = scan.wake_tik;
+#if SENSOR_SLEEP_MEASURE
+	if (meas_wakeup_tik && (!tik || (int)(meas_wakeup_tik - tik) < 0))
+		tik = meas_wakeup_tik;
+#endif
+	if (tik != app_wakeup_tik) {
+		app_wakeup_tik = tik;
+		if (tik) {
+			bls_pm_registerAppWakeupLowPowerCb(app_wakeup_cb);
+			bls_pm_setAppWakeupLowPower(tik, 1);
+		} else
+			bls_pm_setAppWakeupLowPower(0, 0); // clear callback
+	}
+}
+#endif // USE_SYNC_SCAN
+
 _attribute_ram_code_
 static void suspend_exit_cb(u8 e, u8 *p, int n) {
 	(void) e; (void) p; (void) n;
+#if USE_ENERGY_STAT
+	estat_wake(ESTAT_SUSPEND);
+#endif
 	rf_set_power_level_index(cfg.rf_tx_power);
 }
 
-#if !defined(SET_NO_SLEEP_MODE) && ( DEV_SERVICES & SERVICE_KEY) || (DEV_SERVICES & SERVICE_RDS)   || (USE_SENSOR_HX71X && SENSOR_HX71X_WAKEAP)
+#if !defined(SET_NO_SLEEP_MODE) && ( DEV_SERVICES & SERVICE_KEY) || (DEV_SERVICES & SERVICE_RDS)   || (USE_SENSOR_HX71X && SENSOR_HX71X_WAKEAP) || (!defined(SET_NO_SLEEP_MODE) && USE_ENERGY_STAT)
 _attribute_ram_code_
 static void suspend_enter_cb(u8 e, u8 *p, int n) {
 	(void) e; (void) p; (void) n;
+#if USE_ENERGY_STAT
+	estat_switch(ESTAT_SUSPEND); // suspend or deep-sleep retention, see estat_wake()
+#endif
 #if (DEV_SERVICES & SERVICE_RDS)
 	cpu_set_gpio_wakeup(GPIO_RDS1, BM_IS_SET(reg_gpio_in(GPIO_RDS1), GPIO_RDS1 & 0xff)? Level_Low : Level_High, trg.rds.type1 != RDS_NONE);  // pad wakeup deepsleep enable
 #ifdef GPIO_RDS2
@@ -643,9 +726,11 @@ static void suspend_enter_cb(u8 e, u8 *p, int n) {
 #if (DEV_SERVICES & SERVICE_KEY)
 	cpu_set_gpio_wakeup(GPIO_KEY2, BM_IS_SET(reg_gpio_in(GPIO_KEY2), GPIO_KEY2 & 0xff)? Level_Low : Level_High, 1);  // pad wakeup deepsleep enable
 #endif
+#if (DEV_SERVICES & SERVICE_KEY) || (DEV_SERVICES & SERVICE_RDS) || (USE_SENSOR_HX71X)
 	bls_pm_setWakeupSource(PM_WAKEUP_PAD | PM_WAKEUP_TIMER);  // gpio pad wakeup suspend/deepsleep
+#endif
 }
-#endif // (DEV_SERVICES & SERVICE_KEY) || (DEV_SERVICES & SERVICE_RDS)
+#endif // (DEV_SERVICES & SERVICE_KEY) || (DEV_SERVICES & SERVICE_RDS) || USE_ENERGY_STAT
 
 #if USE_AVERAGE_BATTERY
 //--- check battery
@@ -821,6 +906,9 @@ void user_init_normal(void) {//this will get executed one time after power up
 #if USE_SDM_OUT
 	init_dac();
 #endif
+#if USE_SENSOR_FILTER
+	init_filter();
+#endif
 #if (DEV_SERVICES & SERVICE_RDS)
 	rds_init();
 #endif
@@ -854,7 +942,7 @@ void user_init_normal(void) {//this will get executed one time after power up
 #endif
 	init_ble();
 	bls_app_registerEventCallback(BLT_EV_FLAG_SUSPEND_EXIT, &suspend_exit_cb);
-#if (DEV_SERVICES & SERVICE_KEY) || (DEV_SERVICES & SERVICE_RDS) || (USE_SENSOR_HX71X)
+#if (DEV_SERVICES & SERVICE_KEY) || (DEV_SERVICES & SERVICE_RDS) || (USE_SENSOR_HX71X) || USE_ENERGY_STAT
 #if !defined(SET_NO_SLEEP_MODE)
 	bls_app_registerEventCallback(BLT_EV_FLAG_SUSPEND_ENTER, &suspend_enter_cb);
 #endif
@@ -875,6 +963,9 @@ void user_init_normal(void) {//this will get executed one time after power up
 #endif
 #if	(DEV_SERVICES & SERVICE_HARD_CLOCK)
 	init_rtc();
+#endif
+#if (USE_EPD)
+	init_epd_cfg();
 #endif
 	init_lcd();
 	set_hw_version();
@@ -913,6 +1004,9 @@ void user_init_normal(void) {//this will get executed one time after power up
 //------------------ user_init_deepRetn -------------------
 _attribute_ram_code_
 void user_init_deepRetn(void) {//after sleep this will get executed
+#if USE_ENERGY_STAT
+	estat_wake(ESTAT_DEEP);
+#endif
 	blc_ll_initBasicMCU();
 	rf_set_power_level_index(cfg.rf_tx_power);
 	blc_ll_recoverDeepRetention();
@@ -923,6 +1017,32 @@ void user_init_deepRetn(void) {//after sleep this will get executed
 #endif
 }
 
+#if SENSOR_SLEEP_MEASURE && !(defined(GPIO_ADC1) || defined(GPIO_ADC2))
+/* End of the measurement start commands: the conversion runs, wakeup at its end */
+_attribute_ram_code_
+static void measure_started(int err) {
+	(void) err;
+	sensor_cfg.time_measure = clock_time() | 1;
+	if(cfg.flg.lp_measures == 0
+#if USE_SENSOR_SHTC3
+		|| sensor_cfg.sensor_type == TH_SENSOR_SHTC3
+#endif
+		) {
+		if(clock_time() - sensor_cfg.time_measure > sensor_cfg.measure_timeout - 3)
+			WakeupLowPowerCb(0);
+		else {
+#if USE_SYNC_SCAN
+			meas_wakeup_tik = (sensor_cfg.time_measure + sensor_cfg.measure_timeout) | 1;
+			app_wakeup_set(); // shared with the peer scan window
+#else
+			bls_pm_registerAppWakeupLowPowerCb(WakeupLowPowerCb);
+			bls_pm_setAppWakeupLowPower(sensor_cfg.time_measure + sensor_cfg.measure_timeout, 1);
+#endif
+		}
+	}
+}
+#endif
+
 //=========================================================
 //----------------------- main_loop() ---------------------
 _attribute_ram_code_
@@ -940,6 +1060,9 @@ void main_loop(void) {
 			}
 			SET_LCD_UPDATE();
 		}
+#endif
+#if USE_ENERGY_STAT
+		estat_fold();
 #endif
 	}
 #if SENSOR_SLEEP_MEASURE
@@ -1081,24 +1204,18 @@ void main_loop(void) {
 			check_battery();
 			WakeupLowPowerCb(0);
 #else
+			u8 estat_prev = estat_enter(ESTAT_SENSOR);
 			check_battery();
 			start_measure_sensor_deep_sleep();
-			sensor_cfg.time_measure = clock_time() | 1;
 #if (DEV_SERVICES & SERVICE_PRESSURE) && USE_SENSOR_HX71X
 			measured_data.pressure = hx71x_get_volume();
 #endif
-			if(cfg.flg.lp_measures == 0
-#if USE_SENSOR_SHTC3
-				|| sensor_cfg.sensor_type == TH_SENSOR_SHTC3
-#endif
-				) {
-				if(clock_time() - sensor_cfg.time_measure > sensor_cfg.measure_timeout - 3)
-					WakeupLowPowerCb(0);
-				else {
-					bls_pm_registerAppWakeupLowPowerCb(WakeupLowPowerCb);
-					bls_pm_setAppWakeupLowPower(sensor_cfg.time_measure + sensor_cfg.measure_timeout, 1);
-				}
-			}
+			estat_leave(estat_prev);
+#if USE_I2C_QUEUE
+			i2c_queue_start(measure_started); // the sensor wakeup delay returns to main_loop
+#else
+			measure_started(0);
+#endif
 #endif
 		} else
 #else // ! SENSOR_SLEEP_MEASURE
@@ -1107,6 +1224,7 @@ void main_loop(void) {
 #endif
 		if (wrk.start_measure) {
 			wrk.start_measure = 0;
+			u8 estat_prev = estat_enter(ESTAT_SENSOR);
 			check_battery();
 			read_sensors();
 #if (DEV_SERVICES & SERVICE_THS) && (!USE_SENSOR_SHTC3) && !USE_SENSOR_SCD41
@@ -1115,11 +1233,13 @@ void main_loop(void) {
 #if (DEV_SERVICES & SERVICE_PRESSURE)
 			measured_data.pressure = hx71x_get_volume();
 #endif
+			estat_leave(estat_prev);
 		} else
 #endif
 		{
 			if (wrk.ble_connected && blc_ll_getTxFifoNumber() < 9) {
 				// if wrk.ble_connected & TxFifo ready
+				u8 estat_prev = estat_enter(ESTAT_NOTIFY);
 				if (wrk.msc.b.send_measure) {
 					wrk.msc.b.send_measure = 0;
 					if (RxTxValueInCCC && wrk.tx_measures) {
@@ -1160,6 +1280,7 @@ void main_loop(void) {
 					}
 #endif
 				}
+				estat_leave(estat_prev);
 			}
 #if (DEV_SERVICES & SERVICE_HARD_CLOCK)
 			else if(rtc_sync_utime) {
@@ -1209,10 +1330,17 @@ void main_loop(void) {
 					if (!lcd_flg.b.ext_data_buf) { // LCD show external data ? No
 						lcd();
 					}
+					u8 estat_prev = estat_enter(ESTAT_LCD);
 					update_lcd();
+					estat_leave(estat_prev);
 				}
 			}
 #endif // #if (DEV_SERVICES & SERVICE_SCREEN)
+#if (DEV_SERVICES & SERVICE_HISTORY) && USE_MEMO_ERASE_AHEAD
+			if (!rd_memo.cnt) // not read history
+				memo_erase_task();
+#endif
+			flash_eep_task();
 #if USE_SYNC_SCAN
 			if (scan.cfg.interval
 			&& wrk.utc_time_sec - scan.start_time > scan.cfg.interval
@@ -1224,7 +1352,15 @@ void main_loop(void) {
 			}
 #endif
 		}
+		if (adv_buf.next_adv || (wrk.msc.b.update_adv && wrk.msc.b.th_sensor_read))
+			set_next_adv_data(); // adv. data for the next adv. event
+#if USE_CCM_PRECOMPUTE
+		else if (adv_buf.crypt_pre)
+			prepare_adv_crypt(); // key stream for the next measurement
+#endif
 #if USE_SYNC_SCAN
+		if(!scan.start_tik)
+			scan_schedule(); // peer scan windows
 		if(scan.start_tik) {
 			scan_task();
 		} else
@@ -1236,10 +1372,24 @@ void main_loop(void) {
 				SUSPEND_ADV | DEEPSLEEP_RETENTION_ADV | SUSPEND_CONN | DEEPSLEEP_RETENTION_CONN);
 #endif
 	}
+#if USE_I2C_QUEUE
+	if (i2c_queue_busy()) {
+		u8 estat_prev = estat_enter(ESTAT_SENSOR);
+		int busy = i2c_queue_poll();
+		estat_leave(estat_prev);
+		if (busy) {
+			bls_pm_setSuspendMask(SUSPEND_DISABLE);
+			return;
+		}
+	}
+#endif
 #if (DEV_SERVICES & SERVICE_SCREEN)
 #if (USE_EPD)
 	if (stage_lcd) {
-		if (task_lcd()) {
+		u8 estat_prev = estat_enter(ESTAT_LCD);
+		int busy = task_lcd();
+		estat_leave(estat_prev);
+		if (busy) {
 			if(!gpio_read(EPD_BUSY)) {
 				cpu_set_gpio_wakeup(EPD_BUSY, Level_High, 1);  // pad high wakeup deepsleep enable
 #if !((DEV_SERVICES & SERVICE_KEY) || (DEV_SERVICES & SERVICE_RDS) || (USE_SENSOR_HX71X))
@@ -121,7 +121,7 @@ typedef struct __attribute__((packed)) _cfg_t {
 
 	struct __attribute__((packed)) {
 		u8 adv_interval_delay	: 4; // 0..15,  in 0.625 ms, a pseudo-random value in the range from 0 to X ms is added to a fixed advInterval so that advertising events change over time.
-		u8 reserved				: 2;
+		u8 adv_adaptive			: 2; // 0 - off, 1..3: max adv. interval = advertising_interval << adv_adaptive, while the measured values do not change
 		u8 date_ddmm			: 1; // display mm:dd (MJWSD05MMC en)
 		u8 not_day_of_week		: 1; // do not display day of week (MJWSD05MMC)
 	} flg3;
@@ -308,6 +308,11 @@ typedef struct _work_flg_t {
 		} b; // bits-flags measurements completed
 	} msc; // flags measurements completed
 	u8 adv_interval_delay; // adv interval + rand delay in 0.625 ms // = 10 or 0
+#if USE_MEAS_ADAPTIVE
+	u8 meas_scale; // measurement step = measurement_step_time * meas_scale, 1..meas_scale_max
+	u8 meas_scale_max; // MEAS_ADAPT_MAX, no more than 250 sec
+	u8 meas_skip; // counter of skipped measurement steps
+#endif
 } work_flg_t;
 extern work_flg_t wrk;
 
@@ -350,6 +355,9 @@ static inline u8 get_key2_pressed(void) {
 void ev_adv_timeout(u8 e, u8 *p, int n); // DURATION_TIMEOUT Event Callback
 void test_config(void); // Test config values
 void set_hw_version(void);
+#if USE_SYNC_SCAN
+void app_wakeup_set(void); // app wakeup of the measurement end and the peer scan window
+#endif
 
 u8 * str_bin2hex(u8 *d, u8 *s, int len);
 
@@ -131,6 +131,9 @@ extern "C" {
 )
 
 #define USE_EPD			(600/50 - 1) // min update time x50 ms
+#ifndef USE_EPD_HW_SPI
+#define USE_EPD_HW_SPI	0 // = 1 EPD_SDA/EPD_SCL on SPI DO/CK (PB7/PD7), 8 data bits via SPI (host model only, not tested on the panel)
+#endif
 #define MI_HW_VER_FADDR 0x55000 // Mi HW version
 
 #define USE_SENSOR_CHT8305		0
@@ -351,6 +354,9 @@ extern "C" {
 )
 
 #define USE_EPD			(550/50 - 1) // min update time ms
+#ifndef USE_EPD_HW_SPI
+#define USE_EPD_HW_SPI	0 // = 1 EPD_SDA/EPD_SCL on SPI DO/CK (PB7/PD7), 8 data bits via SPI (host model only, not tested on the panel)
+#endif
 
 #define USE_SENSOR_CHT8305		0
 #define USE_SENSOR_CHT8215		0
@@ -2571,6 +2577,61 @@ extern "C" {
 #error "Only 1 sensor!"
 #endif
 
+#ifndef USE_CCM_PRECOMPUTE
+#if (DEV_SERVICES & SERVICE_BINDKEY)
+#define USE_CCM_PRECOMPUTE	1 // = 1 the key stream of the next encrypted beacon is calculated in idle time
+#else
+#define USE_CCM_PRECOMPUTE	0
+#endif
+#endif
+
+#ifndef USE_SENSOR_FILTER
+#if (DEV_SERVICES & (SERVICE_THS | SERVICE_PLM))
+#define USE_SENSOR_FILTER	1 // = 1 median/EMA/Kalman filters of the measured values (CMD_ID_FLT), default off
+#else
+#define USE_SENSOR_FILTER	0
+#endif
+#endif
+#if USE_SENSOR_FILTER && !(DEV_SERVICES & (SERVICE_THS | SERVICE_PLM))
+#undef USE_SENSOR_FILTER
+#define USE_SENSOR_FILTER	0
+#endif
+#ifndef USE_MEAS_ADAPTIVE
+#define USE_MEAS_ADAPTIVE	0 // = 1 the measurement step is extended while the measured values do not change
+#endif
+#if USE_MEAS_ADAPTIVE && (USE_SENSOR_SCD41 || !(DEV_SERVICES & (SERVICE_THS | SERVICE_18B20 | SERVICE_PLM)))
+#undef USE_MEAS_ADAPTIVE
+#define USE_MEAS_ADAPTIVE	0
+#endif
+#if USE_MEAS_ADAPTIVE
+#define MEAS_ADAPT_MAX		8	// max measurement step = measurement_step_time * 8 (no more than 250 sec)
+#define MEAS_ADAPT_TEMP		10	// x0.01 C, change per measurement step: <= -> step x2, > x2 -> step x1
+#define MEAS_ADAPT_HUMI		50	// x0.01 %
+#endif
+#ifndef USE_ADV_ADAPTIVE
+#if (DEV_SERVICES & (SERVICE_THS | SERVICE_18B20 | SERVICE_PLM)) && !USE_SENSOR_SCD41
+#define USE_ADV_ADAPTIVE	1 // change-driven adv. interval (cfg.flg3.adv_adaptive)
+#else
+#define USE_ADV_ADAPTIVE	0
+#endif
+#endif
+#if USE_ADV_ADAPTIVE
+#define ADV_ADAPT_TEMP		20	// deadband temperature, x0.01 C
+#define ADV_ADAPT_HUMI		100	// deadband humidity, x0.01 %
+#define ADV_ADAPT_BAT		2	// deadband battery level, %
+#define ADV_ADAPT_STEPS		4	// measurements without changes -> adv. interval x2
+#endif
+#ifndef USE_ENERGY_STAT
+#define USE_ENERGY_STAT		1 // = 1 per-subsystem active and sleep time counters (CMD_ID_ESTAT)
+#endif
+#ifndef USE_BTHOME_ESTAT
+#define USE_BTHOME_ESTAT	0 // = 1 BTHome: active time, ms (count32 object in the second packet)
+#endif
+#if USE_BTHOME_ESTAT && !(USE_ENERGY_STAT && USE_BTHOME_BEACON)
+#undef USE_BTHOME_ESTAT
+#define USE_BTHOME_ESTAT	0
+#endif
+
 
 /* Special DIY version - Voltage Logger:
  * Temperature 0..36.00 = ADC pin PB7 input 0..3.6V, LYWSD03MMC pcb mark "B1"
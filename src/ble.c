@@ -186,9 +186,123 @@ int otaWritePre(void * p) {
 	return otaWrite(p);
 }
 
+#if USE_ADV_ADAPTIVE
+RAM struct {
+	s16 temp;		// x0.01 C
+	s16 humi;		// x0.01 %
+	u8 battery_level;	// %
+} adv_ref; // measured values at the last change of the adv. interval
+
+static int adv_delta(int a, int b, int deadband) {
+	a -= b;
+	return (a > deadband || a < -deadband);
+}
+
+/* Change-driven adv. interval: called from main_loop after a new measurement.
+ * Measured values in the deadband ADV_ADAPT_STEPS times -> adv. interval x2,
+ * up to (cfg.advertising_interval << cfg.flg3.adv_adaptive),
+ * no more than cfg.measure_interval and 10 sec.
+ * Values out of the deadband -> restore adv. interval. */
+__attribute__((optimize("-Os")))
+void adv_adaptive_interval(void) {
+	u32 adv_int = cfg.advertising_interval * 100;
+	u8 scale = adv_buf.scale;
+#if (DEV_SERVICES & (SERVICE_THS | SERVICE_PLM))
+	s16 temp = measured_data.temp;
+	s16 humi = measured_data.humi;
+#else // SERVICE_18B20
+	s16 temp = measured_data.xtemp[0];
+#if (USE_SENSOR_MY18B20 == 2)
+	s16 humi = measured_data.xtemp[1];
+#else
+	s16 humi = 0;
+#endif
+#endif
+	if (wrk.ble_connected
+		|| wrk.adv_interval != adv_int * scale) { // connectable adv. interval (key, rds)
+		adv_buf.flat_count = 0;
+		return;
+	}
+	if (adv_delta(temp, adv_ref.temp, ADV_ADAPT_TEMP)
+		|| adv_delta(humi, adv_ref.humi, ADV_ADAPT_HUMI)
+		|| adv_delta(measured_data.battery_level, adv_ref.battery_level, ADV_ADAPT_BAT)) {
+		adv_ref.temp = temp;
+		adv_ref.humi = humi;
+		adv_ref.battery_level = measured_data.battery_level;
+		adv_buf.flat_count = 0;
+		if (scale == 1)
+			return;
+		scale = 1;
+	} else if (++adv_buf.flat_count >= ADV_ADAPT_STEPS) {
+		adv_buf.flat_count = 0;
+		scale <<= 1;
+		if (scale > (1 << cfg.flg3.adv_adaptive)
+			|| scale > cfg.measure_interval
+			|| adv_int * scale > 16000) // max 10 sec
+			return;
+	} else
+		return;
+	adv_buf.scale = scale;
+	wrk.adv_interval = adv_int * scale;
+#if (DEV_SERVICES & SERVICE_LE_LR)
+	if (adv_buf.ext_adv_init != EXT_ADV_Off) {
+		ll_ext_adv_t *pea = (ll_ext_adv_t *)&app_adv_set_param;
+		pea->advInt_use = wrk.adv_interval; // next ext.adv. interval
+	} else
+#endif
+		bls_ll_setAdvInterval(wrk.adv_interval, wrk.adv_interval + wrk.adv_interval_delay);
+}
+#endif // USE_ADV_ADAPTIVE
+
+/* Advertising data for the next adv. event: called right after a new
+ * measurement and from main_loop after an adv. event (adv_buf.next_adv).
+ * Data assembly and encryption go into the shadow packet adv_buf.img[],
+ * the adv. prepare callback only swaps it in (not in the RAM code) */
+__attribute__((optimize("-Os")))
+void set_next_adv_data(void) {
+	u8 next_adv = adv_buf.next_adv;
+	adv_buf.next_adv = 0;
+	if(wrk.msc.b.th_sensor_read) { // th sensor work
+		if (wrk.msc.b.update_adv) {
+			// new measured_data
+			wrk.msc.b.update_adv = 0;
+#if USE_ADV_ADAPTIVE
+			adv_adaptive_interval(); // stretch or restore adv. interval
+#endif
+#if USE_SENSOR_INA3221 || USE_SENSOR_SCD41 || USE_SENSOR_INA226
+			adv_buf.send_count++; // count & id advertise, = beacon_nonce.cnt32
+		}
+		set_adv_data();
+#else
+			adv_buf.call_count = 1; // count 1..cfg.measure_interval
+			adv_buf.send_count++; // count & id advertise, = beacon_nonce.cnt32
+			adv_buf.update_count = 0; // refresh adv_buf.data in next set_adv_data()
+			set_adv_data();
+		} else if (next_adv) {
+#if (DEV_SERVICES & SERVICE_RDS)
+			if (!adv_buf.data_size) // flag adv_buf.send_count++ over adv.event
+				adv_buf.send_count++; // count & id advertise, = beacon_nonce.cnt32
+#endif
+			// ++adv_buf.call_count increase the counter of data iteration in advertising
+			// adv_buf.update_count == 0xff -> next call only at next measurement
+			// adv_buf.update_count == 0 -> refresh adv_buf.data in next set_adv_data()
+			if (++adv_buf.call_count > adv_buf.update_count) // refresh adv_buf.data ?
+				set_adv_data();
+		}
+#endif
+	} else { // th sensor bad
+		adv_buf.data_size = 0;
+		load_adv_data();
+	}
+}
+
 _attribute_ram_code_
 int app_advertise_prepare_handler(rf_packet_adv_t * p)	{
-	(void) p;
+	adv_img_t *pimg = adv_buf.img_next;
+	if (p && pimg) { // legacy adv.: the packet built in main_loop
+		adv_buf.img_next = NULL;
+		bls_ll_setAdvData(pimg->data, pimg->size);
+	}
 #if (DEV_SERVICES & SERVICE_RDS)
 	if (!blta.adv_duraton_en)
 #endif
@@ -200,40 +314,25 @@ int app_advertise_prepare_handler(rf_packet_adv_t * p)	{
 		wrk.start_measure = 1;
 #else
 		// counter of advertising broadcasts until the start of the next measurement
+#if USE_ADV_ADAPTIVE
+		adv_buf.meas_count += adv_buf.scale; // the measurement step does not depend on the adv. interval
+		if(adv_buf.meas_count >= cfg.measure_interval) {
+			adv_buf.meas_count -= cfg.measure_interval;
+#else
 		if(++adv_buf.meas_count >= cfg.measure_interval) {
 			adv_buf.meas_count = 0;
-			wrk.start_measure = 1;
-		}
 #endif
-		if(wrk.msc.b.th_sensor_read) { // th sensor work
-			if (wrk.msc.b.update_adv) {
-				// new measured_data
-				wrk.msc.b.update_adv = 0;
-#if USE_SENSOR_INA3221 || USE_SENSOR_SCD41 || USE_SENSOR_INA226
-				adv_buf.send_count++; // count & id advertise, = beacon_nonce.cnt32
+#if USE_MEAS_ADAPTIVE
+			if(++wrk.meas_skip >= wrk.meas_scale) {
+				wrk.meas_skip = 0;
+				wrk.start_measure = 1;
 			}
-			set_adv_data();
 #else
-				adv_buf.call_count = 1; // count 1..cfg.measure_interval
-				adv_buf.send_count++; // count & id advertise, = beacon_nonce.cnt32
-				adv_buf.update_count = 0; // refresh adv_buf.data in next set_adv_data()
-				set_adv_data();
-			} else {
-#if (DEV_SERVICES & SERVICE_RDS)
-				if (!adv_buf.data_size) // flag adv_buf.send_count++ over adv.event
-					adv_buf.send_count++; // count & id advertise, = beacon_nonce.cnt32
-#endif
-				// ++adv_buf.call_count increase the counter of data iteration in advertising
-				// adv_buf.update_count == 0xff -> next call only at next measurement
-				// adv_buf.update_count == 0 -> refresh adv_buf.data in next set_adv_data()
-				if (++adv_buf.call_count > adv_buf.update_count) // refresh adv_buf.data ?
-					set_adv_data();
-			}
+			wrk.start_measure = 1;
 #endif
-		} else { // th sensor bad
-			adv_buf.data_size = 0;
-			load_adv_data();
 		}
+#endif
+		adv_buf.next_adv = 1; // build adv. data for the next adv. event in main_loop
 #if (DEV_SERVICES & SERVICE_KEY) || (DEV_SERVICES & SERVICE_RDS)
 		if(ext_key.rest_adv_int_tad) {
 			ext_key.rest_adv_int_tad--;
@@ -390,6 +489,9 @@ void set_adv_con_time(int restore) {
 		ext_key.rest_adv_int_tad = 0; // stop timer event restore adv.intervals
 	} else {
 		wrk.adv_interval = CONNECTABLE_ADV_INERVAL; // new adv.intervals = 1 sec
+#if USE_ADV_ADAPTIVE
+		adv_buf.scale = 1;
+#endif
 		ext_key.rest_adv_int_tad = -1; // start timer event restore adv.intervals
 	}
 	if(!wrk.ble_connected) {
@@ -589,7 +691,14 @@ void load_adv_data(void) {
 		blc_ll_setExtAdvData(ADV_HANDLE0, DATA_OPER_COMPLETE, DATA_FRAGM_ALLOWED, size, p);
 	else
 #endif
-	bls_ll_setAdvData(p, size);
+	if (size <= ADV_IMG_SIZE) {
+		// shadow packet: app_advertise_prepare_handler() loads it at the next adv. event
+		adv_img_t *pimg = &adv_buf.img[adv_buf.img_back];
+		memcpy(pimg->data, p, size);
+		pimg->size = size;
+		adv_buf.img_next = pimg;
+		adv_buf.img_back ^= 1;
+	}
 }
 
 __attribute__((optimize("-Os"))) void init_ble(void) {
@@ -762,6 +871,9 @@ void set_adv_data(void) {
 #else
 		bthome_encrypt_data_beacon();
 #endif // (USE_CUSTOM_BEACON + USE_BTHOME_BEACON + USE_MIHOME_BEACON + USE_ATC_BEACON) > 1
+#if USE_CCM_PRECOMPUTE
+		adv_buf.crypt_pre = 1;
+#endif
 	} else
 #endif // #if (DEV_SERVICES & SERVICE_BINDKEY)
 	{
@@ -795,6 +907,43 @@ void set_adv_data(void) {
 	load_adv_data();
 }
 
+#if USE_CCM_PRECOMPUTE
+/* Key stream of the encrypted beacon for the next measurement,
+ * called from main_loop in idle time */
+__attribute__((optimize("-Os")))
+void prepare_adv_crypt(void) {
+	adv_buf.crypt_pre = 0;
+	if (!cfg.flg2.adv_crypto)
+		return;
+#if (USE_CUSTOM_BEACON + USE_BTHOME_BEACON + USE_MIHOME_BEACON + USE_ATC_BEACON) > 1
+	u8 adv_type = cfg.flg.advertising_type;
+#if USE_CUSTOM_BEACON
+	if (adv_type == ADV_TYPE_PVVX) {
+		pvvx_encrypt_prepare();
+	} else
+#endif
+#if USE_BTHOME_BEACON
+	if (adv_type == ADV_TYPE_BTHOME) {
+		bthome_encrypt_prepare();
+	} else
+#endif
+#if USE_MIHOME_BEACON
+	if (adv_type == ADV_TYPE_MI) {
+		mi_encrypt_prepare();
+	} else
+#endif
+#if USE_ATC_BEACON
+	if (adv_type == ADV_TYPE_ATC) {
+		atc_encrypt_prepare();
+	} else
+#endif
+	{}
+#else
+	bthome_encrypt_prepare();
+#endif
+}
+#endif // USE_CCM_PRECOMPUTE
+
 void ble_send_measures(void) {
 	int len = MEASURED_MSG_SIZE + 1;
 	send_buf[0] = CMD_ID_MEASURE;
@@ -874,8 +1023,46 @@ void ble_send_trg_flg(void) {
 #endif
 
 #if (DEV_SERVICES & SERVICE_HISTORY)
+/* CMD_ID_LOGBLK: [cmd][number of first record (u16)][memo_blk_t x n], n = (MTU - 3 - 3) / sizeof(memo_blk_t)
+ * end: [cmd][0][0] */
+__attribute__((optimize("-Os")))
+static void send_memo_bulk(void) {
+	u8 buf[3 + MEMO_BULK_RECS_MAX * sizeof(memo_blk_t)];
+	pmemo_blk_t p = (pmemo_blk_t)&buf[3];
+	u32 max = (blc_att_getEffectiveMtuSize(BLS_CONN_HANDLE) - 3 - 3) / sizeof(memo_blk_t);
+	u32 i = 0;
+	if (max > MEMO_BULK_RECS_MAX)
+		max = MEMO_BULK_RECS_MAX;
+	buf[0] = CMD_ID_LOGBLK;
+	buf[1] = rd_memo.cur + 1;
+	buf[2] = (rd_memo.cur + 1) >> 8;
+	while (i < max && rd_memo.cur < rd_memo.cnt) {
+		if (!get_memo(rd_memo.cur + 1, p))
+			break;
+		rd_memo.cur++;
+		p++;
+		i++;
+	}
+	if (i) {
+		bls_att_pushNotifyData(RxTx_CMD_OUT_DP_H, buf, 3 + i * sizeof(memo_blk_t));
+		if (rd_memo.cur < rd_memo.cnt && i == max)
+			return;
+		rd_memo.cur = rd_memo.cnt; // next call: end
+		return;
+	}
+	buf[1] = 0;
+	buf[2] = 0;
+	bls_att_pushNotifyData(RxTx_CMD_OUT_DP_H, buf, 3);
+	bls_pm_setManualLatency(cfg.connect_latency);
+	rd_memo.cnt = 0;
+}
+
 __attribute__((optimize("-Os")))
 void send_memo_blk(void) {
+	if (rd_memo.bulk) {
+		send_memo_bulk();
+		return;
+	}
 	send_buf[0] = CMD_ID_LOGGER;
 	if (++rd_memo.cur > rd_memo.cnt || (!get_memo(rd_memo.cur, (pmemo_blk_t)&send_buf[3]))) {
 		send_buf[1] = 0;
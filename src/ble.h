@@ -23,17 +23,36 @@ enum {
 #else
 #define ADV_BUFFER_SIZE		(31-3)
 #endif
+
+#define ADV_IMG_SIZE		31 // legacy adv. data
+
+typedef struct _adv_img_t {
+	u8 size;
+	u8 data[ADV_IMG_SIZE];	// flags, adv. data, name
+} adv_img_t;
+
 typedef struct _adv_buf_t {
 	u32 send_count; // count & id advertise, = beacon_nonce.cnt32
 	u8 meas_count; // counter of advertising broadcasts until the start of the next measurement (0..cfg.measure_interval)
 	u8 call_count; 	// = 0..cfg.measure_interval, counter of data iteration in advertising
 	u8 update_count;	// flag: = 0 -> refresh adv_buf.data in next set_adv_data(), = 0xff -> next call set_adv_data() only at next measurement
+	u8 next_adv;		// flag: = 1 -> adv. event done, main_loop: set_next_adv_data()
+#if USE_CCM_PRECOMPUTE
+	u8 crypt_pre;		// flag: = 1 -> encrypted adv. data sent, main_loop: prepare_adv_crypt()
+#endif
+#if USE_ADV_ADAPTIVE
+	u8 scale;			// adv. interval = cfg.advertising_interval * 100 * scale, 1..cfg.measure_interval
+	u8 flat_count;		// count of measurements without changes
+#endif
 #if (DEV_SERVICES & SERVICE_LE_LR) // support extension advertise
 	u8 ext_adv_init; 	// flag ext_adv init
 #endif
 	u8 data_size;		// Advertise data size
 	u8 flag[3];		// Advertise type flags
 	u8 data[ADV_BUFFER_SIZE];
+	adv_img_t img[2];	// legacy adv. packets, built in main_loop
+	adv_img_t * img_next;	// next packet for the adv. prepare callback, = NULL -> loaded
+	u8 img_back;		// index of img[] for the next build
 }adv_buf_t;
 extern adv_buf_t adv_buf;
 
@@ -178,6 +197,13 @@ typedef enum
 
 void app_enter_ota_mode(void);
 void set_adv_data(void);
+void set_next_adv_data(void);
+#if USE_CCM_PRECOMPUTE
+void prepare_adv_crypt(void);
+#endif
+#if USE_ADV_ADAPTIVE
+void adv_adaptive_interval(void);
+#endif
 
 void my_att_init();
 void init_ble();
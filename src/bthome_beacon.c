@@ -23,6 +23,9 @@
 #endif
 #include "bthome_beacon.h"
 #include "ccm.h"
+#if USE_BTHOME_ESTAT
+#include "estat.h"
+#endif
 
 _attribute_ram_code_ __attribute__((optimize("-Os")))
 static u32 set_bthome_data1(padv_bthome_data1_t p) {
@@ -128,6 +131,10 @@ static u32 set_bthome_data2(padv_bthome_data2_t p) {
 		p->u_aqi = BtHomeID_count8;
 		p->aqi = ens160.aqi;
 
+#endif
+#if USE_BTHOME_ESTAT
+		p->a_id = BtHomeID_count32;
+		p->active_ms = estat_active_ms();
 #endif
 		return sizeof(adv_bthome_data2_t);
 }
@@ -199,6 +206,20 @@ void bthome_encrypt_data_beacon(void) {
 	}
 }
 
+#if USE_CCM_PRECOMPUTE
+/* Key stream for the next measurement: nonce count = adv_buf.send_count + 1, data1 */
+__attribute__((optimize("-Os")))
+void bthome_encrypt_prepare(void) {
+	bthome_beacon_nonce_t nonce;
+	memcpy(&nonce, &bthome_nonce, sizeof(nonce));
+	nonce.cnt32 = adv_buf.send_count + 1;
+	ccm_precompute((const unsigned char *)&bindkey,
+					   (u8*)&nonce, sizeof(nonce),
+					   NULL, 0,
+					   sizeof(adv_bthome_data1_t), 4);
+}
+#endif
+
 #endif // #if (DEV_SERVICES & SERVICE_BINDKEY)
 
 _attribute_ram_code_ __attribute__((optimize("-Os")))
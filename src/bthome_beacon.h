@@ -237,6 +237,10 @@ typedef struct __attribute__((packed)) _adv_bthome_data2_t {
 	u8 u_vld;	// BtHomeID_heat 0x1d
 	u8 vaidity;
 #endif
+#if USE_BTHOME_ESTAT
+	u8	a_id;	// = BtHomeID_count32 0x3e
+	u32	active_ms; // active time, ms
+#endif
 #if (DEV_SERVICES & SERVICE_IUS)
 #if USE_SENSOR_INA3221
 	u8	i_id0; 	// BtHomeID_current_i16
@@ -332,6 +336,9 @@ typedef struct __attribute__((packed)) _adv_bthome_ev1_t {
 
 void bthome_beacon_init(void);
 void bthome_encrypt_data_beacon(void);
+#if USE_CCM_PRECOMPUTE
+void bthome_encrypt_prepare(void);
+#endif
 #if (DEV_SERVICES & SERVICE_RDS)
 void bthome_encrypt_event_beacon(u8 n); // n = RDS_TYPES
 #endif
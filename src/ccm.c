@@ -31,67 +31,75 @@
 #include "tl_common.h"
 #if (DEV_SERVICES & SERVICE_BINDKEY)
 #include "ccm.h"
+#include "drivers.h"
 #include "drivers/8258/aes.h"
 #include "stack/ble/crypt/aes/aes_att.h"
+#include "estat.h"
 
+#if USE_AES_REGS
 /*
- * Macros for common operations.
- * Results in smaller compiled code than static inline functions.
+ * The key is loaded into the AES engine once per packet, then each
+ * block only feeds and reads four words. Interrupts are disabled for
+ * the packet so that the stack does not reload the engine in between.
  */
+static void aes_set_key(const unsigned char *key)
+{
+    unsigned char i;
+    for (i = 0; i < 16; i++)
+        reg_aes_key(i) = key[i];
+}
 
-/*
- * Update the CBC-MAC state in y using a block in b
- * (Always using b as the source helps the compiler optimise a bit better.)
- */
-#define UPDATE_CBC_MAC          \
-    for (i = 0; i < 16; i++)  	\
-        y[i] ^= b[i];           \
-    aes_encrypt((u8*)key, y, y);
+/* Encrypt one block with the loaded key, in and out are word aligned */
+_attribute_ram_code_
+static void aes_encrypt_block(const u32 *in, u32 *out)
+{
+    reg_aes_ctrl &= (~FLD_AES_CTRL_CODEC_TRIG);
+    while (reg_aes_ctrl & FLD_AES_CTRL_DATA_FEED)
+        reg_aes_data = *in++;
+    while ((reg_aes_ctrl & FLD_AES_CTRL_CODEC_FINISHED) == 0);
+    out[0] = reg_aes_data;
+    out[1] = reg_aes_data;
+    out[2] = reg_aes_data;
+    out[3] = reg_aes_data;
+}
+#else
+/* Through the SDK aes_encrypt() (host build: software AES) */
+static unsigned char *aes_key;
+
+static void aes_set_key(const unsigned char *key)
+{
+    aes_key = (unsigned char *)key;
+}
+
+static void aes_encrypt_block(const u32 *in, u32 *out)
+{
+    aes_encrypt(aes_key, (unsigned char *)in, (unsigned char *)out);
+}
+#endif // USE_AES_REGS
 
 /*
- * Encrypt or decrypt a partial block with CTR
- * Warning: using b for temporary storage! src and dst must not be b!
- * This avoids allocating one more 16 bytes buffer while allowing src == dst.
+ * Update the CBC-MAC state in y with a partial block, the zero padding
+ * of the block leaves y unchanged.
  */
-#define CTR_CRYPT(dst, src, len)	\
-    aes_encrypt((u8*) key, ctr, b);	\
-    for (i = 0; i < len; i++)		\
-        dst[i] = src[i] ^ b[i];
+#define UPDATE_CBC_MAC(src, len)    \
+    for (i = 0; i < len; i++)       \
+        py[i] ^= src[i];            \
+    aes_encrypt_block(y, y);
 
 /*
- * Authenticated encryption or decryption
+ * Start CBC-MAC in y with B_0 and the additional data,
+ * the key is already loaded
  */
-int ccm_auth_crypt( int mode, const unsigned char *key,
-                           const unsigned char *iv, size_t iv_len,
+static int ccm_mac_start( u32 *y, const unsigned char *iv, size_t iv_len,
                            const unsigned char *add, size_t add_len,
-                           const unsigned char *input, size_t length,
-                           unsigned char *output,
-                           unsigned char *tag, size_t tag_len )
+                           size_t length, size_t tag_len )
 {
     unsigned char i;
     unsigned char q;
     size_t len_left;
-    unsigned char b[16];
-    unsigned char y[16];
-    unsigned char ctr[16];
+    unsigned char *py = (unsigned char *)y;
     const unsigned char *src;
-    unsigned char *dst;
-#if 0
-    /*
-     * Check length requirements: SP800-38C A.1
-     * Additional requirement: a < 2^16 - 2^8 to simplify the code.
-     * 'length' checked later (when writing it to the first block)
-     */
-    if (tag_len < 4 || tag_len > 16 || tag_len % 2 != 0)
-		return (-1);
-
-	/* Also implies q is within bounds */
-	if (iv_len < 7 || iv_len > 13)
-		return (-1);
 
-	if (add_len > 0xFF00)
-		return (-1);
-#endif
     q = 16 - 1 - (unsigned char) iv_len;
     /*
      * First block B_0:
@@ -105,18 +113,17 @@ int ccm_auth_crypt( int mode, const unsigned char *key,
      * 5 .. 3   (t - 2) / 2
      * 2 .. 0   q - 1
      */
-    b[0] = 0;
-	b[0] |= (add_len > 0) << 6;
-	b[0] |= ((tag_len - 2) / 2) << 3;
-	b[0] |= q - 1;
-	memcpy(b + 1, iv, iv_len);
+    py[0] = 0;
+	py[0] |= (add_len > 0) << 6;
+	py[0] |= ((tag_len - 2) / 2) << 3;
+	py[0] |= q - 1;
+	memcpy(py + 1, iv, iv_len);
 	for (i = 0, len_left = length; i < q; i++, len_left >>= 8)
-		b[15 - i] = (unsigned char) (len_left & 0xFF);
+		py[15 - i] = (unsigned char) (len_left & 0xFF);
 	if (len_left > 0)
 		return (-1);
 	/* Start CBC-MAC with first block */
-	memset(y, 0, 16);
-	UPDATE_CBC_MAC;
+    aes_encrypt_block(y, y);
     /*
      * If there is additional data, update CBC-MAC with
      * add_len, add, 0 (padding to a block boundary)
@@ -125,37 +132,228 @@ int ccm_auth_crypt( int mode, const unsigned char *key,
 		size_t use_len;
 		len_left = add_len;
 		src = add;
-		memset(b, 0, 16);
-		b[0] = (unsigned char) ((add_len >> 8) & 0xFF);
-		b[1] = (unsigned char) ((add_len) & 0xFF);
+		py[0] ^= (unsigned char) ((add_len >> 8) & 0xFF);
+		py[1] ^= (unsigned char) ((add_len) & 0xFF);
 		use_len = len_left < 16 - 2 ? len_left : 16 - 2;
-		memcpy(b + 2, src, use_len);
+		for (i = 0; i < use_len; i++)
+			py[i + 2] ^= src[i];
+		aes_encrypt_block(y, y);
 		len_left -= use_len;
 		src += use_len;
-		UPDATE_CBC_MAC;
 		while (len_left > 0) {
 			use_len = len_left > 16 ? 16 : len_left;
-			memset(b, 0, 16);
-			memcpy(b, src, use_len);
-			UPDATE_CBC_MAC;
+			UPDATE_CBC_MAC(src, use_len);
 			len_left -= use_len;
 			src += use_len;
 		}
     }
+    return (0);
+}
+
+/*
+ * Prepare counter block A_0:
+ * 0        .. 0        flags
+ * 1        .. iv_len   nonce (aka iv)
+ * iv_len+1 .. 15       counter (0)
+ *
+ * With flags as (bits):
+ * 7 .. 3   0
+ * 2 .. 0   q - 1
+ */
+static void ccm_ctr_start(u32 *ctr, const unsigned char *iv, size_t iv_len)
+{
+    unsigned char *pctr = (unsigned char *)ctr;
+    pctr[0] = 16 - 2 - (unsigned char) iv_len;
+    memcpy( pctr + 1, iv, iv_len );
+    memset( pctr + 1 + iv_len, 0, 16 - 1 - iv_len );
+}
+
+#if USE_CCM_PRECOMPUTE
+/*
+ * Key stream and CBC-MAC prefix of the next encrypted beacon,
+ * calculated in idle time by ccm_precompute().
+ * The key stream depends only on the key and the nonce, the CBC-MAC
+ * prefix also on the additional data and the message length.
+ */
+#define CCM_PRE_BLOCKS  2   // encrypted beacon payloads are up to 32 bytes
+
+typedef struct _ccm_pre_t {
+    u8  s[CCM_PRE_BLOCKS + 1][16]; // S_0 (tag mask), S_1.. (CTR key stream)
+    u8  y[16];          // CBC-MAC after B_0 and the additional data
+    u8  key[16];
+    u8  iv[13];
+    u8  add[14];
+    u8  iv_len;         // 0 - not ready
+    u8  add_len;
+    u8  length;
+    u8  tag_len;
+} ccm_pre_t;
+
+RAM ccm_pre_t ccm_pre __attribute__((aligned(4))); // s[], y[] are word aligned
+
+/* Does the key stream in ccm_pre match the key and nonce? */
+static int ccm_pre_nonce(const unsigned char *key,
+                           const unsigned char *iv, size_t iv_len)
+{
+    return (ccm_pre.iv_len == iv_len
+        && memcmp(ccm_pre.iv, iv, iv_len) == 0
+        && memcmp(ccm_pre.key, key, sizeof(ccm_pre.key)) == 0);
+}
+
+/* Does the CBC-MAC prefix in ccm_pre match the packet? */
+static int ccm_pre_mac(const unsigned char *add, size_t add_len,
+                           size_t length, size_t tag_len)
+{
+    return (ccm_pre.length == length
+        && ccm_pre.tag_len == tag_len
+        && ccm_pre.add_len == add_len
+        && memcmp(ccm_pre.add, add, add_len) == 0);
+}
+
+/*
+ * Precompute the key stream and the CBC-MAC prefix for the nonce
+ * of the next encrypted packet
+ */
+void ccm_precompute( const unsigned char *key,
+                           const unsigned char *iv, size_t iv_len,
+                           const unsigned char *add, size_t add_len,
+                           size_t length, size_t tag_len )
+{
+    unsigned char i;
+    unsigned char r;
+    u32 ctr[4];
+
+    if (iv_len > sizeof(ccm_pre.iv)
+        || add_len > sizeof(ccm_pre.add)
+        || length > CCM_PRE_BLOCKS * 16)
+        return;
+    if (ccm_pre_nonce(key, iv, iv_len)
+        && ccm_pre_mac(add, add_len, length, tag_len))
+        return; // already done
+    u8 estat_prev = estat_enter(ESTAT_AES);
+    ccm_pre.iv_len = 0;
+    ccm_ctr_start(ctr, iv, iv_len);
+    r = irq_disable();
+    aes_set_key(key);
+    for (i = 0; i <= CCM_PRE_BLOCKS; i++) {
+        aes_encrypt_block(ctr, (u32 *)ccm_pre.s[i]);
+        ((unsigned char *)ctr)[15]++;
+    }
+    ccm_mac_start((u32 *)ccm_pre.y, iv, iv_len, add, add_len, length, tag_len);
+    irq_restore(r);
+    memcpy(ccm_pre.key, key, sizeof(ccm_pre.key));
+    memcpy(ccm_pre.iv, iv, iv_len);
+    memcpy(ccm_pre.add, add, add_len);
+    ccm_pre.add_len = add_len;
+    ccm_pre.length = length;
+    ccm_pre.tag_len = tag_len;
+    ccm_pre.iv_len = iv_len;
+    estat_leave(estat_prev);
+}
+
+/*
+ * Encryption with the precomputed key stream: XOR plus the CBC-MAC
+ * of the message blocks. B_0 is recalculated if the length differs.
+ */
+static int ccm_encrypt_pre( const unsigned char *key,
+                           const unsigned char *iv, size_t iv_len,
+                           const unsigned char *add, size_t add_len,
+                           const unsigned char *input, size_t length,
+                           unsigned char *output,
+                           unsigned char *tag, size_t tag_len )
+{
+    unsigned char i;
+    unsigned char n;
+    unsigned char r;
+    size_t len_left;
+    u32 y[4];
+    unsigned char *py = (unsigned char *)y;
+    unsigned char *pb;
+    int ret = 0;
+
+    u8 estat_prev = estat_enter(ESTAT_AES);
+    r = irq_disable();
+    aes_set_key(key);
+    if (ccm_pre_mac(add, add_len, length, tag_len))
+        memcpy(y, ccm_pre.y, sizeof(y));
+    else
+        ret = ccm_mac_start(y, iv, iv_len, add, add_len, length, tag_len);
+    for (n = 1, len_left = length; ret == 0 && len_left > 0; n++) {
+        size_t use_len = len_left > 16 ? 16 : len_left;
+        UPDATE_CBC_MAC(input, use_len);
+        pb = ccm_pre.s[n];
+        for (i = 0; i < use_len; i++)
+            output[i] = input[i] ^ pb[i];
+        output += use_len;
+        input += use_len;
+        len_left -= use_len;
+    }
+    irq_restore(r);
+    pb = ccm_pre.s[0];
+    for (i = 0; i < tag_len; i++)
+        tag[i] = py[i] ^ pb[i];
+    estat_leave(estat_prev);
+    return (ret);
+}
+#endif // USE_CCM_PRECOMPUTE
+
+/*
+ * Authenticated encryption or decryption
+ */
+int ccm_auth_crypt( int mode, const unsigned char *key,
+                           const unsigned char *iv, size_t iv_len,
+                           const unsigned char *add, size_t add_len,
+                           const unsigned char *input, size_t length,
+                           unsigned char *output,
+                           unsigned char *tag, size_t tag_len )
+{
+    unsigned char i;
+    unsigned char q;
+    unsigned char r;
+    size_t len_left;
+    u32 b[4];   // CTR key stream
+    u32 y[4];   // CBC-MAC
+    u32 ctr[4];
+    unsigned char *pb = (unsigned char *)b;
+    unsigned char *py = (unsigned char *)y;
+    unsigned char *pctr = (unsigned char *)ctr;
+    const unsigned char *src;
+    unsigned char *dst;
+#if 0
     /*
-     * Prepare counter block for encryption:
-     * 0        .. 0        flags
-     * 1        .. iv_len   nonce (aka iv)
-     * iv_len+1 .. 15       counter (initially 1)
-     *
-     * With flags as (bits):
-     * 7 .. 3   0
-     * 2 .. 0   q - 1
+     * Check length requirements: SP800-38C A.1
+     * Additional requirement: a < 2^16 - 2^8 to simplify the code.
+     * 'length' checked later (when writing it to the first block)
      */
-    ctr[0] = q - 1;
-    memcpy( ctr + 1, iv, iv_len );
-    memset( ctr + 1 + iv_len, 0, q );
-    ctr[15] = 1;
+    if (tag_len < 4 || tag_len > 16 || tag_len % 2 != 0)
+		return (-1);
+
+	/* Also implies q is within bounds */
+	if (iv_len < 7 || iv_len > 13)
+		return (-1);
+
+	if (add_len > 0xFF00)
+		return (-1);
+#endif
+#if USE_CCM_PRECOMPUTE
+    if (mode == CCM_ENCRYPT
+        && length <= CCM_PRE_BLOCKS * 16
+        && ccm_pre_nonce(key, iv, iv_len))
+        return ccm_encrypt_pre(key, iv, iv_len, add, add_len,
+                               input, length, output, tag, tag_len);
+#endif
+    u8 estat_prev = estat_enter(ESTAT_AES);
+    q = 16 - 1 - (unsigned char) iv_len;
+    ccm_ctr_start(ctr, iv, iv_len);
+    pctr[15] = 1;
+
+    r = irq_disable();
+    aes_set_key(key);
+    if (ccm_mac_start(y, iv, iv_len, add, add_len, length, tag_len) != 0) {
+        irq_restore(r);
+        estat_leave(estat_prev);
+        return (-1);
+    }
     /*
      * Authenticate and {en,de}crypt the message.
      *
@@ -168,15 +366,13 @@ int ccm_auth_crypt( int mode, const unsigned char *key,
     while (len_left > 0) {
 		size_t use_len = len_left > 16 ? 16 : len_left;
 		if (mode == CCM_ENCRYPT) {
-			memset(b, 0, 16);
-			memcpy(b, src, use_len);
-			UPDATE_CBC_MAC;
+			UPDATE_CBC_MAC(src, use_len);
 		}
-		CTR_CRYPT( dst, src, use_len );
+		aes_encrypt_block(ctr, b);
+		for (i = 0; i < use_len; i++)
+			dst[i] = src[i] ^ pb[i];
 		if (mode == CCM_DECRYPT) {
-			memset(b, 0, 16);
-			memcpy(b, dst, use_len);
-			UPDATE_CBC_MAC;
+			UPDATE_CBC_MAC(dst, use_len);
 		}
 		dst += use_len;
 		src += use_len;
@@ -186,16 +382,19 @@ int ccm_auth_crypt( int mode, const unsigned char *key,
          * No need to check for overflow thanks to the length check above.
          */
         for (i = 0; i < q; i++)
-			if (++ctr[15 - i] != 0)
+			if (++pctr[15 - i] != 0)
 				break;
     }
     /*
      * Authentication: reset counter and crypt/mask internal tag
      */
     for (i = 0; i < q; i++)
-		ctr[15 - i] = 0;
-	CTR_CRYPT( y, y, 16 );
-	memcpy(tag, y, tag_len);
+		pctr[15 - i] = 0;
+    aes_encrypt_block(ctr, b);
+    irq_restore(r);
+    for (i = 0; i < tag_len; i++)
+		tag[i] = py[i] ^ pb[i];
+    estat_leave(estat_prev);
 	return (0);
 }
 
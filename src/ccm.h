@@ -27,6 +27,10 @@
 extern "C" {
 #endif
 
+#ifndef USE_AES_REGS
+#define USE_AES_REGS 1 // = 0 - blocks through aes_encrypt() (host build)
+#endif
+
 #define CCM_ENCRYPT 0
 #define CCM_DECRYPT 1
 /*
@@ -39,6 +43,18 @@ int ccm_auth_crypt( int mode, const unsigned char *key,
                            unsigned char *output,
                            unsigned char *tag, size_t tag_len );
 
+#if USE_CCM_PRECOMPUTE
+/*
+ * Precompute the CTR key stream and the CBC-MAC prefix for the nonce
+ * of the next encrypted packet, the next aes_ccm_encrypt_and_tag()
+ * with this key and nonce only XORs and authenticates the message
+ */
+void ccm_precompute( const unsigned char *key,
+                           const unsigned char *iv, size_t iv_len,
+                           const unsigned char *add, size_t add_len,
+                           size_t length, size_t tag_len );
+#endif
+
 /**
  * \brief           CCM buffer encryption
  *
@@ -37,6 +37,12 @@
 #if USE_SDM_OUT
 #include "sdm_out.h"
 #endif
+#if USE_SENSOR_FILTER
+#include "filter.h"
+#endif
+#if USE_ENERGY_STAT
+#include "estat.h"
+#endif
 
 
 #define _flash_read(faddr,len,pbuf) flash_read_page(FLASH_BASE_ADDR + (u32)faddr, len, (u8 *)pbuf)
@@ -515,6 +521,18 @@ void cmd_parser(void * p) {
 				 lcd_flg.all_flg = req->dat[1];
 			 send_buf[1] = lcd_flg.all_flg;
  			 olen = 2;
+#if (USE_EPD)
+		} else if (cmd == CMD_ID_EPD_CFG) { // Get/Set e-paper full refresh cadence
+			if (len) {
+				if (len > sizeof(epd_cfg))
+					len = sizeof(epd_cfg);
+				memcpy(&epd_cfg, &req->dat[1], len);
+				flash_write_cfg(&epd_cfg, EEP_ID_EPD, sizeof(epd_cfg));
+				epd_refresh_reset();
+			}
+			memcpy(&send_buf[1], &epd_cfg, sizeof(epd_cfg));
+			olen = sizeof(epd_cfg) + 1;
+#endif
 #endif // DEV_SERVICES & SERVICE_SCREEN
 #if (DEV_SERVICES & SERVICE_PINCODE)
 		} else if (cmd == CMD_ID_PINCODE && len > 3) { // Set new pinCode 0..999999
@@ -592,10 +610,11 @@ void cmd_parser(void * p) {
 			olen = sizeof(wrk.utc_time_tick_step) + 1;
 #endif
 #if (DEV_SERVICES & SERVICE_HISTORY)
-		} else if (cmd == CMD_ID_LOGGER && len > 1) { // Read memory measures
+		} else if ((cmd == CMD_ID_LOGGER || cmd == CMD_ID_LOGBLK) && len > 1) { // Read memory measures
+			rd_memo.bulk = (cmd == CMD_ID_LOGBLK);
 			rd_memo.cnt = req->dat[1] | (req->dat[2] << 8);
 			if (rd_memo.cnt) {
-				rd_memo.saved = memo;
+				memo_rd_init();
 				if (len > 3)
 					rd_memo.cur = req->dat[3] | (req->dat[4] << 8);
 				else
@@ -603,6 +622,20 @@ void cmd_parser(void * p) {
 				bls_pm_setManualLatency(0);
 			} else
 				bls_pm_setManualLatency(cfg.connect_latency);
+		} else if (cmd == CMD_ID_LOGTIM && len > 3) { // Read memory measures from utc time
+			// in: [utc time u32][flag: != 0 -> CMD_ID_LOGBLK], out: [cmd][count u16] + notify records
+			u32 tim = req->dat[1] | (req->dat[2] << 8) | (req->dat[3] << 16) | (req->dat[4] << 24);
+			memo_rd_init();
+			rd_memo.cnt = get_memo_count_from_time(tim);
+			if (rd_memo.cnt > 0xffff)
+				rd_memo.cnt = 0xffff;
+			rd_memo.cur = 0;
+			rd_memo.bulk = (len > 4 && req->dat[5]);
+			send_buf[1] = rd_memo.cnt;
+			send_buf[2] = rd_memo.cnt >> 8;
+			olen = 3;
+			if (rd_memo.cnt)
+				bls_pm_setManualLatency(0);
 		} else if (cmd == CMD_ID_CLRLOG && len > 1) { // Clear memory measures
 			if (req->dat[1] == 0x12 && req->dat[2] == 0x34) {
 				clear_memo();
@@ -783,6 +816,57 @@ void cmd_parser(void * p) {
 			}
 			memcpy(&send_buf[1], &scan.cfg, sizeof(scan.cfg));
 			olen = sizeof(scan.cfg) + 1;
+		} else if (cmd == CMD_ID_SCAN_PEERS) { // Get/Set Scan peer: [n][MAC[6]]
+			if (len && req->dat[1] < SCAN_PEERS) {
+				u8 n = req->dat[1];
+				if (len > sizeof(scan.peers.MAC[0])) {
+					memcpy(scan.peers.MAC[n], &req->dat[2], sizeof(scan.peers.MAC[0]));
+					flash_write_cfg(&scan.peers, EEP_ID_SCP, sizeof(scan.peers));
+					scan_peers_init();
+				}
+				send_buf[1] = n;
+				memcpy(&send_buf[2], scan.peers.MAC[n], sizeof(scan.peers.MAC[0]));
+				memcpy(&send_buf[2 + sizeof(scan.peers.MAC[0])], &scan.peer[n], sizeof(scan_peer_t));
+				olen = sizeof(scan.peers.MAC[0]) + sizeof(scan_peer_t) + 2;
+			} else {
+				send_buf[1] = SCAN_PEERS;
+				olen = 2;
+			}
+#endif
+#if USE_SENSOR_FILTER
+		} else if (cmd == CMD_ID_FLT) { // Get/Set filters of the measured values
+			if (len) {
+				if (len > sizeof(flt.cfg))
+					len = sizeof(flt.cfg);
+				memcpy(&flt.cfg, &req->dat[1], len);
+				flash_write_cfg(&flt.cfg, EEP_ID_FLT, sizeof(flt.cfg));
+				reset_filter();
+			}
+			memcpy(&send_buf[1], &flt.cfg, sizeof(flt.cfg));
+			olen = sizeof(flt.cfg) + 1;
+#endif
+#if USE_ENERGY_STAT
+		} else if (cmd == CMD_ID_ESTAT) { // Get active/sleep time: [n] -> [n][ms[n]..ms[n+3]], [0xff] - clear
+			u8 n = 0;
+			if (len) {
+				n = req->dat[1];
+				if (n == 0xff) {
+					estat_clear();
+					n = 0;
+				}
+			}
+			estat_fold();
+			if (n < ESTAT_CNT) {
+				len = ESTAT_CNT - n;
+				if (len > 4)
+					len = 4;
+				send_buf[1] = n;
+				memcpy(&send_buf[2], &estat.ms[n], len * sizeof(estat.ms[0]));
+				olen = len * sizeof(estat.ms[0]) + 2;
+			} else {
+				send_buf[1] = ESTAT_CNT;
+				olen = 2;
+			}
 #endif
 #if USE_SDM_OUT
 		} else if (cmd == CMD_ID_DAC_CFG) { // Set SDMDAC config
@@ -20,6 +20,7 @@ enum {
 	CMD_ID_MI_REST  = 0x16, // Restore prev mi token & bindkeys
 	CMD_ID_MI_CLR	= 0x17, // Delete all mi keys
 	CMD_ID_BKEY		= 0x18, // Get/Set beacon bindkey in EEP
+	CMD_ID_SCAN_PEERS = 0x1F, // Get/Set Scan peer MAC, Get peer values
 	CMD_ID_COMFORT  = 0x20, // Get/Set comfort parameters
 	CMD_ID_SCAN_CFG = 0x21, // Get/Set Scan Config parameters
 	CMD_ID_EXTDATA  = 0x22, // Get/Set show ext. data
@@ -33,9 +34,13 @@ enum {
 	CMD_ID_RH_CAL	= 0x2A, // Calibrate sensor RH
 	CMD_ID_KZ2 		= 0x2b, // Get/Set sensor KZ2 config
 	CMD_ID_KZ3 		= 0x2c, // Get/Set sensor KZ3 config
+	CMD_ID_FLT		= 0x2d, // Get/Set filters of the measured values
 	CMD_ID_MEASURE  = 0x33, // Start/stop notify measures in connection mode
 	CMD_ID_LOGGER   = 0x35, // Read memory measures
 	CMD_ID_CLRLOG	= 0x36, // Clear memory measures
+	CMD_ID_LOGBLK	= 0x37, // Read memory measures, multi-record notify (up to MTU)
+	CMD_ID_LOGTIM	= 0x38, // Read memory measures from utc time (binary search)
+	CMD_ID_ESTAT	= 0x39, // Get/Clear per-subsystem active and sleep time, ms
 	CMD_ID_RDS      = 0x40, // Get/Set Reed switch config (DIY devices)
 	CMD_ID_TRG      = 0x44, // Get/Set trg and Reed switch data config
 	CMD_ID_TRG_OUT  = 0x45, // Get/Set trg out, Send Reed switch and trg data
@@ -44,6 +49,7 @@ enum {
 	CMD_ID_CFG_DEF  = 0x56,	// Set default device config
 	CMD_ID_LCD_DUMP = 0x60, // Get/Set lcd buf
 	CMD_ID_LCD_FLG  = 0x61, // Start/Stop notify lcd dump and ...
+	CMD_ID_EPD_CFG  = 0x62, // Get/Set e-paper full refresh cadence
 	CMD_ID_DAC_CFG	= 0x68, // Get/Set SDMDAC config
 	CMD_ID_PINCODE  = 0x70, // Set new PinCode 0..999999
 	CMD_ID_MTU		= 0x71, // Request Mtu Size Exchange (23..255)
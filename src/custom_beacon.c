@@ -24,6 +24,24 @@ typedef struct __attribute__((packed)) _enc_beacon_nonce_t{
     adv_cust_head_t head;
 } enc_beacon_nonce_t;
 
+#if USE_CCM_PRECOMPUTE
+/* Key stream for the next measurement: counter = adv_buf.send_count + 1 */
+__attribute__((optimize("-Os")))
+static void cust_encrypt_prepare(u8 size, u32 length) {
+	enc_beacon_nonce_t cbn;
+	u8 aad = 0x11;
+	memcpy(cbn.MAC, mac_public, sizeof(cbn.MAC));
+	cbn.head.size = size;
+	cbn.head.uid = GAP_ADTYPE_SERVICE_DATA_UUID_16BIT; // 16-bit UUID
+	cbn.head.UUID = ADV_CUSTOM_UUID16;
+	cbn.head.counter = (u8)(adv_buf.send_count + 1);
+	ccm_precompute((const unsigned char *)&bindkey,
+					   (u8*)&cbn, sizeof(cbn),
+					   &aad, sizeof(aad),
+					   length, 4);
+}
+#endif
+
 #if USE_ATC_BEACON
 /* Create encrypted custom beacon packet
  * https://github.com/pvvx/ATC_MiThermometer/issues/94#issuecomment-842846036 */
@@ -55,6 +73,12 @@ void atc_encrypt_data_beacon(void) {
 					   (u8 *)&p->data,
 					   p->mic, 4);
 }
+
+#if USE_CCM_PRECOMPUTE
+void atc_encrypt_prepare(void) {
+	cust_encrypt_prepare(sizeof(adv_atc_enc_t) - 1, sizeof(adv_atc_data_t));
+}
+#endif
 #endif
 
 #if USE_CUSTOM_BEACON
@@ -87,6 +111,11 @@ void pvvx_encrypt_data_beacon(void) {
 					   p->mic, 4);
 }
 
+#if USE_CCM_PRECOMPUTE
+void pvvx_encrypt_prepare(void) {
+	cust_encrypt_prepare(sizeof(adv_cust_enc_t) - 1, sizeof(adv_cust_data_t));
+}
+#endif
 #endif
 #endif // #if (DEV_SERVICES & SERVICE_BINDKEY)
 
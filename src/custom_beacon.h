@@ -94,6 +94,10 @@ void default_event_beacon(void);
 #if (DEV_SERVICES & SERVICE_BINDKEY)
 void pvvx_encrypt_data_beacon(void); // n = RDS_TYPES
 void atc_encrypt_data_beacon(void);
+#if USE_CCM_PRECOMPUTE
+void pvvx_encrypt_prepare(void);
+void atc_encrypt_prepare(void);
+#endif
 
 #if (DEV_SERVICES & SERVICE_RDS)
 void pvvx_encrypt_event_beacon(u8 n); // n = RDS_TYPES
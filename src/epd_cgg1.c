@@ -5,17 +5,16 @@
 #include "app.h"
 #include "epd.h"
 #include "lcd.h"
+#include "epd_spi.h"
 #include "battery.h"
 #include "drivers/8258/pm.h"
 #include "drivers/8258/timer.h"
 #include "stack/ble/ll/ll_pm.h"
 
 #define DEF_EPD_SUMBOL_SIGMENTS	13
-#define DEF_EPD_REFRESH_CNT		32
 
 RAM u8 stage_lcd;
 RAM u8 flg_lcd_init;
-RAM u8 lcd_refresh_cnt;
 RAM u8 epd_updated;
 //----------------------------------
 // LUTV, LUT_KK and LUT_KW values taken from the actual device with a
@@ -38,9 +37,6 @@ const u8 bottom_left[DEF_EPD_SUMBOL_SIGMENTS*2] = {13, 1, 13, 2, 14, 2, 14, 0, 1
 const u8 bottom_middle[DEF_EPD_SUMBOL_SIGMENTS*2] = {9, 6, 8, 3, 8, 2, 8, 1, 8, 4, 7, 3, 10, 5, 10, 4, 10, 6, 9, 5, 9, 0, 10, 7, 9, 7};
 const u8 bottom_right[DEF_EPD_SUMBOL_SIGMENTS*2] = {5, 1, 5, 2, 7, 7, 3, 2, 3, 4, 0, 1, 0, 0, 3, 5, 3, 3, 3, 0, 7, 6, 6, 0, 3, 1};
 
-#define delay_SPI_end_cycle() sleep_us(2)
-#define delay_EPD_SCL_pulse() sleep_us(2)
-
 /*
 Now define how each digit maps to the segments:
           1
@@ -137,45 +133,6 @@ _attribute_ram_code_ void show_ble_symbol(bool state){
 		display_buff[9] &= ~BIT(1);
 }
 
-_attribute_ram_code_ __attribute__((optimize("-Os"))) static void transmit(u8 cd, u8 data_to_send) {
-    gpio_write(EPD_SCL, LOW);
-    // enable SPI
-    gpio_write(EPD_CSB, LOW);
-    delay_EPD_SCL_pulse();
-
-    // send the first bit, this indicates if the following is a command or data
-    if (cd != 0)
-        gpio_write(EPD_SDA, HIGH);
-    else
-        gpio_write(EPD_SDA, LOW);
-    delay_EPD_SCL_pulse();
-    gpio_write(EPD_SCL, HIGH);
-    delay_EPD_SCL_pulse();
-
-    // send 8 bits
-    for (int i = 0; i < 8; i++) {
-        // start the clock cycle
-        gpio_write(EPD_SCL, LOW);
-        // set the MOSI according to the data
-        if (data_to_send & 0x80)
-            gpio_write(EPD_SDA, HIGH);
-        else
-            gpio_write(EPD_SDA, LOW);
-        // prepare for the next bit
-        data_to_send = (data_to_send << 1);
-        delay_EPD_SCL_pulse();
-        // the data is read at rising clock (halfway the time MOSI is set)
-        gpio_write(EPD_SCL, HIGH);
-        delay_EPD_SCL_pulse();
-    }
-
-    // finish by ending the clock cycle and disabling SPI
-    gpio_write(EPD_SCL, LOW);
-    delay_SPI_end_cycle();
-    gpio_write(EPD_CSB, HIGH);
-    delay_SPI_end_cycle();
-}
-
 _attribute_ram_code_ __attribute__((optimize("-Os"))) static void epd_set_digit(u8 *buf, u8 digit, const u8 *segments) {
     // set the segments, there are up to 11 segments in a digit
     int segment_byte;
@@ -314,7 +271,7 @@ void init_lcd(void) {
 	// pulse RST_N low for 110 microseconds
     gpio_write(EPD_RST, LOW);
     pm_wait_us(110);
-	lcd_refresh_cnt = DEF_EPD_REFRESH_CNT;
+	epd_refresh_reset();
     stage_lcd = 1;
     epd_updated = 0;
     flg_lcd_init = 1;
@@ -347,8 +304,7 @@ _attribute_ram_code_ void update_lcd(void){
 		if (memcmp(display_cmp_buff, display_buff, sizeof(display_buff))) {
 			memcpy(display_cmp_buff, display_buff, sizeof(display_buff));
 			lcd_flg.b.send_notify = lcd_flg.b.notify_on; // set flag LCD for send notify
-			if (lcd_refresh_cnt) {
-				lcd_refresh_cnt--;
+			if (!epd_refresh_full()) {
 				flg_lcd_init = 0;
 				stage_lcd = 1;
 			} else {
@@ -367,64 +323,57 @@ _attribute_ram_code_  __attribute__((optimize("-Os"))) int task_lcd(void) {
 		switch (stage_lcd) {
 		case 1: // Update/Init lcd, stage 1
 			// send Charge Pump ON command
-			transmit(0, POWER_ON);
+			epd_transmit(0, POWER_ON);
 			// EPD_BUSY: Low 32 ms from reset, 47.5 ms in refresh cycle
 			stage_lcd = 2;
 			break;
 		case 2: // Update/Init lcd, stage 2
 			if (epd_updated == 0) {
-				transmit(0, PANEL_SETTING);
-				transmit(1, 0x0F);
+				epd_transmit(0, PANEL_SETTING);
+				epd_transmit(1, 0x0F);
 
-				transmit(0, POWER_SETTING);
-				transmit(1, 0x32); // transmit(1, 0x32);
-				transmit(1, 0x32); // transmit(1, 0x32);
-				transmit(0, POWER_OFF_SEQUENCE_SETTING);
-				transmit(1, 0x00);
+				epd_transmit(0, POWER_SETTING);
+				epd_transmit(1, 0x32); // epd_transmit(1, 0x32);
+				epd_transmit(1, 0x32); // epd_transmit(1, 0x32);
+				epd_transmit(0, POWER_OFF_SEQUENCE_SETTING);
+				epd_transmit(1, 0x00);
 				// Frame Rate Control
-				transmit(0, PLL_CONTROL);
+				epd_transmit(0, PLL_CONTROL);
 				if (flg_lcd_init)
-					transmit(1, 0x03);
+					epd_transmit(1, 0x03);
 				else {
-					transmit(1, 0x07);
-					transmit(0, PARTIAL_DISPLAY_REFRESH);
-					transmit(1, 0x00);
-					transmit(1, 0x87);
-					transmit(1, 0x01);
-					transmit(0, POWER_OFF_SEQUENCE_SETTING);
-					transmit(1, 0x06);
+					epd_transmit(1, 0x07);
+					epd_transmit(0, PARTIAL_DISPLAY_REFRESH);
+					epd_transmit(1, 0x00);
+					epd_transmit(1, 0x87);
+					epd_transmit(1, 0x01);
+					epd_transmit(0, POWER_OFF_SEQUENCE_SETTING);
+					epd_transmit(1, 0x06);
 				}
 				// send the e-paper voltage settings (waves)
-				transmit(0, LUT_FOR_VCOM);
-				for (int i = 0; i < sizeof(T_LUTV_init); i++)
-					transmit(1, T_LUTV_init[i]);
+				epd_transmit(0, LUT_FOR_VCOM);
+				epd_transmit_blk(1, T_LUTV_init, sizeof(T_LUTV_init));
 
 				if (flg_lcd_init) {
 					flg_lcd_init = 0;
-					transmit(0, LUT_CMD_0x23);
-					for (int i = 0; i < sizeof(T_LUT_KK_init); i++)
-						transmit(1, T_LUT_KK_init[i]);
-					transmit(0, LUT_CMD_0x26);
-					for (int i = 0; i < sizeof(T_LUT_KW_init); i++)
-						transmit(1, T_LUT_KW_init[i]);
+					epd_transmit(0, LUT_CMD_0x23);
+					epd_transmit_blk(1, T_LUT_KK_init, sizeof(T_LUT_KK_init));
+					epd_transmit(0, LUT_CMD_0x26);
+					epd_transmit_blk(1, T_LUT_KW_init, sizeof(T_LUT_KW_init));
 					// start an initialization sequence (white - all 0x00)
 					stage_lcd = 2;
 				} else {
-					transmit(0, LUT_CMD_0x23);
-					for (int i = 0; i < sizeof(T_LUTV_init); i++)
-						transmit(1, T_LUTV_init[i]);
+					epd_transmit(0, LUT_CMD_0x23);
+					epd_transmit_blk(1, T_LUTV_init, sizeof(T_LUTV_init));
 
-					transmit(0, LUT_CMD_0x24);
-					for (int i = 0; i < sizeof(T_LUT_KK_update); i++)
-						transmit(1, T_LUT_KK_update[i]);
+					epd_transmit(0, LUT_CMD_0x24);
+					epd_transmit_blk(1, T_LUT_KK_update, sizeof(T_LUT_KK_update));
 
-					transmit(0, LUT_CMD_0x25);
-					for (int i = 0; i < sizeof(T_LUT_KW_update); i++)
-						transmit(1, T_LUT_KW_update[i]);
+					epd_transmit(0, LUT_CMD_0x25);
+					epd_transmit_blk(1, T_LUT_KW_update, sizeof(T_LUT_KW_update));
 
-					transmit(0, LUT_CMD_0x26);
-					for (int i = 0; i < sizeof(T_LUTV_init); i++)
-						transmit(1, T_LUTV_init[i]);
+					epd_transmit(0, LUT_CMD_0x26);
+					epd_transmit_blk(1, T_LUTV_init, sizeof(T_LUTV_init));
 					// send the actual data
 					stage_lcd = 3;
 				}
@@ -432,17 +381,17 @@ _attribute_ram_code_  __attribute__((optimize("-Os"))) int task_lcd(void) {
 				stage_lcd = 3;
 			}
 			// send the actual data
-			transmit(0, DATA_START_TRANSMISSION_1);
+			epd_transmit(0, DATA_START_TRANSMISSION_1);
 			for (int i = 0; i < sizeof(display_cmp_buff); i++)
-				transmit(1, display_cmp_buff[i]^0xFF);
+				epd_transmit(1, display_cmp_buff[i]^0xFF);
 			// Refresh
-			transmit(0, DISPLAY_REFRESH);
+			epd_transmit(0, DISPLAY_REFRESH);
 			// EPD_BUSY: Low 1217 ms from reset, 608.5 ms in refresh cycle
 			break;
 		case 3: // Update lcd, stage 3
 			// send Charge Pump OFF command
-			transmit(0, POWER_OFF);
-			transmit(1, 0x03);
+			epd_transmit(0, POWER_OFF);
+			epd_transmit(1, 0x03);
 			// EPD_BUSY: Low 9.82 ms in refresh cycle
 			epd_updated = 1;
 			stage_lcd = 0;
@@ -5,6 +5,7 @@
 #include "app.h"
 //#include "epd.h"
 #include "lcd.h"
+#include "epd_spi.h"
 #include "battery.h"
 #include "drivers/8258/pm.h"
 #include "drivers/8258/timer.h"
@@ -52,7 +53,6 @@
 60ff5fff1f7f3fff5fff5fff1f1fff1f00
 */
 #define DEF_EPD_SUMBOL_SIGMENTS	13
-//#define DEF_EPD_REFRESH_CNT		255
 //----------------------------------
 // define segments
 // the data in the arrays consists of {byte, bit} pairs of each segment
@@ -97,9 +97,6 @@ const u8 digits[16][DEF_EPD_SUMBOL_SIGMENTS + 1] = {
 
 RAM u8 stage_lcd;
 //RAM u8 flg_lcd_init;
-#ifdef 	DEF_EPD_REFRESH_CNT
-RAM u8 lcd_refresh_cnt;
-#endif
 RAM u8 epd_updated;
 //----------------------------------
 // T_LUT_ping, T_LUT_init, T_LUT_work values taken from the actual device with a
@@ -110,9 +107,6 @@ const u8 T_LUT_init[14] = {0x082, 0x068, 0x050, 0x0E8, 0x0D0, 0x0A8, 0x065, 0x07
 const u8 T_LUT_work[9] = {0x082, 0x080, 0x000, 0x0C0, 0x080, 0x080, 0x062, 0x0AC, 0x02B};
 //const u8 T_LUT_test[16] = {0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0x00};
 
-#define delay_SPI_end_cycle() sleep_us(2)
-#define delay_EPD_SCL_pulse() sleep_us(2)
-
 /* 0x00 = "  "
  * 0x20 = "°Г"
  * 0x40 = " -"
@@ -314,46 +308,6 @@ _attribute_ram_code_ void show_clock(void) {
 }
 #endif // USE_CLOCK
 
-_attribute_ram_code_ __attribute__((optimize("-Os"))) static void transmit(u8 cd, u8 data_to_send) {
-    gpio_write(EPD_SCL, LOW);
-    gpio_write(EPD_CSB, LOW);
-    delay_EPD_SCL_pulse();
-
-    // send the first bit, this indicates if the following is a command or data
-    gpio_write(EPD_SDA, cd);
-    delay_EPD_SCL_pulse();
-    gpio_write(EPD_SCL, HIGH);
-    delay_EPD_SCL_pulse();
-
-    // send 8 bits
-    for (int i = 0; i < 8; i++) {
-        // start the clock cycle
-        gpio_write(EPD_SCL, LOW);
-        // set the MOSI according to the data
-        if (data_to_send & 0x80)
-            gpio_write(EPD_SDA, HIGH);
-        else
-            gpio_write(EPD_SDA, LOW);
-        // prepare for the next bit
-        data_to_send = (data_to_send << 1);
-        delay_EPD_SCL_pulse();
-        // the data is read at rising clock (halfway the time MOSI is set)
-        gpio_write(EPD_SCL, HIGH);
-        delay_EPD_SCL_pulse();
-    }
-
-    // finish by ending the clock cycle and disabling SPI
-    gpio_write(EPD_SCL, LOW);
-    delay_SPI_end_cycle();
-    gpio_write(EPD_CSB, HIGH);
-    delay_SPI_end_cycle();
-}
-
-_attribute_ram_code_ static void transmit_blk(u8 cd, const u8 * pdata, size_t size_data) {
-	for (int i = 0; i < size_data; i++)
-		transmit(cd, pdata[i]);
-}
-
 _attribute_ram_code_ void update_lcd(void){
 	if(cfg.flg2.screen_off) {
 		stage_lcd = 0;
@@ -363,15 +317,8 @@ _attribute_ram_code_ void update_lcd(void){
 		if (memcmp(display_cmp_buff, display_buff, sizeof(display_buff))) {
 			memcpy(display_cmp_buff, display_buff, sizeof(display_buff));
 			lcd_flg.b.send_notify = lcd_flg.b.notify_on; // set flag LCD for send notify
-#ifdef 	DEF_EPD_REFRESH_CNT
-			if (lcd_refresh_cnt) {
-				lcd_refresh_cnt--;
-			} else {
+			if (epd_refresh_full())
 				init_lcd(); // pulse RST_N low for 110 microseconds
-//				lcd_refresh_cnt = DEF_EPD_REFRESH_CNT;
-//			    epd_updated = 0;
-			}
-#endif
 			stage_lcd = 1;
 		}
 	}
@@ -381,9 +328,7 @@ void init_lcd(void) {
 	// pulse RST_N low for 110 microseconds
     gpio_write(EPD_RST, LOW);
     sleep_us(110);
-#ifdef 	DEF_EPD_REFRESH_CNT
-	lcd_refresh_cnt = DEF_EPD_REFRESH_CNT;
-#endif
+	epd_refresh_reset();
     stage_lcd = 1;
     epd_updated = 0;
     gpio_write(EPD_RST, HIGH);
@@ -399,25 +344,25 @@ _attribute_ram_code_  __attribute__((optimize("-Os"))) int task_lcd(void) {
 	if (gpio_read(EPD_BUSY)) {
 		switch (stage_lcd) {
 		case 1: // Update/Init, stage 1
-			transmit_blk(0, T_LUT_ping, sizeof(T_LUT_ping));
+			epd_transmit_blk(0, T_LUT_ping, sizeof(T_LUT_ping));
 			stage_lcd = 2;
 			break;
 		case 2: // Update/Init, stage 2
 			if (epd_updated == 0) {
-				transmit_blk(0, T_LUT_init, sizeof(T_LUT_init));
+				epd_transmit_blk(0, T_LUT_init, sizeof(T_LUT_init));
 			} else {
-				transmit_blk(0, T_LUT_work, sizeof(T_LUT_work));
+				epd_transmit_blk(0, T_LUT_work, sizeof(T_LUT_work));
 			}
 			stage_lcd = 3;
 			break;
 		case 3: // Update/Init, stage 3
-			transmit(0, 0x040);
-			transmit(0, 0x0A9);
-			transmit(0, 0x0A8);
-			transmit_blk(1, display_cmp_buff, sizeof(display_cmp_buff));
-			transmit(0, 0x0AB);
-			transmit(0, 0x0AA);
-			transmit(0, 0x0AF);
+			epd_transmit(0, 0x040);
+			epd_transmit(0, 0x0A9);
+			epd_transmit(0, 0x0A8);
+			epd_transmit_blk(1, display_cmp_buff, sizeof(display_cmp_buff));
+			epd_transmit(0, 0x0AB);
+			epd_transmit(0, 0x0AA);
+			epd_transmit(0, 0x0AF);
 			if (epd_updated) {
 				stage_lcd = 4;
 				// EPD_BUSY: ~500 ms
@@ -429,9 +374,9 @@ _attribute_ram_code_  __attribute__((optimize("-Os"))) int task_lcd(void) {
 			// sleep_us(200); // Waiting for EPD BUSY to be setting?
 			break;
 		case 4: // Update, stage 4
-			transmit(0, 0x0AE);
-			transmit(0, 0x028);
-			transmit(0, 0x0AD);
+			epd_transmit(0, 0x0AE);
+			epd_transmit(0, 0x028);
+			epd_transmit(0, 0x0AD);
 		default:
 			stage_lcd = 0;
 		}
@@ -4,16 +4,15 @@
 /* Based on source: https://github.com/znanev/ATC_MiThermometer */
 #include "app.h"
 #include "lcd.h"
+#include "epd_spi.h"
 #include "epd.h"
 #include "drivers/8258/pm.h"
 #include "drivers/8258/timer.h"
 #include "stack/ble/ll/ll_pm.h"
 
-#define DEF_EPD_REFRESH_CNT	32
 
 RAM u8 stage_lcd;
 RAM u8 flg_lcd_init;
-RAM u8 lcd_refresh_cnt;
 RAM u8 epd_updated;
 //----------------------------------
 // LUTV, LUT_KK and LUT_KW values taken from the actual device with a
@@ -35,12 +34,6 @@ const u8 top_right[22] = {13, 1, 13, 7, 12, 1, 12, 7, 11, 5, 11, 2, 12, 6, 12, 0
 const u8 bottom_left[22] = {9, 1, 9, 7, 8, 5, 1, 1, 0, 3, 1, 4, 9, 4, 10, 0, 10, 6, 10, 3, 8, 2};
 const u8 bottom_right[22] = {7, 7, 6, 5, 2, 0, 2, 3, 0, 2, 1, 7, 2, 6, 7, 4, 7, 1, 8, 6, 6, 2};
 
-// These values closely reproduce times captured with logic analyser
-//#define delay_SPI_end_cycle() pm_wait_us(3) // 1.5 us
-//#define delay_EPD_SCL_pulse() pm_wait_us(3) // 1.5 us
-#define delay_SPI_end_cycle() sleep_us(2)
-#define delay_EPD_SCL_pulse() sleep_us(2)
-
 /*
 Now define how each digit maps to the segments:
           1
@@ -158,45 +151,6 @@ _attribute_ram_code_ void show_ble_symbol(bool state){
 }
 
 // 223 us
-_attribute_ram_code_ __attribute__((optimize("-Os"))) static void transmit(u8 cd, u8 data_to_send) {
-    gpio_write(EPD_SCL, LOW);
-    // enable SPI
-    gpio_write(EPD_CSB, LOW);
-    delay_EPD_SCL_pulse();
-
-    // send the first bit, this indicates if the following is a command or data
-    if (cd != 0)
-        gpio_write(EPD_SDA, HIGH);
-    else
-        gpio_write(EPD_SDA, LOW);
-    delay_EPD_SCL_pulse();
-    gpio_write(EPD_SCL, HIGH);
-    delay_EPD_SCL_pulse();
-
-    // send 8 bits
-    for (int i = 0; i < 8; i++) {
-        // start the clock cycle
-        gpio_write(EPD_SCL, LOW);
-        // set the MOSI according to the data
-        if (data_to_send & 0x80)
-            gpio_write(EPD_SDA, HIGH);
-        else
-            gpio_write(EPD_SDA, LOW);
-        // prepare for the next bit
-        data_to_send = (data_to_send << 1);
-        delay_EPD_SCL_pulse();
-        // the data is read at rising clock (halfway the time MOSI is set)
-        gpio_write(EPD_SCL, HIGH);
-        delay_EPD_SCL_pulse();
-    }
-
-    // finish by ending the clock cycle and disabling SPI
-    gpio_write(EPD_SCL, LOW);
-    delay_SPI_end_cycle();
-    gpio_write(EPD_CSB, HIGH);
-    delay_SPI_end_cycle();
-}
-
 _attribute_ram_code_ __attribute__((optimize("-Os"))) static void epd_set_digit(u8 *buf, u8 digit, const u8 *segments) {
     // set the segments, there are up to 11 segments in a digit
     int segment_byte;
@@ -303,7 +257,7 @@ void init_lcd(void) {
 	// pulse RST_N low for 110 microseconds
     gpio_write(EPD_RST, LOW);
     pm_wait_us(110);
-	lcd_refresh_cnt = DEF_EPD_REFRESH_CNT;
+	epd_refresh_reset();
     stage_lcd = 1;
     epd_updated = 0;
     flg_lcd_init = 3;
@@ -320,8 +274,7 @@ _attribute_ram_code_ void update_lcd(void){
 		if (memcmp(display_cmp_buff, display_buff, sizeof(display_buff))) {
 			memcpy(display_cmp_buff, display_buff, sizeof(display_buff));
 			lcd_flg.b.send_notify = lcd_flg.b.notify_on; // set flag LCD for send notify
-			if (lcd_refresh_cnt) {
-				lcd_refresh_cnt--;
+			if (!epd_refresh_full()) {
 				flg_lcd_init = 0;
 				stage_lcd = 1;
 			} else {
@@ -344,105 +297,94 @@ int task_lcd(void) {
 			if (flg_lcd_init)
 				flg_lcd_init--;
 			// send Charge Pump ON command
-			transmit(0, POWER_ON);
+			epd_transmit(0, POWER_ON);
 			// wait ~30 ms for the display to become ready to receive new
 			stage_lcd = 2;
 			break;
 		case 2: // Update/Init lcd, stage 2
 			if (epd_updated == 0) {
 				// send next blocks ~25 ms
-				transmit(0, PANEL_SETTING);
-				transmit(1, 0x0B);
-				transmit(0, POWER_SETTING);
-				transmit(1, 0x46);
-				transmit(1, 0x46);
-				transmit(0, POWER_OFF_SEQUENCE_SETTING);
+				epd_transmit(0, PANEL_SETTING);
+				epd_transmit(1, 0x0B);
+				epd_transmit(0, POWER_SETTING);
+				epd_transmit(1, 0x46);
+				epd_transmit(1, 0x46);
+				epd_transmit(0, POWER_OFF_SEQUENCE_SETTING);
 				if (flg_lcd_init)
-					transmit(1, 0x00);
+					epd_transmit(1, 0x00);
 				else
-					transmit(1, 0x06);
+					epd_transmit(1, 0x06);
 				// Frame Rate Control
-				transmit(0, PLL_CONTROL);
+				epd_transmit(0, PLL_CONTROL);
 				if (flg_lcd_init)
-					transmit(1, 0x03); // transmit(1, 0x02);
+					epd_transmit(1, 0x03); // epd_transmit(1, 0x02);
 				else {
-					transmit(1, 0x07); // transmit(1, 0x03);
+					epd_transmit(1, 0x07); // epd_transmit(1, 0x03);
 					// NOTE: Original firmware makes partial refresh on update, but not when initialising the screen.
-					transmit(0, PARTIAL_DISPLAY_REFRESH);
-					transmit(1, 0x00);
-					transmit(1, 0x87);
-					transmit(1, 0x01);
+					epd_transmit(0, PARTIAL_DISPLAY_REFRESH);
+					epd_transmit(1, 0x00);
+					epd_transmit(1, 0x87);
+					epd_transmit(1, 0x01);
 				}
 				// send the e-paper voltage settings (waves)
-				transmit(0, LUT_FOR_VCOM);
-				for (int i = 0; i < 15; i++)
-					transmit(1, T_LUTV_init[i]);
+				epd_transmit(0, LUT_FOR_VCOM);
+				epd_transmit_blk(1, T_LUTV_init, 15);
 
 				if (flg_lcd_init) {
-					transmit(0, LUT_CMD_0x23);
+					epd_transmit(0, LUT_CMD_0x23);
 					if (flg_lcd_init == 1) { // pass 2
-						for (int i = 0; i < 15; i++)
-							transmit(1, T_LUT_KW_update[i]);
-						transmit(0, LUT_CMD_0x26);
-						for (int i = 0; i < 15; i++)
-							transmit(1, T_LUT_KK_update[i]);
+						epd_transmit_blk(1, T_LUT_KW_update, 15);
+						epd_transmit(0, LUT_CMD_0x26);
+						epd_transmit_blk(1, T_LUT_KK_update, 15);
 						// start an initialization sequence (white - all 0x00)
-						transmit(0, DATA_START_TRANSMISSION_1);
+						epd_transmit(0, DATA_START_TRANSMISSION_1);
 						for (int i = 0; i < 18; i++)
-							transmit(1, 0);
-						transmit(0, DATA_START_TRANSMISSION_2);
+							epd_transmit(1, 0);
+						epd_transmit(0, DATA_START_TRANSMISSION_2);
 						for (int i = 0; i < 18; i++)
-							transmit(1, 0);
+							epd_transmit(1, 0);
 					} else { // pass 1
-						for (int i = 0; i < 15; i++)
-							transmit(1, T_LUT_KK_init[i]);
-						transmit(0, LUT_CMD_0x26);
-						for (int i = 0; i < 15; i++)
-							transmit(1, T_LUT_KW_init[i]);
+						epd_transmit_blk(1, T_LUT_KK_init, 15);
+						epd_transmit(0, LUT_CMD_0x26);
+						epd_transmit_blk(1, T_LUT_KW_init, 15);
 						// start an initialization sequence (black - all 0xFF)
-						transmit(0, DATA_START_TRANSMISSION_1);
+						epd_transmit(0, DATA_START_TRANSMISSION_1);
 						for (int i = 0; i < 18; i++)
-							transmit(1, 0xff);
-						transmit(0, DATA_START_TRANSMISSION_2);
+							epd_transmit(1, 0xff);
+						epd_transmit(0, DATA_START_TRANSMISSION_2);
 						for (int i = 0; i < 18; i++)
-							transmit(1, 0xff);
+							epd_transmit(1, 0xff);
 					}
 				} else {
-					transmit(0, LUT_CMD_0x23);
-					for (int i = 0; i < 15; i++)
-						transmit(1, T_LUTV_init[i]);
+					epd_transmit(0, LUT_CMD_0x23);
+					epd_transmit_blk(1, T_LUTV_init, 15);
 
-					transmit(0, LUT_CMD_0x24);
-					for (int i = 0; i < 15; i++)
-						transmit(1, T_LUT_KK_update[i]);
+					epd_transmit(0, LUT_CMD_0x24);
+					epd_transmit_blk(1, T_LUT_KK_update, 15);
 
-					transmit(0, LUT_CMD_0x25);
-					for (int i = 0; i < 15; i++)
-						transmit(1, T_LUT_KW_update[i]);
+					epd_transmit(0, LUT_CMD_0x25);
+					epd_transmit_blk(1, T_LUT_KW_update, 15);
 
-					transmit(0, LUT_CMD_0x26);
-					for (int i = 0; i < 15; i++)
-						transmit(1, T_LUTV_init[i]);
+					epd_transmit(0, LUT_CMD_0x26);
+					epd_transmit_blk(1, T_LUTV_init, 15);
 					// send the actual data
-					transmit(0, DATA_START_TRANSMISSION_1);
-					for (int i = 0; i < 18; i++)
-						transmit(1, display_cmp_buff[i]);
+					epd_transmit(0, DATA_START_TRANSMISSION_1);
+					epd_transmit_blk(1, display_cmp_buff, 18);
 				}
 			} else {
 				// send the actual data
-				transmit(0, DATA_START_TRANSMISSION_1);
-				for (int i = 0; i < 18; i++)
-					transmit(1, display_cmp_buff[i]);
+				epd_transmit(0, DATA_START_TRANSMISSION_1);
+				epd_transmit_blk(1, display_cmp_buff, 18);
 			}
 			stage_lcd = 3;
 			// Refresh
-			transmit(0, DISPLAY_REFRESH);
+			epd_transmit(0, DISPLAY_REFRESH);
 			// wait ~1256 ms for the display to become ready to receive new
 			break;
 		case 3: // Update/Init lcd, stage 3
 			// send Charge Pump OFF command
-			transmit(0, POWER_OFF);
-			transmit(1, 0x03);
+			epd_transmit(0, POWER_OFF);
+			epd_transmit(1, 0x03);
 			if (flg_lcd_init)
 				// wait ~20 ms for the display to become ready to receive new
 				stage_lcd = 1;
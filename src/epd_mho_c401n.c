@@ -9,6 +9,7 @@
 #include "app.h"
 #include "ble.h"
 #include "lcd.h"
+#include "epd_spi.h"
 #include "epd.h"
 #include "drivers/8258/pm.h"
 #include "drivers/8258/timer.h"
@@ -44,8 +45,6 @@ None: 0.1..0.3, 0.5..0.7, 2.3..2.7, 4.3..4.7, 5.1, 5,3, 5.5, 5.7, 6.1, 6.3, 6.7,
 
 RAM u8 stage_lcd;
 RAM u8 epd_updated;
-//#define DEF_EPD_REFRESH_CNT	2048
-//RAM u16 lcd_refresh_cnt;
 
 const u8 T_LUT_ping[5] = {0x07B, 0x081, 0x0E4, 0x0E7, 0x008};
 const u8 T_LUT_init[14] = {0x082, 0x068, 0x050, 0x0E8, 0x0D0, 0x0A8, 0x065, 0x07B, 0x081, 0x0E4, 0x0E7, 0x008, 0x0AC, 0x02B };
@@ -60,10 +59,6 @@ const u8 top_right[22] =  {12, 7, 13, 2, 13, 1, 13, 0, 12, 5, 12, 0, 12, 1, 12,
 const u8 bottom_left[22] = {1, 7,  2, 2,  2, 1,  2, 0,  1, 5,  1, 0,  1, 1,  1, 2,  1, 3,  1, 4,  1, 6};
 const u8 bottom_right[22]= {3, 7,  4, 2,  4, 1,  4, 0,  3, 5,  3, 0,  3, 1,  3, 2,  3, 3,  3, 4,  3, 6};
 
-// These values closely reproduce times captured with logic analyser
-#define delay_SPI_end_cycle() sleep_us(2)
-#define delay_EPD_SCL_pulse() sleep_us(2)
-
 /*
 Now define how each digit maps to the segments:
           1
@@ -281,59 +276,21 @@ void show_small_number(s16 number, bool percent){
 	}
 }
 
-_attribute_ram_code_
-__attribute__((optimize("-Os")))
-static void transmit(u8 cd, u8 data_to_send) {
-    gpio_write(EPD_SCL, LOW);
-    gpio_write(EPD_CSB, LOW);
-    delay_EPD_SCL_pulse();
-
-    // send the first bit, this indicates if the following is a command or data
-    gpio_write(EPD_SDA, cd);
-    delay_EPD_SCL_pulse();
-    gpio_write(EPD_SCL, HIGH);
-    delay_EPD_SCL_pulse();
-
-    // send 8 bits
-    for (int i = 0; i < 8; i++) {
-        // start the clock cycle
-        gpio_write(EPD_SCL, LOW);
-        // set the MOSI according to the data
-        if (data_to_send & 0x80)
-            gpio_write(EPD_SDA, HIGH);
-        else
-            gpio_write(EPD_SDA, LOW);
-        // prepare for the next bit
-        data_to_send = (data_to_send << 1);
-        delay_EPD_SCL_pulse();
-        // the data is read at rising clock (halfway the time MOSI is set)
-        gpio_write(EPD_SCL, HIGH);
-        delay_EPD_SCL_pulse();
-    }
-
-    // finish by ending the clock cycle and disabling SPI
-    gpio_write(EPD_SCL, LOW);
-    delay_SPI_end_cycle();
-    gpio_write(EPD_CSB, HIGH);
-    delay_SPI_end_cycle();
-}
-
-_attribute_ram_code_
-static void transmit_blk(u8 cd, const u8 * pdata, size_t size_data) {
-	for (int i = 0; i < size_data; i++)
-		transmit(cd, pdata[i]);
-}
-
-void init_lcd(void) {
+// full refresh: init LUT, keeps display_cmp_buff
+static void epd_reset(void) {
 	// pulse RST_N low for 110 microseconds
     gpio_write(EPD_RST, LOW);
-//	lcd_refresh_cnt = DEF_EPD_REFRESH_CNT;
+	epd_refresh_reset();
     stage_lcd = 1;
     epd_updated = 0;
     sleep_us(110);
+    gpio_write(EPD_RST, HIGH);
+}
+
+void init_lcd(void) {
 	memset(display_buff, 0, sizeof(display_buff));
 	memset(display_cmp_buff, 0, sizeof(display_cmp_buff));
-    gpio_write(EPD_RST, HIGH);
+	epd_reset();
     bls_pm_setWakeupSource(PM_WAKEUP_PAD | PM_WAKEUP_TIMER);  // gpio pad wakeup suspend/deepsleep
 }
 
@@ -347,13 +304,9 @@ void update_lcd(void){
  	if (!stage_lcd) {
 		if (memcmp(display_cmp_buff, display_buff, sizeof(display_buff))) {
 			memcpy(display_cmp_buff, display_buff, sizeof(display_buff));
-#if 0
-			if (lcd_refresh_cnt)
-				lcd_refresh_cnt--;
-			else if(wrk.ble_connected == 0)
-				init_lcd(); // pulse RST_N low for 110 microseconds
-#endif
 			lcd_flg.b.send_notify = lcd_flg.b.notify_on; // set flag LCD for send notify
+			if (epd_refresh_full())
+				epd_reset(); // pulse RST_N low for 110 microseconds
 			stage_lcd = 1;
 		}
 	}
@@ -368,25 +321,25 @@ int task_lcd(void) {
 	if (gpio_read(EPD_BUSY)) {
 		switch (stage_lcd) {
 		case 1: // Update/Init, stage 1
-			transmit_blk(0, T_LUT_ping, sizeof(T_LUT_ping));
+			epd_transmit_blk(0, T_LUT_ping, sizeof(T_LUT_ping));
 			stage_lcd = 2;
 			break;
 		case 2: // Update/Init, stage 2
 			if (epd_updated) {
-				transmit_blk(0, T_LUT_work, sizeof(T_LUT_work));
+				epd_transmit_blk(0, T_LUT_work, sizeof(T_LUT_work));
 			} else {
-				transmit_blk(0, T_LUT_init, sizeof(T_LUT_init));
+				epd_transmit_blk(0, T_LUT_init, sizeof(T_LUT_init));
 			}
 			stage_lcd = 3;
 			break;
 		case 3: // Update/Init, stage 3
-			transmit(0, 0x040);
-			transmit(0, 0x0A9);
-			transmit(0, 0x0A8);
-			transmit_blk(1, display_cmp_buff, sizeof(display_cmp_buff));
-			transmit(0, 0x0AB);
-			transmit(0, 0x0AA);
-			transmit(0, 0x0AF);
+			epd_transmit(0, 0x040);
+			epd_transmit(0, 0x0A9);
+			epd_transmit(0, 0x0A8);
+			epd_transmit_blk(1, display_cmp_buff, sizeof(display_cmp_buff));
+			epd_transmit(0, 0x0AB);
+			epd_transmit(0, 0x0AA);
+			epd_transmit(0, 0x0AF);
 			if (epd_updated) {
 				stage_lcd = 4;
 				// EPD_BUSY: ~500 ms
@@ -398,9 +351,9 @@ int task_lcd(void) {
 			sleep_us(200); // Waiting for EPD BUSY to be setting?
 			break;
 		case 4: // Update, stage 4
-			transmit(0, 0x0AE);
-			transmit(0, 0x028);
-			transmit(0, 0x0AD);
+			epd_transmit(0, 0x0AE);
+			epd_transmit(0, 0x028);
+			epd_transmit(0, 0x0AD);
 			stage_lcd = 0;
 			break;
 		default:
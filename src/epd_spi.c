@@ -0,0 +1,106 @@
+/*
+ * epd_spi.c
+ *
+ * E-paper 3-wire SPI transport for epd_*.c
+ */
+#include "tl_common.h"
+#include "app_config.h"
+#if (DEV_SERVICES & SERVICE_SCREEN) && (USE_EPD)
+#include "drivers.h"
+#include "drivers/8258/gpio_8258.h"
+#include "epd_spi.h"
+
+// EPD_SCL half period 1.5 us, as captured from the original firmware with a logic analyzer
+#define EPD_SCL_HALF_TICK	(CLOCK_16M_SYS_TIMER_CLK_1US * 3 / 2)
+
+#define epd_pin_hi(pin)	BM_SET(reg_gpio_out(pin), (pin) & 0xff)
+#define epd_pin_lo(pin)	BM_CLR(reg_gpio_out(pin), (pin) & 0xff)
+
+// each edge is timed from the previous one: GPIO writes and the loop are not added to the bit time
+#define epd_next_edge(t) { t += EPD_SCL_HALF_TICK; while((int)(clock_time() - t) < 0); }
+
+// bit 'b' of 'v' on EPD_SDA with EPD_SCL low, the data is read at rising clock,
+// EPD_SCL is low again at the end of the bit
+#define epd_bit(t, v, b) { \
+	if ((v) & BIT(b)) \
+		epd_pin_hi(EPD_SDA); \
+	else \
+		epd_pin_lo(EPD_SDA); \
+	epd_next_edge(t); \
+	epd_pin_hi(EPD_SCL); \
+	epd_next_edge(t); \
+	epd_pin_lo(EPD_SCL); \
+}
+
+#if USE_EPD_HW_SPI
+#define EPD_SPI_CLK		1000000 // Hz
+#define EPD_SPI_DIV		(CLOCK_SYS_CLOCK_HZ / (2 * EPD_SPI_CLK) - 1)
+
+// SPI master, mode 0: PB7 - DO, PD7 - CK. The pins stay GPIO between the frames.
+// Once after the power-up or deep retention (SPI clock off), as init_i2c().
+_attribute_ram_code_
+static void epd_spi_init(void) {
+	reg_clk_en0 |= FLD_CLK0_SPI_EN;
+	reg_spi_sp = EPD_SPI_DIV | FLD_SPI_ENABLE;
+	reg_spi_ctrl |= FLD_SPI_MASTER_MODE_EN;
+	reg_spi_ctrl &= ~(FLD_SPI_DATA_OUT_DIS | FLD_SPI_RD); // data output on, write (SDK spi_write())
+	reg_spi_inv_clk &= ~FLD_SPI_MODE_WORK_MODE;
+	reg_pin_i2c_spi_out_en |= FLD_PIN_PBGROUP_SPI_EN | FLD_PIN_PDGROUP_SPI_EN;
+	gpio_set_func(EPD_SDA, AS_SPI);
+	gpio_set_func(EPD_SCL, AS_SPI);
+	reg_pin_i2c_spi_en = (reg_pin_i2c_spi_en | FLD_PIN_PD7_SPI_EN) & (~FLD_PIN_PD7_I2C_EN);
+	BM_SET(reg_gpio_func(EPD_SDA), EPD_SDA & 0xff);
+	BM_SET(reg_gpio_func(EPD_SCL), EPD_SCL & 0xff);
+}
+#endif // USE_EPD_HW_SPI
+
+/* One 9-bit frame from EPD_SCL low, unrolled: EPD_CSB low with the D/C bit,
+ * high with the last falling edge and for a half period after it.
+ * 19 half periods, 't' - the time of the last edge */
+_attribute_ram_code_
+static u32 epd_frame(u32 t, u8 cd, u8 data_to_send) {
+	epd_pin_lo(EPD_CSB);
+	epd_bit(t, cd, 0);
+#if USE_EPD_HW_SPI
+	// 8 bits
+	BM_CLR(reg_gpio_func(EPD_SDA), EPD_SDA & 0xff);
+	BM_CLR(reg_gpio_func(EPD_SCL), EPD_SCL & 0xff);
+	reg_spi_data = data_to_send;
+	while (reg_spi_ctrl & FLD_SPI_BUSY);
+	BM_SET(reg_gpio_func(EPD_SCL), EPD_SCL & 0xff);
+	BM_SET(reg_gpio_func(EPD_SDA), EPD_SDA & 0xff);
+	t = clock_time();
+#else
+	epd_bit(t, data_to_send, 7);
+	epd_bit(t, data_to_send, 6);
+	epd_bit(t, data_to_send, 5);
+	epd_bit(t, data_to_send, 4);
+	epd_bit(t, data_to_send, 3);
+	epd_bit(t, data_to_send, 2);
+	epd_bit(t, data_to_send, 1);
+	epd_bit(t, data_to_send, 0);
+#endif
+	epd_pin_hi(EPD_CSB);
+	epd_next_edge(t);
+	return t;
+}
+
+_attribute_ram_code_
+void epd_transmit_blk(u8 cd, const u8 * pdata, u32 size_data) {
+	u32 t;
+#if USE_EPD_HW_SPI
+	if ((reg_clk_en0 & FLD_CLK0_SPI_EN)==0)
+		epd_spi_init();
+#endif
+	epd_pin_lo(EPD_SCL);
+	t = clock_time();
+	while (size_data--)
+		t = epd_frame(t, cd, *pdata++);
+}
+
+_attribute_ram_code_
+void epd_transmit(u8 cd, u8 data_to_send) {
+	epd_transmit_blk(cd, &data_to_send, 1);
+}
+
+#endif // (DEV_SERVICES & SERVICE_SCREEN) && (USE_EPD)
@@ -0,0 +1,18 @@
+/*
+ * epd_spi.h
+ *
+ * E-paper 3-wire SPI: 9-bit frames (D/C bit + 8 bits, MSB first),
+ * data latched on the rising edge of EPD_SCL, EPD_CSB low for each frame.
+ */
+#ifndef _EPD_SPI_H_
+#define _EPD_SPI_H_
+
+#ifndef USE_EPD_HW_SPI
+#define USE_EPD_HW_SPI	0 // = 1 8 data bits via SPI block (EPD_SDA = GPIO_PB7, EPD_SCL = GPIO_PD7)
+#endif
+
+// cd: 0 - command, 1 - data
+void epd_transmit(u8 cd, u8 data_to_send);
+void epd_transmit_blk(u8 cd, const u8 * pdata, u32 size_data);
+
+#endif // _EPD_SPI_H_
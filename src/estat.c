@@ -0,0 +1,78 @@
+/*
+ * estat.c
+ *
+ * Per-subsystem active and sleep time accounting
+ */
+#include "tl_common.h"
+#include "app_config.h"
+#if USE_ENERGY_STAT
+#include "drivers.h"
+#include "estat.h"
+
+RAM estat_t estat;
+
+/* Charge the ticks since the last switch to the subsystem id */
+_attribute_ram_code_
+static void estat_charge(u8 id) {
+	u32 t = clock_time();
+	estat.acc[id] += t - estat.tick;
+	estat.tick = t;
+}
+
+_attribute_ram_code_
+void estat_switch(u8 id) {
+	estat_charge(estat.cur);
+	estat.cur = id;
+}
+
+/* Returns the previous subsystem for estat_switch() on exit */
+_attribute_ram_code_
+u8 estat_enter(u8 id) {
+	u8 prev = estat.cur;
+	estat_switch(id);
+	return prev;
+}
+
+/* Switch only if the current subsystem is 'from' (scan window open/close) */
+_attribute_ram_code_
+void estat_set(u8 from, u8 to) {
+	if (estat.cur == from)
+		estat_switch(to);
+}
+
+/* Wakeup: the sleep time goes to ESTAT_SUSPEND or ESTAT_DEEP */
+_attribute_ram_code_
+void estat_wake(u8 id) {
+	estat_charge(id);
+	estat.cur = ESTAT_OTHER;
+}
+
+/* Called once per second: u32 ticks overflow in 268 sec */
+_attribute_ram_code_
+__attribute__((optimize("-Os")))
+void estat_fold(void) {
+	u32 i, ms;
+	for (i = 0; i < ESTAT_CNT; i++) {
+		if (estat.acc[i] >= CLOCK_16M_SYS_TIMER_CLK_1MS) {
+			ms = estat.acc[i] / CLOCK_16M_SYS_TIMER_CLK_1MS;
+			estat.ms[i] += ms;
+			estat.acc[i] -= ms * CLOCK_16M_SYS_TIMER_CLK_1MS;
+		}
+	}
+}
+
+void estat_clear(void) {
+	memset(estat.acc, 0, sizeof(estat.acc));
+	memset(estat.ms, 0, sizeof(estat.ms));
+	estat.tick = clock_time();
+}
+
+__attribute__((optimize("-Os")))
+u32 estat_active_ms(void) {
+	u32 i, ms = 0;
+	for (i = 0; i < ESTAT_ACTIVE_CNT; i++)
+		ms += estat.ms[i];
+	return ms;
+}
+
+#endif // USE_ENERGY_STAT
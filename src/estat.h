@@ -0,0 +1,56 @@
+/*
+ * estat.h
+ *
+ * Per-subsystem active and sleep time accounting.
+ * The time between two switches is charged to one subsystem only:
+ * nested sections (memo write in read_sensors) are not counted twice.
+ */
+#ifndef _ESTAT_H_
+#define _ESTAT_H_
+
+#if USE_ENERGY_STAT
+
+typedef enum {
+	ESTAT_OTHER = 0,	// active: BLE stack, main_loop
+	ESTAT_SENSOR,		// sensor I/O, battery ADC
+	ESTAT_FLASH,		// flash writes/erases
+	ESTAT_LCD,			// display transfer
+	ESTAT_AES,			// AES-CCM
+	ESTAT_NOTIFY,		// notify sending
+	ESTAT_SCAN,			// scan windows
+	ESTAT_SUSPEND,		// suspend
+	ESTAT_DEEP,			// deep-sleep retention
+	ESTAT_CNT
+} ESTAT_IDS_e;
+
+#define ESTAT_ACTIVE_CNT	ESTAT_SUSPEND // ESTAT_OTHER..ESTAT_SCAN
+
+typedef struct _estat_t {
+	u32 tick;				// clock_time() of the last switch
+	u32 acc[ESTAT_CNT];		// ticks < 1 ms, folded into ms[] by estat_fold()
+	u32 ms[ESTAT_CNT];		// totals, ms
+	u8 cur;					// ESTAT_IDS_e
+} estat_t;
+
+extern estat_t estat;
+
+void estat_switch(u8 id);
+u8 estat_enter(u8 id);
+void estat_set(u8 from, u8 to);
+void estat_wake(u8 id);
+void estat_fold(void);
+void estat_clear(void);
+u32 estat_active_ms(void);
+
+/* A section: u8 prev = estat_enter(id); ... estat_leave(prev);
+ * the sections nest, each one restores the subsystem it interrupted */
+#define estat_leave(prev)	estat_switch(prev)
+
+#else
+
+#define estat_enter(id)		0
+#define estat_leave(prev)	((void)(prev))
+
+#endif // USE_ENERGY_STAT
+
+#endif // _ESTAT_H_
@@ -0,0 +1,167 @@
+/*
+ * filter.c
+ *
+ *  Fixed-point filters of the measured values (median, EMA, Kalman),
+ *  adaptive measurement step
+ */
+#include "tl_common.h"
+#include "app_config.h"
+
+#if USE_SENSOR_FILTER || USE_MEAS_ADAPTIVE
+
+#include "app.h"
+#include "sensor.h"
+#include "flash_eep.h"
+#include "filter.h"
+
+#if USE_SENSOR_FILTER
+
+RAM filter_t flt;
+
+__attribute__((optimize("-Os")))
+static s16 filter_median(filter_ch_t *pch, filter_cfg_t *pcfg, s16 z) {
+	s16 tmp[FILTER_MEDIAN_MAX];
+	s16 v;
+	int i, j, n = pcfg->par1;
+	if (n < 3)
+		n = 3;
+	else if (n > FILTER_MEDIAN_MAX)
+		n = FILTER_MEDIAN_MAX;
+	if (pch->idx >= n)
+		pch->idx = 0;
+	pch->buf[pch->idx++] = z;
+	if (pch->cnt < n)
+		pch->cnt++;
+	// insertion sort of a copy
+	for (i = 0; i < pch->cnt; i++) {
+		v = pch->buf[i];
+		for (j = i; j > 0 && tmp[j - 1] > v; j--)
+			tmp[j] = tmp[j - 1];
+		tmp[j] = v;
+	}
+	return tmp[pch->cnt >> 1];
+}
+
+__attribute__((optimize("-Os")))
+static s16 filter_ema(filter_ch_t *pch, filter_cfg_t *pcfg, s16 z) {
+	int shf = pcfg->par1;
+	if (shf < 1)
+		shf = 1;
+	else if (shf > 7)
+		shf = 7;
+	if (pch->cnt == 0) {
+		pch->cnt = 1;
+		pch->x = (s32)z << FILTER_EMA_SHL;
+	} else
+		pch->x += (((s32)z << FILTER_EMA_SHL) - pch->x) >> shf;
+	return (pch->x + (1 << (FILTER_EMA_SHL - 1))) >> FILTER_EMA_SHL;
+}
+
+__attribute__((optimize("-Os")))
+static s16 filter_kalman(filter_ch_t *pch, filter_cfg_t *pcfg, s16 z) {
+	u32 q = (pcfg->par1 * pcfg->par1) << FILTER_KALMAN_PSHL; // process variance
+	u32 r = (pcfg->par2 * pcfg->par2) << FILTER_KALMAN_PSHL; // measurement variance
+	u32 k;
+	if (r == 0)
+		r = 1 << FILTER_KALMAN_PSHL;
+	if (pch->cnt == 0) {
+		pch->cnt = 1;
+		pch->x = (s32)z << FILTER_KALMAN_SHL;
+		pch->p = r;
+	} else {
+		pch->p += q;
+		if (pch->p > (0xffff << FILTER_KALMAN_PSHL))
+			pch->p = 0xffff << FILTER_KALMAN_PSHL; // p << 8 fits u32
+		r += pch->p; // p + r
+		k = (pch->p << 8) / r; // gain x256, rounded
+		if (((pch->p << 8) - k * r) * 2 >= r)
+			k++;
+		if (k == 0)
+			k = 1; // q = 0: p decays to 0, the estimate must not freeze
+		pch->x += ((((s32)z << FILTER_KALMAN_SHL) - pch->x) * (s32)k + 128) >> 8;
+		pch->p = (pch->p * (256 - k)) >> 8;
+	}
+	return (pch->x + (1 << (FILTER_KALMAN_SHL - 1))) >> FILTER_KALMAN_SHL;
+}
+
+__attribute__((optimize("-Os")))
+static s16 filter_value(int chn, s16 z) {
+	filter_ch_t *pch = &flt.ch[chn];
+	filter_cfg_t *pcfg = &flt.cfg[chn];
+	switch (pcfg->type) {
+	case FILTER_MEDIAN:
+		return filter_median(pch, pcfg, z);
+	case FILTER_EMA:
+		return filter_ema(pch, pcfg, z);
+	case FILTER_KALMAN:
+		return filter_kalman(pch, pcfg, z);
+	default:
+		return z;
+	}
+}
+
+// Called after a successful read of the sensor, before the values are used
+__attribute__((optimize("-Os")))
+void filter_measures(void) {
+	measured_data.temp = filter_value(0, measured_data.temp);
+	measured_data.humi = filter_value(1, measured_data.humi);
+}
+
+void reset_filter(void) {
+	memset(&flt.ch, 0, sizeof(flt.ch));
+}
+
+void init_filter(void) {
+	if (flash_read_cfg(&flt.cfg, EEP_ID_FLT, sizeof(flt.cfg)) != sizeof(flt.cfg))
+		memset(&flt.cfg, 0, sizeof(flt.cfg)); // all FILTER_NONE
+	reset_filter();
+}
+
+#endif // USE_SENSOR_FILTER
+
+#if USE_MEAS_ADAPTIVE
+RAM struct {
+	s16 temp; // x0.01 C
+	s16 humi; // x0.01 %
+} meas_prev; // previous measured values
+
+/* Adaptive measurement step (rate of change), after read sensors:
+ * change over the step <= MEAS_ADAPT_x -> step x2, up to wrk.meas_scale_max,
+ * change over the step > 2 * MEAS_ADAPT_x -> step = measurement_step_time (cfg.measure_interval) */
+_attribute_ram_code_
+__attribute__((optimize("-Os")))
+void meas_adaptive_step(void) {
+#if (DEV_SERVICES & (SERVICE_THS | SERVICE_PLM))
+	int dt = measured_data.temp - meas_prev.temp;
+	int dh = measured_data.humi - meas_prev.humi;
+	meas_prev.temp = measured_data.temp;
+	meas_prev.humi = measured_data.humi;
+#else // SERVICE_18B20
+	int dt = measured_data.xtemp[0] - meas_prev.temp;
+	int dh = 0;
+	meas_prev.temp = measured_data.xtemp[0];
+#if (USE_SENSOR_MY18B20 == 2)
+	dh = measured_data.xtemp[1] - meas_prev.humi;
+	meas_prev.humi = measured_data.xtemp[1];
+#endif
+#endif
+	if (dt < 0)
+		dt = -dt;
+	if (dh < 0)
+		dh = -dh;
+	if (wrk.ble_connected
+		|| dt > 2 * MEAS_ADAPT_TEMP
+		|| dh > 2 * MEAS_ADAPT_HUMI) {
+		wrk.meas_scale = 1;
+		wrk.meas_skip = 0;
+	} else if (dt <= MEAS_ADAPT_TEMP
+		&& dh <= MEAS_ADAPT_HUMI
+		&& wrk.meas_scale < wrk.meas_scale_max) {
+		wrk.meas_scale <<= 1;
+		if (wrk.meas_scale > wrk.meas_scale_max)
+			wrk.meas_scale = wrk.meas_scale_max;
+	}
+}
+#endif // USE_MEAS_ADAPTIVE
+
+#endif // USE_SENSOR_FILTER || USE_MEAS_ADAPTIVE
@@ -0,0 +1,58 @@
+/*
+ * filter.h
+ *
+ *  Fixed-point filters of the measured values, adaptive measurement step
+ */
+
+#ifndef _FILTER_H_
+#define _FILTER_H_
+
+#include "app_config.h"
+
+#if USE_SENSOR_FILTER
+
+#define FILTER_CHANNELS		2	// measured_data.temp, measured_data.humi
+#define FILTER_MEDIAN_MAX	5	// max median window
+#define FILTER_EMA_SHL		8	// EMA estimate x256
+#define FILTER_KALMAN_SHL	4	// Kalman estimate x16
+#define FILTER_KALMAN_PSHL	8	// Kalman variance x256, up to 0xffff
+
+typedef enum {
+	FILTER_NONE = 0,
+	FILTER_MEDIAN,	// median of the last par1 (3..5) values
+	FILTER_EMA,		// x += (z - x) >> par1 (1..7)
+	FILTER_KALMAN	// 1-D Kalman: par1 = process noise, par2 = measurement noise (x0.01 units)
+} FILTER_TYPES_e;
+
+typedef struct __attribute__((packed)) _filter_cfg_t {
+	u8 type;	// FILTER_TYPES_e
+	u8 par1;
+	u8 par2;
+} filter_cfg_t;
+
+typedef struct _filter_ch_t {
+	s32 x;		// EMA, Kalman: estimate
+	u32 p;		// Kalman: estimate variance x256
+	s16 buf[FILTER_MEDIAN_MAX]; // median: last values
+	u8 cnt;		// number of values, 0 - reset
+	u8 idx;		// median: buf index
+} filter_ch_t;
+
+typedef struct _filter_t {
+	filter_cfg_t cfg[FILTER_CHANNELS];
+	filter_ch_t ch[FILTER_CHANNELS];
+} filter_t;
+
+extern filter_t flt;
+
+void init_filter(void);
+void reset_filter(void);
+void filter_measures(void);
+
+#endif // USE_SENSOR_FILTER
+
+#if USE_MEAS_ADAPTIVE
+void meas_adaptive_step(void);	// after read sensors: wrk.meas_scale
+#endif
+
+#endif /* _FILTER_H_ */
@@ -9,6 +9,7 @@
 #include "stack/ble/ble.h"
 #include "vendor/common/blt_common.h"
 #include "flash_eep.h"
+#include "estat.h"
 
 //-----------------------------------------------------------------------------
 #define FEEP_ERR_PREFIX         "[FEEP Err]"
@@ -90,6 +91,30 @@ typedef union __attribute__((packed)) // заголовок объекта со
 #define FMEM_ERROR_MAX 5
 
 unsigned char buf_epp[MAX_FOBJ_SIZE+fobj_head_size];
+
+// RAM directory of the current segment: the last record of each object id
+typedef struct _feep_dir_t {
+	unsigned int base;	// адрес текущего сегмента, = 0 - не загружен
+	unsigned int fend;	// адрес для записи следующего объекта
+	unsigned char cnt;	// кол-во id в таблице
+	unsigned char ovr;	// = 1 - не все id в таблице, искать во flash
+	struct {
+		unsigned short id;
+		unsigned short size;
+		unsigned short offs;	// смещение заголовка объекта в сегменте
+	} __attribute__((packed)) obj[FEEP_DIR_SIZE];
+} feep_dir_t;
+
+RAM feep_dir_t feep_dir;
+
+// incremental pack: old segment = feep_dir.base
+typedef struct _feep_pack_t {
+	unsigned int seg;	// новый сегмент, = 0 - нет упаковки
+	unsigned int rdaddr;	// курсор в старом сегменте, = 0 - новый сегмент не подготовлен
+	unsigned int wraddr;	// адрес записи в новом сегменте
+} feep_pack_t;
+
+RAM feep_pack_t feep_pack;
 #if 0
 #define _flash_read_dword(a) (*(volatile u32*)(FLASH_BASE_ADDR + (a)))
 #define _flash_read(a,b,c) memcpy((void *)c, (void *)(FLASH_BASE_ADDR + (unsigned int)a), b) // _flash_read(rdaddr, len, pbuf);
@@ -186,91 +211,166 @@ LOCAL unsigned int get_addr_fobj(unsigned int base, fobj_head *obj, bool flg)
 	return reta;
 }
 //-----------------------------------------------------------------------------
-// FunctionName : get_addr_fend
-// Поиск последнего адреса в сегменте для записи объекта
-// Returns : адрес для записи объекта
-// ret < FMEM_ERROR_MAX - ошибка
-// ret = 0 - не влезет, на pack
+// FunctionName : feep_dir_set
+// Обновить запись объекта в RAM директории
+//-----------------------------------------------------------------------------
+FEEP_CODE_ATTR
+LOCAL void feep_dir_set(fobj_head obj, unsigned int faddr)
+{
+	unsigned int i;
+	for (i = 0; i < feep_dir.cnt; i++) {
+		if (feep_dir.obj[i].id == obj.n.id)
+			break;
+	}
+	if (i >= FEEP_DIR_SIZE) {
+		feep_dir.ovr = 1;
+		return;
+	}
+	if (i == feep_dir.cnt)
+		feep_dir.cnt++;
+	feep_dir.obj[i].id = obj.n.id;
+	feep_dir.obj[i].size = obj.n.size;
+	feep_dir.obj[i].offs = faddr - feep_dir.base;
+}
+//-----------------------------------------------------------------------------
+// FunctionName : feep_dir_load
+// Построить RAM директорию текущего сегмента (один проход по сегменту)
 //-----------------------------------------------------------------------------
 FEEP_CODE_ATTR
-LOCAL unsigned int get_addr_fobj_save(unsigned int base, fobj_head obj)
+LOCAL void feep_dir_load(void)
 {
 	fobj_head fobj;
+	unsigned int base = get_addr_bscfg();
 	unsigned int faddr = base + 4;
-	unsigned int fend = base + FMEMORY_SCFG_BANK_SIZE - align(obj.n.size + fobj_head_size);
+	unsigned int fend = base + FMEMORY_SCFG_BANK_SIZE - align(fobj_head_size);
+	feep_dir.base = base;
+	feep_dir.cnt = 0;
+	feep_dir.ovr = 0;
 	do {
-		fobj.x = _flash_read_dword(faddr); // if (flash_read(faddr, &fobj, fobj_head_size)) return -(FMEM_FLASH_ERR);
-		if (fobj.x == fobj_x_free) {
-			if (faddr < fend) {
-				return faddr;
-			}
-			return 0; // не влезет, на pack
-		}
+		fobj.x = _flash_read_dword(faddr);
+		if (fobj.x == fobj_x_free) break;
 		if (fobj.n.size <= MAX_FOBJ_SIZE) {
+			feep_dir_set(fobj, faddr);
 			faddr += align(fobj.n.size + fobj_head_size);
 		}
 		else faddr += align(MAX_FOBJ_SIZE + fobj_head_size);
 	}
 	while (faddr < fend);
-	return 0; // не влезет, на pack
+	feep_dir.fend = faddr;
+}
+//-----------------------------------------------------------------------------
+// FunctionName : feep_dir_get
+// Поиск последней записи объекта по id в RAM директории
+// Returns : адрес записи объекта, obj->n.size - размер
+// 0 - не найден
+//-----------------------------------------------------------------------------
+FEEP_CODE_ATTR
+LOCAL unsigned int feep_dir_get(fobj_head *obj)
+{
+	unsigned int i;
+	if (feep_dir.base == 0)
+		feep_dir_load();
+	for (i = 0; i < feep_dir.cnt; i++) {
+		if (feep_dir.obj[i].id == obj->n.id) {
+			obj->n.size = feep_dir.obj[i].size;
+			return feep_dir.base + feep_dir.obj[i].offs;
+		}
+	}
+	if (feep_dir.ovr)
+		return get_addr_fobj(feep_dir.base, obj, false);
+	return 0;
 }
 //=============================================================================
-// FunctionName : pack_cfg_fmem
-// Returns      : адрес для записи объекта
+// FunctionName : pack_cfg_start
+// Начать упаковку текущего сегмента в следующий
 //-----------------------------------------------------------------------------
 FEEP_CODE_ATTR
-LOCAL unsigned int pack_cfg_fmem(fobj_head obj)
+LOCAL void pack_cfg_start(void)
 {
-	fobj_head fobj;
-	unsigned int foldseg = get_addr_bscfg(); // поиск текушего сегмента
-//	if (foldseg < FMEM_ERROR_MAX) return fnewseg; // error
-	unsigned int fnewseg = foldseg + FMEMORY_SCFG_BANK_SIZE;
+	unsigned int fnewseg = feep_dir.base + FMEMORY_SCFG_BANK_SIZE;
 	if (fnewseg >= (FMEMORY_SCFG_BASE_ADDR + FMEMORY_SCFG_BANKS * FMEMORY_SCFG_BANK_SIZE))
 		fnewseg = FMEMORY_SCFG_BASE_ADDR;
-	unsigned int faddr = foldseg;
-	unsigned int rdaddr, wraddr;
-	unsigned short len;
-	unsigned int * pbuf = (unsigned int *) malloc(align(MAX_FOBJ_SIZE + fobj_head_size) >> 2);
-	if (pbuf == NULL) {
-		DBG_FEEP_ERR("pack malloc error!\n");
-		return -(FMEM_MEM_ERR);
-	}
 #if CONFIG_DEBUG_LOG > 3
 	DBG_FEEP_INFO("repack base to new seg: %p\n", fnewseg);
 #endif
-	if (_flash_read_dword(fnewseg) != 0xFFFFFFFF)
-		_flash_erase_sector(fnewseg); // if (flash_erase_sector(fnewseg)) return -(FMEM_FLASH_ERR);
-	_flash_write_dword(fnewseg, 0x7FFFFFFF); // сегмент занят
-	faddr += 4;
-	wraddr = fnewseg + 4;
-	do {
-		fobj.x = _flash_read_dword(faddr); //if (flash_read(faddr, &fobj, fobj_head_size)) return -(FMEM_FLASH_ERR); // последовательное чтение id из старого сегмента
-		if (fobj.x == fobj_x_free) break;
-		if (fobj.n.size > MAX_FOBJ_SIZE) len = align(MAX_FOBJ_SIZE + fobj_head_size);
-		else len = align(fobj.n.size + fobj_head_size);
-		if (fobj.n.id != obj.n.id &&  fobj.n.size <= MAX_FOBJ_SIZE) { // объект валидный
-			if (get_addr_fobj(fnewseg, &fobj, true) == 0) { // найдем, сохранили ли мы его уже? нет
-				rdaddr = get_addr_fobj(foldseg, &fobj, false); // найдем последнее сохранение объекта в старом сенгменте, size изменен
-				if (rdaddr < FMEM_ERROR_MAX) return rdaddr; // ???
-				if (wraddr + len >= fnewseg + FMEMORY_SCFG_BANK_SIZE) {
-					DBG_FEEP_ERR("pack segment overflow!\n");
-					return -(FMEM_OVR_ERR);
-				};
-				_flash_read(rdaddr, len, pbuf);
-				// перепишем данные obj в новый сектор
-				_flash_write(wraddr, len, pbuf);
-			};
-		};
-		faddr += len;
-	} while (faddr  < (foldseg + FMEMORY_SCFG_BANK_SIZE - align(fobj_head_size+1)));
-	free(pbuf);
-	// обратный счетчик стираний/записей секторов как id
-	_flash_write_dword(fnewseg, (_flash_read_dword(foldseg) - 1)); // if (flash_write(fnewseg, &foldseg + SPI_FLASH_BASE, 4)) return -(FMEM_FLASH_ERR);
-	_flash_erase_sector(foldseg);
+	feep_pack.seg = fnewseg;
+	feep_pack.rdaddr = 0;
+}
+//-----------------------------------------------------------------------------
+// FunctionName : pack_cfg_step
+// Один шаг упаковки: стирание нового сегмента, перенос одного объекта
+// или фиксация нового сегмента (запись счетчика в заголовок).
+// До фиксации текущим остается старый сегмент (заголовок нового = 0x7FFFFFFF),
+// новые записи идут в старый сегмент после курсора и будут перенесены.
+// Returns : 1 - продолжается, 0 - завершена (нет упаковки)
+// ret < 0 - ошибка, упаковка прервана
+//-----------------------------------------------------------------------------
+FEEP_CODE_ATTR
+LOCAL int pack_cfg_step(void)
+{
+	fobj_head fobj, lobj;
+	unsigned int rdaddr = feep_pack.rdaddr;
+	unsigned int len;
+	if (feep_pack.seg == 0)
+		return 0;
+	if (rdaddr == 0) {
+		if (_flash_read_dword(feep_pack.seg) != 0xFFFFFFFF)
+			_flash_erase_sector(feep_pack.seg); // if (flash_erase_sector(fnewseg)) return -(FMEM_FLASH_ERR);
+		_flash_write_dword(feep_pack.seg, 0x7FFFFFFF); // сегмент занят
+		feep_pack.rdaddr = feep_dir.base + 4;
+		feep_pack.wraddr = feep_pack.seg + 4;
+		return 1;
+	}
+	if (rdaddr >= feep_dir.fend) {
+		// обратный счетчик стираний/записей секторов как id
+		_flash_write_dword(feep_pack.seg, (_flash_read_dword(feep_dir.base) - 1)); // if (flash_write(fnewseg, &foldseg + SPI_FLASH_BASE, 4)) return -(FMEM_FLASH_ERR);
+		feep_pack.seg = 0;
+		feep_dir_load();
 #if CONFIG_DEBUG_LOG > 3
-	DBG_FEEP_INFO("free: %d\n", FMEMORY_SCFG_BANK_SIZE - (faddr & (FMEMORY_SCFG_BANK_SIZE-1)));
+		DBG_FEEP_INFO("free: %d\n", feep_dir.base + FMEMORY_SCFG_BANK_SIZE - feep_dir.fend);
 #endif
-	return get_addr_fobj_save(fnewseg, obj); // адрес для записи объекта;
+		return 0;
+	}
+	fobj.x = _flash_read_dword(rdaddr); //if (flash_read(faddr, &fobj, fobj_head_size)) return -(FMEM_FLASH_ERR); // последовательное чтение id из старого сегмента
+	if (fobj.n.size > MAX_FOBJ_SIZE) {
+		feep_pack.rdaddr += align(MAX_FOBJ_SIZE + fobj_head_size);
+		return 1;
+	}
+	len = align(fobj.n.size + fobj_head_size);
+	feep_pack.rdaddr += len;
+	lobj = fobj;
+	if (feep_dir_get(&lobj) == rdaddr) { // последняя запись объекта
+		if (feep_pack.wraddr + len >= feep_pack.seg + FMEMORY_SCFG_BANK_SIZE) {
+			DBG_FEEP_ERR("pack segment overflow!\n");
+			feep_pack.seg = 0;
+			return FMEM_OVR_ERR;
+		}
+		_flash_read(rdaddr, len, buf_epp);
+		// перепишем данные obj в новый сектор
+		_flash_write(feep_pack.wraddr, len, buf_epp);
+		feep_pack.wraddr += len;
+	}
+	return 1;
+}
+//=============================================================================
+// FunctionName : flash_eep_task
+// Упаковка по шагам в свободное время (main_loop),
+// начинается при свободном месте в сегменте < FEEP_PACK_FREE
+//-----------------------------------------------------------------------------
+FEEP_CODE_ATTR
+void flash_eep_task(void)
+{
+	if (feep_dir.base == 0
+		|| (int)(bls_pm_getSystemWakeupTick() - clock_time()) <= FEEP_STEP_TIME_MS * CLOCK_16M_SYS_TIMER_CLK_1MS)
+		return;
+	if (feep_pack.seg == 0
+		&& feep_dir.base + FMEMORY_SCFG_BANK_SIZE - feep_dir.fend >= FEEP_PACK_FREE)
+		return;
+	u8 estat_prev = estat_enter(ESTAT_FLASH);
+	if (feep_pack.seg == 0)
+		pack_cfg_start();
+	pack_cfg_step();
+	estat_leave(estat_prev);
 }
 //-----------------------------------------------------------------------------
 FEEP_CODE_ATTR
@@ -280,50 +380,55 @@ LOCAL signed short _flash_write_cfg(void *ptr, unsigned short id, unsigned short
 	fobj.n.id = id;
 	fobj.n.size = size;
 //	bool retb = false;
-	unsigned int faddr = get_addr_bscfg();
-
-	if (faddr >= FMEM_ERROR_MAX)  {
-		unsigned int xfaddr = get_addr_fobj(faddr, &fobj, false);
-		if (xfaddr > FMEM_ERROR_MAX && size == fobj.n.size) {
-			if (size == 0
-					|| _flash_memcmp(xfaddr + fobj_head_size, size, ptr) == 0) {
+	unsigned int faddr;
+	unsigned int xfaddr = feep_dir_get(&fobj);
+	if (xfaddr > FMEM_ERROR_MAX && size == fobj.n.size) {
+		if (size == 0
+				|| _flash_memcmp(xfaddr + fobj_head_size, size, ptr) == 0) {
 #if CONFIG_DEBUG_LOG > 3
-					DBG_FEEP_INFO("write obj is identical, id: %04x [%d]\n", id, size);
+				DBG_FEEP_INFO("write obj is identical, id: %04x [%d]\n", id, size);
 #endif
-					return size; // уже записано то-же самое
-			}
+				return size; // уже записано то-же самое
+		}
 #if CONFIG_DEBUG_LOG > 100
-			else {
-				int i;
-				uint8_t * p = (uint8_t *)(SPI_FLASH_BASE + xfaddr + fobj_head_size);
-				uint8_t * r = (uint8_t *) ptr;
-				for(i=0; i < size; i+=8) {
-					DBG_8195A("buf[%d]\t%02X %02X %02X %02X  %02X %02X %02X %02X\n",
-								i, r[i], r[i+1], r[i+2], r[i+3], r[i+4], r[i+5], r[i+6], r[i+7]);
-					DBG_8195A("obj[%d]\t%02X %02X %02X %02X  %02X %02X %02X %02X\n",
-								i, p[i], p[i+1], p[i+2], p[i+3], p[i+4], p[i+5], p[i+6], p[i+7]);
-				}
+		else {
+			int i;
+			uint8_t * p = (uint8_t *)(SPI_FLASH_BASE + xfaddr + fobj_head_size);
+			uint8_t * r = (uint8_t *) ptr;
+			for(i=0; i < size; i+=8) {
+				DBG_8195A("buf[%d]\t%02X %02X %02X %02X  %02X %02X %02X %02X\n",
+							i, r[i], r[i+1], r[i+2], r[i+3], r[i+4], r[i+5], r[i+6], r[i+7]);
+				DBG_8195A("obj[%d]\t%02X %02X %02X %02X  %02X %02X %02X %02X\n",
+							i, p[i], p[i+1], p[i+2], p[i+3], p[i+4], p[i+5], p[i+6], p[i+7]);
 			}
-#endif
 		}
+#endif
 	}
 	DBG_FEEP_INFO("write obj id: %04x [%d]\n", id, size);
 	fobj.n.size = size;
 //	flash_write_protect(&flashobj, 0); // Flash Unprotect
-	faddr = get_addr_fobj_save(faddr, fobj);
-	if (faddr == 0) {
-		faddr = pack_cfg_fmem(fobj);
-		if (faddr == 0) {
+	faddr = feep_dir.fend;
+	if (faddr >= feep_dir.base + FMEMORY_SCFG_BANK_SIZE - align(size + fobj_head_size)) {
+		// не влезет: завершить упаковку сейчас
+		int ret;
+		if (feep_pack.seg == 0)
+			pack_cfg_start();
+		while ((ret = pack_cfg_step()) > 0);
+		if (ret < 0)
+			return ret;
+		faddr = feep_dir.fend;
+		if (faddr >= feep_dir.base + FMEMORY_SCFG_BANK_SIZE - align(size + fobj_head_size)) {
 			DBG_FEEP_ERR("banks overflow!\n");
 			return FMEM_NOT_FOUND;
 		}
 	}
-	else if (faddr < FMEM_ERROR_MAX) return - faddr - 1; // error
 
 #if CONFIG_DEBUG_LOG > 3
 	DBG_FEEP_INFO("write obj to faddr %p\n", faddr);
 #endif
 	_flash_write_dword(faddr, fobj.x); // if (flash_write(faddr, &fobj.x, 4)) return FMEM_FLASH_ERR;
+	feep_dir_set(fobj, faddr);
+	feep_dir.fend = faddr + align(size + fobj_head_size);
 	faddr+=4;
 #if 1
 	u32 len = (size + 3) & (~3);
@@ -357,12 +462,14 @@ bool flash_write_cfg(void *ptr, unsigned short id, unsigned short size)
 	bool retb = false;
 	if (size > MAX_FOBJ_SIZE) return retb;
 	_flash_mutex_lock();
+	u8 estat_prev = estat_enter(ESTAT_FLASH);
 	if (_flash_write_cfg(ptr, id, size) >= 0) {
 #if CONFIG_DEBUG_LOG > 3
 		DBG_FEEP_INFO("saved ok\n");
 #endif
 		retb = true;
 	}
+	estat_leave(estat_prev);
 	_flash_mutex_unlock();
 	return retb;
 }
@@ -388,26 +495,22 @@ signed short flash_read_cfg(void *ptr, unsigned short id, unsigned short maxsize
 		fobj.n.id = id;
 		fobj.n.size = 0;
 		DBG_FEEP_INFO("read obj id: %04x[%d]\n", id, maxsize);
-		unsigned int faddr = get_addr_bscfg();
+		unsigned int faddr = feep_dir_get(&fobj);
 		if (faddr >= FMEM_ERROR_MAX) {
-			faddr = get_addr_fobj(faddr, &fobj, false);
-			if (faddr >= FMEM_ERROR_MAX) {
-				if (maxsize != 0 && ptr != NULL)
-					_flash_read(faddr + fobj_head_size, mMIN(fobj.n.size, maxsize), ptr);
+			if (maxsize != 0 && ptr != NULL)
+				_flash_read(faddr + fobj_head_size, mMIN(fobj.n.size, maxsize), ptr);
 
 #if CONFIG_DEBUG_LOG > 3
-				DBG_FEEP_INFO("read ok, faddr: %p, size: %d\n", faddr,  fobj.n.size);
+			DBG_FEEP_INFO("read ok, faddr: %p, size: %d\n", faddr,  fobj.n.size);
 #endif
-				rets = fobj.n.size;
-			}
-			else {
+			rets = fobj.n.size;
+		}
+		else {
 #if CONFIG_DEBUG_LOG > 3
-				DBG_FEEP_INFO("obj not found\n");
+			DBG_FEEP_INFO("obj not found\n");
 #endif
-				rets = -faddr-1;
-			}
+			rets = -faddr-1;
 		}
-		else rets = -faddr-1;
 		_flash_mutex_unlock();
 	}
     return rets;
@@ -434,6 +537,8 @@ bool flash_supported_eep_ver(unsigned int min_ver, unsigned int new_ver) {
 		faddr += FLASH_SECTOR_SIZE;
 	} while (faddr < FLASH_SIZE);
 	_flash_clear_cache();
+	feep_dir.base = 0;
+	feep_pack.seg = 0;
 	tmp = new_ver;
 	flash_write_cfg(&tmp, EEP_ID_VER, sizeof(tmp));
 	_flash_mutex_unlock();
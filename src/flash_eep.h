@@ -15,14 +15,19 @@ extern "C" {
 // EEPROM IDs
 #define EEP_ID_CFG (0x0CFC) // EEP ID config data
 #define EEP_ID_CFS (0x0CF5) // EEP ID sensor TH coefficients
+#define EEP_ID_SID (0x0C5D) // EEP ID detected sensor: id, i2c address, type
+#define EEP_ID_FLT (0x0F17) // EEP ID filters of the measured values
 #define EEP_ID_CMY (0x0B20) // EEP ID sensor MY18B20 coefficients
 #define EEP_ID_TRG (0x0DFE) // EEP ID trigger data
 #define EEP_ID_RPC (0x0DF5) // EEP ID reed switch pulse counter
 #define EEP_ID_HXC (0x53A3) // EEP ID hx71x config data
 #define EEP_ID_SCN (0x2CA8) // EEP ID scan config data
+#define EEP_ID_SCP (0x2CA9) // EEP ID scan peers MAC table
 #define EEP_ID_DAC (0xCDAC) // EEP ID DAC config
 #define EEP_ID_PCD (0xC0DE) // EEP ID pincode
 #define EEP_ID_CMF (0x0FCC) // EEP ID comfort data
+#define EEP_ID_EPD (0x0EFD) // EEP ID e-paper refresh config
+#define EEP_ID_MGN (0x0A6E) // EEP ID history generation (clear_memo())
 #define EEP_ID_DVN (0x0DB5) // EEP ID device name
 #define EEP_ID_TIM (0x0ADA) // EEP ID time adjust
 #define EEP_ID_KEY (0xBEAC) // EEP ID bkey
@@ -45,10 +50,14 @@ enum eFMEMORY_ERRORS {
 };
 //-----------------------------------------------------------------------------
 #define MAX_FOBJ_SIZE 64 // максимальный размер сохраняемых объeктов (32..512)
+#define FEEP_DIR_SIZE 16 // кол-во id объектов в RAM директории (остальные - поиск во flash)
+#define FEEP_PACK_FREE 1024 // начать упаковку по шагам (flash_eep_task), если свободно меньше
+#define FEEP_STEP_TIME_MS 125 // время до следующего события BLE для шага упаковки (стирание сектора), ms
 // extern QueueHandle_t flash_mutex;
 signed short flash_read_cfg(void *ptr, unsigned short id, unsigned short maxsize); // возврат: размер объекта последнего сохранения, -1 - не найден, -2 - error
 bool flash_write_cfg(void *ptr, unsigned short id, unsigned short size);
 bool flash_supported_eep_ver(unsigned int min_ver, unsigned int new_ver);
+void flash_eep_task(void); // шаг упаковки в свободное время
 //-----------------------------------------------------------------------------
 
 #ifdef __cplusplus
@@ -37,27 +37,17 @@ int scan_i2c_addr(int address) {
 	return ((reg_i2c_status & FLD_I2C_NAK)? 0 : address);
 }
 
-/* send_i2c_byte() return: NAK (=0 - send ok) */
+/* send_i2c_byte() return: NAK or rejected (=0 - send ok) */
 int send_i2c_byte(u8 i2c_addr, u8 cmd) {
-	if ((reg_clk_en0 & FLD_CLK0_I2C_EN)==0)
-			init_i2c();
-	reg_i2c_id = i2c_addr;
-	reg_i2c_adr = cmd;
-	reg_i2c_ctrl = FLD_I2C_CMD_START | FLD_I2C_CMD_ID | FLD_I2C_CMD_ADDR | FLD_I2C_CMD_STOP;
-	while (reg_i2c_status & FLD_I2C_CMD_BUSY);
-	return (reg_i2c_status & FLD_I2C_NAK);
+	i2c_queue_cmd(i2c_addr, cmd, 1, NULL, 0, 0);
+	return i2c_queue_run();
 }
 
-/* send_i2c_word() return: NAK (=0 - send ok)
+/* send_i2c_word() return: NAK or rejected (=0 - send ok)
 * cmd - [0:7] addr, [8:16] cmd -> send: [addr], [7:0], [15:8] */
 int send_i2c_word(u8 i2c_addr, u16 cmd) {
-	if ((reg_clk_en0 & FLD_CLK0_I2C_EN)==0)
-			init_i2c();
-	reg_i2c_id = i2c_addr;
-	reg_i2c_adr_dat = cmd;
-	reg_i2c_ctrl = FLD_I2C_CMD_START | FLD_I2C_CMD_ID | FLD_I2C_CMD_DO | FLD_I2C_CMD_ADDR | FLD_I2C_CMD_STOP;
-	while (reg_i2c_status & FLD_I2C_CMD_BUSY);
-	return (reg_i2c_status & FLD_I2C_NAK);
+	i2c_queue_cmd(i2c_addr, cmd, 2, NULL, 0, 0);
+	return i2c_queue_run();
 }
 
 /* send_i2c_addr_word() return: NAK (=0 - send ok)
@@ -73,103 +63,33 @@ int send_i2c_addr_word(u8 i2c_addr, u32 ra_w) {
 }
 
 
-/* send_i2c_buf() return: NAK (=0 - send ok) */
+/* send_i2c_buf() return: NAK or rejected (=0 - send ok), dataLen <= 255 */
 int send_i2c_buf(u8 i2c_addr, u8 * dataBuf, u32 dataLen) {
-	int err = 0;
-	if ((reg_clk_en0 & FLD_CLK0_I2C_EN)==0)
-			init_i2c();
-	u8 * p = dataBuf;
-	reg_i2c_id = i2c_addr;
-	reg_i2c_ctrl = FLD_I2C_CMD_START | FLD_I2C_CMD_ID;
-	while (reg_i2c_status & FLD_I2C_CMD_BUSY);
-	err = reg_i2c_status & FLD_I2C_NAK;
-	if(!err) {
-		while (dataLen--) {
-			reg_i2c_do = *p++;
-			reg_i2c_ctrl = FLD_I2C_CMD_DO;
-			while (reg_i2c_status & FLD_I2C_CMD_BUSY);
-			err = reg_i2c_status & FLD_I2C_NAK;
-			if(err)
-				break;
-		}
-	}
-	reg_i2c_ctrl = FLD_I2C_CMD_STOP;
-	while (reg_i2c_status & FLD_I2C_CMD_BUSY);
-	return err;
+	i2c_queue_wr(i2c_addr, dataBuf, dataLen);
+	return i2c_queue_run();
 }
 
-/* read_i2c_byte_addr() return: NAK (=0 - read ok) */
+/* read_i2c_byte_addr() return: NAK or rejected (=0 - read ok), dataLen <= 255 */
 #if (DEV_SERVICES & SERVICE_HARD_CLOCK)
 _attribute_ram_code_
 #endif
 int read_i2c_byte_addr(u8 i2c_addr, u8 reg_addr, u8 * dataBuf, u32 dataLen) {
-	int ret = -1;
-	int size = dataLen;
-	u8 *p = dataBuf;
-	if ((reg_clk_en0 & FLD_CLK0_I2C_EN)==0)
-			init_i2c();
-	//u8 r = irq_disable();
-	reg_i2c_id = i2c_addr;
-	reg_i2c_adr = reg_addr;
-	reg_i2c_ctrl = FLD_I2C_CMD_START | FLD_I2C_CMD_ID | FLD_I2C_CMD_ADDR;
-	while (reg_i2c_status & FLD_I2C_CMD_BUSY);
-	ret = reg_i2c_status & FLD_I2C_NAK;
-	if (ret == 0 && size) {
-		// Start By Master Read, Write Slave Address, Read data first byte
-		reg_rst0 = FLD_RST0_I2C;
-		reg_rst0 = 0;
-		reg_i2c_id = i2c_addr | FLD_I2C_WRITE_READ_BIT;
-		reg_i2c_ctrl = FLD_I2C_CMD_START | FLD_I2C_CMD_ID; // | FLD_I2C_CMD_READ_ID;
-	    while(reg_i2c_status & FLD_I2C_CMD_BUSY);
-		ret = reg_i2c_status & FLD_I2C_NAK;
-		if(ret == 0) {
-			while(size--) {
-				if(!size)
-					reg_i2c_ctrl = FLD_I2C_CMD_DI | FLD_I2C_CMD_READ_ID | FLD_I2C_CMD_ACK;
-				else
-					reg_i2c_ctrl = FLD_I2C_CMD_DI | FLD_I2C_CMD_READ_ID;
-				while(reg_i2c_status & FLD_I2C_CMD_BUSY);
-				*p++ = reg_i2c_di;
-			}
-		}
-	}
-	reg_i2c_ctrl = FLD_I2C_CMD_STOP;
-    while(reg_i2c_status & FLD_I2C_CMD_BUSY);
-    //irq_restore(r);
-    return ret;
+	i2c_queue_cmd(i2c_addr, reg_addr, 1, dataBuf, dataLen, 0);
+	return i2c_queue_run();
 }
 
+/* read_i2c_buf() return: NAK or rejected (=0 - read ok), dataLen = 1..255 */
 _attribute_ram_code_
 int read_i2c_buf(u8 i2c_addr, u8 * dataBuf, u32 dataLen) {
-	int ret = -1;
-	int size = dataLen;
-	u8 *p = dataBuf;
-	if ((reg_clk_en0 & FLD_CLK0_I2C_EN)==0)
-			init_i2c();
-	//u8 r = irq_disable();
-	reg_i2c_id = i2c_addr | FLD_I2C_WRITE_READ_BIT;
-	reg_i2c_ctrl = FLD_I2C_CMD_START | FLD_I2C_CMD_ID; // | FLD_I2C_CMD_READ_ID;
-    while(reg_i2c_status & FLD_I2C_CMD_BUSY);
-	ret = reg_i2c_status & FLD_I2C_NAK;
-	if(ret == 0) {
-		while(size--) {
-			if(!size)
-				reg_i2c_ctrl = FLD_I2C_CMD_DI | FLD_I2C_CMD_READ_ID | FLD_I2C_CMD_ACK;
-			else
-				reg_i2c_ctrl = FLD_I2C_CMD_DI | FLD_I2C_CMD_READ_ID;
-			while(reg_i2c_status & FLD_I2C_CMD_BUSY);
-			*p++ = reg_i2c_di;
-		}
-	}
-	reg_i2c_ctrl = FLD_I2C_CMD_STOP;
-    while(reg_i2c_status & FLD_I2C_CMD_BUSY);
-    //irq_restore(r);
-    return ret;
+	i2c_queue_cmd(i2c_addr, 0, 0, dataBuf, dataLen, 0);
+	return i2c_queue_run();
 }
 
 
 /* Universal I2C/SMBUS read-write transaction
  * wrlen = 0..127 !
+ * Debug command only (CMD_ID_I2C_UTR): any repeated START position, with or
+ * without STOP, interrupts disabled - the bus is polled, not queued.
  * return NAK (=0 - ok) */
 int I2CBusUtr(void * outdata, i2c_utr_t * tr, u32 wrlen) {
 	u8 * pwrdata = (u8 *) &tr->wrdata;
@@ -224,6 +144,101 @@ int I2CBusUtr(void * outdata, i2c_utr_t * tr, u32 wrlen) {
 	irq_restore(r);
 	return ret;
 }
+
+RAM i2c_queue_t i2c_queue;
+
+// i2c_queue.stage
+enum {
+	I2C_QS_IDLE = 0,
+	I2C_QS_ID,		// START + id (write)
+	I2C_QS_WR,		// write byte
+	I2C_QS_RDID,	// START + id (read)
+	I2C_QS_RD,		// read byte
+	I2C_QS_STOP,	// STOP
+	I2C_QS_WAIT		// delay after the transaction
+} I2C_QUEUE_STAGES_e;
+
+// time of one byte on the bus (9 clk + START/STOP) at reg_i2c_speed, in us
+#define I2C_BYTE_us		((reg_i2c_speed * (4 * 10)) / CLOCK_SYS_CLOCK_1US + 1)
+
+static void i2c_queue_rd_cmd(i2c_qtr_t * tr);
+static u32 i2c_queue_end(void);
+
+/* Next bus command of the transaction (no busy-wait)
+ * return: 0 - transaction done, else the time to the next step in us */
+_attribute_ram_code_
+static u32 i2c_queue_step(i2c_qtr_t * tr) {
+	if (reg_i2c_status & FLD_I2C_CMD_BUSY)
+		return I2C_BYTE_us;
+	switch (i2c_queue.stage) {
+	case I2C_QS_IDLE:
+		if ((reg_clk_en0 & FLD_CLK0_I2C_EN)==0)
+			init_i2c();
+		i2c_queue.idx = 0;
+		if (tr->wrlen) {
+			reg_i2c_id = tr->addr;
+			i2c_queue.stage = I2C_QS_ID;
+		} else {
+			reg_i2c_id = tr->addr | FLD_I2C_WRITE_READ_BIT;
+			i2c_queue.stage = I2C_QS_RDID;
+		}
+		reg_i2c_ctrl = FLD_I2C_CMD_START | FLD_I2C_CMD_ID;
+		break;
+	case I2C_QS_ID:
+	case I2C_QS_WR:
+		if (reg_i2c_status & FLD_I2C_NAK) {
+			i2c_queue.err = 1;
+		} else if (i2c_queue.idx < tr->wrlen) {
+			reg_i2c_do = tr->wrbuf[i2c_queue.idx++];
+			reg_i2c_ctrl = FLD_I2C_CMD_DO;
+			i2c_queue.stage = I2C_QS_WR;
+			break;
+		} else if (tr->rdlen) {
+			// hw reset I2C, repeated START + id (read)
+			reg_rst0 = FLD_RST0_I2C;
+			reg_rst0 = 0;
+			reg_i2c_id = tr->addr | FLD_I2C_WRITE_READ_BIT;
+			reg_i2c_ctrl = FLD_I2C_CMD_START | FLD_I2C_CMD_ID;
+			i2c_queue.stage = I2C_QS_RDID;
+			break;
+		}
+		reg_i2c_ctrl = FLD_I2C_CMD_STOP;
+		i2c_queue.stage = I2C_QS_STOP;
+		break;
+	case I2C_QS_RDID:
+		if (reg_i2c_status & FLD_I2C_NAK) {
+			i2c_queue.err = 1;
+			reg_i2c_ctrl = FLD_I2C_CMD_STOP;
+			i2c_queue.stage = I2C_QS_STOP;
+			break;
+		}
+		i2c_queue.idx = 0;
+		i2c_queue.stage = I2C_QS_RD;
+		i2c_queue_rd_cmd(tr);
+		break;
+	case I2C_QS_RD:
+		tr->rddata[i2c_queue.idx++] = reg_i2c_di;
+		if (i2c_queue.idx < tr->rdlen) {
+			i2c_queue_rd_cmd(tr);
+			break;
+		}
+		reg_i2c_ctrl = FLD_I2C_CMD_STOP;
+		i2c_queue.stage = I2C_QS_STOP;
+		break;
+	default: // I2C_QS_STOP, I2C_QS_WAIT
+		return i2c_queue_end();
+	}
+	return I2C_BYTE_us;
+}
+
+_attribute_ram_code_
+static void i2c_queue_rd_cmd(i2c_qtr_t * tr) {
+	if (i2c_queue.idx + 1 >= tr->rdlen) // the last byte read generates NACK
+		reg_i2c_ctrl = FLD_I2C_CMD_DI | FLD_I2C_CMD_READ_ID | FLD_I2C_CMD_ACK;
+	else
+		reg_i2c_ctrl = FLD_I2C_CMD_DI | FLD_I2C_CMD_READ_ID;
+}
+
 #elif defined(I2C_SCL) &&  defined(I2C_SDA)
 
 #include "drivers.h"
@@ -438,4 +453,171 @@ int I2CBusUtr(void * outdata, i2c_utr_t * tr, u32 wrlen) {
 	return ret;
 }
 
+RAM i2c_queue_t i2c_queue;
+
+// i2c_queue.stage
+enum {
+	I2C_QS_IDLE = 0,
+	I2C_QS_WAIT		// delay after the transaction
+} I2C_QUEUE_STAGES_e;
+
+static u32 i2c_queue_end(void);
+
+/* Transaction on the soft I2C bus
+ * return: 0 - transaction done, else the time to the next step in us */
+static u32 i2c_queue_step(i2c_qtr_t * tr) {
+	int i;
+	if (i2c_queue.stage == I2C_QS_IDLE) {
+		soft_i2c_start();
+		i2c_queue.err = soft_i2c_wr_byte(tr->addr | (tr->wrlen ? 0 : 1)) != 0;
+		for (i = 0; i2c_queue.err == 0 && i < tr->wrlen; i++)
+			i2c_queue.err = soft_i2c_wr_byte(tr->wrbuf[i]) != 0;
+		if (i2c_queue.err == 0 && tr->wrlen && tr->rdlen) {
+			soft_i2c_start(); // repeated START
+			i2c_queue.err = soft_i2c_wr_byte(tr->addr | 1) != 0;
+		}
+		for (i = 0; i2c_queue.err == 0 && i < tr->rdlen; i++)
+			tr->rddata[i] = soft_i2c_rd_byte(i + 1 < tr->rdlen);
+		soft_i2c_stop();
+	}
+	return i2c_queue_end();
+}
 #endif // def I2C_GROUP
+
+#if defined(I2C_GROUP) || (defined(I2C_SCL) && defined(I2C_SDA))
+
+/* End of the transaction: delay wait_us without busy-wait
+ * return: 0 - done, else the time to the end of the delay in us */
+_attribute_ram_code_
+static u32 i2c_queue_end(void) {
+	i2c_qtr_t * tr = &i2c_queue.tr[i2c_queue.rd];
+	u32 t;
+	if (i2c_queue.stage != I2C_QS_WAIT) {
+		i2c_queue.stage = I2C_QS_WAIT;
+		i2c_queue.tik = clock_time();
+		if (i2c_queue.err)
+			return 0;
+	}
+	t = (clock_time() - i2c_queue.tik) / CLOCK_16M_SYS_TIMER_CLK_1US;
+	if (t < tr->wait_us)
+		return tr->wait_us - t;
+	return 0;
+}
+
+/* Reject a transaction: the chain fails at it */
+_attribute_ram_code_
+static int i2c_queue_reject(void) {
+	if (!i2c_queue.drop)
+		i2c_queue.drop = i2c_queue.done + i2c_queue.cnt + 1;
+	return 0;
+}
+
+static int i2c_queue_exec(int bg);
+
+_attribute_ram_code_
+static i2c_qtr_t * i2c_queue_add(u8 i2c_addr, u32 wrlen, u8 * rddata, u32 rdlen, u32 wait_us) {
+	i2c_qtr_t * tr;
+	if (i2c_queue.cb) // a chain of i2c_queue_start() is in a delay: finish it first
+		i2c_queue_exec(0);
+	if (i2c_queue.drop || i2c_queue.cnt >= I2C_QUEUE_SIZE
+		|| wrlen > 0xff || rdlen > 0xff || wait_us > 0xffff)
+		return NULL;
+	tr = &i2c_queue.tr[(i2c_queue.rd + i2c_queue.cnt) & (I2C_QUEUE_SIZE - 1)];
+	tr->addr = i2c_addr;
+	tr->wrlen = wrlen;
+	tr->rdlen = rdlen;
+	tr->wait_us = wait_us;
+	tr->wrbuf = tr->wrdata;
+	tr->rddata = rddata;
+	i2c_queue.cnt++;
+	return tr;
+}
+
+_attribute_ram_code_
+int i2c_queue_cmd(u8 i2c_addr, u32 cmd, u32 wrlen, u8 * rddata, u32 rdlen, u32 wait_us) {
+	i2c_qtr_t * tr;
+	if (wrlen > I2C_QTR_WRMAX
+		|| (tr = i2c_queue_add(i2c_addr, wrlen, rddata, rdlen, wait_us)) == NULL)
+		return i2c_queue_reject();
+	tr->wrdata[0] = cmd;
+	tr->wrdata[1] = cmd >> 8;
+	tr->wrdata[2] = cmd >> 16;
+	return 1;
+}
+
+int i2c_queue_wr(u8 i2c_addr, u8 * dataBuf, u32 dataLen) {
+	i2c_qtr_t * tr;
+	if ((tr = i2c_queue_add(i2c_addr, dataLen, NULL, 0, 0)) == NULL)
+		return i2c_queue_reject();
+	tr->wrbuf = dataBuf;
+	return 1;
+}
+
+/* Next steps of the chain
+ * return: 0 - the chain is done, else the time to the next step in us */
+_attribute_ram_code_
+static u32 i2c_queue_next(void) {
+	u32 us;
+	while (i2c_queue.cnt) {
+		us = i2c_queue_step(&i2c_queue.tr[i2c_queue.rd]);
+		if (us)
+			return us;
+		// transaction done
+		i2c_queue.done++;
+		i2c_queue.stage = I2C_QS_IDLE;
+		if (i2c_queue.err) {
+			i2c_queue.err = 0;
+			i2c_queue.fail = i2c_queue.done;
+			i2c_queue.cnt = 0; // drop the rest of the chain
+			break;
+		}
+		i2c_queue.rd = (i2c_queue.rd + 1) & (I2C_QUEUE_SIZE - 1);
+		i2c_queue.cnt--;
+	}
+	return 0;
+}
+
+/* Run the chain to its end or, if 'bg', up to a delay after a transaction
+ * return: -1 - delay (bg), else the result of the chain */
+_attribute_ram_code_
+static int i2c_queue_exec(int bg) {
+	i2c_queue_cb_t cb;
+	int ret;
+	u32 us;
+	while ((us = i2c_queue_next()) != 0) {
+		if (bg && i2c_queue.stage == I2C_QS_WAIT)
+			return -1;
+		if (us >= I2C_QUEUE_STALL_us)
+			pm_wait_us(us); // cpu stall, wakeup by timer0
+	}
+	ret = i2c_queue.fail;
+	if (!ret)
+		ret = i2c_queue.drop;
+	cb = i2c_queue.cb;
+	i2c_queue.cb = NULL;
+	i2c_queue.rd = 0;
+	i2c_queue.done = 0;
+	i2c_queue.fail = 0;
+	i2c_queue.drop = 0;
+	if (cb)
+		cb(ret);
+	return ret;
+}
+
+_attribute_ram_code_
+int i2c_queue_run(void) {
+	return i2c_queue_exec(0);
+}
+
+_attribute_ram_code_
+void i2c_queue_start(i2c_queue_cb_t cb) {
+	i2c_queue.cb = cb;
+	i2c_queue_exec(1);
+}
+
+_attribute_ram_code_
+int i2c_queue_poll(void) {
+	return i2c_queue_exec(1) < 0;
+}
+
+#endif // defined(I2C_GROUP) || (defined(I2C_SCL) && defined(I2C_SDA))
@@ -23,4 +23,63 @@ typedef struct _i2c_utr_t {
 } i2c_utr_t;
 int I2CBusUtr(void * outdata, i2c_utr_t * tr, u32 wrlen);
 
+/* Queued I2C transactions: the CPU stalls (wakeup by timer0) instead of busy-wait */
+#define I2C_QUEUE_SIZE	4 // max number of transactions in the queue
+#define I2C_QTR_WRMAX	3 // max number of bytes to write in a transaction of i2c_queue_cmd()
+#define I2C_QUEUE_STALL_us	10 // min. time of the cpu stall, in us
+
+#if defined(I2C_GROUP) || (defined(I2C_SCL) && defined(I2C_SDA))
+#define USE_I2C_QUEUE	1
+#else
+#define USE_I2C_QUEUE	0
+#endif
+
+/* Queued I2C transaction: START, write wrbuf, (repeated START), read rddata, STOP, wait */
+typedef struct _i2c_qtr_t {
+	u8 addr;	// I2C address (<< 1)
+	u8 wrlen;	// number of bytes to write
+	u8 rdlen;	// number of bytes to read
+	u8 wrdata[I2C_QTR_WRMAX];
+	u16 wait_us;	// delay after the transaction (sensor wakeup/reset), in us
+	u8 * wrbuf;	// bytes to write: wrdata or the buffer of i2c_queue_wr()
+	u8 * rddata;
+} i2c_qtr_t;
+
+/* End of the chain, err: as i2c_queue_run() */
+typedef void (*i2c_queue_cb_t)(int err);
+
+typedef struct _i2c_queue_t {
+	i2c_qtr_t tr[I2C_QUEUE_SIZE];
+	i2c_queue_cb_t cb; // end of the chain started by i2c_queue_start()
+	u32 tik;	// start of the delay after the transaction
+	u8 rd;		// current transaction
+	u8 cnt;		// number of transactions in the queue
+	u8 stage;	// I2C_QUEUE_STAGES_e
+	u8 idx;		// byte counter
+	u8 done;	// number of the finished transactions of the chain
+	u8 fail;	// number (1..) of the failed transaction, 0 - none
+	u8 drop;	// number (1..) of the first rejected transaction, 0 - none
+	u8 err;		// NAK of the current transaction
+} i2c_queue_t;
+
+extern i2c_queue_t i2c_queue;
+
+/* Add a transaction to the queue.
+ * cmd - bytes to write: [7:0], [15:8], [23:16]
+ * return: 0 - rejected (queue full, wrlen > I2C_QTR_WRMAX, rdlen > 255),
+ * the chain then fails at this transaction */
+int i2c_queue_cmd(u8 i2c_addr, u32 cmd, u32 wrlen, u8 * rddata, u32 rdlen, u32 wait_us);
+/* Add a write of dataLen (<= 255) bytes of dataBuf, kept by the caller up to the end of the chain */
+int i2c_queue_wr(u8 i2c_addr, u8 * dataBuf, u32 dataLen);
+/* Run the chain of queued transactions. On NAK, the rest of the chain is dropped.
+ * return: 0 - ok, else the number (1..) of the failed transaction */
+int i2c_queue_run(void);
+/* Run the chain in the background: the bytes are sent here and in i2c_queue_poll(),
+ * the delays after the transactions return to main_loop. cb (may be NULL) at the end.
+ * A transaction added in a delay first runs the rest of the chain (cpu stall) */
+void i2c_queue_start(i2c_queue_cb_t cb);
+/* main_loop: the next transactions of the chain, return: 1 - busy (no suspend) */
+int i2c_queue_poll(void);
+#define i2c_queue_busy()	(i2c_queue.cnt != 0)
+
 #endif //_I2C_H_
@@ -18,6 +18,7 @@
 #include "lcd.h"
 #include "ble.h"
 #include "battery.h"
+#include "flash_eep.h"
 
 //RAM u8 show_stage; // count/stage update lcd code buffer
 //RAM u32 chow_ext_sec; // count show validity time, in sec
@@ -31,6 +32,75 @@ RAM u8 display_buff[LCD_BUF_SIZE], display_cmp_buff[LCD_BUF_SIZE+1];
 #else
 RAM u8 display_buff[LCD_BUF_SIZE], display_cmp_buff[LCD_BUF_SIZE];
 #endif
+#if (USE_EPD)
+RAM epd_cfg_t epd_cfg;
+RAM u32 epd_refresh_ut; // last full refresh, utc time sec
+RAM u8 epd_refresh_cnt;
+
+void init_epd_cfg(void) {
+	if (flash_read_cfg(&epd_cfg, EEP_ID_EPD, sizeof(epd_cfg)) != sizeof(epd_cfg)) {
+		epd_cfg.refresh_cnt = DEF_EPD_REFRESH_CNT;
+		epd_cfg.refresh_min = 0;
+	}
+}
+
+// init_lcd(): a full refresh starts the cadence again
+void epd_refresh_reset(void) {
+	epd_refresh_cnt = epd_cfg.refresh_cnt;
+	epd_refresh_ut = wrk.utc_time_sec;
+}
+
+// update_lcd(): 1 - this update must be a full refresh
+_attribute_ram_code_
+int epd_refresh_full(void) {
+	if (epd_cfg.refresh_cnt) {
+		if (!epd_refresh_cnt)
+			return 1;
+		epd_refresh_cnt--;
+	}
+	if (epd_cfg.refresh_min
+		&& wrk.utc_time_sec - epd_refresh_ut >= (u32)epd_cfg.refresh_min * 60)
+		return 1;
+	return 0;
+}
+#endif
+
+#if USE_LCD_DIRTY
+RAM u32 lcd_dirty;
+
+/* Bytes for send_to_lcd(). A direct call (OTA, reboot screen) sends all.
+ * display_cmp_buff becomes a copy of the LCD controller RAM. */
+_attribute_ram_code_
+u32 lcd_take_dirty(void) {
+	u32 mask = lcd_dirty;
+	if(!mask)
+		mask = LCD_DIRTY_ALL;
+	lcd_dirty = 0;
+	memcpy(&display_cmp_buff, &display_buff, sizeof(display_buff));
+	return mask;
+}
+
+/* Next run of bytes to write from *pos, returns its length (0 - end).
+ * Gaps of up to 2 unchanged bytes are sent inside the run:
+ * this is shorter than a new I2C transfer (START, ID, ADSET). */
+_attribute_ram_code_
+int lcd_next_run(u32 *pmask, int *pos) {
+	u32 mask = *pmask;
+	int n = 0;
+	if(mask) {
+		while(!(mask & 1)) {
+			mask >>= 1;
+			(*pos)++;
+		}
+		do {
+			mask >>= 1;
+			n++;
+		} while(mask & 7);
+		*pmask = mask;
+	}
+	return n;
+}
+#endif
 
 #if (!USE_EPD)
 _attribute_ram_code_
@@ -41,6 +111,13 @@ void update_lcd(void){
 	if (memcmp(&display_cmp_buff[1], &display_buff, sizeof(display_buff))) {
 		memcpy(&display_cmp_buff[1], &display_buff, sizeof(display_buff));
 		send_to_lcd();
+#elif USE_LCD_DIRTY
+	for(int i = 0; i < LCD_BUF_SIZE; i++) {
+		if(display_buff[i] != display_cmp_buff[i])
+			lcd_dirty |= 1 << i;
+	}
+	if (lcd_dirty) {
+		send_to_lcd();
 #else
 	if (memcmp(&display_cmp_buff, &display_buff, sizeof(display_buff))) {
 		send_to_lcd();
@@ -102,6 +102,7 @@ void show_clock(void);
 #define POWERUP_SCREEN	0
 #define SHOW_REBOOT_SCREEN()
 #define LCD_BUF_SIZE	18
+#define DEF_EPD_REFRESH_CNT	32
 #define SHOW_SMILEY		1
 extern u8 stage_lcd;
 void show_small_number(s16 number, bool percent); // -9 .. 99
@@ -116,6 +117,7 @@ extern u8 display_buff[LCD_BUF_SIZE], display_cmp_buff[LCD_BUF_SIZE];
 #define POWERUP_SCREEN	0
 #define SHOW_REBOOT_SCREEN()
 #define LCD_BUF_SIZE	16
+#define DEF_EPD_REFRESH_CNT	0
 #define SHOW_SMILEY		1
 extern u8 stage_lcd;
 void show_small_number(s16 number, bool percent); // -9 .. 99
@@ -132,8 +134,10 @@ extern u8 display_buff[LCD_BUF_SIZE], display_cmp_buff[LCD_BUF_SIZE];
 #define SHOW_REBOOT_SCREEN()
 #if DEVICE_CGG1_ver == 2022
 #define LCD_BUF_SIZE	16
+#define DEF_EPD_REFRESH_CNT	0
 #else
 #define LCD_BUF_SIZE	18
+#define DEF_EPD_REFRESH_CNT	32
 #endif
 #define SHOW_SMILEY		1
 extern u8 stage_lcd;
@@ -152,6 +156,7 @@ void show_ota_screen(void);
 void show_reboot_screen(void);
 #define SHOW_REBOOT_SCREEN() show_reboot_screen()
 #define LCD_BUF_SIZE	6
+#define USE_LCD_DIRTY	1
 #define SHOW_SMILEY		1
 extern u8 display_buff[LCD_BUF_SIZE], display_cmp_buff[LCD_BUF_SIZE];
 void show_small_number(s16 number, bool percent); // -9 .. 99
@@ -181,6 +186,7 @@ void show_ota_screen(void);
 void show_reboot_screen(void);
 #define SHOW_REBOOT_SCREEN() show_reboot_screen()
 #define LCD_BUF_SIZE	6
+#define USE_LCD_DIRTY	1
 #define SHOW_SMILEY		1
 extern u8 display_buff[LCD_BUF_SIZE], display_cmp_buff[LCD_BUF_SIZE];
 void show_small_number(s16 number, bool percent); // -9 .. 99
@@ -223,6 +229,7 @@ void show_ota_screen(void);
 void show_reboot_screen(void);
 #define SHOW_REBOOT_SCREEN() show_reboot_screen()
 #define LCD_BUF_SIZE	6
+#define USE_LCD_DIRTY	1
 #define SHOW_SMILEY		1
 extern u8 display_buff[LCD_BUF_SIZE], display_cmp_buff[LCD_BUF_SIZE];
 void show_small_number(s16 number, bool percent); // -9 .. 99
@@ -259,6 +266,28 @@ void show_small_number(s16 number, bool percent); // -9 .. 99
 #error "Set DEVICE_TYPE!"
 #endif
 
+#ifndef USE_LCD_DIRTY
+#define USE_LCD_DIRTY	0 // 1 - send_to_lcd() writes only the changed bytes of display_buff
+#endif
+
+#if (USE_EPD)
+typedef struct __attribute__((packed)) _epd_cfg_t {
+	u8 refresh_cnt;	// partial updates between full (ghost clearing) refreshes, 0 - off
+	u8 refresh_min;	// full refresh at the first update after this time, in minutes, 0 - off
+} epd_cfg_t;
+extern epd_cfg_t epd_cfg;
+void init_epd_cfg(void);
+void epd_refresh_reset(void);
+int epd_refresh_full(void);
+#endif
+
+#if USE_LCD_DIRTY
+#define LCD_DIRTY_ALL	((1 << LCD_BUF_SIZE) - 1)
+extern u32 lcd_dirty; // bit n: display_buff[n] is not yet in the LCD controller RAM
+u32 lcd_take_dirty(void);
+int lcd_next_run(u32 *pmask, int *pos);
+#endif
+
 #else // (DEVICE_TYPE == DEVICE_MJWSD05MMC)
 
 
@@ -280,8 +280,11 @@ _attribute_ram_code_
 void send_to_lcd(void){
 	unsigned int buff_index;
 	u8 * p = display_buff;
+	u32 mask;
+	int n;
 	if(cfg.flg2.screen_off)
 		return;
+	mask = lcd_take_dirty();
 	if (lcd_i2c_addr > N16_I2C_ADDR) {
 		if ((reg_clk_en0 & FLD_CLK0_I2C_EN)==0)
 			init_i2c();
@@ -291,13 +294,17 @@ void send_to_lcd(void){
 		}
 		if (lcd_i2c_addr == (B14_I2C_ADDR << 1)) {
 			// B1.4, B1.7, B2.0
+			// only the address 0 setting is known: send up to the last changed byte
+			n = sizeof(display_buff);
+			while(!(mask & (1 << (n - 1))))
+				n--;
 			reg_i2c_speed = (u8)(CLOCK_SYS_CLOCK_HZ/(4*700000)); // 700 kHz
 			reg_i2c_id = lcd_i2c_addr;
 			reg_i2c_adr_dat = 0x4080;
 			reg_i2c_ctrl = FLD_I2C_CMD_START | FLD_I2C_CMD_ID | FLD_I2C_CMD_ADDR | FLD_I2C_CMD_DO;
 			while (reg_i2c_status & FLD_I2C_CMD_BUSY);
 			reg_i2c_adr = 0xC0;
-			for(buff_index = 0; buff_index < sizeof(display_buff); buff_index++) {
+			for(buff_index = 0; buff_index < n; buff_index++) {
 				reg_i2c_do = *p++;
 				reg_i2c_ctrl = FLD_I2C_CMD_ADDR | FLD_I2C_CMD_DO;
 				while (reg_i2c_status & FLD_I2C_CMD_BUSY);
@@ -305,55 +312,33 @@ void send_to_lcd(void){
 			reg_i2c_ctrl = FLD_I2C_CMD_STOP;
 		} else { // (lcd_i2c_addr == (B19_I2C_ADDR << 1))
 			// B1.9 BU9792AFUV
-#if 1
-			for(buff_index = 0; buff_index < sizeof(display_buff); buff_index++)
-				utxb.data[buff_index] = reverse(*p++);
-			p = utxb.data;
+			// RAM from ADSET 4: d0,d1,0,0,d2,d3,0,0,d4,d5
+			u8 ram[10];
+			u32 ram_mask = 0;
+			int pos = 0, i;
+			memset(ram, 0, sizeof(ram));
+			for(buff_index = 0; buff_index < sizeof(display_buff); buff_index++) {
+				i = buff_index + (buff_index & ~1);
+				ram[i] = reverse(*p++);
+				if(mask & (1 << buff_index))
+					ram_mask |= 1 << i;
+			}
 			reg_i2c_id = lcd_i2c_addr;
-			reg_i2c_adr = 0x04;	// addr: 4
-			reg_i2c_do = *p++;
-			reg_i2c_di = *p++;
-			reg_i2c_ctrl = FLD_I2C_CMD_ID | FLD_I2C_CMD_ADDR | FLD_I2C_CMD_DO | FLD_I2C_CMD_DI | FLD_I2C_CMD_START;
-			while (reg_i2c_status & FLD_I2C_CMD_BUSY);
-			reg_i2c_adr_dat = 0;
-			reg_i2c_ctrl = FLD_I2C_CMD_ADDR | FLD_I2C_CMD_DO;
-			while (reg_i2c_status & FLD_I2C_CMD_BUSY);
-			reg_i2c_adr = *p++;
-			reg_i2c_do = *p++;
-			reg_i2c_ctrl = FLD_I2C_CMD_ADDR | FLD_I2C_CMD_DO;
-			while (reg_i2c_status & FLD_I2C_CMD_BUSY);
-			reg_i2c_adr_dat = 0;
-			reg_i2c_ctrl = FLD_I2C_CMD_ADDR | FLD_I2C_CMD_DO;
-			while (reg_i2c_status & FLD_I2C_CMD_BUSY);
-			reg_i2c_adr = *p++;
-			reg_i2c_do = *p;
-			reg_i2c_ctrl = FLD_I2C_CMD_ADDR | FLD_I2C_CMD_DO | FLD_I2C_CMD_STOP;
-			while (reg_i2c_status & FLD_I2C_CMD_BUSY);
+			while((n = lcd_next_run(&ram_mask, &pos)) != 0) {
+				reg_i2c_adr = 0x04 + (pos << 1); // ADSET
+				reg_i2c_ctrl = FLD_I2C_CMD_START | FLD_I2C_CMD_ID | FLD_I2C_CMD_ADDR;
+				while (reg_i2c_status & FLD_I2C_CMD_BUSY);
+				do {
+					reg_i2c_do = ram[pos++];
+					reg_i2c_ctrl = FLD_I2C_CMD_DO;
+					while (reg_i2c_status & FLD_I2C_CMD_BUSY);
+				} while(--n);
+				reg_i2c_ctrl = FLD_I2C_CMD_STOP;
+				while (reg_i2c_status & FLD_I2C_CMD_BUSY);
+			}
 			// LCD cmd: 0xc8 - Mode Set (MODE SET): Display ON, 1/3 Bias
 			reg_i2c_adr = 0xC8;
 			reg_i2c_ctrl = FLD_I2C_CMD_START | FLD_I2C_CMD_ID | FLD_I2C_CMD_ADDR | FLD_I2C_CMD_STOP;
-
-#else
-			reg_i2c_id = lcd_i2c_addr;
-			reg_i2c_adr = 0x04;	// addr: 4
-			reg_i2c_do = reverse(*p++);
-			reg_i2c_di = reverse(*p++);
-			reg_i2c_ctrl = FLD_I2C_CMD_ID | FLD_I2C_CMD_ADDR | FLD_I2C_CMD_DO | FLD_I2C_CMD_DI | FLD_I2C_CMD_START;
-			while (reg_i2c_status & FLD_I2C_CMD_BUSY);
-			reg_i2c_adr_dat = 0;
-			reg_i2c_ctrl = FLD_I2C_CMD_ADDR | FLD_I2C_CMD_DO;
-			while (reg_i2c_status & FLD_I2C_CMD_BUSY);
-			reg_i2c_adr = reverse(*p++);
-			reg_i2c_do = reverse(*p++);
-			reg_i2c_ctrl = FLD_I2C_CMD_ADDR | FLD_I2C_CMD_DO;
-			while (reg_i2c_status & FLD_I2C_CMD_BUSY);
-			reg_i2c_adr_dat = 0;
-			reg_i2c_ctrl = FLD_I2C_CMD_ADDR | FLD_I2C_CMD_DO;
-			while (reg_i2c_status & FLD_I2C_CMD_BUSY);
-			reg_i2c_adr = reverse(*p++);
-			reg_i2c_do = reverse(*p);
-			reg_i2c_ctrl = FLD_I2C_CMD_ADDR | FLD_I2C_CMD_DO | FLD_I2C_CMD_STOP;
-#endif
 		}
 		while (reg_i2c_status & FLD_I2C_CMD_BUSY);
 	}
@@ -370,6 +355,7 @@ void send_to_lcd(void){
 
 void init_lcd(void){
 	memset(display_buff, BIT(1), sizeof(display_buff)); // display off "--- ---"
+	lcd_dirty = LCD_DIRTY_ALL; // LCD controller RAM is cleared
 	lcd_i2c_addr = (u8) scan_i2c_addr(B14_I2C_ADDR << 1);
 	if (lcd_i2c_addr) { // B1.4, B1.7, B2.0
 // 		GPIO_PB6 set in app_config.h!
@@ -97,9 +97,16 @@ _attribute_ram_code_
 void send_to_lcd(void){
 	unsigned int buff_index;
 	u8 * p = display_buff;
+	u32 mask;
+	int n;
 	if(cfg.flg2.screen_off)
 		return;
+	mask = lcd_take_dirty();
 	if (lcd_i2c_addr) {
+		// only the address 0 setting is known: send up to the last changed byte
+		n = sizeof(display_buff);
+		while(!(mask & (1 << (n - 1))))
+			n--;
 		if ((reg_clk_en0 & FLD_CLK0_I2C_EN)==0)
 			init_i2c();
 		else {
@@ -111,7 +118,7 @@ void send_to_lcd(void){
 		reg_i2c_ctrl = FLD_I2C_CMD_START | FLD_I2C_CMD_ID | FLD_I2C_CMD_ADDR | FLD_I2C_CMD_DO;
 		while (reg_i2c_status & FLD_I2C_CMD_BUSY);
 		reg_i2c_adr = 0xC0;
-		for(buff_index = 0; buff_index < sizeof(display_buff); buff_index++) {
+		for(buff_index = 0; buff_index < n; buff_index++) {
 			reg_i2c_do = *p++;
 			reg_i2c_ctrl = FLD_I2C_CMD_ADDR | FLD_I2C_CMD_DO;
 			while (reg_i2c_status & FLD_I2C_CMD_BUSY);
@@ -122,6 +129,7 @@ void send_to_lcd(void){
 }
 
 void init_lcd(void){
+	lcd_dirty = LCD_DIRTY_ALL; // LCD controller RAM is cleared
 	lcd_i2c_addr = (u8) scan_i2c_addr(B14_I2C_ADDR << 1);
 	if (lcd_i2c_addr) {
 // 		GPIO_PB6 set in app_config.h!
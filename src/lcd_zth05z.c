@@ -85,31 +85,33 @@ const u8 lcd_init_cmd[]	=	{
 
 _attribute_ram_code_
 void send_to_lcd(void){
+	u32 mask;
+	int n, pos = 0;
 	if(cfg.flg2.screen_off)
 		return;
+	mask = lcd_take_dirty();
 	if (lcd_i2c_addr) {
 		if ((reg_clk_en0 & FLD_CLK0_I2C_EN)==0)
 			init_i2c();
-		u8 * p = display_buff;
 		reg_i2c_id = lcd_i2c_addr;
-		reg_i2c_adr = 0x08;	// addr:8
-		reg_i2c_do = *p++;
-		reg_i2c_di = *p++;
-		reg_i2c_ctrl = FLD_I2C_CMD_ID | FLD_I2C_CMD_ADDR | FLD_I2C_CMD_DO | FLD_I2C_CMD_DI | FLD_I2C_CMD_START;
-		while (reg_i2c_status & FLD_I2C_CMD_BUSY);
-		reg_i2c_do = *p++;
-		reg_i2c_di = *p++;
-		reg_i2c_ctrl = FLD_I2C_CMD_DO | FLD_I2C_CMD_DI;
-		while (reg_i2c_status & FLD_I2C_CMD_BUSY);
-		reg_i2c_do = *p++;
-		reg_i2c_di = *p;
-		reg_i2c_ctrl = FLD_I2C_CMD_DO | FLD_I2C_CMD_DI | FLD_I2C_CMD_STOP;
-		while (reg_i2c_status & FLD_I2C_CMD_BUSY);
+		while((n = lcd_next_run(&mask, &pos)) != 0) {
+			reg_i2c_adr = 0x08 + (pos << 1); // ADSET, display_buff[0] in addr:8
+			reg_i2c_ctrl = FLD_I2C_CMD_START | FLD_I2C_CMD_ID | FLD_I2C_CMD_ADDR;
+			while (reg_i2c_status & FLD_I2C_CMD_BUSY);
+			do {
+				reg_i2c_do = display_buff[pos++];
+				reg_i2c_ctrl = FLD_I2C_CMD_DO;
+				while (reg_i2c_status & FLD_I2C_CMD_BUSY);
+			} while(--n);
+			reg_i2c_ctrl = FLD_I2C_CMD_STOP;
+			while (reg_i2c_status & FLD_I2C_CMD_BUSY);
+		}
 	}
 }
 
 
 void init_lcd(void){
+	lcd_dirty = LCD_DIRTY_ALL; // LCD controller RAM is cleared
 	lcd_i2c_addr = (u8) scan_i2c_addr(BL55028_I2C_ADDR << 1);
 	if (lcd_i2c_addr) { // B1.9
 		if(cfg.flg2.screen_off) {
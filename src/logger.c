@@ -12,6 +12,7 @@
 #include "flash_eep.h"
 #include "logger.h"
 #include "ble.h"
+#include "estat.h"
 
 #define MEMO1M_SEC_COUNT	((FLASH1M_ADDR_END_MEMO - FLASH1M_ADDR_START_MEMO) / FLASH_SECTOR_SIZE) // 52 or 128 sectors
 #define MEMO1M_SEC_RECS		((FLASH_SECTOR_SIZE-sizeof(memo_head_t))/sizeof(memo_blk_t)) // 1 sector = 409 records
@@ -68,6 +69,9 @@ typedef struct _summ_data_t {
 #endif
 #endif
 	u32 	count;
+#if USE_MEAS_ADAPTIVE
+	u32 	over; // steps of the last measurement over averaging_measurements
+#endif
 } summ_data_t;
 RAM summ_data_t summ_data;
 
@@ -84,6 +88,10 @@ RAM memo_rd_t rd_memo;
 #define MEMO_END_ADDR		FLASH_ADDR_END_MEMO
 #endif
 
+// sector head ids of the current generation
+#define MEMO_ID				MEMO_GEN_ID(MEMO_SEC_ID, memo.gen)
+#define MEMO_ID_DLT			MEMO_GEN_ID(MEMO_SEC_ID_DLT, memo.gen)
+
 static u32 test_next_memo_sec_addr(u32 faddr) {
 	u32 mfaddr = faddr;
 	if (mfaddr >= MEMO_END_ADDR)
@@ -96,9 +104,40 @@ static u32 test_next_memo_sec_addr(u32 faddr) {
 static void memo_sec_init(u32 faddr) {
 	u32 mfaddr = faddr;
 	mfaddr &= ~(FLASH_SECTOR_SIZE-1);
-	_flash_erase_sector(mfaddr);
-	_flash_write_dword(mfaddr, MEMO_SEC_ID);
+#if USE_MEMO_DELTA
+	memo_dhead_t mhs;
+	_flash_read(test_next_memo_sec_addr(mfaddr - FLASH_SECTOR_SIZE), sizeof(mhs), &mhs);
+	if (mhs.id == MEMO_ID_DLT) {
+		mhs.seq++;
+		if (mhs.flg == 0) // closed
+			mhs.base += mhs.cnt;
+	} else {
+		mhs.seq = 0;
+		mhs.base = 0;
+	}
+	mhs.id = MEMO_ID_DLT;
+	mhs.flg = 0xffff;
+	mhs.cnt = 0xffff;
+#if USE_MEMO_ERASE_AHEAD
+	if (memo.erased != mfaddr)
+#endif
+		_flash_erase_sector(mfaddr);
+	_flash_write(mfaddr, sizeof(mhs), &mhs);
+	memo.faddr = mfaddr + sizeof(memo_dhead_t);
+	memo.tab = mfaddr + FLASH_SECTOR_SIZE;
+	memo.base = mhs.base;
+#else
+#if USE_MEMO_ERASE_AHEAD
+	if (memo.erased != mfaddr)
+#endif
+		_flash_erase_sector(mfaddr);
+	_flash_write_dword(mfaddr, MEMO_ID);
 	memo.faddr = mfaddr + sizeof(memo_head_t);
+#endif
+#if USE_MEMO_ERASE_AHEAD
+	if (memo.erased == mfaddr)
+		memo.erased = 0;
+#endif
 	memo.cnt_cur_sec = 0;
 }
 
@@ -106,10 +145,192 @@ static void memo_sec_close(u32 faddr) {
 	u32 mfaddr = faddr;
 	u16 flg = 0;
 	mfaddr &= ~(FLASH_SECTOR_SIZE-1);
+#if USE_MEMO_DELTA
+	u32 tmp;
+	_flash_read(mfaddr, sizeof(tmp), &tmp);
+	if (tmp == MEMO_ID_DLT) {
+		tmp = memo.cnt_cur_sec << 16; // flg = 0, cnt
+		_flash_write(mfaddr + sizeof(u32), sizeof(tmp), &tmp);
+	} else
+#endif
 	_flash_write(mfaddr + sizeof(memo_head_t) - sizeof(flg), sizeof(flg), &flg);
 	memo_sec_init(test_next_memo_sec_addr(mfaddr + FLASH_SECTOR_SIZE));
 }
 
+/* Number of the records in the sector of the old format (MEMO_SEC_ID): binary search of the first free record */
+static u32 memo_sec_cnt(u32 faddr) {
+	u32 lo = 0, hi = MEMO_SECTORS, mid, tmp;
+	faddr += sizeof(memo_head_t);
+	while (lo < hi) {
+		mid = (lo + hi) >> 1;
+		_flash_read(faddr + mid * sizeof(memo_blk_t), sizeof(tmp), &tmp);
+		if (tmp != 0xffffffff)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+#if USE_MEMO_DELTA
+static const u8 memo_dlt_size[4] = {0, 1, 2, 4};
+
+/* Delta field: code 0 - not changed, 1 - s8, 2 - s16, 3 - s32 */
+static s32 memo_dlt_get(u8 *p, u32 code) {
+	if (code == 1)
+		return (s8)p[0];
+	if (code == 2)
+		return (s16)(p[0] | (p[1] << 8));
+	if (code == 3)
+		return p[0] | (p[1] << 8) | (p[2] << 16) | (p[3] << 24);
+	return 0;
+}
+
+/* Encode the delta record from the last record (memo.last, memo.last_dt).
+ * Return: size of the record, *pdt - new time step */
+static u32 memo_dlt_enc(u8 *buf, pmemo_blk_t p, u32 *pdt) {
+	s32 d[4];
+	u32 i, code, tag = 0, len = 1;
+	*pdt = p->time - memo.last.time;
+	d[0] = *pdt - memo.last_dt;
+	d[1] = p->val1 - memo.last.val1;
+	d[2] = p->val2 - memo.last.val2;
+	d[3] = p->val0 - memo.last.val0;
+	for (i = 0; i < 4; i++) {
+		if (d[i] == 0)
+			code = 0;
+		else if (d[i] == (s8)d[i])
+			code = 1;
+		else if (d[i] == (s16)d[i])
+			code = 2;
+		else
+			code = 3;
+		memcpy(&buf[len], &d[i], memo_dlt_size[code]);
+		len += memo_dlt_size[code];
+		tag |= code << (i << 1);
+	}
+	buf[0] = tag;
+	return len;
+}
+
+/* Decode the block of the delta sector: up to *pn records, no more than 'size' bytes.
+ * Return: p - last record, *pdt - last time step, *pn - number of records (= 0 - empty block),
+ * the size of the block */
+static u32 memo_dlt_blk(u32 faddr, u32 size, u32 *pn, pmemo_blk_t p, u32 *pdt) {
+	u8 buf[MEMO_DLT_BLK_MAX];
+	u32 i, code, tag, len, n = 1, pos = sizeof(memo_blk_t);
+	s32 d[4];
+	if (size > sizeof(buf))
+		size = sizeof(buf);
+	*pdt = 0;
+	if (size < pos) {
+		*pn = 0;
+		return 0;
+	}
+	_flash_read(faddr, size, buf);
+	memcpy(p, buf, sizeof(memo_blk_t));
+	if (p->time == 0xffffffff) {
+		*pn = 0;
+		return 0;
+	}
+	while (n < *pn && pos < size && (tag = buf[pos]) != 0xff) {
+		len = 1;
+		for (i = 0; i < 4; i++)
+			len += memo_dlt_size[(tag >> (i << 1)) & 3];
+		if (pos + len > size)
+			break;
+		pos++;
+		for (i = 0; i < 4; i++) {
+			code = (tag >> (i << 1)) & 3;
+			d[i] = memo_dlt_get(&buf[pos], code);
+			pos += memo_dlt_size[code];
+		}
+		*pdt += d[0];
+		p->time += *pdt;
+		p->val1 += d[1];
+		p->val2 += d[2];
+		p->val0 += d[3];
+		n++;
+	}
+	*pn = n;
+	return pos;
+}
+
+/* Read the record 'idx' (0 - the oldest) of the logger sector, any format */
+static unsigned memo_read_rec(u32 faddr, u32 id, u32 idx, pmemo_blk_t p) {
+	u16 offs;
+	u32 n, dt, size;
+	if (id != MEMO_ID_DLT) {
+		_flash_read(faddr + sizeof(memo_head_t) + idx * sizeof(memo_blk_t), sizeof(memo_blk_t), p);
+		return 1;
+	}
+	_flash_read(faddr + FLASH_SECTOR_SIZE - sizeof(offs) * (idx / MEMO_DLT_BLK_RECS + 1), sizeof(offs), &offs);
+	if (offs < sizeof(memo_dhead_t) || offs >= FLASH_SECTOR_SIZE)
+		return 0;
+	idx = idx % MEMO_DLT_BLK_RECS + 1;
+	n = idx;
+	size = sizeof(memo_blk_t) + (n - 1) * MEMO_DLT_REC_MAX;
+	if (size > FLASH_SECTOR_SIZE - offs)
+		size = FLASH_SECTOR_SIZE - offs;
+	memo_dlt_blk(faddr + offs, size, &n, p, &dt);
+	return n == idx;
+}
+
+/* Number of the records in the closed logger sector, *pid = 0 - not a closed logger sector */
+static u32 memo_sec_recs(u32 faddr, u32 *pid) {
+	memo_dhead_t mhs;
+	_flash_read(faddr, sizeof(mhs), &mhs);
+	*pid = 0;
+	if (mhs.flg != 0)
+		return 0;
+	if (mhs.id == MEMO_ID_DLT) {
+		*pid = mhs.id;
+		return mhs.cnt;
+	}
+	if (mhs.id != MEMO_ID)
+		return 0;
+	*pid = mhs.id;
+	// the sector of the old format closed by memo_init() may be not full
+	return memo_sec_cnt(faddr);
+}
+
+/* Restore memo from the open delta sector */
+static void memo_dlt_restore(u32 faddr) {
+	u32 tab = faddr + FLASH_SECTOR_SIZE, n = 0, k = 0, i = 0, dt;
+	u16 offs = 0, buf[16];
+	memo_dhead_t mhs;
+	_flash_read(faddr, sizeof(mhs), &mhs);
+	memo.base = mhs.base;
+	// the table ends with 0xffff (write_memo() leaves a free u16 before the table)
+	while (!i && tab >= faddr + sizeof(memo_dhead_t) + sizeof(buf)) {
+		_flash_read(tab - sizeof(buf), sizeof(buf), buf);
+		i = sizeof(buf) / sizeof(buf[0]);
+		while (i && buf[i - 1] != 0xffff) {
+			offs = buf[--i];
+			tab -= sizeof(buf[0]);
+			n++;
+		}
+	}
+	memo.tab = tab;
+	memo.faddr = faddr + sizeof(memo_dhead_t);
+	memo.cnt_cur_sec = 0;
+	if (n) {
+		memo.cnt_cur_sec = (n - 1) * MEMO_DLT_BLK_RECS;
+		if (offs >= sizeof(memo_dhead_t) && faddr + offs < tab) {
+			k = MEMO_DLT_BLK_RECS;
+			memo.faddr = faddr + offs + memo_dlt_blk(faddr + offs, tab - faddr - offs, &k, &memo.last, &dt);
+			memo.last_dt = dt;
+		}
+		if (!k) { // broken block (power off)
+			memo_sec_close(faddr);
+			return;
+		}
+		memo.cnt_cur_sec += k;
+		wrk.utc_time_sec = memo.last.time + 5;
+	}
+}
+#endif // USE_MEMO_DELTA
+
 #if 0
 void memo_init_count(void) {
 	memo_head_t mhs;
@@ -127,11 +348,69 @@ void memo_init_count(void) {
 }
 #endif
 
+/* Ring search key of the logger sector: sequence number (delta format) or time of the first record.
+ * Return: 0 - not a logger sector */
+static unsigned memo_sec_key(u32 faddr, u32 *pkey) {
+#if USE_MEMO_DELTA
+	memo_dhead_t mhs;
+	_flash_read(faddr, sizeof(mhs), &mhs);
+	if (mhs.id == MEMO_ID_DLT) {
+		*pkey = mhs.seq;
+		return 1;
+	}
+#else
+	memo_head_t mhs;
+	_flash_read(faddr, sizeof(mhs), &mhs);
+#endif
+	if (mhs.id != MEMO_ID)
+		return 0;
+	_flash_read(faddr + sizeof(memo_head_t), sizeof(u32), pkey);
+	return 1;
+}
+
+/* Restore memo from the sector 'faddr' (not a logger sector - start a new one).
+ * Return: 0 - closed sector */
+static unsigned memo_init_sec(u32 faddr) {
+	memo_head_t mhs;
+	u32 tmp;
+	_flash_read(faddr, sizeof(mhs), &mhs);
+#if USE_MEMO_DELTA
+	if (mhs.id == MEMO_ID_DLT) {
+		if (mhs.flg != 0xffff)
+			return 0;
+		memo_dlt_restore(faddr);
+		return 1;
+	}
+#endif
+	if (mhs.id != MEMO_ID) {
+		memo_sec_init(faddr);
+		return 1;
+	}
+	if (mhs.flg != 0xffff) {
+		if (mhs.flg) { // power off in memo_sec_close(): the readers need flg = 0
+			mhs.flg = 0;
+			_flash_write(faddr + sizeof(memo_head_t) - sizeof(mhs.flg), sizeof(mhs.flg), &mhs.flg);
+		}
+		return 0;
+	}
+	memo.cnt_cur_sec = memo_sec_cnt(faddr);
+	memo.faddr = faddr + sizeof(memo_head_t) + memo.cnt_cur_sec * sizeof(memo_blk_t);
+	if (memo.cnt_cur_sec) {
+		_flash_read(memo.faddr - sizeof(memo_blk_t), sizeof(tmp), &tmp);
+		wrk.utc_time_sec = tmp + 5;
+	}
+#if USE_MEMO_DELTA
+	memo_sec_close(faddr); // continue in a new sector of the delta format
+#else
+	if (memo.cnt_cur_sec >= MEMO_SECTORS)
+		memo_sec_close(faddr);
+#endif
+	return 1;
+}
+
 __attribute__((optimize("-Os")))
 void memo_init(void) {
-	memo_head_t mhs;
-	u32 tmp, fsec_end;
-	u32 faddr;
+	u32 faddr, key0, key, lo, hi, mid;
 #if USE_MEMO_1M
 	u8 buf[4];
 	flash_read_id(buf);
@@ -145,49 +424,103 @@ void memo_init(void) {
 		memo.sectors = MEMO_SEC_RECS;
 	}
 #endif
+#if USE_MEMO_ERASE_AHEAD
+	memo.clr_addr = 0; // memo.erased is kept: = 0 after the power-up
+#endif
+	if (flash_read_cfg(&memo.gen, EEP_ID_MGN, sizeof(memo.gen)) != sizeof(memo.gen))
+		memo.gen = 0;
 	memo.cnt_cur_sec = 0;
-	faddr = MEMO_START_ADDR;
-	while (faddr < MEMO_END_ADDR) {
-		_flash_read(faddr, sizeof(mhs), &mhs);
-		if (mhs.id != MEMO_SEC_ID) {
-			memo_sec_init(faddr);
+	// binary search of the head: the keys grow from the start of the ring to the head sector,
+	// next sectors are older (wrapped ring) or not used
+	if (memo_sec_key(MEMO_START_ADDR, &key0)) {
+		lo = 0;
+		hi = (MEMO_END_ADDR - MEMO_START_ADDR) / FLASH_SECTOR_SIZE - 1;
+		while (lo < hi) {
+			mid = (lo + hi + 1) >> 1;
+			if (memo_sec_key(MEMO_START_ADDR + mid * FLASH_SECTOR_SIZE, &key) && key >= key0)
+				lo = mid;
+			else
+				hi = mid - 1;
+		}
+		faddr = MEMO_START_ADDR + lo * FLASH_SECTOR_SIZE;
+		if (memo_init_sec(faddr))
 			return;
-		} else if (mhs.flg == 0xffff) {
-			fsec_end = faddr + FLASH_SECTOR_SIZE;
-			faddr += sizeof(memo_head_t);
-			while (faddr < fsec_end) {
-				_flash_read(faddr, sizeof(tmp), &tmp);
-				if (tmp == 0xffffffff) {
-					memo.faddr = faddr;
-					return;
-				}
-				wrk.utc_time_sec = tmp + 5;
-				memo.cnt_cur_sec++;
-				faddr += sizeof(memo_blk_t);
-			}
-			memo_sec_close(fsec_end - FLASH_SECTOR_SIZE);
+		// closed head sector (power off after close): the next sector must be not used
+		faddr = test_next_memo_sec_addr(faddr + FLASH_SECTOR_SIZE);
+		if (!memo_sec_key(faddr, &key)) {
+			memo_sec_init(faddr);
 			return;
 		}
+	}
+	// linear search: the keys are not ordered (mixed formats, time not set)
+	faddr = MEMO_START_ADDR;
+	while (faddr < MEMO_END_ADDR) {
+		if (memo_init_sec(faddr))
+			return;
 		faddr += FLASH_SECTOR_SIZE;
 	}
 	memo_sec_init(MEMO_START_ADDR);
 	return;
 }
 
+/* Logical clear: the new generation is saved first (EEP, one write),
+ * the sectors of the older generations are not logger sectors for memo_init()
+ * and the readers, they are erased later (memo_erase_task() or memo_sec_init()) */
 void clear_memo(void) {
-	u32 tmp;
-	u32 faddr = MEMO_START_ADDR + FLASH_SECTOR_SIZE;
-	memo.cnt_cur_sec = 0;
-	while (faddr < MEMO_END_ADDR) {
-		_flash_read(faddr, sizeof(tmp), &tmp);
-		if (tmp == MEMO_SEC_ID)
-			_flash_erase_sector(faddr);
-		faddr += FLASH_SECTOR_SIZE;
-	}
+	u16 gen = memo.gen + 1;
+	if (!flash_write_cfg(&gen, EEP_ID_MGN, sizeof(gen)))
+		return;
+	memo.gen = gen;
 	memo_sec_init(MEMO_START_ADDR);
+#if USE_MEMO_ERASE_AHEAD
+	memo.clr_addr = MEMO_START_ADDR + FLASH_SECTOR_SIZE;
+#endif
 	return;
 }
 
+void memo_rd_init(void) {
+	rd_memo.saved = memo;
+#if USE_MEMO_DELTA
+	rd_memo.sec_addr = 0;
+#endif
+}
+
+#if USE_MEMO_DELTA
+/* Sectors have a different number of records:
+ * walk back over the sector headers from the last read sector (rd_memo.sec_*) */
+__attribute__((optimize("-Os")))
+unsigned get_memo(u32 bnum, pmemo_blk_t p) {
+	u32 faddr, id, cnt, skip;
+	u32 i = (MEMO_END_ADDR - MEMO_START_ADDR) / FLASH_SECTOR_SIZE;
+	if (!bnum)
+		return 0;
+	if (!rd_memo.sec_addr || bnum <= rd_memo.sec_skip) {
+		faddr = rd_memo.saved.faddr & (~(FLASH_SECTOR_SIZE-1));
+		_flash_read(faddr, sizeof(id), &id);
+		cnt = rd_memo.saved.cnt_cur_sec;
+		skip = 0;
+	} else {
+		faddr = rd_memo.sec_addr;
+		id = rd_memo.sec_id;
+		cnt = rd_memo.sec_cnt;
+		skip = rd_memo.sec_skip;
+	}
+	while (bnum > skip + cnt) {
+		if (!--i)
+			return 0;
+		skip += cnt;
+		faddr = test_next_memo_sec_addr(faddr - FLASH_SECTOR_SIZE);
+		cnt = memo_sec_recs(faddr, &id);
+		if (!id)
+			return 0;
+	}
+	rd_memo.sec_addr = faddr;
+	rd_memo.sec_id = id;
+	rd_memo.sec_cnt = cnt;
+	rd_memo.sec_skip = skip;
+	return memo_read_rec(faddr, id, cnt - (bnum - skip), p);
+}
+#else
 //_attribute_ram_code_
 __attribute__((optimize("-Os")))
 unsigned get_memo(u32 bnum, pmemo_blk_t p) {
@@ -207,7 +540,7 @@ unsigned get_memo(u32 bnum, pmemo_blk_t p) {
 		}
 		bnum = MEMO_SECTORS - bnum;
 		_flash_read(faddr, sizeof(mhs), &mhs);
-		if (mhs.id != MEMO_SEC_ID || mhs.flg != 0)
+		if (mhs.id != MEMO_ID || mhs.flg != 0)
 			return 0;
 	} else {
 		bnum = rd_memo.saved.cnt_cur_sec - bnum;
@@ -217,6 +550,118 @@ unsigned get_memo(u32 bnum, pmemo_blk_t p) {
 	_flash_read(faddr, sizeof(memo_blk_t), p);
 	return 1;
 }
+#endif // USE_MEMO_DELTA
+
+/* Address of the sector 'k' back from the current (rd_memo.saved) sector */
+static u32 memo_rd_sec_addr(u32 k) {
+	u32 faddr = rd_memo.saved.faddr & (~(FLASH_SECTOR_SIZE-1));
+	k *= FLASH_SECTOR_SIZE;
+	if (faddr - MEMO_START_ADDR < k)
+		faddr += MEMO_END_ADDR - MEMO_START_ADDR;
+	return faddr - k;
+}
+
+/* Time of the first record in the sector 'k' back from the current one.
+ * Return 0 if the sector is not a closed logger sector (erased, tail of the ring) */
+static u32 memo_rd_sec_time(u32 k) {
+	memo_head_t mhs;
+	u32 tmp;
+	u32 faddr = memo_rd_sec_addr(k);
+	_flash_read(faddr, sizeof(mhs), &mhs);
+#if USE_MEMO_DELTA
+	if (mhs.id == MEMO_ID_DLT && mhs.flg == 0) {
+		_flash_read(faddr + sizeof(memo_dhead_t), sizeof(tmp), &tmp);
+		return tmp;
+	}
+#endif
+	if (mhs.id != MEMO_ID || mhs.flg != 0)
+		return 0;
+	_flash_read(faddr + sizeof(memo_head_t), sizeof(tmp), &tmp);
+	return tmp;
+}
+
+/* Time of the record 'idx' in the sector 'k' back from the current one */
+static u32 memo_rd_rec_time(u32 k, u32 idx) {
+	u32 tmp;
+	u32 faddr = memo_rd_sec_addr(k);
+#if USE_MEMO_DELTA
+	memo_blk_t mblk;
+	_flash_read(faddr, sizeof(tmp), &tmp);
+	if (!memo_read_rec(faddr, tmp, idx, &mblk))
+		return 0xffffffff;
+	tmp = mblk.time;
+#else
+	_flash_read(faddr + sizeof(memo_head_t) + idx * sizeof(memo_blk_t), sizeof(tmp), &tmp);
+#endif
+	return tmp;
+}
+
+/* Number of the records in the sectors 0..k-1 back from the current one (k > 0) */
+static u32 memo_rd_recs_newer(u32 k) {
+#if USE_MEMO_DELTA
+	memo_dhead_t mhs;
+	u32 id, cnt = rd_memo.saved.cnt_cur_sec;
+	// delta sectors: the running count of the sector k-1 (one read)
+	_flash_read(memo_rd_sec_addr(k - 1), sizeof(mhs), &mhs);
+	if (mhs.id == MEMO_ID_DLT)
+		return rd_memo.saved.base + cnt - mhs.base;
+	// the sectors of the old format: walk
+	while (--k)
+		cnt += memo_sec_recs(memo_rd_sec_addr(k), &id);
+	return cnt;
+#else
+	return rd_memo.saved.cnt_cur_sec + (k - 1) * MEMO_SECTORS;
+#endif
+}
+
+/* Number of the records (from the newest) with time >= 'time'.
+ * Binary search over the sector-first timestamps, then over the records of the sector.
+ * Use rd_memo.saved (call memo_rd_init() before),
+ * the result is the value for rd_memo.cnt / get_memo(1..cnt) */
+__attribute__((optimize("-Os")))
+u32 get_memo_count_from_time(u32 time) {
+	u32 secs = (MEMO_END_ADDR - MEMO_START_ADDR) / FLASH_SECTOR_SIZE;
+	u32 lo, hi, mid, recs, tmp;
+	// sector 0 (current) - only if it has records
+	if (rd_memo.saved.cnt_cur_sec) {
+		if (memo_rd_rec_time(0, 0) <= time) {
+			lo = 0;
+			goto found;
+		}
+	}
+	// closed sectors 1..secs-1: find the first 'k' with time_first(k) <= time (or not closed sector)
+	lo = 1;
+	hi = secs;
+	while (lo < hi) {
+		mid = (lo + hi) >> 1;
+		if (memo_rd_sec_time(mid) <= time)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	if (lo >= secs || memo_rd_sec_time(lo) == 0) // all records >= time
+		return memo_rd_recs_newer(lo);
+found:
+#if USE_MEMO_DELTA
+	recs = (lo)? memo_sec_recs(memo_rd_sec_addr(lo), &tmp) : rd_memo.saved.cnt_cur_sec;
+#else
+	recs = (lo)? MEMO_SECTORS : rd_memo.saved.cnt_cur_sec;
+#endif
+	// records of the sector: find the first record with time >= time
+	mid = 0;
+	hi = recs;
+	while (mid < hi) {
+		tmp = (mid + hi) >> 1;
+		if (memo_rd_rec_time(lo, tmp) < time)
+			mid = tmp + 1;
+		else
+			hi = tmp;
+	}
+	recs -= mid;
+	if (lo)
+		recs += memo_rd_recs_newer(lo);
+	return recs;
+}
 
 _attribute_ram_code_
 __attribute__((optimize("-Os")))
@@ -227,10 +672,26 @@ void write_memo(void) {
 		mblk.val1 = measured_val1;
 		mblk.val2 = measured_val2;
 	} else {
+#if USE_MEAS_ADAPTIVE
+		// one measurement over wrk.meas_scale measurement steps,
+		// the steps over averaging_measurements go to the next record
+		// (averaging_measurements < wrk.meas_scale: a record per measurement)
+		u32 w = wrk.meas_scale;
+		if (summ_data.count + w > cfg.averaging_measurements)
+			w = (summ_data.count < cfg.averaging_measurements)? cfg.averaging_measurements - summ_data.count : 0;
+		summ_data.over = wrk.meas_scale - w;
+		if (summ_data.over >= cfg.averaging_measurements)
+			summ_data.over = cfg.averaging_measurements - 1;
+		summ_data.val0 += measured_val0 * w;
+		summ_data.val1 += measured_val1 * (s32)w;
+		summ_data.val2 += measured_val2 * w;
+		summ_data.count += w;
+#else
 		summ_data.val0 += measured_val0;
 		summ_data.val1 += measured_val1;
 		summ_data.val2 += measured_val2;
 		summ_data.count++;
+#endif
 		if (cfg.averaging_measurements > summ_data.count)
 			return;
 		if(wrk.ble_connected && bls_pm_getSystemWakeupTick() - clock_time() < 125*CLOCK_16M_SYS_TIMER_CLK_1MS)
@@ -248,7 +709,16 @@ void write_memo(void) {
 		mblk.val2 = (u16)(summ_data.val2/summ_data.count); // humidity
 #endif
 #endif
+#if USE_MEAS_ADAPTIVE
+		u32 over = summ_data.over;
+		summ_data.val0 = measured_val0 * over;
+		summ_data.val1 = measured_val1 * (s32)over;
+		summ_data.val2 = measured_val2 * over;
+		summ_data.count = over;
+		summ_data.over = 0;
+#else
 		memset(&summ_data, 0, sizeof(summ_data));
+#endif
 	}
 	/* default c4: dcdc 1.8V  -> GD flash; 48M clock may error, need higher DCDC voltage
 	           c6: dcdc 1.9V
@@ -258,11 +728,42 @@ void write_memo(void) {
 		mblk.time = 0xfffffffe;
 	else
 		mblk.time = wrk.utc_time_sec;
+	u8 estat_prev = estat_enter(ESTAT_FLASH);
 	u32 faddr = memo.faddr;
 	if (!faddr) {
 		memo_init();
 		faddr = memo.faddr;
 	}
+#if USE_MEMO_DELTA
+	u8 buf[MEMO_DLT_REC_MAX];
+	u32 len = 0, dt = 0;
+	u16 offs;
+	if (memo.cnt_cur_sec % MEMO_DLT_BLK_RECS) {
+		len = memo_dlt_enc(buf, &mblk, &dt);
+		if (buf[0] == 0xff || faddr + len + sizeof(offs) > memo.tab) {
+			memo_sec_close(faddr);
+			faddr = memo.faddr;
+			len = 0;
+		}
+	}
+	if (!len) { // new block: base record + offset in the table
+		if (faddr + sizeof(memo_blk_t) + 2 * sizeof(offs) > memo.tab) {
+			memo_sec_close(faddr);
+			faddr = memo.faddr;
+		}
+		memo.tab -= sizeof(offs);
+		offs = faddr & (FLASH_SECTOR_SIZE-1);
+		_flash_write(memo.tab, sizeof(offs), &offs);
+		memcpy(buf, &mblk, sizeof(memo_blk_t));
+		len = sizeof(memo_blk_t);
+		dt = 0;
+	}
+	_flash_write(faddr, len, buf);
+	memo.faddr = faddr + len;
+	memo.last_dt = dt;
+	memo.last = mblk;
+	memo.cnt_cur_sec++;
+#else
 	_flash_write(faddr, sizeof(memo_blk_t), &mblk);
 	faddr += sizeof(memo_blk_t);
 	faddr &= (~(FLASH_SECTOR_SIZE-1));
@@ -273,6 +774,40 @@ void write_memo(void) {
 		memo.cnt_cur_sec++;
 		memo.faddr += sizeof(memo_blk_t);
 	}
+#endif // USE_MEMO_DELTA
+	estat_leave(estat_prev);
+}
+
+#if USE_MEMO_ERASE_AHEAD
+/* Erase-ahead: erase the next sector if there is time before the next wakeup (BLE event).
+ * Otherwise memo_sec_init() erases it at the sector change (up to ~45..100 ms stall in write_memo).
+ * After clear_memo(): erase one sector of an older generation per call */
+void memo_erase_task(void) {
+	u32 tmp, faddr = memo.faddr;
+	if (!faddr
+		|| (int)(bls_pm_getSystemWakeupTick() - clock_time()) <= MEMO_ERASE_TIME_MS * CLOCK_16M_SYS_TIMER_CLK_1MS)
+		return;
+	faddr = test_next_memo_sec_addr((faddr & (~(FLASH_SECTOR_SIZE-1))) + FLASH_SECTOR_SIZE);
+	if (memo.erased != faddr) {
+		u8 estat_prev = estat_enter(ESTAT_FLASH);
+		_flash_erase_sector(faddr);
+		estat_leave(estat_prev);
+		memo.erased = faddr;
+		return;
+	}
+	while (memo.clr_addr && memo.clr_addr < MEMO_END_ADDR) {
+		faddr = memo.clr_addr;
+		memo.clr_addr += FLASH_SECTOR_SIZE;
+		_flash_read(faddr, sizeof(tmp), &tmp);
+		if (tmp != 0xffffffff && tmp != MEMO_ID && tmp != MEMO_ID_DLT) {
+			u8 estat_prev = estat_enter(ESTAT_FLASH);
+			_flash_erase_sector(faddr);
+			estat_leave(estat_prev);
+			return;
+		}
+	}
+	memo.clr_addr = 0;
 }
+#endif // USE_MEMO_ERASE_AHEAD
 
 #endif // #if (DEV_SERVICES & SERVICE_HISTORY)
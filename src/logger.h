@@ -15,7 +15,19 @@
 #define USE_MEMO_1M		1
 #endif
 
+#ifndef USE_MEMO_DELTA
+#define USE_MEMO_DELTA	0 // = 1 write sectors in the compact delta format (MEMO_SEC_ID_DLT)
+#endif
+
+#ifndef USE_MEMO_ERASE_AHEAD
+#define USE_MEMO_ERASE_AHEAD	1 // = 1 erase the next sector in idle time (main_loop), -1 sector of history
+#endif
+#define MEMO_ERASE_TIME_MS	125 // time of the sector erase + margin, ms
+
 #define MEMO_SEC_ID		0x55AAC0DE // sector head
+#define MEMO_SEC_ID_DLT	0x55AAC1DE // sector head, delta format
+// generation of the history (+1 in clear_memo()), bits 16..31 of the sector head id
+#define MEMO_GEN_ID(id, gen)	((id) ^ ((u32)(u16)(gen) << 16))
 #define FLASH_ADDR_START_MEMO	0x40000
 #define FLASH_ADDR_END_MEMO		0x74000 // 49 sectors
 
@@ -32,31 +44,79 @@ typedef struct _memo_blk_t {
 typedef struct _memo_inf_t {
 	u32 faddr;
 	u32 cnt_cur_sec;
+	u16 gen; // generation (EEP_ID_MGN), = 0 - never cleared
 #if USE_MEMO_1M
 	u32 sectors;
 	u32 start_addr;
 	u32 end_addr;
 #endif
+#if USE_MEMO_ERASE_AHEAD
+	u32 erased; // address of the erased next sector (= 0 - none)
+	u32 clr_addr; // next sector to check for erase (older generation) after clear_memo() (= 0 - none)
+#endif
+#if USE_MEMO_DELTA
+	u32 tab;	// address of the last block offset (the table grows down from the end of the sector)
+	u32 last_dt; // last time step, sec
+	memo_blk_t last; // last record
+	u32 base;	// running count of the current sector (memo_dhead_t)
+#endif
 }memo_inf_t;
 
+// CMD_ID_LOGBLK: max records in one notify (fifo: 7 x 27 bytes)
+#define MEMO_BULK_RECS_MAX	16
+
 typedef struct _memo_rd_t {
 	memo_inf_t saved;
 	u32 cnt;
 	u32 cur;
+	u32 bulk; // = 0 - one record in notify (CMD_ID_LOGGER), = 1 - records up to MTU (CMD_ID_LOGBLK)
+#if USE_MEMO_DELTA
+	u32 sec_addr; // read cache: sector address (= 0 - none)
+	u32 sec_id;	// read cache: sector format (MEMO_SEC_ID or MEMO_SEC_ID_DLT)
+	u32 sec_skip; // read cache: number of records in newer sectors
+	u32 sec_cnt; // read cache: number of records in sector
+#endif
 }memo_rd_t;
 
 typedef struct _memo_head_t {
-	u32 id;  // = 0x55AAC0DE (MEMO_SEC_ID)
+	u32 id;  // = 0x55AAC0DE (MEMO_SEC_ID) ^ (generation << 16)
 	u16 flg;  // = 0xffff - new sector, = 0 close sector
 }memo_head_t;
 
+#if USE_MEMO_DELTA
+/* Delta sector format (MEMO_SEC_ID_DLT):
+ * 0x000: memo_dhead_t
+ * 0x010: blocks: memo_blk_t (base record) + (MEMO_DLT_BLK_RECS - 1) delta records
+ * ....   free (at least 2 bytes, end of the table)
+ * 0xffe: u16 offsets of the blocks in the sector, grows down from the end
+ * Delta record: [tag][dt - last_dt][val1][val2][val0],
+ * tag: 2 bits per field (bit0..1 - dt, ..., bit6..7 - val0): 0 - not changed, 1 - s8, 2 - s16, 3 - s32.
+ * tag = 0xff - free (not used, a new sector is started) */
+#define MEMO_DLT_BLK_RECS	16
+#define MEMO_DLT_REC_MAX	(1 + 4 * 4)
+#define MEMO_DLT_BLK_MAX	(sizeof(memo_blk_t) + (MEMO_DLT_BLK_RECS - 1) * MEMO_DLT_REC_MAX)
+
+typedef struct _memo_dhead_t {
+	u32 id;  // = 0x55AAC1DE (MEMO_SEC_ID_DLT) ^ (generation << 16)
+	u16 flg;  // = 0xffff - new sector, = 0 close sector
+	u16 cnt;  // number of records, writes on close sector
+	u32 seq;  // sector sequence number (+1 for each new sector), the ring search in memo_init()
+	u32 base; // running count: records in the older delta sectors, writes on open sector
+}memo_dhead_t;
+#endif
+
 extern memo_rd_t rd_memo;
 extern memo_inf_t memo;
 
+void memo_rd_init(void);
 void memo_init(void);
 void clear_memo(void);
 unsigned get_memo(u32 bnum, pmemo_blk_t p);
+u32 get_memo_count_from_time(u32 time);
 void write_memo(void);
+#if USE_MEMO_ERASE_AHEAD
+void memo_erase_task(void);
+#endif
 
 #endif // #if (DEV_SERVICES & SERVICE_HISTORY)
 #endif /* _LOGGER_H_ */
@@ -157,6 +157,24 @@ void mi_encrypt_data_beacon(void) {
 						   (u8 *)&p->data, // указатель куда писать результат
 						   pmic, 4); // указатель куда писать типа подпись-"контрольную сумму" шифра
 }
+#if USE_CCM_PRECOMPUTE
+/* Key stream for the next measurement: nonce count = adv_buf.send_count + 1, next stage */
+__attribute__((optimize("-Os")))
+void mi_encrypt_prepare(void) {
+	mi_beacon_nonce_t nonce;
+	u8 aad = 0x11;
+	u8 stage = mi_beacon_data.stage + 1;
+	if (stage > 2)
+		stage = 0;
+	memcpy(&nonce, &beacon_nonce, sizeof(nonce));
+	nonce.cnt32 = adv_buf.send_count + 1;
+	ccm_precompute((const unsigned char *)&bindkey,
+						   (u8*)&nonce, sizeof(nonce),
+						   &aad, sizeof(aad),
+						   (stage == 2)? 1 + 3 : 2 + 3, // data.size + size data head (id, size)
+						   4);
+}
+#endif
 #if (DEV_SERVICES & SERVICE_RDS)
 /* n - RDS_TYPES */
 void mi_encrypt_event_beacon(u8 n) {
@@ -225,6 +225,9 @@ typedef struct __attribute__((packed)) _adv_mi_cr_ev2_t {
 
 void mi_beacon_init(void);
 void mi_encrypt_data_beacon(void);
+#if USE_CCM_PRECOMPUTE
+void mi_encrypt_prepare(void);
+#endif
 void mi_encrypt_event_beacon(u8 n); // n = RDS_TYPES
 #endif
 
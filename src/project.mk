@@ -19,6 +19,7 @@ $(OUT_PATH)/src/epd_cgg1.o \
 $(OUT_PATH)/src/epd_cgg1n.o \
 $(OUT_PATH)/src/epd_mho_c401.o \
 $(OUT_PATH)/src/epd_mho_c401n.o \
+$(OUT_PATH)/src/epd_spi.o \
 $(OUT_PATH)/src/sensors.o \
 $(OUT_PATH)/src/ens160.o \
 $(OUT_PATH)/src/scd41.o \
@@ -29,6 +30,8 @@ $(OUT_PATH)/src/hx71x.o \
 $(OUT_PATH)/src/rtc_pcf85163.o \
 $(OUT_PATH)/src/bme280.o \
 $(OUT_PATH)/src/sdm_out.o \
+$(OUT_PATH)/src/filter.o \
+$(OUT_PATH)/src/estat.o \
 $(OUT_PATH)/src/trigger.o \
 $(OUT_PATH)/src/rds_count.o \
 $(OUT_PATH)/src/app_att.o \
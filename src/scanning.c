@@ -16,6 +16,7 @@
 #include "flash_eep.h"
 #include "scanning.h"
 #include "bthome_beacon.h"
+#include "sensor.h"
 #if SCAN_USE_BINDKEY
 #include "ccm.h"
 #endif
@@ -30,6 +31,16 @@
 #define SCAN_ADV_INTERVAL	ADV_INTERVAL_505MS
 #define SCAN_ADV_COUNT	3
 
+#define SCAN_WIN_TIME	9		// ms, time server scan window
+#define SCAN_PEER_WIN	3		// ms, peer scan window margin without misses, x2 after each miss
+#define SCAN_ADV_DELAY	10		// ms, random advDelay of the peer adv. event
+#define SCAN_WAKE_MIN	5		// ms, closer windows are opened at once
+#define SCAN_MISS_MAX	5		// missed windows in succession -> learn the period again
+#define SCAN_ACQ_TIME	12000	// ms, max window to learn the adv. period of the peers
+#define SCAN_ACQ_INTERVAL	60	// sec, acquisition interval of a peer, x2 after each empty window
+#define SCAN_ACQ_MISS_MAX	6	// empty acquisition windows in succession -> no acquisition until the peer is heard
+#define SCAN_PERIOD_MAX	(60*CLOCK_16M_SYS_TIMER_CLK_1S) // max peer adv. period, in system ticks
+
 typedef struct __attribute__((packed)) _ad_uuid16_t {
 	u8 size;
 	u8 type;
@@ -83,8 +94,207 @@ const u8 ccm_aad = 0x11;
 
 bthome_beacon_nonce_t scan_bthome_nonce;
 
+//////////////////////////////////////////////////////////
+// peers MAC lookup table (open addressing)
+//////////////////////////////////////////////////////////
+static inline u32 scan_hash(u8 * pmac) {
+	return (pmac[0] ^ pmac[1] ^ pmac[2]) & (SCAN_HASH_SIZE - 1);
+}
+
+/* Find peer by MAC, return NULL if not in the table */
+_attribute_ram_code_
+__attribute__((optimize("-Os")))
+static scan_peer_t * scan_find_peer(u8 * pmac) {
+	u32 h = scan_hash(pmac);
+	u32 n;
+	while ((n = scan.hash[h]) != 0) {
+		if (memcmp(scan.peers.MAC[n - 1], pmac, sizeof(scan.peers.MAC[0])) == 0)
+			return &scan.peer[n - 1];
+		h = (h + 1) & (SCAN_HASH_SIZE - 1);
+	}
+	return NULL;
+}
+
+RAM scan_sched_t scan_sched[SCAN_PEERS];
+
+/* Rebuild the lookup table after changing scan.peers */
+void scan_peers_init(void) {
+	static const u8 mac_empty[6] = {0};
+	u32 h, i;
+	memset(scan.hash, 0, sizeof(scan.hash));
+	memset(scan.peer, 0, sizeof(scan.peer));
+	memset(scan_sched, 0, sizeof(scan_sched));
+	scan.peer_mask = 0;
+	for (i = 0; i < SCAN_PEERS; i++) {
+		scan_sched[i].acq_time = wrk.utc_time_sec; // acquisition at once
+		if (memcmp(scan.peers.MAC[i], mac_empty, sizeof(mac_empty)) == 0
+			|| scan_find_peer(scan.peers.MAC[i]) != NULL) // empty or duplicate
+			continue;
+		h = scan_hash(scan.peers.MAC[i]);
+		while (scan.hash[h])
+			h = (h + 1) & (SCAN_HASH_SIZE - 1);
+		scan.hash[h] = i + 1;
+		scan.peer_mask |= BIT(i);
+	}
+}
+
+//////////////////////////////////////////////////////////
+// peer scan windows
+//////////////////////////////////////////////////////////
+
+/* Report of the peer n received: learn the adv. period and phase */
+_attribute_ram_code_
+__attribute__((optimize("-Os")))
+static void scan_peer_learn(u32 n) {
+	scan_sched_t *ps = &scan_sched[n];
+	u32 now = clock_time();
+	u32 d = now - ps->last_tik;
+	u32 k;
+	scan.win_mask &= ~BIT(n);
+	ps->miss = 0;
+	ps->acq_miss = 0;
+	if (ps->last_tik && d < SCAN_ADV_DELAY * 2 * CLOCK_16M_SYS_TIMER_CLK_1MS)
+		return; // the same adv. event on the next channel
+	if (ps->last_tik && d < SCAN_PERIOD_MAX) {
+		if (ps->period == 0)
+			ps->period = d; // may be a multiple of the period, refined below
+		else {
+			// d = k periods, correct the period by 1/4 of the error
+			k = (d + (ps->period >> 1)) / ps->period;
+			if (k) {
+				d /= k;
+				ps->period += ((s32)d - (s32)ps->period) / 4;
+			}
+		}
+	}
+	ps->last_tik = now | 1;
+}
+
+_attribute_ram_code_
+static void scan_open(u32 win_tik, u8 win_type) {
+	scan.win_tik = win_tik;
+	scan.win_type = win_type;
+	scan_wakeup();
+}
+
+/* App wakeup (app_wakeup_set): open the peer scan window */
+_attribute_ram_code_
+void scan_window_open(void) {
+	if (!scan.start_tik && !scan.enabled && !wrk.ble_connected)
+		scan_open(scan.win_tik, SCAN_WIN_PEER);
+}
+
+/* Peers with an unknown adv. period */
+_attribute_ram_code_
+static u32 scan_peers_unknown(void) {
+	u32 i, mask = 0;
+	for (i = 0; i < SCAN_PEERS; i++) {
+		if ((scan.peer_mask & BIT(i)) && scan_sched[i].period == 0)
+			mask |= BIT(i);
+	}
+	return mask;
+}
+
+/* Peers for an acquisition window now: unknown period, not stopped, backoff time passed */
+_attribute_ram_code_
+static u32 scan_peers_acq(void) {
+	u32 i, mask = scan_peers_unknown();
+	for (i = 0; i < SCAN_PEERS; i++) {
+		if (scan_sched[i].acq_miss >= SCAN_ACQ_MISS_MAX
+			|| (s32)(wrk.utc_time_sec - scan_sched[i].acq_time) < 0)
+			mask &= ~BIT(i);
+	}
+	return mask;
+}
+
+/* Window closed: count the misses of the expected peers */
+_attribute_ram_code_
+__attribute__((optimize("-Os")))
+static void scan_window_end(void) {
+	scan_sched_t *ps;
+	u32 i;
+	for (i = 0; i < SCAN_PEERS; i++) {
+		ps = &scan_sched[i];
+		if (scan.win_type == SCAN_WIN_ACQ) {
+			if ((scan.acq_mask & BIT(i)) == 0)
+				continue;
+			if ((scan.win_mask & BIT(i)) && ps->acq_miss < SCAN_ACQ_MISS_MAX)
+				ps->acq_miss++; // not heard
+			ps->acq_time = wrk.utc_time_sec + (SCAN_ACQ_INTERVAL << ps->acq_miss);
+		} else if ((scan.win_mask & BIT(i)) && ++ps->miss > SCAN_MISS_MAX) {
+			// lost: learn again, after the backoff of the peer
+			ps->miss = 0;
+			ps->period = 0;
+			ps->acq_time = wrk.utc_time_sec + (SCAN_ACQ_INTERVAL << ps->acq_miss);
+		}
+	}
+	scan.win_mask = 0;
+	scan.acq_mask = 0;
+}
+
+/* Opens a short scan window around the next predicted peer report,
+ * or an acquisition window for peers with an unknown adv. period.
+ * Called from main_loop if the scan is not running */
+_attribute_ram_code_
+__attribute__((optimize("-Os")))
+void scan_schedule(void) {
+	scan_sched_t *ps;
+	u32 now = clock_time();
+	u32 i, dt, w;
+	u32 t_open[SCAN_PEERS], t_close[SCAN_PEERS];
+	u32 open = 0xffffffff, close = 0;
+	u8 mask = 0;
+	if (!scan.peer_mask || scan.enabled || wrk.ble_connected)
+		return;
+	// predicted windows of the peers, the earliest one
+	for (i = 0; i < SCAN_PEERS; i++) {
+		if ((scan.peer_mask & BIT(i)) == 0)
+			continue;
+		ps = &scan_sched[i];
+		if (ps->period == 0)
+			continue;
+		// report = last report + k * period +/- advDelay/2
+		w = ((SCAN_PEER_WIN * CLOCK_16M_SYS_TIMER_CLK_1MS) << ps->miss)
+			+ SCAN_ADV_DELAY * CLOCK_16M_SYS_TIMER_CLK_1MS / 2;
+		dt = (now - ps->last_tik) % ps->period; // time after the last predicted report
+		dt = ps->period - dt; // time to the next predicted report
+		t_open[i] = (dt > w)? dt - w : 0;
+		t_close[i] = dt + w;
+		if (t_open[i] < open) {
+			open = t_open[i];
+			close = t_close[i];
+		}
+		mask |= BIT(i);
+	}
+	// join the overlapping windows
+	for (i = 0; i < SCAN_PEERS; i++) {
+		if (mask & BIT(i)) {
+			if (t_open[i] > close)
+				mask &= ~BIT(i);
+			else if (t_close[i] > close)
+				close = t_close[i];
+		}
+	}
+	scan.wake_tik = 0;
+	if ((scan.acq_mask = scan_peers_acq()) != 0) {
+		// listen to learn the adv. period
+		scan.win_mask = scan.acq_mask;
+		scan_open(SCAN_ACQ_TIME * CLOCK_16M_SYS_TIMER_CLK_1MS, SCAN_WIN_ACQ);
+	} else if (mask) {
+		scan.win_mask = mask;
+		if (open < SCAN_WAKE_MIN * CLOCK_16M_SYS_TIMER_CLK_1MS)
+			scan_open(close, SCAN_WIN_PEER);
+		else {
+			scan.win_tik = close - open;
+			scan.wake_tik = (now + open) | 1;
+		}
+	}
+	app_wakeup_set(); // shared with the measurement
+}
+
+/* pp = NULL - time server, else BTHome peer */
 __attribute__((optimize("-Os")))
-void filter_bthome_ad(padv_bthome_t p, u8 * pmac) {
+void filter_bthome_ad(padv_bthome_t p, u8 * pmac, scan_peer_t * pp) {
 	int len = p->size;
 	if(len > sizeof(padv_bthome_t)) {
 		len -= sizeof(adv_bthome_t) - 2; // p->data len
@@ -126,7 +336,21 @@ void filter_bthome_ad(padv_bthome_t p, u8 * pmac) {
 		int size;
 		while(len > 0) {
 			if(ps->type < sizeof(tblBTHome)) {
-				if(ps->type == BtHomeID_timestamp) { // in 1 sec
+				if(pp) { // peer values
+					if(ps->type == BtHomeID_PacketId) {
+						pp->pid = ps->data_ub[0];
+					} else if(ps->type == BtHomeID_temperature) { // in 0.01 C
+						pp->temp = ps->data_is[0];
+					} else if(ps->type == BtHomeID_temperature_01) {  // in 0.1 C
+						pp->temp = ps->data_is[0]*10;
+					} else if(ps->type == BtHomeID_humidity) { // in 0.01 %
+						pp->humi = ps->data_us[0];
+					} else if(ps->type == BtHomeID_humidity8) { // in 1 %
+						pp->humi = ps->data_ub[0]*100;
+					} else if(ps->type == BtHomeID_battery) { // Batt in %
+						pp->battery = ps->data_ub[0];
+					}
+				} else if(ps->type == BtHomeID_timestamp) { // in 1 sec
 					wrk.utc_time_sec = ps->data_uw; // + scan.cfg.localt;
 #if 0 //(DEV_SERVICES & SERVICE_SCREEN)
 				} else if(ps->type == BtHomeID_raw) { // Show ext. small and big number
@@ -177,7 +401,7 @@ void filter_bthome_ad(padv_bthome_t p, u8 * pmac) {
 			if(size == 0x10)
 				size = ps->data_ub[0] + 2;
 			len -= size;
-			ps = (padv_bthome_sruct_t)((u32)ps + size);
+			ps = (padv_bthome_sruct_t)((u8 *)ps + size);
 		}
 	}
 }
@@ -195,9 +419,17 @@ int scanning_event_callback(u32 h, u8 *p, int n) {
 			if (p[0] == HCI_SUB_EVT_LE_ADVERTISING_REPORT) { // ADV packet
 				//after controller is set to scan state, it will report all the adv packet it received by this event
 				event_adv_report_t *pa = (event_adv_report_t *) p;
-				if(memcmp(scan.cfg.MAC, pa->mac, sizeof(scan.cfg.MAC)) == 0) {
+				scan_peer_t *pp = NULL;
+				int srv = memcmp(scan.cfg.MAC, pa->mac, sizeof(scan.cfg.MAC)) == 0; // time server
+				if(srv) {
 					blc_ll_setScanEnable(BLC_SCAN_DISABLE, DUP_FILTER_DISABLE); // отсановить сканирование
 					scan.start_tik = 0; // разрешить sleep
+#if USE_ENERGY_STAT
+					estat_set(ESTAT_SCAN, ESTAT_OTHER);
+#endif
+				} else
+					pp = scan_find_peer(pa->mac);
+				if(srv || pp) {
 					u32 adlen = pa->len;
 					u8 rssi = pa->data[adlen];
 					if (adlen && adlen < 32 && rssi != 0) { // rssi != 0
@@ -209,9 +441,15 @@ int scanning_event_callback(u32 h, u8 *p, int n) {
 								if(len >= sizeof(ad_uuid16_t) && pd->type == GAP_ADTYPE_SERVICE_DATA_UUID_16BIT) {
 									if((pd->uuid16) == ADV_BTHOME_UUID16) { // GATT Service: BTHome v2
 										memcpy(prev_advs, pd, len);
-										filter_bthome_ad((adv_bthome_t *)prev_advs, pa->mac);
-										blta.adv_duraton_en = 0; // reload adv
-										scan_stop(); // stop scan
+										filter_bthome_ad((adv_bthome_t *)prev_advs, pa->mac, pp);
+										if(pp) {
+											pp->rssi = (s8)rssi;
+											pp->time = wrk.utc_time_sec;
+											scan_peer_learn(pp - scan.peer);
+										} else {
+											blta.adv_duraton_en = 0; // reload adv
+											scan_stop(); // stop scan
+										}
 									}
 								}
 							} else
@@ -231,7 +469,15 @@ int scanning_event_callback(u32 h, u8 *p, int n) {
 // start wakeup if(scan.enabled) scan_wakeup();
 //////////////////////////////////////////////////////////
 void scan_wakeup(void) {
+	if (scan.enabled) { // time server
+		scan.win_tik = SCAN_WIN_TIME * CLOCK_16M_SYS_TIMER_CLK_1MS;
+		scan.win_type = SCAN_WIN_SERVER;
+		scan.win_mask = 0;
+	}
 	scan.start_tik = clock_time() | 1;
+#if USE_ENERGY_STAT
+	estat_set(ESTAT_OTHER, ESTAT_SCAN);
+#endif
 	//scan setting
 	blc_ll_initScanning_module(mac_public);
 	//bluetooth low energy(LE) event
@@ -263,6 +509,9 @@ void scan_init(void) {
 	scan.cfg.MAC[4] = 0x05;
 	scan.cfg.MAC[5] = 0x06;
 #endif
+	if(flash_read_cfg(&scan.peers, EEP_ID_SCP, sizeof(scan.peers)) != sizeof(scan.peers))
+		memset(&scan.peers, 0, sizeof(scan.peers));
+	scan_peers_init();
 	scan_stop();
 }
 
@@ -303,16 +552,25 @@ _attribute_ram_code_
 __attribute__((optimize("-Os")))
 void scan_task(void) {
 	u32 tt = clock_time() - scan.start_tik;
-	if(tt > 9*CLOCK_16M_SYS_TIMER_CLK_1MS) {
+	if(tt > scan.win_tik
+		|| (scan.win_type == SCAN_WIN_PEER && !scan.win_mask) // all expected peers received
+		|| (scan.win_type == SCAN_WIN_ACQ && !(scan.acq_mask & scan_peers_unknown()))) { // all periods are known
 		blc_ll_setScanEnable(BLC_SCAN_DISABLE, DUP_FILTER_DISABLE); // остановить сканирование
 		scan.start_tik = 0;
+#if USE_ENERGY_STAT
+		estat_set(ESTAT_SCAN, ESTAT_OTHER);
+#endif
+		scan_window_end();
+		scan_schedule(); // next peer window
+	}
+	if(scan.start_tik) {
+		bls_pm_setSuspendMask(SUSPEND_DISABLE);
+	} else {
 #ifdef SET_NO_SLEEP_MODE
 		bls_pm_setSuspendMask(SET_NO_SLEEP_MODE);
 #else
 		bls_pm_setSuspendMask(SUSPEND_ADV | SUSPEND_CONN | DEEPSLEEP_RETENTION_ADV);
 #endif
-	} else {
-		bls_pm_setSuspendMask(SUSPEND_DISABLE);
 	}
 }
 
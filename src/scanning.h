@@ -8,6 +8,8 @@
 #ifndef _SCANING_H_
 #define _SCANING_H_
 
+#include "estat.h"
+
 #define SCAN_USE_BINDKEY	0
 
 // saved to EEP_ID_SCN
@@ -19,26 +21,77 @@ typedef struct {
 #endif
 } scan_cfg_t;
 
+#define SCAN_PEERS		8	// max BTHome peers (outdoor sensors)
+#define SCAN_HASH_SIZE	16	// peer lookup table size, power of 2, > SCAN_PEERS
+
+enum {
+	SCAN_WIN_SERVER = 0,	// time server, after own adv.
+	SCAN_WIN_PEER,			// predicted peer reports
+	SCAN_WIN_ACQ			// acquisition: learning the peer adv. period
+} SCAN_WIN_TYPES_e;
+
+// saved to EEP_ID_SCP
+typedef struct {
+	u8 	MAC[SCAN_PEERS][6]; // MAC peers [0] - lo, .. [5] - hi digits, 00:00:00:00:00:00 - empty
+} scan_peers_cfg_t;
+
+// last values of the peer
+typedef struct {
+	u32	time;		// wrk.utc_time_sec of the last report, = 0 - none
+	s16	temp;		// x0.01 C
+	u16	humi;		// x0.01 %
+	u8	battery;	// %
+	u8	pid;		// BTHome PacketId
+	s8	rssi;
+} scan_peer_t;
+
 typedef struct {
 	u32	start_tik;		// = 0 - сканирование отключено (разрешить sleep), !=0 - штамп времени старта сканирования
 	u32	start_time;		// = wrk.utc_time_sec при старте каждого интервала
 	scan_cfg_t cfg;
 	u8 	enabled;
+	scan_peers_cfg_t peers;
+	scan_peer_t peer[SCAN_PEERS];
+	u8	hash[SCAN_HASH_SIZE]; // peer index + 1, = 0 - empty
+	u32	win_tik;		// scan window length, in system ticks
+	u32	wake_tik;		// app wakeup of the next peer window (app_wakeup_set), = 0 - none
+	u8	peer_mask;		// configured peers
+	u8	win_mask;		// peers expected in the current scan window, not heard yet
+	u8	acq_mask;		// peers of the current acquisition window
+	u8	win_type;		// SCAN_WIN_TYPES_e
 } scan_wrk_t;
 
 extern scan_wrk_t scan;
 
+// peer adv. timing, learned from the received reports
+typedef struct {
+	u32	last_tik;	// clock_time() of the last report, = 0 - none
+	u32	period;		// adv. period, in system ticks, = 0 - unknown
+	u32	acq_time;	// wrk.utc_time_sec of the next acquisition window
+	u8	miss;		// missed windows in succession
+	u8	acq_miss;	// empty acquisition windows in succession
+} scan_sched_t;
+
+extern scan_sched_t scan_sched[SCAN_PEERS];
+
 //////////////////////////////////////////////////////////
 // scan stop
 //////////////////////////////////////////////////////////
 inline void scan_stop(void) {
 	scan.enabled = 0; // stop scan
 	scan.start_tik = 0;
+	scan.win_mask = 0;
+#if USE_ENERGY_STAT
+	estat_set(ESTAT_SCAN, ESTAT_OTHER);
+#endif
 }
 
 void scan_init(void);
+void scan_peers_init(void);
 void scan_wakeup(void);
 void scan_start(void);
 void scan_task(void);
+void scan_schedule(void);
+void scan_window_open(void);
 
 #endif /* _SCANNING_H_ */
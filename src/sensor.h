@@ -95,9 +95,18 @@ typedef struct _sensor_cfg_t {
 extern sensor_cfg_t sensor_cfg;
 #define sensor_cfg_send_size 18 //max 19
 
+/* Detected sensor, saved in EEP_ID_SID (= sensor_cfg.id, i2c_addr, sensor_type) */
+typedef struct _sensor_sid_t {
+	u32 id;
+	u8 i2c_addr;
+	u8 sensor_type; // SENSOR_TYPES
+} sensor_sid_t;
+
 #endif // !USE_SENSOR_BME280
 
 void init_sensor(void);
+/* SENSOR_SLEEP_MEASURE: the start commands may be left in the I2C queue,
+ * the caller runs them (i2c_queue_start()) */
 void start_measure_sensor_deep_sleep(void);
 int read_sensor_cb(void);
 
@@ -11,6 +11,7 @@
 #include "i2c.h"
 #include "sensor.h"
 #include "app.h"
+#include "flash_eep.h"
 
 //==================================== SHTC3
 
@@ -89,6 +90,7 @@ const sensor_def_cfg_t def_thcoef_sht4x = {
 #define SHT30_SOFT_RESET	0xA230 // Soft reset command
 #define SHT30_RD_STATUS		0x2DF3 // Read status reg (2 bytes + crc)
 #define SHT30_CLR_STATUS	0x4130 // Clear status reg (2 bytes + crc)
+#define SHT30_RD_SN			0x8037 // Read serial number (2 x (2 bytes + crc)), SHT3x only
 #define SHT30_HIMEASURE		0x0024 // Measurement commands, Clock Stretching Disabled, Normal Mode, Read T First
 #define SHT30_HIMEASURE_CS	0x062C // Measurement commands, Clock Stretching, Normal Mode, Read T First
 #define SHT30_LPMEASURE		0x1624 // Measurement commands, Clock Stretching Disabled, Low Power Mode, Read T First
@@ -96,6 +98,7 @@ const sensor_def_cfg_t def_thcoef_sht4x = {
 
 #define SHT30_POWER_TIMEOUT_us	1500	// time us, 0.5..1.5 ms
 #define SHT30_SOFT_RESET_us		1500	// time us, 0.5..1.5 ms
+#define SHT30_RD_SN_us			1000	// time us
 #define SHT30_HI_MEASURE_us		15000	// time us, 12.5..15.5 ms
 #define SHT30_MD_MEASURE_us		5500	// time us, 4.5..6.5 ms
 #define SHT30_LO_MEASURE_us		3500	// time us, 2.5..4.5 ms
@@ -127,6 +130,8 @@ const sensor_def_cfg_t def_thcoef_sht30 = { // = shtc3
 the measurement is completed, and then six bytes can be read continuously */
 #define AHT2x_CMD_RST		0x0BA  // Soft Reset Command
 #define AHT2x_RD_STATUS		0x071  // Read Status
+#define AHT2x_STATUS_BUSY	0x80  // Status: measurement in progress
+#define AHT2x_STATUS_INIT	0x18  // Status: calibrated, initialized
 /*Before reading the temperature and humidity value,
 get a byte of status word by sending 0x71. If the status word and 0x18 are not equal to 0x18,
 initialize the 0x1B, 0x1C, 0x1E registers, details Please refer to our official website routine for
@@ -304,11 +309,11 @@ static u8 sensor_crc_buf(u8 * msg, int len) {
 	return crc;
 }
 
+/* Queue the start of the measurement */
 _attribute_ram_code_
-static int start_measure_aht2x(void) {
-	const u8 data[3] = {AHT2x_CMD_TMS, AHT2x_DATA1_TMS, AHT2x_DATA2_TMS};
+static void start_measure_aht2x(void) {
 	// 04000070ac3300
-	return send_i2c_buf(sensor_cfg.i2c_addr, (u8 *)data, sizeof(data));
+	i2c_queue_cmd(sensor_cfg.i2c_addr, AHT2x_CMD_TMS | (AHT2x_DATA1_TMS << 8) | (AHT2x_DATA2_TMS << 16), 3, NULL, 0, 0);
 }
 
 _attribute_ram_code_ __attribute__((optimize("-Os")))
@@ -316,7 +321,8 @@ static int read_sensor_aht2x(void) {
 	u32 _temp;
 	u8 data[7];
 	// 04000771
-	if(read_i2c_buf(sensor_cfg.i2c_addr, data, sizeof(data)) == 0
+	i2c_queue_cmd(sensor_cfg.i2c_addr, 0, 0, data, sizeof(data), 0);
+	if(i2c_queue_run() == 0
 	    && (data[0] & 0x80) == 0
 	    && sensor_crc_buf(data, sizeof(data)) == 0) {
 			_temp = (data[3] & 0x0F) << 16 | (data[4] << 8) | data[5];
@@ -327,7 +333,8 @@ static int read_sensor_aht2x(void) {
 			else if (measured_data.humi > 9999) measured_data.humi = 9999;
 			measured_data.count++;
 #if !SENSOR_SLEEP_MEASURE
-			if(!start_measure_aht2x()) // start measure T/H
+			start_measure_aht2x(); // start measure T/H
+			if(!i2c_queue_run())
 #endif
 				return 1;
 	}
@@ -344,7 +351,8 @@ static int read_sensor_cht8305(void) {
 	u32 _temp, i = 3;
 	u8 reg_data[4];
 	while(i--) {
-		if (!read_i2c_buf(sensor_cfg.i2c_addr, reg_data, sizeof(reg_data))) {
+		i2c_queue_cmd(sensor_cfg.i2c_addr, 0, 0, reg_data, sizeof(reg_data), 0);
+		if (!i2c_queue_run()) {
 			_temp = (reg_data[0] << 8) | reg_data[1];
 			measured_data.temp = ((u32)(_temp * sensor_cfg.coef.val1_k) >> 16) + sensor_cfg.coef.val1_z; // x 0.01 C // 16500 -4000
 			_temp = (reg_data[2] << 8) | reg_data[3];
@@ -353,7 +361,8 @@ static int read_sensor_cht8305(void) {
 			else if (measured_data.humi > 9999) measured_data.humi = 9999;
 			measured_data.count++;
 #if !SENSOR_SLEEP_MEASURE
-			send_i2c_byte(sensor_cfg.i2c_addr, CHT8305_REG_TMP); // start measure T/H
+			i2c_queue_cmd(sensor_cfg.i2c_addr, CHT8305_REG_TMP, 1, NULL, 0, 0); // start measure T/H
+			i2c_queue_run();
 #endif
 			return 1;
 		}
@@ -370,8 +379,9 @@ static int read_sensor_cht8215(void) {
 	u32 _temp, i = 3;
 	u8 reg_data[4];
 	while(i--) {
-		if ((!read_i2c_byte_addr(sensor_cfg.i2c_addr, CHT8215_REG_TMP, reg_data, 2))
-			&&(!read_i2c_byte_addr(sensor_cfg.i2c_addr, CHT8215_REG_HMD, &reg_data[2], 2))) {
+		i2c_queue_cmd(sensor_cfg.i2c_addr, CHT8215_REG_TMP, 1, reg_data, 2, 0);
+		i2c_queue_cmd(sensor_cfg.i2c_addr, CHT8215_REG_HMD, 1, &reg_data[2], 2, 0);
+		if (!i2c_queue_run()) {
 			_temp = (reg_data[0] << 8) | reg_data[1];
 			measured_data.temp = ((u32)(_temp * sensor_cfg.coef.val1_k) >> 16) + sensor_cfg.coef.val1_z; // x 0.01 C // 16500 -4000
 			_temp = (reg_data[2] << 8) | reg_data[3];
@@ -392,107 +402,32 @@ static int read_sensor_cht8215(void) {
 _attribute_ram_code_ __attribute__((optimize("-Os")))
 static int read_sensor_sht30_shtc3_sht4x(void) {
 	int ret = 0;
-	int i;
+	int i = 256;
 	u16 _temp;
 	u16 _humi;
-#ifndef I2C_GROUP
 	u8 buf[6];
-	i = 256;
-#else
-	u8 crc; // calculated checksum
-	u8 data;
-	i = 512;
+	u8 i2c_addr = sensor_cfg.i2c_addr;
+#if (DEVICE_TYPE == DEVICE_CGDK2) // SHTC3
+	if(sensor_cfg.id == 0xBDC3)
+		i2c_addr = 0;
+#endif
+#if (I2C_MAX_SPEED > 400000) && defined(I2C_GROUP)
 	if ((reg_clk_en0 & FLD_CLK0_I2C_EN)==0)
 		init_i2c();
-#if (I2C_MAX_SPEED > 400000)
 	u8 r = reg_i2c_speed;
 	reg_i2c_speed = (u8)(CLOCK_SYS_CLOCK_HZ/(4*I2C_MAX_SPEED)); // 700 kHz
-#endif
-#if (DEVICE_TYPE == DEVICE_CGDK2) // SHTC3
-	if(sensor_cfg.id == 0xBDC3)
-		reg_i2c_id = FLD_I2C_WRITE_READ_BIT;
-	else
-		reg_i2c_id = sensor_cfg.i2c_addr | FLD_I2C_WRITE_READ_BIT;
-#else
-	reg_i2c_id = sensor_cfg.i2c_addr | FLD_I2C_WRITE_READ_BIT;
-#endif
 #endif
 	do {
-#ifndef I2C_GROUP
-#if (DEVICE_TYPE == DEVICE_CGDK2) // SHTC3
-		if(sensor_cfg.id == 0xBDC3)
-			if(read_i2c_buf(0, buf, sizeof(buf)))
-				continue;
-		else {
-			if(read_i2c_buf(sensor_cfg.i2c_addr, buf, sizeof(buf)))
-				continue;
-		}
-#else
-		if(read_i2c_buf(sensor_cfg.i2c_addr, buf, sizeof(buf)))
+		// NAK - the measurement is not ready
+		i2c_queue_cmd(i2c_addr, 0, 0, buf, sizeof(buf), 0);
+		if(i2c_queue_run())
 			continue;
-#endif
 		if ((sensor_crc(buf[1] ^ sensor_crc(buf[0] ^ 0xff)) == buf[2])
 		&& (sensor_crc(buf[4] ^ sensor_crc(buf[3] ^ 0xff)) == buf[5]))
 		{
 			_temp = (buf[0] << 8) | buf[1];
 			_humi = (buf[3] << 8) | buf[4];
 			if(_temp != 0xffff) {
-
-#else
-		reg_i2c_ctrl = FLD_I2C_CMD_ID | FLD_I2C_CMD_START;
-		while (reg_i2c_status & FLD_I2C_CMD_BUSY);
-		if (reg_i2c_status & FLD_I2C_NAK) {
-			reg_i2c_ctrl = FLD_I2C_CMD_STOP;
-			while (reg_i2c_status & FLD_I2C_CMD_BUSY);
-		} else { // ACK ok
-			reg_i2c_ctrl = FLD_I2C_CMD_DI | FLD_I2C_CMD_READ_ID;
-			while (reg_i2c_status & FLD_I2C_CMD_BUSY);
-			data = reg_i2c_di;
-			reg_i2c_ctrl = FLD_I2C_CMD_DI | FLD_I2C_CMD_READ_ID;
-			_temp = data << 8;
-			crc = sensor_crc(data ^ 0xff);
-			while (reg_i2c_status & FLD_I2C_CMD_BUSY);
-			data = reg_i2c_di;
-			reg_i2c_ctrl = FLD_I2C_CMD_DI | FLD_I2C_CMD_READ_ID;
-			_temp |= data;
-			crc = sensor_crc(crc ^ data);
-			while (reg_i2c_status & FLD_I2C_CMD_BUSY);
-			data = reg_i2c_di;
-#if 1	// use humi CRC
-			if (crc != data) {
-				reg_i2c_ctrl = FLD_I2C_CMD_STOP;
-				while (reg_i2c_status & FLD_I2C_CMD_BUSY);
-				continue;
-			}
-			reg_i2c_ctrl = FLD_I2C_CMD_DI | FLD_I2C_CMD_READ_ID;
-			while (reg_i2c_status & FLD_I2C_CMD_BUSY);
-			data = reg_i2c_di;
-			reg_i2c_ctrl = FLD_I2C_CMD_DI | FLD_I2C_CMD_READ_ID;
-			_humi = data << 8;
-			crc = sensor_crc(data ^ 0xff);
-			while (reg_i2c_status & FLD_I2C_CMD_BUSY);
-			data = reg_i2c_di;
-			reg_i2c_ctrl = FLD_I2C_CMD_DI | FLD_I2C_CMD_READ_ID | FLD_I2C_CMD_ACK;
-			_humi |= data;
-			crc = sensor_crc(crc ^ data);
-			while (reg_i2c_status & FLD_I2C_CMD_BUSY);
-			data = reg_i2c_di;
-			reg_i2c_ctrl = FLD_I2C_CMD_STOP;
-			while (reg_i2c_status & FLD_I2C_CMD_BUSY);
-			if (crc == data) {
-#else
-			reg_i2c_ctrl = FLD_I2C_CMD_DI | FLD_I2C_CMD_READ_ID;
-			while (reg_i2c_status & FLD_I2C_CMD_BUSY);
-			data = reg_i2c_di;
-			reg_i2c_ctrl = FLD_I2C_CMD_DI | FLD_I2C_CMD_READ_ID | FLD_I2C_CMD_ACK;
-				_humi = data << 8;
-			while (reg_i2c_status & FLD_I2C_CMD_BUSY);
-			_humi |= reg_i2c_di;
-			reg_i2c_ctrl = FLD_I2C_CMD_STOP;
-			while (reg_i2c_status & FLD_I2C_CMD_BUSY);
-			if (crc == data && _temp != 0xffff) {
-#endif
-#endif
 				measured_data.temp = ((s32)(_temp * sensor_cfg.coef.val1_k) >> 16) + sensor_cfg.coef.val1_z; // x 0.01 C //17500 - 4500
 				measured_data.humi = ((u32)(_humi * sensor_cfg.coef.val2_k) >> 16) + sensor_cfg.coef.val2_z; // x 0.01 %	   // 10000 -0
 				if (measured_data.humi < 0) measured_data.humi = 0;
@@ -500,22 +435,23 @@ static int read_sensor_sht30_shtc3_sht4x(void) {
 				measured_data.count++;
 #if USE_SENSOR_SHTC3
 				if (sensor_cfg.sensor_type == TH_SENSOR_SHTC3) {
-					send_i2c_word(sensor_cfg.i2c_addr, SHTC3_GO_SLEEP); // Sleep command of the sensor
+					i2c_queue_cmd(sensor_cfg.i2c_addr, SHTC3_GO_SLEEP, 2, NULL, 0, 0); // Sleep command of the sensor
 				} else
 #endif
 #if !SENSOR_SLEEP_MEASURE
 #if USE_SENSOR_SHT4X
 				if(sensor_cfg.sensor_type == TH_SENSOR_SHT4x) {
-					send_i2c_byte(sensor_cfg.i2c_addr, SHT4x_MEASURE_HI);
+					i2c_queue_cmd(sensor_cfg.i2c_addr, SHT4x_MEASURE_HI, 1, NULL, 0, 0);
 				} else
 #endif // USE_SENSOR_SHT4X
 #if USE_SENSOR_SHT30
 				if(sensor_cfg.sensor_type == TH_SENSOR_SHT30) {
-					send_i2c_word(sensor_cfg.i2c_addr, SHT30_HIMEASURE); // start measure T/H
+					i2c_queue_cmd(sensor_cfg.i2c_addr, SHT30_HIMEASURE, 2, NULL, 0, 0); // start measure T/H
 				} else
 #endif //USE_SENSOR_SHT30
 #endif
 				{}
+				i2c_queue_run();
 				ret = 1;
 				break;
 			}
@@ -530,6 +466,221 @@ static int read_sensor_sht30_shtc3_sht4x(void) {
 }
 #endif
 
+#if USE_SENSOR_SHTC3
+static sensor_def_cfg_t * probe_shtc3(u8 * buf) {
+	sensor_def_cfg_t *ptabinit = NULL;
+	int err;
+	// SHTC3
+	i2c_queue_cmd(sensor_cfg.i2c_addr, SHTC3_WAKEUP, 2, NULL, 0, SHTC3_WAKEUP_us); //	Wake-up command of the SHTC3 sensor
+	i2c_queue_cmd(sensor_cfg.i2c_addr, SHTC3_GET_ID, 2, NULL, 0, 0); // Get ID
+	i2c_queue_cmd(sensor_cfg.i2c_addr, 0, 0, buf, 3, 0);
+	err = i2c_queue_run();
+	if(err != 1) { // wake-up ok
+		// cfg.hw_cfg.shtc3 = 1; // = 1 - sensor SHTC3
+		if(!err
+		&& buf[2] == sensor_crc(buf[1] ^ sensor_crc(buf[0] ^ 0xff))) { // = 0x5b
+			sensor_cfg.id = (0x00C3<<16) | (buf[0] << 8) | buf[1]; // = 0x8708
+		} else {
+			// DEVICE_CGDK2 and bad sensor
+			sensor_cfg.id = 0xBDC3;
+		}
+		cfg.flg.lp_measures = 0;
+		ptabinit = (sensor_def_cfg_t *)&def_thcoef_shtc3;
+	}
+	i2c_queue_cmd(sensor_cfg.i2c_addr, SHTC3_GO_SLEEP, 2, NULL, 0, 0); // Sleep command of the sensor
+	i2c_queue_run();
+	return ptabinit;
+}
+#endif
+
+#if USE_SENSOR_AHT20_30
+static sensor_def_cfg_t * probe_aht2x(u8 * buf) {
+	// AHT2x..30
+	// pm_wait_us(AHT2x_POWER_TIMEOUT_us);
+	i2c_queue_cmd(sensor_cfg.i2c_addr, AHT2x_CMD_RST, 1, NULL, 0, AHT2x_SOFT_RESET_us); // Soft reset command
+	// 0401017071 -> I2C addres 0x70, write 1 bytes, read: 18
+	i2c_queue_cmd(sensor_cfg.i2c_addr, 0, 0, buf, 1, 0); // buf[0] = 0x18
+	if(!i2c_queue_run()) {
+		sensor_cfg.id = (0x0020 << 16) | buf[0];
+//		start_measure_aht2x();
+		return (sensor_def_cfg_t *)&def_thcoef_aht2x;
+	}
+	return NULL;
+}
+#endif
+
+#if (USE_SENSOR_CHT8305 || USE_SENSOR_CHT8215)
+/* Configure the CHT8305/CHT8215 of sensor_cfg.id */
+static sensor_def_cfg_t * init_cht83xx(void) {
+#if USE_SENSOR_CHT8305
+	if(sensor_cfg.id == ((CHT8305_VID << 16) | CHT8305_MID)) {
+		// Soft reset command: [reg], [15:8], [7:0]
+		i2c_queue_cmd(sensor_cfg.i2c_addr, CHT8305_REG_CFG
+			| (((CHT8305_CFG_SOFT_RESET | CHT8305_CFG_MODE) >> 8) << 8)
+			| (((CHT8305_CFG_SOFT_RESET | CHT8305_CFG_MODE) & 0xff) << 16),
+			3, NULL, 0, CHT8305_SOFT_RESET_us);
+		// Configure
+		i2c_queue_cmd(sensor_cfg.i2c_addr, CHT8305_REG_CFG
+			| ((CHT8305_CFG_MODE >> 8) << 8)
+			| ((CHT8305_CFG_MODE & 0xff) << 16),
+			3, NULL, 0, CHT8305_SOFT_RESET_us);
+		i2c_queue_cmd(sensor_cfg.i2c_addr, CHT8305_REG_TMP, 1, NULL, 0, 0); // start measure T/H
+		i2c_queue_run();
+		//sensor_cfg.sensor_type = TH_SENSOR_CHT8305;
+//		pm_wait_us(CHT8305_MEASURE_us);
+//		read_sensor_cht8305();
+		return (sensor_def_cfg_t *)&def_thcoef_cht8305;
+	}
+#endif
+#if USE_SENSOR_CHT8215
+	if(sensor_cfg.id == ((CHT8215_VID << 16) | CHT8215_MID)) {
+		//sensor_cfg.sensor_type = TH_SENSOR_CHT8215;
+		if(wrk.measurement_step_time >= 5000 * CLOCK_16M_SYS_TIMER_CLK_1MS) { // > 5 sec
+			i2c_queue_cmd(sensor_cfg.i2c_addr, CHT8215_REG_CRT | (0x03 << 8), 3, NULL, 0, 0); // Set conversion ratio 5 sec
+			i2c_queue_run();
+		}
+		return (sensor_def_cfg_t *)&def_thcoef_cht8215;
+	}
+#endif
+	return NULL;
+}
+
+static sensor_def_cfg_t * probe_cht83xx(u8 * buf) {
+	// I2C addr 0x40..0x43
+	// CHT8305/CHT8315
+	i2c_queue_cmd(sensor_cfg.i2c_addr, CHT8305_REG_MID, 1, buf, 2, 0); // Get MID
+	i2c_queue_cmd(sensor_cfg.i2c_addr, CHT8305_REG_VID, 1, &buf[2], 2, 0); // Get VID
+	if (!i2c_queue_run()) {
+		sensor_cfg.id = (buf[2] << 24) | (buf[3] << 16) | (buf[0] << 8) | buf[1];
+		return init_cht83xx();
+	}
+	return NULL;
+}
+#endif // (USE_SENSOR_CHT8305 || USE_SENSOR_CHT8215)
+
+#if USE_SENSOR_SHT4X
+static sensor_def_cfg_t * probe_sht4x(u8 * buf) {
+	// SHT4x
+	i2c_queue_cmd(sensor_cfg.i2c_addr, SHT4x_SOFT_RESET, 1, NULL, 0, SHT4x_SOFT_RESET_us); // Soft reset command
+	i2c_queue_cmd(sensor_cfg.i2c_addr, SHT4x_GET_ID, 1, NULL, 0, SHT4x_SOFT_RESET_us); // Get ID
+	i2c_queue_cmd(sensor_cfg.i2c_addr, 0, 0, buf, 6, 0);
+	if(i2c_queue_run() == 0
+	&& buf[2] == sensor_crc(buf[1] ^ sensor_crc(buf[0] ^ 0xff))
+	&& buf[5] == sensor_crc(buf[4] ^ sensor_crc(buf[3] ^ 0xff))
+	) {
+		sensor_cfg.id = (buf[3] << 24) | (buf[4] << 16) | (buf[0] << 8) | buf[1];
+		return (sensor_def_cfg_t *)&def_thcoef_sht4x;
+	}
+	return NULL;
+}
+#endif // USE_SENSOR_SHT4X
+
+#if USE_SENSOR_SHT30
+#define SHT30_ID_STATUS(id)	(((id) >> 16) == 0x0030) // id without serial number
+
+/* SHT30 id: the serial number (SHT3x) or, if none (GXHT3x, CHT832x),
+ * 0x0030 << 16 | status reg. return: 0 - no answer */
+static u32 get_id_sht30(u8 * buf) {
+	u32 id;
+	// read status reg
+	i2c_queue_cmd(sensor_cfg.i2c_addr, SHT30_RD_STATUS, 2, NULL, 0, 0);
+	i2c_queue_cmd(sensor_cfg.i2c_addr, 0, 0, buf, 3, 0);
+	if(i2c_queue_run()
+	|| buf[2] != sensor_crc(buf[1] ^ sensor_crc(buf[0] ^ 0xff)))
+		return 0;
+	id = (0x0030 << 16) | (buf[0] << 8) | buf[1];
+	i2c_queue_cmd(sensor_cfg.i2c_addr, SHT30_RD_SN, 2, NULL, 0, SHT30_RD_SN_us); // Get serial number
+	i2c_queue_cmd(sensor_cfg.i2c_addr, 0, 0, buf, 6, 0);
+	if(i2c_queue_run() == 0
+	&& buf[2] == sensor_crc(buf[1] ^ sensor_crc(buf[0] ^ 0xff))
+	&& buf[5] == sensor_crc(buf[4] ^ sensor_crc(buf[3] ^ 0xff)))
+		id = (buf[0] << 24) | (buf[1] << 16) | (buf[3] << 8) | buf[4];
+	return id;
+}
+
+static sensor_def_cfg_t * probe_sht30(u8 * buf) {
+	// SHT30/GXHT3x/CHT832x
+	i2c_queue_cmd(sensor_cfg.i2c_addr, SHT30_SOFT_RESET, 2, NULL, 0, SHT30_SOFT_RESET_us); // Soft reset command
+	// clear status reg
+	// i2c_queue_cmd(sensor_cfg.i2c_addr, SHT30_CLR_STATUS, 2, NULL, 0, 0);
+	if(i2c_queue_run() == 0
+	&& (sensor_cfg.id = get_id_sht30(buf)) != 0)
+		return (sensor_def_cfg_t *)&def_thcoef_sht30;
+	return NULL;
+}
+#endif // USE_SENSOR_SHT30
+
+/* Confirm the sensor saved in EEP_ID_SID: one ID read at the saved I2C address,
+ * no reset. SHT30: the serial number, if the part has one, else the status is read.
+ * AHT2x has no ID: the status must be calibrated and idle. */
+static sensor_def_cfg_t * confirm_sensor(u8 * buf) {
+	sensor_def_cfg_t *ptabinit = NULL;
+	sensor_sid_t sid;
+	int cmp_id = 1;
+	if (flash_read_cfg(&sid, EEP_ID_SID, sizeof(sid)) != sizeof(sid))
+		return NULL;
+	sensor_cfg.i2c_addr = sid.i2c_addr;
+	switch(sid.sensor_type) {
+#if USE_SENSOR_SHTC3
+	case TH_SENSOR_SHTC3:
+		ptabinit = probe_shtc3(buf); // wakeup, ID, sleep
+		break;
+#endif
+#if USE_SENSOR_AHT20_30
+	case TH_SENSOR_AHT2x:
+		i2c_queue_cmd(sensor_cfg.i2c_addr, 0, 0, buf, 1, 0); // status
+		if (!i2c_queue_run()
+			&& (buf[0] & (AHT2x_STATUS_BUSY | AHT2x_STATUS_INIT)) == AHT2x_STATUS_INIT) {
+			sensor_cfg.id = (0x0020 << 16) | buf[0];
+			ptabinit = (sensor_def_cfg_t *)&def_thcoef_aht2x;
+		}
+		cmp_id = 0;
+		break;
+#endif
+#if USE_SENSOR_CHT8305
+	case TH_SENSOR_CHT8305:
+#endif
+#if USE_SENSOR_CHT8215
+	case TH_SENSOR_CHT8215:
+#endif
+#if (USE_SENSOR_CHT8305 || USE_SENSOR_CHT8215)
+		i2c_queue_cmd(sensor_cfg.i2c_addr, CHT8305_REG_VID, 1, buf, 2, 0); // Get VID
+		if (!i2c_queue_run()
+			&& ((buf[0] << 8) | buf[1]) == (sid.id >> 16)) {
+			sensor_cfg.id = sid.id;
+			ptabinit = init_cht83xx();
+		}
+		break;
+#endif
+#if USE_SENSOR_SHT4X
+	case TH_SENSOR_SHT4x:
+		i2c_queue_cmd(sensor_cfg.i2c_addr, SHT4x_GET_ID, 1, NULL, 0, SHT4x_SOFT_RESET_us); // Get ID
+		i2c_queue_cmd(sensor_cfg.i2c_addr, 0, 0, buf, 6, 0);
+		if(i2c_queue_run() == 0
+		&& buf[2] == sensor_crc(buf[1] ^ sensor_crc(buf[0] ^ 0xff))
+		&& buf[5] == sensor_crc(buf[4] ^ sensor_crc(buf[3] ^ 0xff))) {
+			sensor_cfg.id = (buf[3] << 24) | (buf[4] << 16) | (buf[0] << 8) | buf[1];
+			ptabinit = (sensor_def_cfg_t *)&def_thcoef_sht4x;
+		}
+		break;
+#endif
+#if USE_SENSOR_SHT30
+	case TH_SENSOR_SHT30:
+		if((sensor_cfg.id = get_id_sht30(buf)) != 0)
+			ptabinit = (sensor_def_cfg_t *)&def_thcoef_sht30;
+		// the status id changes: compared only if one has a serial number
+		cmp_id = !SHT30_ID_STATUS(sensor_cfg.id) || !SHT30_ID_STATUS(sid.id);
+		break;
+#endif
+	default:
+		break;
+	}
+	if (ptabinit
+		&& (ptabinit->sensor_type != sid.sensor_type || (cmp_id && sensor_cfg.id != sid.id)))
+		ptabinit = NULL; // other sensor -> full scan
+	return ptabinit;
+}
+
 static int check_sensor(void) {
 #if USE_SENSOR_CHT8305 || USE_SENSOR_CHT8215
 	int test_i2c_addr = CHT8305_I2C_ADDR << 1;
@@ -539,144 +690,62 @@ static int check_sensor(void) {
 #endif
 #endif
 	u8 buf[8];
-	sensor_def_cfg_t *ptabinit = NULL;
+	sensor_def_cfg_t *ptabinit;
 	sensor_cfg.sensor_type = TH_SENSOR_NONE;
 #if SENSOR_SLEEP_MEASURE
 	sensor_cfg.measure_timeout = 16384*CLOCK_16M_SYS_TIMER_CLK_1US;
 #endif
 	sensor_cfg.id = 0;
+	ptabinit = confirm_sensor(buf); // saved sensor?
+	if(!ptabinit) {
 #if USE_SENSOR_SHTC3
-	// cfg.hw_cfg.shtc3 = 0;
-	// Scan I2C addr 0x70
-	if ((sensor_cfg.i2c_addr = (u8) scan_i2c_addr(SHTC3_I2C_ADDR << 1)) != 0) {
-		// SHTC3
-		if(!send_i2c_word(SHTC3_I2C_ADDR << 1, SHTC3_WAKEUP)) { //	Wake-up command of the SHTC3 sensor
-			sleep_us(SHTC3_WAKEUP_us);	// 240 us
-			// cfg.hw_cfg.shtc3 = 1; // = 1 - sensor SHTC3
-			if(!send_i2c_word(sensor_cfg.i2c_addr, SHTC3_GET_ID) // Get ID
-			&& !read_i2c_buf(sensor_cfg.i2c_addr, buf, 3)
-			&& buf[2] == sensor_crc(buf[1] ^ sensor_crc(buf[0] ^ 0xff))) { // = 0x5b
-				sensor_cfg.id = (0x00C3<<16) | (buf[0] << 8) | buf[1]; // = 0x8708
-			} else {
-				// DEVICE_CGDK2 and bad sensor
-				sensor_cfg.id = 0xBDC3;
-			}
-			cfg.flg.lp_measures = 0;
-			ptabinit = (sensor_def_cfg_t *)&def_thcoef_shtc3;
-		}
-		send_i2c_word(sensor_cfg.i2c_addr, SHTC3_GO_SLEEP); // Sleep command of the sensor
-	} else
+		// cfg.hw_cfg.shtc3 = 0;
+		// Scan I2C addr 0x70
+		if ((sensor_cfg.i2c_addr = (u8) scan_i2c_addr(SHTC3_I2C_ADDR << 1)) != 0) {
+			ptabinit = probe_shtc3(buf);
+		} else
 #endif
 #if USE_SENSOR_AHT20_30
-	// Scan I2C addr 0x38
-	 if ((sensor_cfg.i2c_addr = (u8) scan_i2c_addr(AHT2x_I2C_ADDR << 1)) != 0) {
-		// AHT2x..30
-		// pm_wait_us(AHT2x_POWER_TIMEOUT_us);
-		if(!send_i2c_byte(sensor_cfg.i2c_addr, AHT2x_CMD_RST)) { // Soft reset command
-			pm_wait_us(AHT2x_SOFT_RESET_us);
-			// 0401017071 -> I2C addres 0x70, write 1 bytes, read: 18
-			//if(!read_i2c_byte_addr(sensor_cfg.i2c_addr, AHT2x_RD_STATUS, buf, 1)) { // buf[0] = 0x18
-			if(!read_i2c_buf(sensor_cfg.i2c_addr, buf, 1)) { // buf[0] = 0x18
-				sensor_cfg.id = (0x0020 << 16) | buf[0];
-//				start_measure_aht2x();
-				ptabinit = (sensor_def_cfg_t *)&def_thcoef_aht2x;
-			}
-		}
-	} else
+		// Scan I2C addr 0x38
+		 if ((sensor_cfg.i2c_addr = (u8) scan_i2c_addr(AHT2x_I2C_ADDR << 1)) != 0) {
+			ptabinit = probe_aht2x(buf);
+		} else
 #endif
-	// Scan I2C addr 0x40..0x46
-	 {
+		// Scan I2C addr 0x40..0x46
+		 {
 #if (USE_SENSOR_CHT8305 || USE_SENSOR_CHT8215 || USE_SENSOR_SHT4X || USE_SENSOR_SHT30)
-		do {
-			if((sensor_cfg.i2c_addr = (u8) scan_i2c_addr(test_i2c_addr)) != 0) {
+			do {
+				if((sensor_cfg.i2c_addr = (u8) scan_i2c_addr(test_i2c_addr)) != 0) {
 #if (USE_SENSOR_CHT8305 || USE_SENSOR_CHT8215)
-				if(sensor_cfg.i2c_addr <= (CHT8305_I2C_ADDR_MAX << 1)) {
-					// I2C addr 0x40..0x43
-					// CHT8305/CHT8315
-					if (!read_i2c_byte_addr(sensor_cfg.i2c_addr, CHT8305_REG_MID, buf, 2) // Get MID
-						&& !read_i2c_byte_addr(sensor_cfg.i2c_addr, CHT8305_REG_VID, &buf[2], 2)) {
-						sensor_cfg.id = (buf[2] << 24) | (buf[3] << 16) | (buf[0] << 8) | buf[1];
-#if USE_SENSOR_CHT8305
-						if(sensor_cfg.id == ((CHT8305_VID << 16) | CHT8305_MID)) {
-							// Soft reset command
-							buf[0] = CHT8305_REG_CFG;
-							buf[1] = (CHT8305_CFG_SOFT_RESET | CHT8305_CFG_MODE) >> 8;
-							buf[2] = (CHT8305_CFG_SOFT_RESET | CHT8305_CFG_MODE) & 0xff;
-							send_i2c_buf(sensor_cfg.i2c_addr, buf, 3);
-							pm_wait_us(CHT8305_SOFT_RESET_us);
-							// Configure
-//							buf[0] = CHT8305_REG_CFG;
-							buf[1] = CHT8305_CFG_MODE >> 8;
-							buf[2] = CHT8305_CFG_MODE & 0xff;
-							send_i2c_buf(sensor_cfg.i2c_addr, buf, 3);
-							pm_wait_us(CHT8305_SOFT_RESET_us);
-							//sensor_cfg.sensor_type = TH_SENSOR_CHT8305;
-							ptabinit = (sensor_def_cfg_t *)&def_thcoef_cht8305;
-							send_i2c_byte(sensor_cfg.i2c_addr, CHT8305_REG_TMP); // start measure T/H
-//							pm_wait_us(CHT8305_MEASURE_us);
-//							read_sensor_cht8305();
-							break;
-						} else
-#endif
-#if USE_SENSOR_CHT8215
-						if(sensor_cfg.id == ((CHT8215_VID << 16) | CHT8215_MID)) {
-							//sensor_cfg.sensor_type = TH_SENSOR_CHT8215;
-							if(wrk.measurement_step_time >= 5000 * CLOCK_16M_SYS_TIMER_CLK_1MS) { // > 5 sec
-								buf[0] = CHT8215_REG_CRT;
-								buf[1] = 0x03;
-								buf[2] = 0;
-								send_i2c_buf(sensor_cfg.i2c_addr, buf, 3); // Set conversion ratio 5 sec
-							}
-							ptabinit = (sensor_def_cfg_t *)&def_thcoef_cht8215;
+					if(sensor_cfg.i2c_addr <= (CHT8305_I2C_ADDR_MAX << 1)) {
+						if((ptabinit = probe_cht83xx(buf)) != NULL)
 							break;
-						} else
-#endif
-							sensor_cfg.i2c_addr = 0;
-					}
-				} else
+					} else
 #endif // USE_SENSOR_CHT8305
-				{
-					// I2C addr 0x44..0x46
+					{
+						// I2C addr 0x44..0x46
 #if USE_SENSOR_SHT4X
-					// SHT4x
-					if(!send_i2c_byte(sensor_cfg.i2c_addr, SHT4x_SOFT_RESET)) { // Soft reset command
-						sleep_us(SHT4x_SOFT_RESET_us);
-						if(!send_i2c_byte(sensor_cfg.i2c_addr, SHT4x_GET_ID)) { // Get ID
-							sleep_us(SHT4x_SOFT_RESET_us);
-							if(read_i2c_buf(sensor_cfg.i2c_addr,  buf, 6) == 0
-							&& buf[2] == sensor_crc(buf[1] ^ sensor_crc(buf[0] ^ 0xff))
-							&& buf[5] == sensor_crc(buf[4] ^ sensor_crc(buf[3] ^ 0xff))
-							) {
-								sensor_cfg.id = (buf[3] << 24) | (buf[4] << 16) | (buf[0] << 8) | buf[1];
-								ptabinit = (sensor_def_cfg_t *)&def_thcoef_sht4x;
-								break;
-							}
-						}
-					}
+						if((ptabinit = probe_sht4x(buf)) != NULL)
+							break;
 #endif // USE_SENSOR_SHT4X
 #if USE_SENSOR_SHT30
-					// SHT30/GXHT3x/CHT832x
-					if(!send_i2c_word(sensor_cfg.i2c_addr, SHT30_SOFT_RESET)) { // Soft reset command
-						sleep_us(SHT30_SOFT_RESET_us);
-						// clear status reg
-						// send_i2c_word(sensor_cfg.i2c_addr, SHT30_CLR_STATUS);
-						// read status reg
-						if(!send_i2c_word(sensor_cfg.i2c_addr, SHT30_RD_STATUS)
-						&& !read_i2c_buf(sensor_cfg.i2c_addr, buf, 3)
-						&& buf[2] == sensor_crc(buf[1] ^ sensor_crc(buf[0] ^ 0xff))) {
-							//if(!send_i2c_word(sensor_cfg.i2c_addr, SHT30_HIMEASURE)) { // start measure T/H
-								sensor_cfg.id = (0x0030 << 16) | (buf[0] << 8) | buf[1];
-								ptabinit = (sensor_def_cfg_t *)&def_thcoef_sht30;
-							//}
+						if((ptabinit = probe_sht30(buf)) != NULL)
 							break;
-						}
-					}
 #endif // USE_SENSOR_SHT30
+					}
 				}
-			}
-			test_i2c_addr += 2;
-		} while(test_i2c_addr <= (SHT4x_I2C_ADDR_MAX << 1));
+				test_i2c_addr += 2;
+			} while(test_i2c_addr <= (SHT4x_I2C_ADDR_MAX << 1));
 #endif // (USE_SENSOR_CHT8305 || USE_SENSOR_SHT4X || USE_SENSOR_SHT30)
+		}
+		if(ptabinit) {
+			// save new sensor: id, i2c_addr, sensor_type
+			sensor_sid_t sid;
+			sid.id = sensor_cfg.id;
+			sid.i2c_addr = sensor_cfg.i2c_addr;
+			sid.sensor_type = ptabinit->sensor_type;
+			flash_write_cfg(&sid, EEP_ID_SID, sizeof(sid));
+		}
 	}
 	if(ptabinit) {
 		if(sensor_cfg.coef.val1_k == 0) {
@@ -697,8 +766,8 @@ static int check_sensor(void) {
 
 void init_sensor(void) {
 	//scan_i2c_addr(0);
-	send_i2c_byte(0, 0x06); // Reset command using the general call address
-	sleep_us(SHTC3_WAKEUP_us);	// 240 us
+	i2c_queue_cmd(0, 0x06, 1, NULL, 0, SHTC3_WAKEUP_us); // Reset command using the general call address
+	i2c_queue_run();
 	check_sensor();
 #if !SENSOR_SLEEP_MEASURE
 	pm_wait_ms(80);
@@ -740,7 +809,7 @@ void start_measure_sensor_deep_sleep(void) {
 #if USE_SENSOR_CHT8305
 		if(sensor_cfg.sensor_type == TH_SENSOR_CHT8305) {
 			scan_i2c_addr(sensor_cfg.i2c_addr); // wakeup?
-			send_i2c_byte(sensor_cfg.i2c_addr, CHT8305_REG_TMP); // start measure T/H
+			i2c_queue_cmd(sensor_cfg.i2c_addr, CHT8305_REG_TMP, 1, NULL, 0, 0); // start measure T/H
 		} else
 #endif // USE_SENSOR_CHT8305
 #if USE_SENSOR_AHT20_30
@@ -750,34 +819,32 @@ void start_measure_sensor_deep_sleep(void) {
 #endif // USE_SENSOR_AHT20_30
 #if USE_SENSOR_SHTC3
 		if(sensor_cfg.sensor_type == TH_SENSOR_SHTC3) {
-			send_i2c_word(sensor_cfg.i2c_addr, SHTC3_WAKEUP); //	Wake-up command of the sensor
-			sleep_us(SHTC3_WAKEUP_us - 5);	// 240 us
+			i2c_queue_cmd(sensor_cfg.i2c_addr, SHTC3_WAKEUP, 2, NULL, 0, SHTC3_WAKEUP_us - 5); //	Wake-up command of the sensor
 #if (DEVICE_TYPE == DEVICE_CGDK2)
 			if(sensor_cfg.id == 0xBDC3)
-				send_i2c_word(0, SHTC3_MEASURE_CS);
+				i2c_queue_cmd(0, SHTC3_MEASURE_CS, 2, NULL, 0, 0);
 			else
-				send_i2c_word(sensor_cfg.i2c_addr, SHTC3_MEASURE);
+				i2c_queue_cmd(sensor_cfg.i2c_addr, SHTC3_MEASURE, 2, NULL, 0, 0);
 #else
-			send_i2c_word(sensor_cfg.i2c_addr, SHTC3_MEASURE);
+			i2c_queue_cmd(sensor_cfg.i2c_addr, SHTC3_MEASURE, 2, NULL, 0, 0);
 #endif
 		} else
 #endif	// USE_SENSOR_SHTC3
 #if USE_SENSOR_SHT4X
 		if(sensor_cfg.sensor_type == TH_SENSOR_SHT4x) {
-			send_i2c_byte(sensor_cfg.i2c_addr, SHT4x_MEASURE_HI);
+			i2c_queue_cmd(sensor_cfg.i2c_addr, SHT4x_MEASURE_HI, 1, NULL, 0, 0);
 		} else
 #endif // USE_SENSOR_SHT4X
 #if USE_SENSOR_SHT30
 		if(sensor_cfg.sensor_type == TH_SENSOR_SHT30) {
-			send_i2c_word(sensor_cfg.i2c_addr, SHT30_HIMEASURE); // start measure T/H
+			i2c_queue_cmd(sensor_cfg.i2c_addr, SHT30_HIMEASURE, 2, NULL, 0, 0); // start measure T/H
 		} else
 #endif //USE_SENSOR_SHT30
 		{};
-	}
-
-#if SENSOR_SLEEP_MEASURE
-//	sensor_cfg.time_measure = clock_time() | 1;
+#if !SENSOR_SLEEP_MEASURE
+		i2c_queue_run();
 #endif
+	}
 	return;
 }
 
@@ -31,9 +31,25 @@ inline void bcopy(register unsigned char * src, register unsigned char * dest, u
 	bbcopy(src, dest, len);
 }
 
+#define MEM_WORD_MIN	8 // shorter blocks are processed byte by byte
+
 _attribute_ram_code_
 void * memset(void * dest, int val, unsigned int len) {
 	register unsigned char *ptr = (unsigned char*) dest;
+	if (len >= MEM_WORD_MIN) {
+		unsigned int w = (unsigned char)val;
+		w |= w << 8;
+		w |= w << 16;
+		while ((unsigned int)ptr & 3) {
+			*ptr++ = (unsigned char)val;
+			len--;
+		}
+		while (len >= 4) {
+			*(unsigned int *)ptr = w;
+			ptr += 4;
+			len -= 4;
+		}
+	}
 	while (len-- > 0)
 		*ptr++ = (unsigned char)val;
 	return dest;
@@ -41,7 +57,26 @@ void * memset(void * dest, int val, unsigned int len) {
 
 _attribute_ram_code_
 void * memcpy(void * out, const void * in, unsigned int length) {
-	bcopy((unsigned char *) in, (unsigned char *) out, (int) length);
+	register unsigned char *d = (unsigned char *) out;
+	register const unsigned char *s = (const unsigned char *) in;
+	// words only if both pointers have the same alignment and the forward copy is safe
+	if (length >= MEM_WORD_MIN
+		&& (((unsigned int)d ^ (unsigned int)s) & 3) == 0
+		&& (d <= s || d >= s + length)) {
+		while ((unsigned int)d & 3) {
+			*d++ = *s++;
+			length--;
+		}
+		while (length >= 4) {
+			*(unsigned int *)d = *(const unsigned int *)s;
+			d += 4;
+			s += 4;
+			length -= 4;
+		}
+		while (length--)
+			*d++ = *s++;
+	} else
+		bcopy((unsigned char *) s, d, length);
 	return out;
 }
 
@@ -50,6 +85,22 @@ int memcmp(const void * m1, const void *m2, unsigned int len) {
 	unsigned char *st1 = (unsigned char *) m1;
 	unsigned char *st2 = (unsigned char *) m2;
 
+	if (len >= MEM_WORD_MIN
+		&& (((unsigned int)st1 ^ (unsigned int)st2) & 3) == 0) {
+		while ((unsigned int)st1 & 3) {
+			if (*st1 != *st2)
+				return (*st1 - *st2);
+			st1++;
+			st2++;
+			len--;
+		}
+		// the differing word is resolved by the byte loop
+		while (len >= 4 && *(unsigned int *)st1 == *(unsigned int *)st2) {
+			st1 += 4;
+			st2 += 4;
+			len -= 4;
+		}
+	}
 	while (len--){
 		if (*st1 != *st2){
 			return (*st1 - *st2);